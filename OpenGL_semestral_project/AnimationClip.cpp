@@ -0,0 +1,276 @@
+#include "AnimationClip.h"
+
+#include <math.h>
+#include <algorithm>
+
+#include "CpuTrace.h"
+
+#if defined(_M_X64) || defined(_M_IX86) || defined(__SSE2__)
+#define ANIMATION_SIMD 1
+#include <emmintrin.h>
+#endif
+
+constexpr float AnimationClip::DEFAULT_SAMPLE_RATE;
+
+AnimationClip::AnimationClip()
+{
+	duration = 0.0f;
+	sampleRate = DEFAULT_SAMPLE_RATE;
+	frameCount = 0;
+	laneCount = 0;
+}
+
+static glm::vec3 Interpolate(const glm::vec3& a, const glm::vec3& b, float t)
+{
+	return glm::mix(a, b, t);
+}
+
+static glm::quat Interpolate(const glm::quat& a, const glm::quat& b, float t)
+{
+	return glm::slerp(a, b, t);
+}
+
+template<typename T>
+T AnimationClip::SampleKeys(const std::vector<float>& times, const std::vector<T>& values, float time, T fallback)
+{
+	if (values.empty())
+	{
+		return fallback;
+	}
+	if (values.size() == 1 || time <= times[0])
+	{
+		return values[0];
+	}
+	if (time >= times.back())
+	{
+		return values.back();
+	}
+
+	size_t next = std::upper_bound(times.begin(), times.end(), time) - times.begin();
+	float span = times[next] - times[next - 1];
+	float t = span > 0.0f ? (time - times[next - 1]) / span : 0.0f;
+	return Interpolate(values[next - 1], values[next], t);
+}
+
+static short QuantizeSnorm(float value)
+{
+	float scaled = value * 32767.0f;
+	scaled = scaled > 32767.0f ? 32767.0f : (scaled < -32767.0f ? -32767.0f : scaled);
+	return (short)(scaled < 0.0f ? scaled - 0.5f : scaled + 0.5f);
+}
+
+void AnimationClip::Build(const std::string& clipName, const Skeleton& skeleton, const std::vector<JointTrack>& tracks, float clipDuration, float rate)
+{
+	TRACE_SCOPE("AnimationClip::Build");
+
+	ClearClip();
+
+	name = clipName;
+	duration = clipDuration > 0.0f ? clipDuration : 0.0f;
+	sampleRate = rate > 0.0f ? rate : DEFAULT_SAMPLE_RATE;
+	frameCount = (unsigned int)ceilf(duration * sampleRate) + 1;
+	laneCount = skeleton.GetLaneCount();
+
+	std::vector<const JointTrack*> jointTracks(laneCount, nullptr);
+	bool hasScale = false;
+	for (size_t i = 0; i < tracks.size(); i++)
+	{
+		if (tracks[i].joint < skeleton.GetJointCount())
+		{
+			jointTracks[tracks[i].joint] = &tracks[i];
+			for (size_t k = 0; k < tracks[i].scales.size(); k++)
+			{
+				hasScale |= glm::length(tracks[i].scales[k] - glm::vec3(1.0f)) > 1e-5f;
+			}
+		}
+	}
+
+	const LocalPose& bind = skeleton.GetBindPose();
+	for (unsigned int j = 0; j < skeleton.GetJointCount(); j++)
+	{
+		hasScale |= fabsf(bind.scaleX[j] - 1.0f) > 1e-5f || fabsf(bind.scaleY[j] - 1.0f) > 1e-5f || fabsf(bind.scaleZ[j] - 1.0f) > 1e-5f;
+	}
+
+	positions.resize((size_t)frameCount * laneCount * 3);
+	rotations.resize((size_t)frameCount * laneCount * 4);
+	if (hasScale)
+	{
+		scales.resize((size_t)frameCount * laneCount * 3);
+	}
+
+	std::vector<glm::quat> previous(laneCount, glm::quat(1.0f, 0.0f, 0.0f, 0.0f));
+	for (unsigned int frame = 0; frame < frameCount; frame++)
+	{
+		float time = std::min(frame / sampleRate, duration);
+		float* framePositions = &positions[(size_t)frame * laneCount * 3];
+		short* frameRotations = &rotations[(size_t)frame * laneCount * 4];
+		float* frameScales = hasScale ? &scales[(size_t)frame * laneCount * 3] : nullptr;
+
+		for (unsigned int j = 0; j < laneCount; j++)
+		{
+			glm::vec3 position(bind.positionX[j], bind.positionY[j], bind.positionZ[j]);
+			glm::quat rotation(bind.rotationW[j], bind.rotationX[j], bind.rotationY[j], bind.rotationZ[j]);
+			glm::vec3 scale(bind.scaleX[j], bind.scaleY[j], bind.scaleZ[j]);
+
+			const JointTrack* track = jointTracks[j];
+			if (track)
+			{
+				position = SampleKeys(track->positionTimes, track->positions, time, position);
+				rotation = SampleKeys(track->rotationTimes, track->rotations, time, rotation);
+				scale = SampleKeys(track->scaleTimes, track->scales, time, scale);
+			}
+
+			// Neighbouring frames in the same hemisphere, so sampling can nlerp without a sign check
+			rotation = glm::normalize(rotation);
+			if (frame > 0 && glm::dot(rotation, previous[j]) < 0.0f)
+			{
+				rotation = -rotation;
+			}
+			previous[j] = rotation;
+
+			framePositions[j] = position.x;
+			framePositions[laneCount + j] = position.y;
+			framePositions[laneCount * 2 + j] = position.z;
+			frameRotations[j] = QuantizeSnorm(rotation.x);
+			frameRotations[laneCount + j] = QuantizeSnorm(rotation.y);
+			frameRotations[laneCount * 2 + j] = QuantizeSnorm(rotation.z);
+			frameRotations[laneCount * 3 + j] = QuantizeSnorm(rotation.w);
+			if (frameScales)
+			{
+				frameScales[j] = scale.x;
+				frameScales[laneCount + j] = scale.y;
+				frameScales[laneCount * 2 + j] = scale.z;
+			}
+		}
+	}
+}
+
+#ifdef ANIMATION_SIMD
+// Four snorm16 values to floats, SSE2 has no direct 16-bit sign extension so it goes through the high half
+static __m128 LoadSnorm4(const short* values)
+{
+	__m128i packed = _mm_loadl_epi64((const __m128i*)values);
+	__m128i widened = _mm_srai_epi32(_mm_unpacklo_epi16(packed, packed), 16);
+	return _mm_mul_ps(_mm_cvtepi32_ps(widened), _mm_set1_ps(1.0f / 32767.0f));
+}
+#endif
+
+void AnimationClip::Sample(float time, bool loop, LocalPose& pose) const
+{
+	if (frameCount == 0)
+	{
+		return;
+	}
+
+	if (loop && duration > 0.0f)
+	{
+		time = fmodf(time, duration);
+		if (time < 0.0f) time += duration;
+	}
+	float position = std::max(0.0f, std::min(time, duration)) * sampleRate;
+	unsigned int frame0 = std::min((unsigned int)position, frameCount - 1);
+	unsigned int frame1 = std::min(frame0 + 1, frameCount - 1);
+	float alpha = position - frame0;
+
+	const float* positions0 = &positions[(size_t)frame0 * laneCount * 3];
+	const float* positions1 = &positions[(size_t)frame1 * laneCount * 3];
+	const short* rotations0 = &rotations[(size_t)frame0 * laneCount * 4];
+	const short* rotations1 = &rotations[(size_t)frame1 * laneCount * 4];
+	const float* scales0 = scales.empty() ? nullptr : &scales[(size_t)frame0 * laneCount * 3];
+	const float* scales1 = scales.empty() ? nullptr : &scales[(size_t)frame1 * laneCount * 3];
+
+	float* positionOut[3] = { &pose.positionX[0], &pose.positionY[0], &pose.positionZ[0] };
+	float* rotationOut[4] = { &pose.rotationX[0], &pose.rotationY[0], &pose.rotationZ[0], &pose.rotationW[0] };
+	float* scaleOut[3] = { &pose.scaleX[0], &pose.scaleY[0], &pose.scaleZ[0] };
+
+#ifdef ANIMATION_SIMD
+	__m128 t = _mm_set1_ps(alpha);
+	for (unsigned int j = 0; j < laneCount; j += 4)
+	{
+		for (unsigned int c = 0; c < 3; c++)
+		{
+			__m128 a = _mm_loadu_ps(&positions0[laneCount * c + j]);
+			__m128 b = _mm_loadu_ps(&positions1[laneCount * c + j]);
+			_mm_storeu_ps(&positionOut[c][j], _mm_add_ps(a, _mm_mul_ps(_mm_sub_ps(b, a), t)));
+		}
+
+		__m128 q[4];
+		__m128 lengthSquared = _mm_setzero_ps();
+		for (unsigned int c = 0; c < 4; c++)
+		{
+			__m128 a = LoadSnorm4(&rotations0[laneCount * c + j]);
+			__m128 b = LoadSnorm4(&rotations1[laneCount * c + j]);
+			q[c] = _mm_add_ps(a, _mm_mul_ps(_mm_sub_ps(b, a), t));
+			lengthSquared = _mm_add_ps(lengthSquared, _mm_mul_ps(q[c], q[c]));
+		}
+		// Full precision divide, rsqrt's 12 bits would show up as joint creep on long chains
+		__m128 inverseLength = _mm_div_ps(_mm_set1_ps(1.0f), _mm_sqrt_ps(lengthSquared));
+		for (unsigned int c = 0; c < 4; c++)
+		{
+			_mm_storeu_ps(&rotationOut[c][j], _mm_mul_ps(q[c], inverseLength));
+		}
+
+		for (unsigned int c = 0; c < 3; c++)
+		{
+			if (scales0)
+			{
+				__m128 a = _mm_loadu_ps(&scales0[laneCount * c + j]);
+				__m128 b = _mm_loadu_ps(&scales1[laneCount * c + j]);
+				_mm_storeu_ps(&scaleOut[c][j], _mm_add_ps(a, _mm_mul_ps(_mm_sub_ps(b, a), t)));
+			}
+			else
+			{
+				_mm_storeu_ps(&scaleOut[c][j], _mm_set1_ps(1.0f));
+			}
+		}
+	}
+#else
+	for (unsigned int j = 0; j < laneCount; j++)
+	{
+		for (unsigned int c = 0; c < 3; c++)
+		{
+			float a = positions0[laneCount * c + j], b = positions1[laneCount * c + j];
+			positionOut[c][j] = a + (b - a) * alpha;
+			if (scales0)
+			{
+				float sa = scales0[laneCount * c + j], sb = scales1[laneCount * c + j];
+				scaleOut[c][j] = sa + (sb - sa) * alpha;
+			}
+			else
+			{
+				scaleOut[c][j] = 1.0f;
+			}
+		}
+
+		float q[4];
+		float lengthSquared = 0.0f;
+		for (unsigned int c = 0; c < 4; c++)
+		{
+			float a = rotations0[laneCount * c + j] / 32767.0f, b = rotations1[laneCount * c + j] / 32767.0f;
+			q[c] = a + (b - a) * alpha;
+			lengthSquared += q[c] * q[c];
+		}
+		float inverseLength = 1.0f / sqrtf(lengthSquared);
+		for (unsigned int c = 0; c < 4; c++)
+		{
+			rotationOut[c][j] = q[c] * inverseLength;
+		}
+	}
+#endif
+}
+
+void AnimationClip::ClearClip()
+{
+	name.clear();
+	duration = 0.0f;
+	frameCount = 0;
+	laneCount = 0;
+	positions.clear();
+	rotations.clear();
+	scales.clear();
+}
+
+AnimationClip::~AnimationClip()
+{
+	ClearClip();
+}
@@ -0,0 +1,65 @@
+#pragma once
+
+#include <vector>
+#include <string>
+
+#include <glm\glm.hpp>
+#include <glm\gtc\quaternion.hpp>
+
+#include "Skeleton.h"
+
+// Keyframes of one joint as the importer hands them over, times in seconds. Empty channels keep the bind pose
+struct JointTrack
+{
+	unsigned int joint;
+	std::vector<float> positionTimes;
+	std::vector<glm::vec3> positions;
+	std::vector<float> rotationTimes;
+	std::vector<glm::quat> rotations;
+	std::vector<float> scaleTimes;
+	std::vector<glm::vec3> scales;
+
+	JointTrack() : joint(Skeleton::NO_JOINT) {}
+};
+
+// A clip resampled at a fixed rate into one SoA frame per sample: positions and scales as floats,
+// rotations as 16-bit snorm quaternions kept in one hemisphere from frame to frame. Sampling a pose is
+// then two frame lookups and a lerp / nlerp over every joint, four at a time, with no key searches
+class AnimationClip
+{
+public:
+	static constexpr float DEFAULT_SAMPLE_RATE = 30.0f;
+
+	AnimationClip();
+
+	void Build(const std::string& clipName, const Skeleton& skeleton, const std::vector<JointTrack>& tracks, float duration,
+		float sampleRate = DEFAULT_SAMPLE_RATE);
+
+	// Wraps time when looping, otherwise holds the last frame. pose has to have the skeleton's lane count
+	void Sample(float time, bool loop, LocalPose& pose) const;
+
+	const std::string& GetName() const { return name; }
+	float GetDuration() const { return duration; }
+	unsigned int GetFrameCount() const { return frameCount; }
+	size_t GetMemoryBytes() const { return positions.size() * sizeof(float) + rotations.size() * sizeof(short) + scales.size() * sizeof(float); }
+
+	void ClearClip();
+
+	~AnimationClip();
+
+private:
+	std::string name;
+	float duration;
+	float sampleRate;
+	unsigned int frameCount;
+	unsigned int laneCount;
+
+	// Per frame: laneCount x, then y, then z (then w for rotations)
+	std::vector<float> positions;
+	std::vector<short> rotations;
+	// Empty when every joint keeps unit scale for the whole clip
+	std::vector<float> scales;
+
+	template<typename T>
+	static T SampleKeys(const std::vector<float>& times, const std::vector<T>& values, float time, T fallback);
+};
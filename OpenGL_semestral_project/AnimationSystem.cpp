@@ -0,0 +1,219 @@
+#include "AnimationSystem.h"
+
+#include <stdio.h>
+
+#include "JobSystem.h"
+#include "GpuMemory.h"
+#include "Clock.h"
+#include "CpuTrace.h"
+
+const unsigned int AnimationSystem::NO_INSTANCE;
+const unsigned int AnimationSystem::JOB_BATCH;
+const unsigned int AnimationSystem::MIN_PALETTE_ROWS;
+
+AnimationSystem::AnimationSystem()
+{
+	paletteLimit = MIN_PALETTE_ROWS;
+	refusedInstances = 0;
+
+	updateCount = 0;
+	updateMsSum = 0.0;
+
+	paletteBuffer = 0;
+	paletteTexture = 0;
+	paletteBytes = 0;
+	allocation = GpuMemory::NO_ALLOCATION;
+}
+
+unsigned int AnimationSystem::AddInstance(const Skeleton* skeleton, const AnimationClip* clip, float startTime, float speed, bool loop)
+{
+	if (!skeleton || skeleton->GetBoneCount() == 0)
+	{
+		return NO_INSTANCE;
+	}
+
+	// shader.vert can't fetch rows past the texture buffer's size, an instance there would collapse to nothing
+	if (palette.size() + (size_t)skeleton->GetBoneCount() * Skeleton::PALETTE_ROWS > paletteLimit)
+	{
+		if (refusedInstances == 0)
+		{
+			printf("Bone palette is full at %u rows, further instances are drawn in their bind pose\n", paletteLimit);
+		}
+		refusedInstances++;
+		return NO_INSTANCE;
+	}
+
+	Instance instance;
+	instance.skeleton = skeleton;
+	instance.clip = clip;
+	instance.time = startTime;
+	instance.speed = speed;
+	instance.loop = loop;
+	instance.paletteBase = (unsigned int)(palette.size() / Skeleton::PALETTE_ROWS);
+	instances.push_back(instance);
+
+	// Bind pose until the first Update, so a packet built before it still draws something sensible
+	palette.resize(palette.size() + skeleton->GetBoneCount() * Skeleton::PALETTE_ROWS);
+	std::vector<glm::mat4> scratch;
+	skeleton->BuildPalette(skeleton->GetBindPose(), scratch, &palette[instance.paletteBase * Skeleton::PALETTE_ROWS]);
+
+	return (unsigned int)instances.size() - 1;
+}
+
+void AnimationSystem::SetClip(unsigned int instance, const AnimationClip* clip, float startTime)
+{
+	instances[instance].clip = clip;
+	instances[instance].time = startTime;
+}
+
+void AnimationSystem::UpdateRange(unsigned int begin, unsigned int end, float deltaTime)
+{
+	// One pose and one set of joint matrices per batch, reused for every instance in it
+	LocalPose pose;
+	std::vector<glm::mat4> scratch;
+
+	for (unsigned int i = begin; i < end; i++)
+	{
+		Instance& instance = instances[i];
+		instance.time += deltaTime * instance.speed;
+
+		const Skeleton* skeleton = instance.skeleton;
+		if (instance.clip)
+		{
+			pose.Resize(skeleton->GetLaneCount());
+			instance.clip->Sample(instance.time, instance.loop, pose);
+			skeleton->BuildPalette(pose, scratch, &palette[instance.paletteBase * Skeleton::PALETTE_ROWS]);
+		}
+		else
+		{
+			skeleton->BuildPalette(skeleton->GetBindPose(), scratch, &palette[instance.paletteBase * Skeleton::PALETTE_ROWS]);
+		}
+	}
+}
+
+void AnimationSystem::Update(float deltaTime, JobSystem* jobs)
+{
+	TRACE_SCOPE("AnimationSystem::Update");
+
+	if (instances.empty())
+	{
+		return;
+	}
+
+	double start = Clock::Now();
+
+	unsigned int count = (unsigned int)instances.size();
+	if (jobs && count > JOB_BATCH)
+	{
+		jobs->ParallelFor(count, JOB_BATCH, [this, deltaTime](unsigned int begin, unsigned int end)
+			{
+				UpdateRange(begin, end, deltaTime);
+			});
+	}
+	else
+	{
+		UpdateRange(0, count, deltaTime);
+	}
+
+	updateMsSum += (Clock::Now() - start) * 1000.0;
+	updateCount++;
+}
+
+void AnimationSystem::QueryPaletteLimit()
+{
+	GLint maxTexels = 0;
+	glGetIntegerv(GL_MAX_TEXTURE_BUFFER_SIZE, &maxTexels);
+	if ((unsigned int)maxTexels > paletteLimit)
+	{
+		paletteLimit = (unsigned int)maxTexels;
+	}
+}
+
+void AnimationSystem::UploadPalette(const glm::vec4* rows, unsigned int rowCount)
+{
+	TRACE_SCOPE("AnimationSystem::UploadPalette");
+
+	if (rowCount == 0)
+	{
+		return;
+	}
+
+	if (paletteBuffer == 0)
+	{
+		glGenBuffers(1, &paletteBuffer);
+		glGenTextures(1, &paletteTexture);
+		allocation = GpuMemory::Allocate(GPU_MEMORY_UNIFORM, 0, "BonePalette");
+	}
+
+	GLsizeiptr size = sizeof(glm::vec4) * rowCount;
+	glBindBuffer(GL_TEXTURE_BUFFER, paletteBuffer);
+	if (size != paletteBytes)
+	{
+		glBufferData(GL_TEXTURE_BUFFER, size, rows, GL_STREAM_DRAW);
+
+		glBindTexture(GL_TEXTURE_BUFFER, paletteTexture);
+		glTexBuffer(GL_TEXTURE_BUFFER, GL_RGBA32F, paletteBuffer);
+		glBindTexture(GL_TEXTURE_BUFFER, 0);
+
+		paletteBytes = size;
+		GpuMemory::Resize(allocation, (size_t)size);
+	}
+	else
+	{
+		// Every row changes every frame, orphan rather than wait for last frame's draws
+		glBufferData(GL_TEXTURE_BUFFER, size, nullptr, GL_STREAM_DRAW);
+		glBufferSubData(GL_TEXTURE_BUFFER, 0, size, rows);
+	}
+	glBindBuffer(GL_TEXTURE_BUFFER, 0);
+}
+
+void AnimationSystem::UsePalette(GLuint textureUnit)
+{
+	glActiveTexture(GL_TEXTURE0 + textureUnit);
+	glBindTexture(GL_TEXTURE_BUFFER, paletteTexture);
+	glActiveTexture(GL_TEXTURE0);
+}
+
+void AnimationSystem::PrintStats()
+{
+	if (instances.empty())
+	{
+		return;
+	}
+
+	printf("Animation, %u instances, %zu bones\n", (unsigned int)instances.size(), palette.size() / Skeleton::PALETTE_ROWS);
+	printf("  update:          %8.3f ms per step (%llu steps)\n", updateCount ? updateMsSum / updateCount : 0.0, updateCount);
+	printf("  palette:         %8.1f KB per frame, %zu of %u rows\n", palette.size() * sizeof(glm::vec4) / 1024.0, palette.size(), paletteLimit);
+	if (refusedInstances > 0)
+	{
+		printf("  refused:         %8u instances over the palette limit\n", refusedInstances);
+	}
+}
+
+void AnimationSystem::ClearAnimations()
+{
+	instances.clear();
+	palette.clear();
+	refusedInstances = 0;
+	updateCount = 0;
+	updateMsSum = 0.0;
+
+	if (paletteTexture != 0)
+	{
+		glDeleteTextures(1, &paletteTexture);
+		paletteTexture = 0;
+	}
+
+	if (paletteBuffer != 0)
+	{
+		glDeleteBuffers(1, &paletteBuffer);
+		paletteBuffer = 0;
+	}
+	paletteBytes = 0;
+	GpuMemory::Free(allocation);
+}
+
+AnimationSystem::~AnimationSystem()
+{
+	ClearAnimations();
+}
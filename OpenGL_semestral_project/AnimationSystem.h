@@ -0,0 +1,79 @@
+#pragma once
+
+#include <vector>
+
+#include <GL\glew.h>
+#include <glm\glm.hpp>
+
+#include "Skeleton.h"
+#include "AnimationClip.h"
+
+class JobSystem;
+
+// Animated skeleton instances and the bone palette they share. The simulation thread advances and
+// samples every instance (split across the jobs) into one array of palette rows, the GL thread uploads
+// a copy of it into an RGBA32F texture buffer that shader.vert (USE_SKINNING) reads at boneBase
+class AnimationSystem
+{
+public:
+	static const unsigned int NO_INSTANCE = 0xFFFFFFFF;
+	// Instances per job, a 64 joint character takes a few microseconds
+	static const unsigned int JOB_BATCH = 16;
+	// Texels every GL 3.3 implementation can address in a texture buffer, the palette limit until QueryPaletteLimit
+	static const unsigned int MIN_PALETTE_ROWS = 65536;
+
+	AnimationSystem();
+
+	// The skeleton and clip stay owned by their model. Returns NO_INSTANCE without bones or when the
+	// palette has no room left for them, their meshes then draw in the bind pose
+	unsigned int AddInstance(const Skeleton* skeleton, const AnimationClip* clip, float startTime = 0.0f, float speed = 1.0f, bool loop = true);
+	void SetClip(unsigned int instance, const AnimationClip* clip, float startTime = 0.0f);
+	void SetSpeed(unsigned int instance, float speed) { instances[instance].speed = speed; }
+
+	// First bone of the instance's palette, what boneBase has to be for its meshes
+	unsigned int GetPaletteBase(unsigned int instance) { return instances[instance].paletteBase; }
+	unsigned int GetInstanceCount() { return (unsigned int)instances.size(); }
+
+	// Simulation thread: advances every instance and rebuilds the palette
+	void Update(float deltaTime, JobSystem* jobs = nullptr);
+	const std::vector<glm::vec4>& GetPalette() { return palette; }
+
+	// GL thread: raises the palette limit to GL_MAX_TEXTURE_BUFFER_SIZE, before instances are added
+	void QueryPaletteLimit();
+	unsigned int GetPaletteLimit() { return paletteLimit; }
+
+	// GL thread: replaces the texture buffer contents, Skeleton::PALETTE_ROWS rows per bone
+	void UploadPalette(const glm::vec4* rows, unsigned int rowCount);
+	void UsePalette(GLuint textureUnit);
+
+	void PrintStats();
+
+	void ClearAnimations();
+
+	~AnimationSystem();
+
+private:
+	struct Instance
+	{
+		const Skeleton* skeleton;
+		const AnimationClip* clip;
+		float time;
+		float speed;
+		bool loop;
+		unsigned int paletteBase;
+	};
+
+	std::vector<Instance> instances;
+	std::vector<glm::vec4> palette;
+	unsigned int paletteLimit;
+	unsigned int refusedInstances;
+
+	unsigned long long updateCount;
+	double updateMsSum;
+
+	GLuint paletteBuffer, paletteTexture;
+	GLsizeiptr paletteBytes;
+	unsigned int allocation;
+
+	void UpdateRange(unsigned int begin, unsigned int end, float deltaTime);
+};
@@ -0,0 +1,1371 @@
+#include "Benchmarks.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <chrono>
+#include <vector>
+#include <thread>
+#include <atomic>
+#include <algorithm>
+#include <cmath>
+
+#include <glm\glm.hpp>
+#include <glm\gtc\matrix_transform.hpp>
+#include <glm\gtc\quaternion.hpp>
+
+#include "TransformStore.h"
+#include "Scene.h"
+#include "Frustum.h"
+#include "JobSystem.h"
+#include "FrameMailbox.h"
+#include "Clock.h"
+#include "FixedTimestep.h"
+#include "FrameLimiter.h"
+#include "FrameStats.h"
+#include "Window.h"
+#include "Mesh.h"
+#include "MeshBvh.h"
+#include "ParticleSystem.h"
+#include "AnimationSystem.h"
+#include "Shader.h"
+#include "TransformBuffer.h"
+#include "LightCuller.h"
+#include "LightBaker.h"
+
+#include <assimp\Importer.hpp>
+#include <assimp\scene.h>
+#include <assimp\postprocess.h>
+
+static double ElapsedMs(std::chrono::steady_clock::time_point start)
+{
+	return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+}
+
+int RunBenchmark(const char* name)
+{
+	if (strcmp(name, "transforms") == 0) return RunTransformBenchmark();
+	if (strcmp(name, "entities") == 0) return RunEntityBenchmark();
+	if (strcmp(name, "jobs") == 0) return RunJobBenchmark();
+	if (strcmp(name, "pipeline") == 0) return RunPipelineBenchmark();
+	if (strcmp(name, "pacing") == 0) return RunPacingBenchmark();
+	if (strcmp(name, "meshes") == 0) return RunMeshUpdateBenchmark();
+	if (strcmp(name, "rays") == 0) return RunRaycastBenchmark();
+	if (strcmp(name, "particles") == 0) return RunParticleBenchmark();
+	if (strcmp(name, "skinning") == 0) return RunSkinningBenchmark();
+	if (strcmp(name, "prepass") == 0) return RunDepthPrepassBenchmark();
+	if (strcmp(name, "lights") == 0) return RunLightCullingBenchmark();
+	if (strcmp(name, "bake") == 0) return RunLightBakeBenchmark();
+
+	printf("Unknown benchmark: %s\n", name);
+	return 1;
+}
+
+int RunTransformBenchmark()
+{
+	const unsigned int transformCount = 100000;
+	const unsigned int frameCount = 200;
+
+	TransformStore store;
+	store.Reserve(transformCount);
+
+	std::vector<glm::vec3> positions(transformCount);
+	std::vector<glm::vec3> scales(transformCount);
+
+	for (unsigned int i = 0; i < transformCount; i++)
+	{
+		// Every 8th transform hangs off the previous one to exercise the hierarchy pass
+		unsigned int parent = (i % 8 == 7) ? i - 1 : TransformStore::NO_PARENT;
+		unsigned int id = store.CreateTransform(parent);
+
+		positions[i] = glm::vec3((float)(i % 100), (float)((i / 100) % 100), (float)(i / 10000));
+		scales[i] = glm::vec3(1.0f + (i % 3) * 0.5f, 1.0f, 1.0f + (i % 5) * 0.25f);
+
+		store.SetPosition(id, positions[i]);
+		store.SetScale(id, scales[i]);
+	}
+	store.UpdateWorldMatrices();
+
+	auto start = std::chrono::steady_clock::now();
+	for (unsigned int frame = 0; frame < frameCount; frame++)
+	{
+		glm::quat rotation = glm::angleAxis(frame * 0.01f, glm::vec3(0.0f, 1.0f, 0.0f));
+		for (unsigned int i = 0; i < transformCount; i++)
+		{
+			store.SetRotation(i, rotation);
+		}
+		store.UpdateWorldMatrices();
+	}
+	double storeMs = ElapsedMs(start) / frameCount;
+
+	// Reference: what main.cpp and shader.vert did per object, matrix chain plus inverse-transpose
+	std::vector<glm::mat4> models(transformCount);
+	std::vector<glm::mat3> normals(transformCount);
+
+	start = std::chrono::steady_clock::now();
+	for (unsigned int frame = 0; frame < frameCount; frame++)
+	{
+		glm::quat rotation = glm::angleAxis(frame * 0.01f, glm::vec3(0.0f, 1.0f, 0.0f));
+		for (unsigned int i = 0; i < transformCount; i++)
+		{
+			glm::mat4 model = glm::translate(glm::mat4(1.0f), positions[i]) * glm::mat4_cast(rotation);
+			model = glm::scale(model, scales[i]);
+			if (i % 8 == 7) model = models[i - 1] * model;
+
+			models[i] = model;
+			normals[i] = glm::transpose(glm::inverse(glm::mat3(model)));
+		}
+	}
+	double referenceMs = ElapsedMs(start) / frameCount;
+
+	printf("Transform update, %u transforms, %u frames\n", transformCount, frameCount);
+	printf("  TransformStore:  %8.3f ms/frame (%.1f ns/transform)\n", storeMs, storeMs * 1e6 / transformCount);
+	printf("  glm reference:   %8.3f ms/frame (%.1f ns/transform)\n", referenceMs, referenceMs * 1e6 / transformCount);
+	printf("  speedup:         %8.2fx\n", referenceMs / storeMs);
+
+	return 0;
+}
+
+int RunEntityBenchmark()
+{
+	const unsigned int entityCount = 1000000;
+	const unsigned int frameCount = 50;
+
+	Scene scene;
+	scene.Reserve(entityCount);
+
+	BoundingBox unitBox(glm::vec3(-0.5f, -0.5f, -0.5f), glm::vec3(0.5f, 0.5f, 0.5f));
+
+	auto start = std::chrono::steady_clock::now();
+	for (unsigned int i = 0; i < entityCount; i++)
+	{
+		Entity entity = scene.CreateEntity();
+		glm::vec3 position((float)(i % 1000) - 500.0f, 0.0f, -(float)(i / 1000));
+		scene.AddTransform(entity, position, glm::quat(), glm::vec3(1.0f, 1.0f, 1.0f));
+		scene.AddRenderable(entity, nullptr, unitBox);
+	}
+	double createMs = ElapsedMs(start);
+
+	Frustum frustum;
+	glm::mat4 projection = glm::perspective(glm::radians(45.0f), 4.0f / 3.0f, 0.1f, 1000.0f);
+	glm::mat4 view = glm::lookAt(glm::vec3(0.0f, 10.0f, 10.0f), glm::vec3(0.0f, 0.0f, -100.0f), glm::vec3(0.0f, 1.0f, 0.0f));
+	frustum.Update(projection * view);
+
+	TransformStore& transforms = scene.GetTransforms();
+	double updateMs = 0.0, queryMs = 0.0;
+	size_t visibleCount = 0;
+
+	for (unsigned int frame = 0; frame < frameCount; frame++)
+	{
+		// A tenth of the scene moves each frame, a different slice every time
+		unsigned int sliceBegin = (frame % 10) * (entityCount / 10);
+		for (unsigned int i = sliceBegin; i < sliceBegin + entityCount / 10; i++)
+		{
+			glm::vec3 position = transforms.GetPosition(i);
+			position.y = (float)(frame % 7);
+			transforms.SetPosition(i, position);
+		}
+
+		start = std::chrono::steady_clock::now();
+		scene.Update();
+		updateMs += ElapsedMs(start);
+
+		start = std::chrono::steady_clock::now();
+		visibleCount = scene.QueryVisible(frustum).size();
+		queryMs += ElapsedMs(start);
+	}
+
+	printf("Entity scene, %u entities with transform + renderable, %u frames\n", entityCount, frameCount);
+	printf("  create:              %8.1f ms total\n", createMs);
+	printf("  transforms + bounds: %8.3f ms/frame\n", updateMs / frameCount);
+	printf("  visibility query:    %8.3f ms/frame (%zu visible)\n", queryMs / frameCount, visibleCount);
+	printf("  per entity:          %8.2f ns/frame\n", (updateMs + queryMs) * 1e6 / frameCount / entityCount);
+
+	return 0;
+}
+
+int RunJobBenchmark()
+{
+	unsigned int hardwareThreads = std::thread::hardware_concurrency();
+	if (hardwareThreads == 0) hardwareThreads = 1;
+
+	// Scheduling overhead: empty jobs submitted from one thread, stolen and run by all of them
+	{
+		const unsigned int jobCount = 1000000;
+		const unsigned int batchSize = 4000;
+
+		JobSystem jobs;
+		jobs.Start();
+
+		auto start = std::chrono::steady_clock::now();
+		for (unsigned int submitted = 0; submitted < jobCount; submitted += batchSize)
+		{
+			JobCounter counter;
+			for (unsigned int i = 0; i < batchSize; i++)
+			{
+				jobs.Run([]() {}, &counter);
+			}
+			jobs.Wait(&counter);
+		}
+		double emptyMs = ElapsedMs(start);
+
+		printf("Job system, %u threads\n", jobs.GetThreadCount());
+		printf("  empty jobs:      %8.2f M jobs/s (%.0f ns/job, %llu steals)\n", jobCount / emptyMs / 1000.0, emptyMs * 1e6 / jobCount, jobs.GetStealCount());
+	}
+
+	// Scaling: an ALU heavy kernel and the real scene update + culling, 1..N threads
+	const unsigned int elementCount = 1 << 22;
+	std::vector<float> values(elementCount);
+
+	const unsigned int entityCount = 1000000;
+	Scene scene;
+	scene.Reserve(entityCount);
+	BoundingBox unitBox(glm::vec3(-0.5f, -0.5f, -0.5f), glm::vec3(0.5f, 0.5f, 0.5f));
+	for (unsigned int i = 0; i < entityCount; i++)
+	{
+		Entity entity = scene.CreateEntity();
+		scene.AddTransform(entity, glm::vec3((float)(i % 1000) - 500.0f, 0.0f, -(float)(i / 1000)), glm::quat(), glm::vec3(1.0f, 1.0f, 1.0f));
+		scene.AddRenderable(entity, nullptr, unitBox);
+	}
+
+	Frustum frustum;
+	glm::mat4 projection = glm::perspective(glm::radians(45.0f), 4.0f / 3.0f, 0.1f, 1000.0f);
+	glm::mat4 view = glm::lookAt(glm::vec3(0.0f, 10.0f, 10.0f), glm::vec3(0.0f, 0.0f, -100.0f), glm::vec3(0.0f, 1.0f, 0.0f));
+	frustum.Update(projection * view);
+
+	printf("  parallel-for scaling (kernel: %u elements, scene: %u entities all moving)\n", elementCount, entityCount);
+	printf("  threads   kernel ms  speedup    scene ms  speedup\n");
+
+	double kernelBase = 0.0, sceneBase = 0.0;
+	for (unsigned int threads = 1; threads <= hardwareThreads; threads++)
+	{
+		JobSystem jobs;
+		if (threads > 1)
+		{
+			jobs.Start(threads - 1);
+		}
+
+		const unsigned int frameCount = 10;
+
+		auto start = std::chrono::steady_clock::now();
+		for (unsigned int frame = 0; frame < frameCount; frame++)
+		{
+			jobs.ParallelFor(elementCount, 16384, [&values, frame](unsigned int begin, unsigned int end)
+			{
+				for (unsigned int i = begin; i < end; i++)
+				{
+					float x = (float)(i + frame);
+					values[i] = sqrtf(x) * sinf(x * 0.001f) + cosf(x * 0.002f);
+				}
+			});
+		}
+		double kernelMs = ElapsedMs(start) / frameCount;
+
+		TransformStore& transforms = scene.GetTransforms();
+		double sceneMs = 0.0;
+		for (unsigned int frame = 0; frame < frameCount; frame++)
+		{
+			for (unsigned int i = 0; i < entityCount; i++)
+			{
+				transforms.SetScale(i, glm::vec3(1.0f, 1.0f + (frame % 3) * 0.1f, 1.0f));
+			}
+
+			start = std::chrono::steady_clock::now();
+			JobCounter counter;
+			scene.ScheduleUpdate(jobs, frustum, counter);
+			jobs.Wait(&counter);
+			sceneMs += ElapsedMs(start);
+		}
+		sceneMs /= frameCount;
+
+		if (threads == 1)
+		{
+			kernelBase = kernelMs;
+			sceneBase = sceneMs;
+		}
+
+		printf("  %7u  %10.3f  %6.2fx  %10.3f  %6.2fx\n", threads, kernelMs, kernelBase / kernelMs, sceneMs, sceneBase / sceneMs);
+	}
+
+	return 0;
+}
+
+static void SpinFor(double milliseconds)
+{
+	auto start = std::chrono::steady_clock::now();
+	while (ElapsedMs(start) < milliseconds) {}
+}
+
+static void PrintFrameTimes(const char* label, std::vector<double>& frameTimes)
+{
+	std::sort(frameTimes.begin(), frameTimes.end());
+
+	double sum = 0.0;
+	for (size_t i = 0; i < frameTimes.size(); i++) sum += frameTimes[i];
+
+	printf("  %-10s avg %7.3f ms   p50 %7.3f ms   p99 %7.3f ms   max %7.3f ms\n", label, sum / frameTimes.size(),
+		frameTimes[frameTimes.size() / 2], frameTimes[frameTimes.size() * 99 / 100], frameTimes.back());
+}
+
+// Simulation step of the pipeline benchmark: everything moves, every 8th frame has a CPU spike
+static void SimulatePipelineFrame(Scene& scene, const Frustum& frustum, unsigned int frame, unsigned int entityCount)
+{
+	TransformStore& transforms = scene.GetTransforms();
+	for (unsigned int i = 0; i < entityCount; i++)
+	{
+		transforms.SetPosition(i, glm::vec3((float)(i % 1000) - 500.0f, (float)(frame % 5), -(float)(i / 1000)));
+	}
+
+	scene.Update();
+	scene.QueryVisible(frustum);
+
+	if (frame % 8 == 7)
+	{
+		SpinFor(12.0);
+	}
+}
+
+// Stand-in for GL submission: reads the packet's changed transforms like an upload would, then a fixed cost
+static float RenderPipelineFrame(const FramePacket& packet)
+{
+	float checksum = 0.0f;
+	for (unsigned int i = packet.uploadBegin; i < packet.uploadEnd; i += 16)
+	{
+		checksum += packet.worldMatrices[i][3][1];
+	}
+
+	SpinFor(4.0);
+	return checksum;
+}
+
+int RunPipelineBenchmark()
+{
+	const unsigned int entityCount = 200000;
+	const unsigned int frameCount = 240;
+
+	Scene scene;
+	scene.Reserve(entityCount);
+	BoundingBox unitBox(glm::vec3(-0.5f, -0.5f, -0.5f), glm::vec3(0.5f, 0.5f, 0.5f));
+	for (unsigned int i = 0; i < entityCount; i++)
+	{
+		Entity entity = scene.CreateEntity();
+		scene.AddTransform(entity, glm::vec3((float)(i % 1000) - 500.0f, 0.0f, -(float)(i / 1000)), glm::quat(), glm::vec3(1.0f, 1.0f, 1.0f));
+		scene.AddRenderable(entity, nullptr, unitBox);
+	}
+
+	Frustum frustum;
+	glm::mat4 projection = glm::perspective(glm::radians(45.0f), 4.0f / 3.0f, 0.1f, 1000.0f);
+	glm::mat4 view = glm::lookAt(glm::vec3(0.0f, 10.0f, 10.0f), glm::vec3(0.0f, 0.0f, -100.0f), glm::vec3(0.0f, 1.0f, 0.0f));
+	frustum.Update(projection * view);
+
+	float checksum = 0.0f;
+
+	// Serial: what main.cpp used to do, simulate then draw in the same iteration
+	std::vector<double> serialTimes;
+	{
+		FrameMailbox mailbox;
+		auto last = std::chrono::steady_clock::now();
+		for (unsigned int frame = 0; frame < frameCount; frame++)
+		{
+			SimulatePipelineFrame(scene, frustum, frame, entityCount);
+			scene.BuildFramePacket(mailbox.BeginWrite(), frustum, mailbox.GetConsumedSequence());
+			mailbox.Publish();
+			checksum += RenderPipelineFrame(*mailbox.Acquire());
+
+			serialTimes.push_back(ElapsedMs(last));
+			last = std::chrono::steady_clock::now();
+		}
+	}
+
+	// Pipelined: simulation thread publishes packets, this thread draws the newest one
+	std::vector<double> pipelinedTimes;
+	double packetAgeSum = 0.0;
+	unsigned long long publishedCount, droppedCount;
+	{
+		FrameMailbox mailbox;
+		std::atomic<bool> running(true);
+
+		std::thread simulation([&]()
+		{
+			for (unsigned int frame = 0; running.load(); frame++)
+			{
+				SimulatePipelineFrame(scene, frustum, frame, entityCount);
+				FramePacket& packet = mailbox.BeginWrite();
+				scene.BuildFramePacket(packet, frustum, mailbox.GetConsumedSequence());
+				packet.publishTime = Clock::Now();
+				mailbox.Publish();
+			}
+		});
+
+		FramePacket* packet = nullptr;
+		while (!packet)
+		{
+			packet = mailbox.Acquire();
+		}
+
+		auto last = std::chrono::steady_clock::now();
+		for (unsigned int frame = 0; frame < frameCount; frame++)
+		{
+			packet = mailbox.Acquire();
+			packetAgeSum += (Clock::Now() - packet->publishTime) * 1000.0;
+			checksum += RenderPipelineFrame(*packet);
+
+			pipelinedTimes.push_back(ElapsedMs(last));
+			last = std::chrono::steady_clock::now();
+		}
+
+		running.store(false);
+		simulation.join();
+		publishedCount = mailbox.GetPublishedCount();
+		droppedCount = mailbox.GetDroppedCount();
+	}
+
+	printf("Frame pipeline, %u moving entities, 4 ms render, 12 ms simulation spike every 8th frame, %u frames\n", entityCount, frameCount);
+	PrintFrameTimes("serial", serialTimes);
+	PrintFrameTimes("pipelined", pipelinedTimes);
+
+	double pipelinedAvg = 0.0;
+	for (size_t i = 0; i < pipelinedTimes.size(); i++) pipelinedAvg += pipelinedTimes[i];
+	pipelinedAvg /= pipelinedTimes.size();
+
+	double ageMs = packetAgeSum / frameCount;
+	printf("  packet age at draw: %.3f ms, %.2f frames of added latency\n", ageMs, ageMs / pipelinedAvg);
+	printf("  packets: %llu published, %llu never drawn (checksum %.1f)\n", publishedCount, droppedCount, checksum);
+
+	return 0;
+}
+
+int RunPacingBenchmark()
+{
+	// Frame cap accuracy with a varying amount of work per frame, no window so no vsync involved
+	const double caps[] = { 60.0, 144.0, 240.0 };
+
+	for (unsigned int c = 0; c < sizeof(caps) / sizeof(caps[0]); c++)
+	{
+		FrameLimiter limiter;
+		limiter.SetFrameCap(caps[c]);
+		FrameStats stats(512);
+
+		double last = Clock::Now();
+		for (unsigned int frame = 0; frame < (unsigned int)(caps[c] * 2.0); frame++)
+		{
+			SpinFor((frame % 4) * 0.5);
+			limiter.Wait();
+
+			double now = Clock::Now();
+			stats.AddFrame(now - last);
+			last = now;
+		}
+
+		char label[64];
+		snprintf(label, sizeof(label), "Frame cap %.0f fps (target %.3f ms)", caps[c], 1000.0 / caps[c]);
+		stats.Print(label);
+		limiter.PrintStats();
+	}
+
+	// Fixed timestep: a 120 Hz simulation fed by irregular frames still steps the same total time
+	FixedTimestep timestep(1.0 / 120.0, 8);
+	double realTime = 0.0;
+	for (unsigned int frame = 0; frame < 1000; frame++)
+	{
+		double frameDelta = (frame % 3 == 0) ? 0.021 : 0.0041;
+		realTime += frameDelta;
+		timestep.Advance(frameDelta);
+	}
+	printf("Fixed timestep 120 Hz over %.3f s of irregular frames\n", realTime);
+	printf("  steps:           %8llu, simulated %.3f s, %.4f s left in accumulator\n", timestep.GetStepCount(), timestep.GetSimulatedTime(), timestep.GetAccumulator());
+
+	return 0;
+}
+
+static GLuint CompileBenchmarkProgram()
+{
+	// Position only, the benchmark measures buffer traffic and not shading
+	const char* vertexCode = "#version 330\nlayout (location = 0) in vec3 pos;\nvoid main() { gl_Position = vec4(pos * 0.001 - 0.5, 1.0); }\n";
+	const char* fragmentCode = "#version 330\nout vec4 colour;\nvoid main() { colour = vec4(1.0); }\n";
+
+	GLuint program = glCreateProgram();
+	const char* codes[2] = { vertexCode, fragmentCode };
+	GLenum types[2] = { GL_VERTEX_SHADER, GL_FRAGMENT_SHADER };
+	for (unsigned int i = 0; i < 2; i++)
+	{
+		GLuint shader = glCreateShader(types[i]);
+		glShaderSource(shader, 1, &codes[i], nullptr);
+		glCompileShader(shader);
+		glAttachShader(program, shader);
+		glDeleteShader(shader);
+	}
+	glLinkProgram(program);
+
+	return program;
+}
+
+int RunMeshUpdateBenchmark()
+{
+	// 1000 x 1000 grid, every vertex rewritten every frame like a CPU-deformed surface
+	const unsigned int gridSize = 1000;
+	const unsigned int vertexCount = gridSize * gridSize;
+	const unsigned int frameCount = 60;
+	const unsigned int partialCount = 65536;
+
+	Window window(256, 256);
+	if (window.InitialiseHeadless() != 0)
+	{
+		return 1;
+	}
+
+	std::vector<GLfloat> vertices(vertexCount * 8, 0.0f);
+	std::vector<unsigned int> indices;
+	indices.reserve((gridSize - 1) * (gridSize - 1) * 6);
+	for (unsigned int z = 0; z + 1 < gridSize; z++)
+	{
+		for (unsigned int x = 0; x + 1 < gridSize; x++)
+		{
+			unsigned int corner = z * gridSize + x;
+			unsigned int quad[6] = { corner, corner + gridSize, corner + 1, corner + 1, corner + gridSize, corner + gridSize + 1 };
+			indices.insert(indices.end(), quad, quad + 6);
+		}
+	}
+
+	GLuint program = CompileBenchmarkProgram();
+	glUseProgram(program);
+
+	printf("Mesh updates, %u vertices (%.1f MB) rewritten per frame, %u frames per strategy\n",
+		vertexCount, vertices.size() * sizeof(GLfloat) / (1024.0 * 1024.0), frameCount);
+	printf("  %-14s %12s %12s %12s\n", "strategy", "update ms", "frame ms", "partial ms");
+
+	for (unsigned int s = 0; s < MESH_UPDATE_COUNT; s++)
+	{
+		MeshUpdateStrategy strategy = (MeshUpdateStrategy)s;
+
+		Mesh mesh;
+		mesh.CreateMesh(&vertices[0], &indices[0], (unsigned int)vertices.size(), (unsigned int)indices.size(), MESH_USAGE_STREAM, strategy);
+		glFinish();
+
+		double updateMs = 0.0;
+		auto start = std::chrono::steady_clock::now();
+		for (unsigned int frame = 0; frame < frameCount; frame++)
+		{
+			for (unsigned int i = 0; i < vertexCount; i++)
+			{
+				GLfloat* vertex = &vertices[i * 8];
+				vertex[0] = (GLfloat)(i % gridSize);
+				vertex[1] = (GLfloat)(i / gridSize);
+				vertex[2] = sinf((i % gridSize) * 0.05f + frame * 0.1f);
+			}
+
+			auto updateStart = std::chrono::steady_clock::now();
+			mesh.UpdateVertices(&vertices[0], (unsigned int)vertices.size());
+			updateMs += ElapsedMs(updateStart);
+
+			glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+			mesh.RenderMesh();
+			window.swapBuffers();
+		}
+		glFinish();
+		double frameMs = ElapsedMs(start) / frameCount;
+
+		// Small moving window of the grid, where the strategies differ in how much they touch
+		auto partialStart = std::chrono::steady_clock::now();
+		for (unsigned int frame = 0; frame < frameCount; frame++)
+		{
+			unsigned int first = (frame * partialCount) % (vertexCount - partialCount);
+			mesh.UpdateVertexRange(&vertices[first * 8], first * 8, partialCount * 8);
+			mesh.RenderMesh();
+			window.swapBuffers();
+		}
+		glFinish();
+		double partialMs = ElapsedMs(partialStart) / frameCount;
+
+		printf("  %-14s %12.3f %12.3f %12.3f\n", Mesh::GetStrategyName(strategy), updateMs / frameCount, frameMs, partialMs);
+	}
+
+	glUseProgram(0);
+	glDeleteProgram(program);
+
+	return 0;
+}
+
+// Whole file as one position-only soup, node transforms baked in
+static bool LoadTriangleSoup(const char* fileName, std::vector<float>& positions, std::vector<unsigned int>& indices)
+{
+	Assimp::Importer importer;
+	const aiScene* scene = importer.ReadFile(fileName, aiProcess_Triangulate | aiProcess_JoinIdenticalVertices | aiProcess_PreTransformVertices);
+	if (!scene)
+	{
+		return false;
+	}
+
+	for (unsigned int m = 0; m < scene->mNumMeshes; m++)
+	{
+		const aiMesh* mesh = scene->mMeshes[m];
+		unsigned int base = (unsigned int)(positions.size() / 3);
+
+		for (unsigned int i = 0; i < mesh->mNumVertices; i++)
+		{
+			positions.insert(positions.end(), { mesh->mVertices[i].x, mesh->mVertices[i].y, mesh->mVertices[i].z });
+		}
+
+		for (unsigned int i = 0; i < mesh->mNumFaces; i++)
+		{
+			if (mesh->mFaces[i].mNumIndices == 3)
+			{
+				indices.insert(indices.end(), { base + mesh->mFaces[i].mIndices[0], base + mesh->mFaces[i].mIndices[1], base + mesh->mFaces[i].mIndices[2] });
+			}
+		}
+	}
+
+	return !indices.empty();
+}
+
+static void CreateBumpyGrid(unsigned int size, std::vector<float>& positions, std::vector<unsigned int>& indices)
+{
+	for (unsigned int z = 0; z <= size; z++)
+	{
+		for (unsigned int x = 0; x <= size; x++)
+		{
+			float height = sinf(x * 0.05f) * cosf(z * 0.07f) * 8.0f + sinf(x * 0.31f + z * 0.17f);
+			positions.insert(positions.end(), { (float)x, height, (float)z });
+		}
+	}
+
+	for (unsigned int z = 0; z < size; z++)
+	{
+		for (unsigned int x = 0; x < size; x++)
+		{
+			unsigned int corner = z * (size + 1) + x;
+			indices.insert(indices.end(), { corner, corner + size + 1, corner + 1, corner + 1, corner + size + 1, corner + size + 2 });
+		}
+	}
+}
+
+int RunRaycastBenchmark()
+{
+	const unsigned int rayCount = 1 << 20;
+
+	JobSystem jobs;
+	jobs.Start();
+
+	const char* names[2] = { "Models/x-wing.obj", "bumpy grid 724^2" };
+	for (unsigned int scene = 0; scene < 2; scene++)
+	{
+		std::vector<float> positions;
+		std::vector<unsigned int> indices;
+		if (scene == 1)
+		{
+			CreateBumpyGrid(724, positions, indices);
+		}
+		else if (!LoadTriangleSoup(names[scene], positions, indices))
+		{
+			printf("%s failed to load, skipped\n", names[scene]);
+			continue;
+		}
+
+		MeshBvh bvh;
+		auto start = std::chrono::steady_clock::now();
+		bvh.Build(&positions[0], 3, &indices[0], (unsigned int)indices.size());
+		double serialMs = ElapsedMs(start);
+
+		start = std::chrono::steady_clock::now();
+		bvh.Build(&positions[0], 3, &indices[0], (unsigned int)indices.size(), &jobs);
+		double parallelMs = ElapsedMs(start);
+
+		printf("%s: %u triangles, %u nodes, %.1f MB\n", names[scene], bvh.GetTriangleCount(), bvh.GetNodeCount(), bvh.GetMemoryBytes() / (1024.0 * 1024.0));
+		printf("  build         %8.2f ms serial, %8.2f ms on %u threads\n", serialMs, parallelMs, jobs.GetThreadCount());
+
+		// From outside the bounds towards random points inside, most hit something
+		BoundingBox bounds = bvh.GetBounds();
+		glm::vec3 centre = bounds.GetCentre();
+		float radius = glm::length(bounds.GetExtents()) * 1.5f;
+
+		std::vector<Ray> rays(rayCount);
+		unsigned int seed = 12345;
+		auto random = [&seed]() { seed = seed * 1664525u + 1013904223u; return (seed >> 8) * (1.0f / 16777216.0f); };
+		for (unsigned int i = 0; i < rayCount; i++)
+		{
+			glm::vec3 side(random() * 2.0f - 1.0f, random() * 2.0f - 1.0f, random() * 2.0f - 1.0f);
+			if (glm::length(side) < 0.001f) side = glm::vec3(0.0f, 1.0f, 0.0f);
+			glm::vec3 origin = centre + glm::normalize(side) * radius;
+			glm::vec3 target = bounds.min + (bounds.max - bounds.min) * glm::vec3(random(), random(), random());
+			rays[i] = Ray(origin, glm::normalize(target - origin));
+		}
+
+		std::vector<RayHit> hits(rayCount);
+		start = std::chrono::steady_clock::now();
+		unsigned int hitCount = 0;
+		for (unsigned int i = 0; i < rayCount; i++)
+		{
+			if (bvh.Intersect(rays[i], hits[i])) hitCount++;
+		}
+		double closestMs = ElapsedMs(start);
+
+		start = std::chrono::steady_clock::now();
+		unsigned int occludedCount = 0;
+		for (unsigned int i = 0; i < rayCount; i++)
+		{
+			if (bvh.Occluded(rays[i])) occludedCount++;
+		}
+		double occludedMs = ElapsedMs(start);
+
+		hits.assign(rayCount, RayHit());
+		start = std::chrono::steady_clock::now();
+		bvh.IntersectBatch(&rays[0], &hits[0], rayCount, &jobs);
+		double batchMs = ElapsedMs(start);
+
+		printf("  closest hit   %8.2f M rays/s on 1 thread (%.0f%% hit)\n", rayCount / closestMs / 1000.0, hitCount * 100.0 / rayCount);
+		printf("  any hit       %8.2f M rays/s on 1 thread (%u occluded)\n", rayCount / occludedMs / 1000.0, occludedCount);
+		printf("  batch         %8.2f M rays/s on %u threads\n", rayCount / batchMs / 1000.0, jobs.GetThreadCount());
+	}
+
+	jobs.Stop();
+	return 0;
+}
+
+int RunParticleBenchmark()
+{
+	const unsigned int particleCount = 1000000;
+	const unsigned int emitterCount = 4;
+	const unsigned int warmupFrames = 30;
+	const unsigned int frameCount = 120;
+
+	Window window(1280, 720);
+	if (window.InitialiseHeadless() != 0)
+	{
+		return 1;
+	}
+
+	glm::mat4 projection = glm::perspective(glm::radians(45.0f), 1280.0f / 720.0f, 0.1f, 100.0f);
+	glm::mat4 view = glm::lookAt(glm::vec3(0.0f, 2.0f, 12.0f), glm::vec3(0.0f, 2.0f, 0.0f), glm::vec3(0.0f, 1.0f, 0.0f));
+
+	printf("Particles, %u in %u emitters, %u frames after %u warm up\n", particleCount, emitterCount, frameCount, warmupFrames);
+	printf("  %-20s %-7s %12s %12s %12s\n", "update", "render", "simulate ms", "render ms", "frame ms");
+
+	for (unsigned int path = 0; path < 2; path++)
+	{
+		bool compute = path == 1;
+		for (unsigned int mode = 0; mode < 2; mode++)
+		{
+			ParticleSystem particles;
+			if (!particles.Initialise(particleCount, compute))
+			{
+				return 1;
+			}
+			if (compute && !particles.IsUsingCompute())
+			{
+				printf("  %-20s not supported\n", "compute");
+				break;
+			}
+			particles.SetRenderMode((ParticleRenderMode)mode);
+
+			// Fountains side by side, most particles alive and on screen at once
+			for (unsigned int e = 0; e < emitterCount; e++)
+			{
+				ParticleEmitter emitter;
+				emitter.position = glm::vec3(-4.5f + 3.0f * e, 0.0f, 0.0f);
+				emitter.spread = 0.4f;
+				emitter.speedMin = 4.0f;
+				emitter.speedMax = 6.0f;
+				emitter.lifeMin = 1.5f;
+				emitter.lifeMax = 2.0f;
+				emitter.acceleration = glm::vec3(0.0f, -4.0f, 0.0f);
+				emitter.sizeStart = 0.05f;
+				emitter.sizeEnd = 0.01f;
+				emitter.colourStart = glm::vec4(0.02f, 0.01f, 0.005f, 1.0f);
+				emitter.count = particleCount / emitterCount;
+				particles.AddEmitter(emitter);
+			}
+
+			std::chrono::steady_clock::time_point start;
+			for (unsigned int frame = 0; frame < warmupFrames + frameCount; frame++)
+			{
+				if (frame == warmupFrames)
+				{
+					glFinish();
+					particles.ResetStats();
+					start = std::chrono::steady_clock::now();
+				}
+
+				glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+				particles.Simulate(1.0f / 60.0f, nullptr, 0);
+				particles.Render(view, projection);
+				window.swapBuffers();
+			}
+			glFinish();
+			double frameMs = ElapsedMs(start) / frameCount;
+
+			// Pending timers only resolve in Simulate, one extra frame collects what glFinish completed
+			particles.Simulate(0.0f, nullptr, 0);
+
+			printf("  %-20s %-7s %12.3f %12.3f %12.3f\n", compute ? "compute" : "transform feedback",
+				mode == PARTICLE_RENDER_POINTS ? "points" : "quads", particles.GetSimulateMs(), particles.GetRenderMs(), frameMs);
+		}
+	}
+
+	return 0;
+}
+
+// Root with three 21 joint chains swaying out of phase, every joint a bone. The mesh is a tube around
+// each chain, one ring per joint fully weighted to it
+static void CreateBenchmarkRig(Skeleton& skeleton, AnimationClip& clip, size_t& keyBytes, std::vector<GLfloat>& vertices,
+	std::vector<unsigned char>& joints, std::vector<unsigned char>& weights, std::vector<unsigned int>& indices)
+{
+	const unsigned int chainCount = 3;
+	const unsigned int chainLength = 21;
+	const unsigned int sides = 8;
+	const float duration = 2.0f;
+	const unsigned int keyCount = 31;
+
+	std::vector<JointTrack> tracks;
+	unsigned int root = skeleton.AddJoint("root", Skeleton::NO_JOINT, glm::vec3(0.0f), glm::quat(), glm::vec3(1.0f));
+	skeleton.AddBone(root, Skeleton::NO_JOINT, glm::mat4(1.0f));
+
+	JointTrack rootTrack;
+	rootTrack.joint = root;
+	for (unsigned int k = 0; k < keyCount; k++)
+	{
+		float time = duration * k / (keyCount - 1);
+		rootTrack.positionTimes.push_back(time);
+		rootTrack.positions.push_back(glm::vec3(0.0f, 0.05f * sinf(time * 6.2831853f), 0.0f));
+	}
+	tracks.push_back(rootTrack);
+
+	for (unsigned int c = 0; c < chainCount; c++)
+	{
+		unsigned int parent = root;
+		float x = (c - 1.0f) * 0.3f;
+		unsigned int ringBase = (unsigned int)vertices.size() / 8;
+
+		for (unsigned int k = 0; k < chainLength; k++)
+		{
+			glm::vec3 local = k == 0 ? glm::vec3(x, 0.0f, 0.0f) : glm::vec3(0.0f, 0.1f, 0.0f);
+			unsigned int joint = skeleton.AddJoint("chain" + std::to_string(c) + "_" + std::to_string(k), parent, local, glm::quat(), glm::vec3(1.0f));
+			glm::vec3 bindPosition(x, 0.1f * k, 0.0f);
+			unsigned int bone = skeleton.AddBone(joint, Skeleton::NO_JOINT, glm::translate(glm::mat4(1.0f), -bindPosition));
+			parent = joint;
+
+			JointTrack track;
+			track.joint = joint;
+			for (unsigned int key = 0; key < keyCount; key++)
+			{
+				float time = duration * key / (keyCount - 1);
+				float angle = 0.15f * sinf(time * 3.14159265f + k * 0.3f + c);
+				track.rotationTimes.push_back(time);
+				track.rotations.push_back(glm::angleAxis(angle, glm::vec3(0.0f, 0.0f, 1.0f)));
+			}
+			tracks.push_back(track);
+
+			for (unsigned int s = 0; s < sides; s++)
+			{
+				float around = 6.2831853f * s / sides;
+				glm::vec3 normal(cosf(around), 0.0f, sinf(around));
+				glm::vec3 position = bindPosition + normal * 0.05f;
+				GLfloat vertex[8] = { position.x, position.y, position.z, (float)s / sides, (float)k / chainLength, -normal.x, -normal.y, -normal.z };
+				vertices.insert(vertices.end(), vertex, vertex + 8);
+
+				unsigned char vertexJoints[4] = { (unsigned char)bone, 0, 0, 0 };
+				unsigned char vertexWeights[4] = { 255, 0, 0, 0 };
+				joints.insert(joints.end(), vertexJoints, vertexJoints + 4);
+				weights.insert(weights.end(), vertexWeights, vertexWeights + 4);
+			}
+
+			if (k > 0)
+			{
+				for (unsigned int s = 0; s < sides; s++)
+				{
+					unsigned int a = ringBase + (k - 1) * sides + s, b = ringBase + (k - 1) * sides + (s + 1) % sides;
+					unsigned int quad[6] = { a, b, a + sides, b, b + sides, a + sides };
+					indices.insert(indices.end(), quad, quad + 6);
+				}
+			}
+		}
+	}
+
+	keyBytes = 0;
+	for (size_t i = 0; i < tracks.size(); i++)
+	{
+		keyBytes += (tracks[i].positions.size() + tracks[i].scales.size()) * (sizeof(float) + sizeof(glm::vec3));
+		keyBytes += tracks[i].rotations.size() * (sizeof(float) + sizeof(glm::quat));
+	}
+
+	clip.Build("sway", skeleton, tracks, duration);
+}
+
+int RunSkinningBenchmark()
+{
+	const unsigned int characterCount = 1000;
+	const unsigned int frameCount = 120;
+	const float frameDelta = 1.0f / 60.0f;
+
+	Skeleton skeleton;
+	AnimationClip clip;
+	size_t keyBytes;
+	std::vector<GLfloat> vertices;
+	std::vector<unsigned char> joints, weights;
+	std::vector<unsigned int> indices;
+	CreateBenchmarkRig(skeleton, clip, keyBytes, vertices, joints, weights, indices);
+
+	// The palette limit comes from the context, so it is up before any instance
+	Window window(1280, 720);
+	if (window.InitialiseHeadless() != 0)
+	{
+		return 1;
+	}
+
+	AnimationSystem animations;
+	animations.QueryPaletteLimit();
+	for (unsigned int i = 0; i < characterCount; i++)
+	{
+		// Spread over the clip so no two characters sample the same frame
+		animations.AddInstance(&skeleton, &clip, clip.GetDuration() * i / characterCount, 0.8f + 0.4f * (i % 7) / 6.0f);
+	}
+	unsigned int animatedCount = animations.GetInstanceCount();
+
+	printf("Skinning, %u characters of %u joints / %u bones, %u triangles each\n", characterCount, skeleton.GetJointCount(),
+		skeleton.GetBoneCount(), (unsigned int)indices.size() / 3);
+	if (animatedCount < characterCount)
+	{
+		printf("  animated:        %8u, the rest over the %u row palette limit\n", animatedCount, animations.GetPaletteLimit());
+	}
+	printf("  clip:            %8.1f KB resampled (%u frames), %.1f KB of source keys\n", clip.GetMemoryBytes() / 1024.0, clip.GetFrameCount(), keyBytes / 1024.0);
+	printf("  palette:         %8.1f KB per frame\n", animations.GetPalette().size() * sizeof(glm::vec4) / 1024.0);
+
+	auto start = std::chrono::steady_clock::now();
+	for (unsigned int frame = 0; frame < frameCount; frame++)
+	{
+		animations.Update(frameDelta);
+	}
+	double serialMs = ElapsedMs(start) / frameCount;
+
+	JobSystem jobs;
+	jobs.Start();
+	start = std::chrono::steady_clock::now();
+	for (unsigned int frame = 0; frame < frameCount; frame++)
+	{
+		animations.Update(frameDelta, &jobs);
+	}
+	double parallelMs = ElapsedMs(start) / frameCount;
+
+	printf("  evaluate:        %8.3f ms serial (%.2f us per character), %.3f ms on %u threads\n",
+		serialMs, serialMs * 1000.0 / animatedCount, parallelMs, jobs.GetThreadCount());
+
+	Mesh mesh;
+	mesh.CreateMesh(&vertices[0], &indices[0], (unsigned int)vertices.size(), (unsigned int)indices.size());
+	mesh.SetSkinning(&joints[0], &weights[0], (unsigned int)vertices.size() / 8);
+
+	// Characters on a grid in front of the camera, one transform and one palette range each
+	unsigned int gridSize = (unsigned int)ceilf(sqrtf((float)characterCount));
+	std::vector<glm::mat4> worldMatrices(characterCount);
+	std::vector<glm::vec4> normalMatrices(characterCount * 3);
+	for (unsigned int i = 0; i < characterCount; i++)
+	{
+		glm::vec3 position((i % gridSize) * 1.2f - gridSize * 0.6f, -1.0f, -3.0f - (i / gridSize) * 1.2f);
+		worldMatrices[i] = glm::translate(glm::mat4(1.0f), position);
+		normalMatrices[i * 3] = glm::vec4(1.0f, 0.0f, 0.0f, 0.0f);
+		normalMatrices[i * 3 + 1] = glm::vec4(0.0f, 1.0f, 0.0f, 0.0f);
+		normalMatrices[i * 3 + 2] = glm::vec4(0.0f, 0.0f, 1.0f, 0.0f);
+	}
+	TransformBuffer transforms;
+	transforms.Upload(&worldMatrices[0], &normalMatrices[0], characterCount, 0, characterCount);
+
+	Shader shader;
+	shader.CreateFromFiles("Shaders/shader.vert", "Shaders/shader.frag");
+	shader.UseShader(SHADER_FEATURE_DIRECTIONAL_LIGHT | SHADER_FEATURE_SKINNING);
+	UniformTable& uniforms = shader.GetUniforms();
+	uniforms.SetMat4(Uniforms::Projection, glm::perspective(glm::radians(45.0f), 1280.0f / 720.0f, 0.1f, 100.0f));
+	uniforms.SetMat4(Uniforms::View, glm::lookAt(glm::vec3(0.0f, 3.0f, 4.0f), glm::vec3(0.0f, 0.0f, -10.0f), glm::vec3(0.0f, 1.0f, 0.0f)));
+	uniforms.SetInt(Uniforms::ModelMatrices, TRANSFORM_MODEL_TEXTURE_UNIT);
+	uniforms.SetInt(Uniforms::NormalMatrices, TRANSFORM_NORMAL_TEXTURE_UNIT);
+	uniforms.SetInt(Uniforms::BonePalette, BONE_PALETTE_TEXTURE_UNIT);
+	transforms.UseTransforms(TRANSFORM_MODEL_TEXTURE_UNIT, TRANSFORM_NORMAL_TEXTURE_UNIT);
+
+	glEnable(GL_DEPTH_TEST);
+	double updateMs = 0.0, uploadMs = 0.0;
+	start = std::chrono::steady_clock::now();
+	for (unsigned int frame = 0; frame < frameCount; frame++)
+	{
+		auto stepStart = std::chrono::steady_clock::now();
+		animations.Update(frameDelta, &jobs);
+		updateMs += ElapsedMs(stepStart);
+
+		stepStart = std::chrono::steady_clock::now();
+		const std::vector<glm::vec4>& palette = animations.GetPalette();
+		animations.UploadPalette(&palette[0], (unsigned int)palette.size());
+		animations.UsePalette(BONE_PALETTE_TEXTURE_UNIT);
+		uploadMs += ElapsedMs(stepStart);
+
+		glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+		for (unsigned int i = 0; i < characterCount; i++)
+		{
+			uniforms.SetInt(Uniforms::TransformIndex, i);
+			uniforms.SetInt(Uniforms::BoneBase, i < animatedCount ? (int)animations.GetPaletteBase(i) : -1);
+			mesh.RenderMesh();
+		}
+		window.swapBuffers();
+	}
+	glFinish();
+	double frameMs = ElapsedMs(start) / frameCount;
+
+	printf("  frame:           %8.3f ms (%.3f update, %.3f palette upload, %u draws)\n", frameMs, updateMs / frameCount, uploadMs / frameCount, characterCount);
+
+	glUseProgram(0);
+	mesh.ClearMesh();
+	transforms.ClearBuffer();
+	animations.ClearAnimations();
+	jobs.Stop();
+
+	return 0;
+}
+
+int RunDepthPrepassBenchmark()
+{
+	const unsigned int layerCount = 16;
+	const unsigned int gridSize = 64;
+	const unsigned int warmupFrames = 10;
+	const unsigned int frameCount = 60;
+
+	Window window(1280, 720);
+	if (window.InitialiseHeadless() != 0)
+	{
+		return 1;
+	}
+
+	// Screen filling grids stacked along the view axis, every pixel covered layerCount times
+	std::vector<GLfloat> vertices;
+	std::vector<unsigned int> indices;
+	for (unsigned int y = 0; y <= gridSize; y++)
+	{
+		for (unsigned int x = 0; x <= gridSize; x++)
+		{
+			GLfloat u = (GLfloat)x / gridSize, v = (GLfloat)y / gridSize;
+			GLfloat vertex[8] = { u * 2.0f - 1.0f, v * 2.0f - 1.0f, 0.0f, u, v, 0.0f, 0.0f, -1.0f };
+			vertices.insert(vertices.end(), vertex, vertex + 8);
+
+			if (x < gridSize && y < gridSize)
+			{
+				unsigned int a = y * (gridSize + 1) + x, b = a + gridSize + 1;
+				unsigned int quad[6] = { a, a + 1, b, a + 1, b + 1, b };
+				indices.insert(indices.end(), quad, quad + 6);
+			}
+		}
+	}
+
+	Mesh mesh;
+	mesh.CreateMesh(&vertices[0], &indices[0], (unsigned int)vertices.size(), (unsigned int)indices.size());
+	mesh.CreatePositionStream(&vertices[0], (unsigned int)vertices.size());
+
+	// Layer 0 is the nearest, each one further back is scaled to cover the same screen area
+	std::vector<glm::mat4> worldMatrices(layerCount);
+	std::vector<glm::vec4> normalMatrices(layerCount * 3);
+	for (unsigned int i = 0; i < layerCount; i++)
+	{
+		float distance = 2.0f + i * 0.5f;
+		worldMatrices[i] = glm::scale(glm::translate(glm::mat4(1.0f), glm::vec3(0.0f, 0.0f, -distance)), glm::vec3(distance * 0.8f, distance * 0.5f, 1.0f));
+		normalMatrices[i * 3] = glm::vec4(1.0f, 0.0f, 0.0f, 0.0f);
+		normalMatrices[i * 3 + 1] = glm::vec4(0.0f, 1.0f, 0.0f, 0.0f);
+		normalMatrices[i * 3 + 2] = glm::vec4(0.0f, 0.0f, 1.0f, 0.0f);
+	}
+	TransformBuffer transforms;
+	transforms.Upload(&worldMatrices[0], &normalMatrices[0], layerCount, 0, layerCount);
+	transforms.UseTransforms(TRANSFORM_MODEL_TEXTURE_UNIT, TRANSFORM_NORMAL_TEXTURE_UNIT);
+
+	DirectionalLight directionalLight(1.0f, 1.0f, 1.0f, 0.2f, 0.5f, 0.0f, 0.0f, -1.0f);
+	std::vector<PointLight> pointLights;
+	std::vector<SpotLight> spotLights;
+	for (int i = 0; i < MAX_POINT_LIGHTS; i++)
+	{
+		pointLights.push_back(PointLight(1.0f, 0.5f, 0.2f, 0.0f, 0.5f, -2.0f + 2.0f * i, 0.0f, -3.0f, 0.3f, 0.2f, 0.1f));
+	}
+	for (int i = 0; i < MAX_SPOT_LIGHTS; i++)
+	{
+		spotLights.push_back(SpotLight(0.2f, 0.5f, 1.0f, 0.0f, 1.0f, -1.0f + i, 0.0f, 0.0f, 0.0f, 0.0f, -1.0f, 0.3f, 0.1f, 0.05f, 30.0f));
+	}
+
+	glm::mat4 projection = glm::perspective(glm::radians(45.0f), 1280.0f / 720.0f, 0.1f, 100.0f);
+	glm::mat4 view(1.0f);
+
+	Shader shader;
+	shader.CreateFromFiles("Shaders/shader.vert", "Shaders/shader.frag");
+	unsigned int variants[2] = { SHADER_FEATURE_DEPTH_ONLY, SHADER_FEATURES_DEFAULT & ~SHADER_FEATURE_TEXTURE };
+	for (unsigned int i = 0; i < 2; i++)
+	{
+		shader.UseShader(variants[i]);
+		UniformTable& uniforms = shader.GetUniforms();
+		uniforms.SetMat4(Uniforms::Projection, projection);
+		uniforms.SetMat4(Uniforms::View, view);
+		uniforms.SetInt(Uniforms::ModelMatrices, TRANSFORM_MODEL_TEXTURE_UNIT);
+		uniforms.SetInt(Uniforms::NormalMatrices, TRANSFORM_NORMAL_TEXTURE_UNIT);
+		uniforms.SetFloat(Uniforms::MaterialSpecularIntensity, 1.0f);
+		uniforms.SetFloat(Uniforms::MaterialShininess, 32.0f);
+		shader.SetDirectionalLight(&directionalLight);
+		shader.SetPointLights(&pointLights[0], (unsigned int)pointLights.size());
+		shader.SetSpotLights(&spotLights[0], (unsigned int)spotLights.size());
+	}
+
+	GLuint queries[2];
+	glGenQueries(2, queries);
+
+	printf("Depth pre-pass, %u layers of %u triangles at %dx%d, %u frames after %u warm up\n", layerCount,
+		(unsigned int)indices.size() / 3, window.getBufferWidth(), window.getBufferHeight(), frameCount, warmupFrames);
+	printf("  %-14s %-8s %10s %14s %12s\n", "order", "pre-pass", "frame ms", "shaded frags", "complexity");
+
+	glEnable(GL_DEPTH_TEST);
+	for (unsigned int order = 0; order < 2; order++)
+	{
+		bool backToFront = order == 0;
+		for (unsigned int mode = 0; mode < 2; mode++)
+		{
+			bool prepass = mode == 1;
+			GLuint64 prepassSamples = 0, shadedSamples = 0;
+
+			std::chrono::steady_clock::time_point start;
+			double frameMs = 0.0;
+			for (unsigned int frame = 0; frame <= warmupFrames + frameCount; frame++)
+			{
+				if (frame == warmupFrames)
+				{
+					glFinish();
+					start = std::chrono::steady_clock::now();
+				}
+				// One extra frame after the timed ones counts the fragments
+				bool measure = frame == warmupFrames + frameCount;
+
+				glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+
+				if (prepass)
+				{
+					shader.UseShader(SHADER_FEATURE_DEPTH_ONLY);
+					glColorMask(GL_FALSE, GL_FALSE, GL_FALSE, GL_FALSE);
+					if (measure) glBeginQuery(GL_SAMPLES_PASSED, queries[0]);
+					for (unsigned int i = 0; i < layerCount; i++)
+					{
+						shader.GetUniforms().SetInt(Uniforms::TransformIndex, backToFront ? layerCount - 1 - i : i);
+						mesh.RenderDepth();
+					}
+					if (measure) glEndQuery(GL_SAMPLES_PASSED);
+					glColorMask(GL_TRUE, GL_TRUE, GL_TRUE, GL_TRUE);
+					glDepthFunc(GL_EQUAL);
+					glDepthMask(GL_FALSE);
+				}
+
+				shader.UseShader(variants[1]);
+				if (measure) glBeginQuery(GL_SAMPLES_PASSED, queries[1]);
+				for (unsigned int i = 0; i < layerCount; i++)
+				{
+					shader.GetUniforms().SetInt(Uniforms::TransformIndex, backToFront ? layerCount - 1 - i : i);
+					mesh.RenderMesh();
+				}
+				if (measure) glEndQuery(GL_SAMPLES_PASSED);
+
+				glDepthFunc(GL_LESS);
+				glDepthMask(GL_TRUE);
+
+				window.swapBuffers();
+				if (frame + 1 == warmupFrames + frameCount)
+				{
+					glFinish();
+					frameMs = ElapsedMs(start) / frameCount;
+				}
+			}
+
+			glGetQueryObjectui64v(queries[1], GL_QUERY_RESULT, &shadedSamples);
+			if (prepass)
+			{
+				glGetQueryObjectui64v(queries[0], GL_QUERY_RESULT, &prepassSamples);
+			}
+
+			// Without the pre-pass the lighting pass itself passes as many samples as the pre-pass would
+			char complexity[32] = "-";
+			if (prepass && shadedSamples > 0)
+			{
+				snprintf(complexity, sizeof(complexity), "%.2f", (double)prepassSamples / shadedSamples);
+			}
+			printf("  %-14s %-8s %10.3f %14llu %12s\n", backToFront ? "back to front" : "front to back", prepass ? "on" : "off",
+				frameMs, (unsigned long long)shadedSamples, complexity);
+		}
+	}
+
+	glDeleteQueries(2, queries);
+	glUseProgram(0);
+	mesh.ClearMesh();
+	transforms.ClearBuffer();
+	shader.ClearShader();
+
+	return 0;
+}
+
+int RunLightCullingBenchmark()
+{
+	const unsigned int drawGrid = 128;
+	const unsigned int pointCount = 64;
+	const unsigned int spotCount = 32;
+	const unsigned int frameCount = 50;
+	const float fieldSize = 256.0f;
+
+	// Lights scattered over the field with ranges from a few units to a few dozen
+	std::vector<PointLight> pointLights;
+	std::vector<SpotLight> spotLights;
+	unsigned int seed = 1;
+	auto random = [&seed]() { seed = seed * 1664525u + 1013904223u; return (float)(seed >> 8) / 16777216.0f; };
+
+	for (unsigned int i = 0; i < pointCount; i++)
+	{
+		pointLights.push_back(PointLight(random(), random(), random(), 0.0f, 0.5f + random(),
+			random() * fieldSize, 1.0f + random() * 4.0f, random() * fieldSize,
+			1.0f, 0.1f + random() * 0.2f, 0.1f + random() * 0.4f));
+	}
+	for (unsigned int i = 0; i < spotCount; i++)
+	{
+		float angle = random() * 6.2831853f;
+		spotLights.push_back(SpotLight(1.0f, 1.0f, 1.0f, 0.0f, 1.0f + random(),
+			random() * fieldSize, 6.0f, random() * fieldSize,
+			cosf(angle), -0.7f, sinf(angle),
+			1.0f, 0.05f, 0.05f + random() * 0.1f,
+			15.0f + random() * 20.0f));
+	}
+
+	std::vector<BoundingBox> bounds;
+	float spacing = fieldSize / drawGrid;
+	for (unsigned int z = 0; z < drawGrid; z++)
+	{
+		for (unsigned int x = 0; x < drawGrid; x++)
+		{
+			glm::vec3 centre((x + 0.5f) * spacing, 0.5f, (z + 0.5f) * spacing);
+			glm::vec3 extents(spacing * 0.4f, 0.5f + (x * 7 + z * 3) % 5 * 0.5f, spacing * 0.4f);
+			bounds.push_back(BoundingBox(centre - extents, centre + extents));
+		}
+	}
+
+	printf("Light culling, %u draws against %u point and %u spot lights, %u frames\n", (unsigned int)bounds.size(), pointCount, spotCount, frameCount);
+	printf("  culling  ns/draw   point/draw  spot/draw  over limit\n");
+
+	// Off, every draw is shaded by the first lights of each list whether they reach it or not
+	for (int pass = 0; pass < 2; pass++)
+	{
+		LightCuller culler;
+		culler.SetEnabled(pass == 1);
+		LightSelection selection;
+
+		auto start = std::chrono::steady_clock::now();
+		for (unsigned int frame = 0; frame < frameCount; frame++)
+		{
+			for (size_t i = 0; i < bounds.size(); i++)
+			{
+				culler.SelectLights(&pointLights[0], pointCount, &spotLights[0], spotCount, bounds[i], selection);
+			}
+		}
+		double ms = ElapsedMs(start);
+
+		printf("  %-8s %8.1f %12.2f %10.2f %10.1f%%\n", culler.IsEnabled() ? "on" : "off", ms * 1e6 / ((double)frameCount * bounds.size()),
+			culler.GetMeanPointLights(), culler.GetMeanSpotLights(), culler.GetOverLimitFraction() * 100.0);
+	}
+
+	return 0;
+}
+
+// Unit square in XZ facing +Y, as Model imports it: 8 floats per vertex with the normal flipped
+static void CreateBakeQuad(unsigned int size, std::vector<GLfloat>& vertices, std::vector<unsigned int>& indices)
+{
+	for (unsigned int z = 0; z <= size; z++)
+	{
+		for (unsigned int x = 0; x <= size; x++)
+		{
+			float u = (float)x / size, v = (float)z / size;
+			vertices.insert(vertices.end(), { u * 2.0f - 1.0f, 0.0f, v * 2.0f - 1.0f, u, v, 0.0f, -1.0f, 0.0f });
+		}
+	}
+
+	for (unsigned int z = 0; z < size; z++)
+	{
+		for (unsigned int x = 0; x < size; x++)
+		{
+			unsigned int i = z * (size + 1) + x;
+			indices.insert(indices.end(), { i, i + size + 1, i + 1, i + 1, i + size + 1, i + size + 2 });
+		}
+	}
+}
+
+static void SetUpBakeScene(LightBaker& baker, const std::vector<GLfloat>& vertices, const std::vector<unsigned int>& indices)
+{
+	unsigned int vertexCount = (unsigned int)vertices.size() / 8;
+
+	// Floor, a back wall and a left wall, the corners only get light that bounced off the other surfaces
+	glm::mat4 floor = glm::scale(glm::mat4(1.0f), glm::vec3(5.0f, 1.0f, 5.0f));
+	glm::mat4 back = glm::translate(glm::mat4(1.0f), glm::vec3(0.0f, 5.0f, -5.0f)) *
+		glm::rotate(glm::mat4(1.0f), glm::radians(90.0f), glm::vec3(1.0f, 0.0f, 0.0f)) * floor;
+	glm::mat4 left = glm::translate(glm::mat4(1.0f), glm::vec3(-5.0f, 5.0f, 0.0f)) *
+		glm::rotate(glm::mat4(1.0f), glm::radians(-90.0f), glm::vec3(0.0f, 0.0f, 1.0f)) * floor;
+
+	baker.AddMesh(&vertices[0], vertexCount, &indices[0], (unsigned int)indices.size(), floor);
+	baker.AddMesh(&vertices[0], vertexCount, &indices[0], (unsigned int)indices.size(), back);
+	baker.AddMesh(&vertices[0], vertexCount, &indices[0], (unsigned int)indices.size(), left);
+
+	baker.SetDirectionalLight(DirectionalLight(1.0f, 0.95f, 0.9f, 0.1f, 0.8f, 0.4f, -1.0f, -0.3f));
+	baker.AddPointLight(PointLight(1.0f, 0.5f, 0.2f, 0.0f, 1.0f, 2.0f, 1.0f, -2.0f, 1.0f, 0.2f, 0.1f));
+	baker.AddSpotLight(SpotLight(0.2f, 0.4f, 1.0f, 0.0f, 2.0f, 3.0f, 4.0f, 3.0f, -1.0f, -1.0f, -1.0f, 1.0f, 0.05f, 0.02f, 30.0f));
+}
+
+// Root mean square luminance difference over every vertex of the bake
+static double BakeError(LightBaker& baker, LightBaker& reference)
+{
+	double sum = 0.0;
+	size_t count = 0;
+	for (unsigned int m = 0; m < baker.GetMeshCount(); m++)
+	{
+		const std::vector<GLfloat>& light = baker.GetBakedLight(m);
+		const std::vector<GLfloat>& expected = reference.GetBakedLight(m);
+		for (size_t i = 0; i < light.size(); i += 3)
+		{
+			double difference = 0.2126 * (light[i] - expected[i]) + 0.7152 * (light[i + 1] - expected[i + 1]) + 0.0722 * (light[i + 2] - expected[i + 2]);
+			sum += difference * difference;
+			count++;
+		}
+	}
+
+	return count > 0 ? sqrt(sum / count) : 0.0;
+}
+
+int RunLightBakeBenchmark()
+{
+	const unsigned int quadSize = 24;
+	const unsigned int referenceSamples = 4096;
+
+	std::vector<GLfloat> vertices;
+	std::vector<unsigned int> indices;
+	CreateBakeQuad(quadSize, vertices, indices);
+
+	JobSystem jobs;
+	jobs.Start();
+
+	LightBaker reference;
+	SetUpBakeScene(reference, vertices, indices);
+	LightBakeSettings referenceSettings;
+	referenceSettings.minSamples = referenceSamples;
+	referenceSettings.maxSamples = referenceSamples;
+	referenceSettings.samplesPerPass = referenceSamples;
+	referenceSettings.denoisePasses = 0;
+	reference.SetSettings(referenceSettings);
+	reference.Bake(&jobs);
+
+	printf("Light bake, 3 quads of %u vertices against a %u path reference\n", (quadSize + 1) * (quadSize + 1), referenceSamples);
+	printf("  threads  denoise   bake ms   paths/vertex   rms error\n");
+
+	for (int run = 0; run < 3; run++)
+	{
+		LightBaker baker;
+		SetUpBakeScene(baker, vertices, indices);
+		LightBakeSettings settings;
+		settings.denoisePasses = run == 1 ? 0 : settings.denoisePasses;
+		baker.SetSettings(settings);
+
+		bool threaded = run > 0;
+		auto start = std::chrono::steady_clock::now();
+		baker.Bake(threaded ? &jobs : nullptr);
+		double bakeMs = ElapsedMs(start);
+
+		printf("  %7u  %-7s %9.1f %14.1f %11.5f\n", threaded ? jobs.GetThreadCount() : 1, settings.denoisePasses > 0 ? "on" : "off",
+			bakeMs, baker.GetPathsPerVertex(), BakeError(baker, reference));
+	}
+
+	jobs.Stop();
+
+	return 0;
+}
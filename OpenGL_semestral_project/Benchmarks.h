@@ -0,0 +1,18 @@
+#pragma once
+
+// Microbenchmarks run with "--bench <name>", they print their results and need no window.
+// The GL ones open their own headless context
+int RunBenchmark(const char* name);
+
+int RunTransformBenchmark();
+int RunEntityBenchmark();
+int RunJobBenchmark();
+int RunPipelineBenchmark();
+int RunPacingBenchmark();
+int RunMeshUpdateBenchmark();
+int RunRaycastBenchmark();
+int RunParticleBenchmark();
+int RunSkinningBenchmark();
+int RunDepthPrepassBenchmark();
+int RunLightCullingBenchmark();
+int RunLightBakeBenchmark();
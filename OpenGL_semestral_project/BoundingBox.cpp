@@ -0,0 +1,93 @@
+#include "BoundingBox.h"
+
+#include <float.h>
+
+BoundingBox::BoundingBox()
+{
+	// Inverted so the first Expand sets both corners
+	min = glm::vec3(FLT_MAX, FLT_MAX, FLT_MAX);
+	max = glm::vec3(-FLT_MAX, -FLT_MAX, -FLT_MAX);
+}
+
+BoundingBox::BoundingBox(glm::vec3 boxMin, glm::vec3 boxMax)
+{
+	min = boxMin;
+	max = boxMax;
+}
+
+void BoundingBox::Expand(glm::vec3 point)
+{
+	min = glm::min(min, point);
+	max = glm::max(max, point);
+}
+
+void BoundingBox::Expand(const BoundingBox& box)
+{
+	if (!box.IsValid())
+	{
+		return;
+	}
+
+	min = glm::min(min, box.min);
+	max = glm::max(max, box.max);
+}
+
+BoundingBox BoundingBox::Transform(const glm::mat4& matrix) const
+{
+	if (!IsValid())
+	{
+		return *this;
+	}
+
+	// Arvo: transform the centre, then project the extents onto the absolute matrix axes
+	glm::vec3 centre = glm::vec3(matrix * glm::vec4(GetCentre(), 1.0f));
+	glm::vec3 extents = GetExtents();
+
+	glm::vec3 newExtents = glm::abs(glm::vec3(matrix[0])) * extents.x +
+		glm::abs(glm::vec3(matrix[1])) * extents.y +
+		glm::abs(glm::vec3(matrix[2])) * extents.z;
+
+	return BoundingBox(centre - newExtents, centre + newExtents);
+}
+
+bool BoundingBox::IntersectRay(glm::vec3 origin, glm::vec3 direction, float maxDistance) const
+{
+	if (!IsValid())
+	{
+		return false;
+	}
+
+	float enter = 0.0f;
+	float exit = maxDistance;
+
+	for (int axis = 0; axis < 3; axis++)
+	{
+		if (direction[axis] == 0.0f)
+		{
+			if (origin[axis] < min[axis] || origin[axis] > max[axis])
+			{
+				return false;
+			}
+			continue;
+		}
+
+		float inverse = 1.0f / direction[axis];
+		float t0 = (min[axis] - origin[axis]) * inverse;
+		float t1 = (max[axis] - origin[axis]) * inverse;
+		if (t0 > t1)
+		{
+			float swap = t0;
+			t0 = t1;
+			t1 = swap;
+		}
+
+		enter = t0 > enter ? t0 : enter;
+		exit = t1 < exit ? t1 : exit;
+		if (enter > exit)
+		{
+			return false;
+		}
+	}
+
+	return true;
+}
@@ -0,0 +1,25 @@
+#pragma once
+
+#include <glm\glm.hpp>
+
+struct BoundingBox
+{
+	glm::vec3 min;
+	glm::vec3 max;
+
+	BoundingBox();
+	BoundingBox(glm::vec3 boxMin, glm::vec3 boxMax);
+
+	bool IsValid() const { return min.x <= max.x && min.y <= max.y && min.z <= max.z; }
+	glm::vec3 GetCentre() const { return (min + max) * 0.5f; }
+	glm::vec3 GetExtents() const { return (max - min) * 0.5f; }
+
+	void Expand(glm::vec3 point);
+	void Expand(const BoundingBox& box);
+
+	// Axis-aligned box enclosing this box after the transform
+	BoundingBox Transform(const glm::mat4& matrix) const;
+
+	// Slab test, true when the ray enters the box within maxDistance (in multiples of direction)
+	bool IntersectRay(glm::vec3 origin, glm::vec3 direction, float maxDistance) const;
+};
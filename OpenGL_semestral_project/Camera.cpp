@@ -62,6 +62,33 @@ void Camera::mouseControl(GLfloat xChange, GLfloat yChange)
 	update();
 }
 
+void Camera::setPose(glm::vec3 newPosition, glm::vec3 target)
+{
+	position = newPosition;
+
+	glm::vec3 direction = target - newPosition;
+	if (glm::length(direction) < 0.0001f)
+	{
+		return;
+	}
+	direction = glm::normalize(direction);
+
+	pitch = glm::degrees(asin(direction.y));
+	yaw = glm::degrees(atan2(direction.z, direction.x));
+
+	if (pitch > 89.0f)
+	{
+		pitch = 89.0f;
+	}
+
+	if (pitch < -89.0f)
+	{
+		pitch = -89.0f;
+	}
+
+	update();
+}
+
 glm::mat4 Camera::calculateViewMatrix()
 {
 	return glm::lookAt(position, position + front, up);
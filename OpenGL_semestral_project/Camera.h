@@ -15,6 +15,8 @@ public:
 
 	void keyControl(bool* keys, GLfloat deltaTime);
 	void mouseControl(GLfloat xChange, GLfloat yChange);
+	// Places the camera at position looking at target, used by scripted flythroughs
+	void setPose(glm::vec3 newPosition, glm::vec3 target);
 
 	glm::vec3 getCameraPosition();
 	glm::vec3 getCameraDirection();
@@ -0,0 +1,128 @@
+#include "CameraPath.h"
+
+#include <stdio.h>
+#include <fstream>
+#include <sstream>
+
+CameraPath::CameraPath()
+{
+}
+
+void CameraPath::AddPoint(glm::vec3 position, glm::vec3 target)
+{
+	positions.push_back(position);
+	targets.push_back(target);
+}
+
+bool CameraPath::LoadPath(const std::string& fileName)
+{
+	std::ifstream fileStream(fileName.c_str(), std::ios::in);
+	if (!fileStream.is_open())
+	{
+		printf("Failed to read %s! File doesn't exist.\n", fileName.c_str());
+		return false;
+	}
+
+	ClearPath();
+
+	std::string line;
+	unsigned int lineNumber = 0;
+	while (std::getline(fileStream, line))
+	{
+		lineNumber++;
+		if (line.empty() || line[0] == '#')
+		{
+			continue;
+		}
+
+		std::istringstream values(line);
+		glm::vec3 position, target;
+		if (!(values >> position.x >> position.y >> position.z >> target.x >> target.y >> target.z))
+		{
+			printf("%s:%u: expected \"x y z tx ty tz\"\n", fileName.c_str(), lineNumber);
+			continue;
+		}
+
+		AddPoint(position, target);
+	}
+
+	if (positions.size() < 2)
+	{
+		printf("%s: a camera path needs at least 2 points\n", fileName.c_str());
+		ClearPath();
+		return false;
+	}
+
+	return true;
+}
+
+void CameraPath::CreateDefaultPath()
+{
+	ClearPath();
+
+	// Circle the x-wing with the mountains in the background, then pull back over the lights
+	glm::vec3 xwing(-5.0f, 2.0f, 0.0f);
+	AddPoint(glm::vec3(0.0f, 0.0f, 0.0f), xwing);
+	AddPoint(glm::vec3(-5.0f, 3.0f, 6.0f), xwing);
+	AddPoint(glm::vec3(-11.0f, 4.0f, 0.0f), xwing);
+	AddPoint(glm::vec3(-5.0f, 3.0f, -6.0f), xwing);
+	AddPoint(glm::vec3(2.0f, 6.0f, -4.0f), glm::vec3(-7.0f, -10.0f, 10.0f));
+	AddPoint(glm::vec3(4.0f, 10.0f, 12.0f), glm::vec3(-7.0f, -20.0f, 10.0f));
+	AddPoint(glm::vec3(0.0f, 0.0f, 0.0f), xwing);
+}
+
+void CameraPath::Evaluate(float t, glm::vec3& position, glm::vec3& target)
+{
+	if (positions.empty())
+	{
+		return;
+	}
+
+	if (positions.size() == 1)
+	{
+		position = positions[0];
+		target = targets[0];
+		return;
+	}
+
+	if (t < 0.0f) t = 0.0f;
+	if (t > 1.0f) t = 1.0f;
+
+	float scaled = t * (positions.size() - 1);
+	unsigned int segment = (unsigned int)scaled;
+	if (segment >= positions.size() - 1)
+	{
+		segment = (unsigned int)positions.size() - 2;
+	}
+
+	float local = scaled - segment;
+	position = CatmullRom(positions, segment, local);
+	target = CatmullRom(targets, segment, local);
+}
+
+glm::vec3 CameraPath::CatmullRom(const std::vector<glm::vec3>& points, unsigned int segment, float t)
+{
+	// End keys are repeated so the curve still passes through the first and last point
+	const glm::vec3& p0 = points[segment > 0 ? segment - 1 : 0];
+	const glm::vec3& p1 = points[segment];
+	const glm::vec3& p2 = points[segment + 1];
+	const glm::vec3& p3 = points[segment + 2 < points.size() ? segment + 2 : segment + 1];
+
+	float t2 = t * t;
+	float t3 = t2 * t;
+
+	return 0.5f * ((2.0f * p1) +
+		(p2 - p0) * t +
+		(2.0f * p0 - 5.0f * p1 + 4.0f * p2 - p3) * t2 +
+		(3.0f * p1 - p0 - 3.0f * p2 + p3) * t3);
+}
+
+void CameraPath::ClearPath()
+{
+	positions.clear();
+	targets.clear();
+}
+
+CameraPath::~CameraPath()
+{
+}
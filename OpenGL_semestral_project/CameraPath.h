@@ -0,0 +1,35 @@
+#pragma once
+
+#include <vector>
+#include <string>
+
+#include <glm\glm.hpp>
+
+// Scripted camera flight, Catmull-Rom through (position, target) keys so benchmark runs see the same frames
+class CameraPath
+{
+public:
+	CameraPath();
+
+	void AddPoint(glm::vec3 position, glm::vec3 target);
+
+	// One key per line, "x y z tx ty tz", lines starting with # are comments
+	bool LoadPath(const std::string& fileName);
+	// Loop around the default scene when no path file is given
+	void CreateDefaultPath();
+
+	unsigned int GetPointCount() { return (unsigned int)positions.size(); }
+
+	// t in [0, 1] over the whole path, keys evenly spaced in t
+	void Evaluate(float t, glm::vec3& position, glm::vec3& target);
+
+	void ClearPath();
+
+	~CameraPath();
+
+private:
+	std::vector<glm::vec3> positions;
+	std::vector<glm::vec3> targets;
+
+	static glm::vec3 CatmullRom(const std::vector<glm::vec3>& points, unsigned int segment, float t);
+};
@@ -0,0 +1,24 @@
+#include "Clock.h"
+
+#include <chrono>
+#include <thread>
+
+static const std::chrono::steady_clock::time_point processStart = std::chrono::steady_clock::now();
+
+double Clock::Now()
+{
+	return std::chrono::duration<double>(std::chrono::steady_clock::now() - processStart).count();
+}
+
+void Clock::SleepFor(double seconds)
+{
+	if (seconds > 0.0)
+	{
+		std::this_thread::sleep_for(std::chrono::duration<double>(seconds));
+	}
+}
+
+void Clock::SleepUntil(double time)
+{
+	SleepFor(time - Now());
+}
@@ -0,0 +1,13 @@
+#pragma once
+
+// Monotonic process time in double seconds. Counting from process start keeps full
+// sub-microsecond precision for months, unlike a float from glfwGetTime
+class Clock
+{
+public:
+	static double Now();
+
+	// Plain sleep, wakes up late by however much the OS scheduler rounds
+	static void SleepFor(double seconds);
+	static void SleepUntil(double time);
+};
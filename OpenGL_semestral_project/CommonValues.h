@@ -1,4 +1,33 @@
 #pragma once
 
 const int MAX_POINT_LIGHTS = 3;
-const int MAX_SPOT_LIGHTS = 3;
\ No newline at end of file
+const int MAX_SPOT_LIGHTS = 3;
+
+// Shader variant feature bits, each one maps to a USE_* define in shader.frag
+const unsigned int SHADER_FEATURE_DIRECTIONAL_LIGHT = 1 << 0;
+const unsigned int SHADER_FEATURE_POINT_LIGHTS = 1 << 1;
+const unsigned int SHADER_FEATURE_SPOT_LIGHTS = 1 << 2;
+const unsigned int SHADER_FEATURE_TEXTURE = 1 << 3;
+const unsigned int SHADER_FEATURE_SPECULAR = 1 << 4;
+const unsigned int SHADER_FEATURE_FOG = 1 << 5;
+const unsigned int SHADER_FEATURE_TEXTURE_ARRAY = 1 << 6;
+const unsigned int SHADER_FEATURE_TERRAIN = 1 << 7;
+const unsigned int SHADER_FEATURE_SKINNING = 1 << 8;
+// Depth pre-pass program, the fragment shader writes nothing and no lighting is compiled in
+const unsigned int SHADER_FEATURE_DEPTH_ONLY = 1 << 9;
+// Adds the per-vertex indirect light LightBaker stored in the meshes
+const unsigned int SHADER_FEATURE_BAKED_LIGHTING = 1 << 10;
+
+const unsigned int SHADER_FEATURE_COUNT = 11;
+const unsigned int SHADER_FEATURES_DEFAULT = SHADER_FEATURE_DIRECTIONAL_LIGHT | SHADER_FEATURE_POINT_LIGHTS |
+	SHADER_FEATURE_SPOT_LIGHTS | SHADER_FEATURE_TEXTURE | SHADER_FEATURE_SPECULAR;
+
+// Texture units reserved for the TransformStore buffers, unit 0 stays the material texture
+const int TRANSFORM_MODEL_TEXTURE_UNIT = 1;
+const int TRANSFORM_NORMAL_TEXTURE_UNIT = 2;
+// Models imported with texture arrays keep their current array here
+const int TEXTURE_ARRAY_TEXTURE_UNIT = 3;
+// AnimationSystem's bone palette for skinned draws
+const int BONE_PALETTE_TEXTURE_UNIT = 4;
+// Draws and nodes without an animated pose
+const unsigned int NO_BONE_PALETTE = 0xFFFFFFFF;
@@ -0,0 +1,88 @@
+#pragma once
+
+#include <vector>
+
+// Sparse-set storage: components stay packed in one array, the sparse array maps entity index -> slot
+template <typename T>
+class ComponentPool
+{
+public:
+	static const unsigned int NO_SLOT = 0xFFFFFFFF;
+
+	T& Add(unsigned int entityIndex, const T& component)
+	{
+		if (entityIndex >= sparse.size())
+		{
+			sparse.resize(entityIndex + 1, NO_SLOT);
+		}
+
+		if (sparse[entityIndex] != NO_SLOT)
+		{
+			components[sparse[entityIndex]] = component;
+			return components[sparse[entityIndex]];
+		}
+
+		sparse[entityIndex] = (unsigned int)dense.size();
+		dense.push_back(entityIndex);
+		components.push_back(component);
+		return components.back();
+	}
+
+	// Swap-and-pop, the last component moves into the freed slot
+	void Remove(unsigned int entityIndex)
+	{
+		if (!Has(entityIndex))
+		{
+			return;
+		}
+
+		unsigned int slot = sparse[entityIndex];
+		unsigned int last = (unsigned int)dense.size() - 1;
+
+		if (slot != last)
+		{
+			dense[slot] = dense[last];
+			components[slot] = components[last];
+			sparse[dense[slot]] = slot;
+		}
+
+		dense.pop_back();
+		components.pop_back();
+		sparse[entityIndex] = NO_SLOT;
+	}
+
+	bool Has(unsigned int entityIndex) const
+	{
+		return entityIndex < sparse.size() && sparse[entityIndex] != NO_SLOT;
+	}
+
+	T& Get(unsigned int entityIndex) { return components[sparse[entityIndex]]; }
+	T* Find(unsigned int entityIndex) { return Has(entityIndex) ? &components[sparse[entityIndex]] : nullptr; }
+
+	unsigned int Size() const { return (unsigned int)dense.size(); }
+	T* Data() { return components.empty() ? nullptr : &components[0]; }
+	T& At(unsigned int slot) { return components[slot]; }
+	unsigned int EntityAt(unsigned int slot) const { return dense[slot]; }
+
+	void Reserve(unsigned int count)
+	{
+		sparse.reserve(count);
+		dense.reserve(count);
+		components.reserve(count);
+	}
+
+	void Clear()
+	{
+		sparse.clear();
+		dense.clear();
+		components.clear();
+	}
+
+private:
+	std::vector<unsigned int> sparse;
+	std::vector<unsigned int> dense;
+	std::vector<T> components;
+};
+
+template <typename T>
+const unsigned int ComponentPool<T>::NO_SLOT;
@@ -0,0 +1,173 @@
+#include "CpuTrace.h"
+
+#include <stdio.h>
+
+#include "Clock.h"
+#include "GpuProfiler.h"
+
+const unsigned int CpuTrace::RING_SIZE;
+
+std::mutex CpuTrace::registryMutex;
+std::vector<CpuTrace::ThreadBuffer*> CpuTrace::registry;
+unsigned int CpuTrace::nextThreadId = 1;
+
+thread_local CpuTrace::ThreadBuffer* CpuTrace::threadBuffer = nullptr;
+
+CpuTrace::ThreadBuffer* CpuTrace::GetThreadBuffer()
+{
+	if (threadBuffer)
+	{
+		return threadBuffer;
+	}
+
+	// Buffers live until the process exits so threads that already finished still show up in exports
+	ThreadBuffer* buffer = new ThreadBuffer();
+	buffer->threadName = nullptr;
+	buffer->events.resize(RING_SIZE);
+	buffer->writeIndex.store(0);
+
+	{
+		std::lock_guard<std::mutex> lock(registryMutex);
+		buffer->threadId = nextThreadId++;
+		registry.push_back(buffer);
+	}
+
+	threadBuffer = buffer;
+	return buffer;
+}
+
+void CpuTrace::Record(const char* name, double begin, double end)
+{
+	ThreadBuffer* buffer = GetThreadBuffer();
+
+	unsigned long long index = buffer->writeIndex.load(std::memory_order_relaxed);
+	CpuTraceEvent& event = buffer->events[index & (RING_SIZE - 1)];
+	event.name = name;
+	event.begin = begin;
+	event.end = end;
+
+	buffer->writeIndex.store(index + 1, std::memory_order_release);
+}
+
+void CpuTrace::SetThreadName(const char* name)
+{
+	GetThreadBuffer()->threadName = name;
+}
+
+unsigned long long CpuTrace::GetEventCount()
+{
+	std::lock_guard<std::mutex> lock(registryMutex);
+
+	unsigned long long count = 0;
+	for (size_t i = 0; i < registry.size(); i++)
+	{
+		count += registry[i]->writeIndex.load(std::memory_order_acquire);
+	}
+
+	return count;
+}
+
+static void WriteJsonString(FILE* file, const char* text)
+{
+	fputc('"', file);
+	for (const char* c = text; *c; c++)
+	{
+		if (*c == '"' || *c == '\\') fputc('\\', file);
+		fputc(*c, file);
+	}
+	fputc('"', file);
+}
+
+bool CpuTrace::ExportChromeTrace(const char* fileName, GpuProfiler* gpuProfiler)
+{
+	FILE* file = fopen(fileName, "w");
+	if (!file)
+	{
+		printf("Failed to open %s for writing the trace\n", fileName);
+		return false;
+	}
+
+	fprintf(file, "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n");
+	fprintf(file, "{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":1,\"tid\":0,\"args\":{\"name\":\"OpenGL_semestral_project\"}}");
+
+	unsigned long long exported = 0;
+	std::vector<ThreadBuffer*> buffers;
+	{
+		std::lock_guard<std::mutex> lock(registryMutex);
+		buffers = registry;
+	}
+
+	std::vector<CpuTraceEvent> events;
+	for (size_t b = 0; b < buffers.size(); b++)
+	{
+		ThreadBuffer* buffer = buffers[b];
+
+		fprintf(file, ",\n{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":%u,\"args\":{\"name\":", buffer->threadId);
+		char fallbackName[32];
+		snprintf(fallbackName, sizeof(fallbackName), "Thread %u", buffer->threadId);
+		WriteJsonString(file, buffer->threadName ? buffer->threadName : fallbackName);
+		fprintf(file, "}}");
+
+		unsigned long long end = buffer->writeIndex.load(std::memory_order_acquire);
+		unsigned long long begin = end > RING_SIZE ? end - RING_SIZE : 0;
+
+		events.clear();
+		for (unsigned long long i = begin; i < end; i++)
+		{
+			events.push_back(buffer->events[i & (RING_SIZE - 1)]);
+		}
+
+		// The owner may have lapped us while copying, those oldest entries are torn
+		unsigned long long after = buffer->writeIndex.load(std::memory_order_acquire);
+		unsigned long long firstValid = after > RING_SIZE ? after - RING_SIZE : 0;
+
+		for (unsigned long long i = begin; i < end; i++)
+		{
+			if (i < firstValid)
+			{
+				continue;
+			}
+
+			const CpuTraceEvent& event = events[(size_t)(i - begin)];
+			fprintf(file, ",\n{\"name\":");
+			WriteJsonString(file, event.name);
+			fprintf(file, ",\"cat\":\"cpu\",\"ph\":\"X\",\"pid\":1,\"tid\":%u,\"ts\":%.3f,\"dur\":%.3f}",
+				buffer->threadId, event.begin * 1e6, (event.end - event.begin) * 1e6);
+			exported++;
+		}
+	}
+
+	if (gpuProfiler)
+	{
+		// Own track with a tid no CPU thread uses
+		const unsigned int gpuTrack = 1000;
+		fprintf(file, ",\n{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":%u,\"args\":{\"name\":\"GPU\"}}", gpuTrack);
+
+		std::vector<GpuTimelineEvent> gpuEvents = gpuProfiler->GetTimeline();
+		for (size_t i = 0; i < gpuEvents.size(); i++)
+		{
+			const GpuTimelineEvent& event = gpuEvents[i];
+			fprintf(file, ",\n{\"name\":");
+			WriteJsonString(file, gpuProfiler->GetScopeLabel(event.scope).c_str());
+			fprintf(file, ",\"cat\":\"gpu\",\"ph\":\"X\",\"pid\":1,\"tid\":%u,\"ts\":%.3f,\"dur\":%.3f}",
+				gpuTrack, event.begin * 1e6, (event.end - event.begin) * 1e6);
+			exported++;
+		}
+	}
+
+	fprintf(file, "\n]}\n");
+	fclose(file);
+
+	printf("Trace with %llu events written to %s\n", exported, fileName);
+	return true;
+}
+
+CpuTraceScope::CpuTraceScope(const char* name) : name(name)
+{
+	begin = Clock::Now();
+}
+
+CpuTraceScope::~CpuTraceScope()
+{
+	CpuTrace::Record(name, begin, Clock::Now());
+}
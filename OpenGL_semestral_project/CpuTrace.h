@@ -0,0 +1,76 @@
+#pragma once
+
+#include <atomic>
+#include <vector>
+#include <mutex>
+
+class GpuProfiler;
+
+// Set to 0 in the project settings to compile every TRACE_* macro away
+#ifndef ENABLE_CPU_TRACE
+#define ENABLE_CPU_TRACE 1
+#endif
+
+struct CpuTraceEvent
+{
+	const char* name;
+	double begin;
+	double end;
+};
+
+// Scoped CPU markers. Every thread writes into its own ring buffer, recording is a couple of
+// stores and an atomic index bump with no locks; only the first event of a thread registers it
+class CpuTrace
+{
+public:
+	static const unsigned int RING_SIZE = 1 << 16;
+
+	// name has to be a string literal or otherwise outlive the trace
+	static void Record(const char* name, double begin, double end);
+	static void SetThreadName(const char* name);
+
+	// Chrome / Perfetto trace event JSON. GPU scopes, when given, go on their own track in CPU time
+	static bool ExportChromeTrace(const char* fileName, GpuProfiler* gpuProfiler = nullptr);
+
+	static unsigned long long GetEventCount();
+
+private:
+	struct ThreadBuffer
+	{
+		unsigned int threadId;
+		const char* threadName;
+		std::vector<CpuTraceEvent> events;
+		// Only the owning thread writes, readers copy and then drop what was overwritten meanwhile
+		std::atomic<unsigned long long> writeIndex;
+	};
+
+	// Registration only, the recording path never touches these
+	static std::mutex registryMutex;
+	static std::vector<ThreadBuffer*> registry;
+	static unsigned int nextThreadId;
+	static thread_local ThreadBuffer* threadBuffer;
+
+	static ThreadBuffer* GetThreadBuffer();
+};
+
+class CpuTraceScope
+{
+public:
+	CpuTraceScope(const char* name);
+	~CpuTraceScope();
+
+private:
+	const char* name;
+	double begin;
+};
+
+#define TRACE_CONCAT_INNER(a, b) a##b
+#define TRACE_CONCAT(a, b) TRACE_CONCAT_INNER(a, b)
+
+#if ENABLE_CPU_TRACE
+#define TRACE_SCOPE(name) CpuTraceScope TRACE_CONCAT(traceScope, __LINE__)(name)
+#define TRACE_THREAD_NAME(name) CpuTrace::SetThreadName(name)
+#else
+#define TRACE_SCOPE(name) ((void)0)
+#define TRACE_THREAD_NAME(name) ((void)0)
+#endif
@@ -12,14 +12,19 @@ DirectionalLight::DirectionalLight(GLfloat red, GLfloat green, GLfloat blue,
 	direction = glm::vec3(xDir, yDir, zDir);
 }
 
-void DirectionalLight::UseLight(GLfloat ambientIntensityLocation, GLfloat ambientColourLocation,
-	GLfloat diffuseIntensityLocation, GLfloat directionLocation)
+void DirectionalLight::UseLight(UniformTable& uniforms)
 {
-	glUniform3f(ambientColourLocation, colour.x, colour.y, colour.z);
-	glUniform1f(ambientIntensityLocation, ambientIntensity);
+	uniforms.SetVec3(Uniforms::DirectionalColour, colour);
+	uniforms.SetFloat(Uniforms::DirectionalAmbientIntensity, ambientIntensity);
 
-	glUniform3f(directionLocation, direction.x, direction.y, direction.z);
-	glUniform1f(diffuseIntensityLocation, diffuseIntensity);
+	uniforms.SetVec3(Uniforms::DirectionalDirection, direction);
+	uniforms.SetFloat(Uniforms::DirectionalDiffuseIntensity, diffuseIntensity);
+}
+
+glm::vec3 DirectionalLight::GetDiffuse(glm::vec3 normal, glm::vec3& toLight)
+{
+	toLight = -glm::normalize(direction);
+	return colour * diffuseIntensity * glm::max(glm::dot(normal, toLight), 0.0f);
 }
 
 DirectionalLight::~DirectionalLight()
@@ -1,5 +1,6 @@
 #pragma once
 #include "Light.h"
+#include "UniformTable.h"
 
 class DirectionalLight :
 	public Light
@@ -10,8 +11,11 @@ public:
 		GLfloat aIntensity, GLfloat dIntensity,
 		GLfloat xDir, GLfloat yDir, GLfloat zDir);
 
-	void UseLight(GLfloat ambientIntensityLocation, GLfloat ambientColourLocation,
-		GLfloat diffuseIntensityLocation, GLfloat directionLocation);
+	void UseLight(UniformTable& uniforms);
+
+	// Diffuse term shader.frag adds for a surface facing normal (away from the surface), for bakes on the CPU.
+	// toLight receives the unit direction towards the light
+	glm::vec3 GetDiffuse(glm::vec3 normal, glm::vec3& toLight);
 
 	~DirectionalLight();
 
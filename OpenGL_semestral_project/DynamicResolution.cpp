@@ -0,0 +1,279 @@
+#include "DynamicResolution.h"
+
+#include <stdio.h>
+#include <math.h>
+#include <algorithm>
+
+#include "GpuProfiler.h"
+#include "Clock.h"
+#include "CpuTrace.h"
+
+constexpr float DynamicResolution::DEFAULT_MIN_SCALE;
+constexpr float DynamicResolution::RAISE_THRESHOLD;
+constexpr float DynamicResolution::HEADROOM;
+constexpr float DynamicResolution::MAX_DROP;
+constexpr float DynamicResolution::MAX_RAISE;
+constexpr float DynamicResolution::SCALE_STEP;
+const unsigned int DynamicResolution::SETTLE_FRAMES;
+const unsigned int DynamicResolution::RAISE_FRAMES;
+
+// Weight of a new sample in the smoothed frame time, a single spike moves it a quarter of the way
+static const double SMOOTHING = 0.25;
+
+DynamicResolution::DynamicResolution()
+{
+	emptyVAO = 0;
+
+	outputWidth = 0;
+	outputHeight = 0;
+	renderWidth = 0;
+	renderHeight = 0;
+
+	targetMs = 0.0;
+	minScale = DEFAULT_MIN_SCALE;
+	maxScale = 1.0f;
+	scale = 1.0f;
+
+	frameScope = -1;
+	lastSample = 0;
+	smoothedMs = 0.0;
+	smoothedValid = false;
+	settleFrames = 0;
+	underCount = 0;
+
+	frameCount = 0;
+	scaleSum = 0.0;
+	lowestScale = 1.0f;
+	dropCount = 0;
+	raiseCount = 0;
+	sampleCount = 0;
+	overTargetCount = 0;
+
+	overStart = -1.0;
+	overStartFrame = 0;
+	recoveryCount = 0;
+	recoveryMsSum = 0.0;
+	recoveryMsMax = 0.0;
+	recoveryFramesSum = 0;
+}
+
+bool DynamicResolution::Initialise(GLint width, GLint height, double frameTargetMs, float lowest, float highest)
+{
+	ClearResolution();
+
+	// Allocated once at the output size, scaling only moves the viewport so nothing is reallocated mid-run
+	if (!target.CreateTarget(width, height))
+	{
+		return false;
+	}
+
+	upscaleShader.CreateFromFiles("Shaders/upscale.vert", "Shaders/upscale.frag");
+	glGenVertexArrays(1, &emptyVAO);
+
+	outputWidth = width;
+	outputHeight = height;
+	targetMs = frameTargetMs;
+	maxScale = std::min(std::max(highest, 0.1f), 1.0f);
+	minScale = std::min(std::max(lowest, 0.1f), maxScale);
+	lowestScale = maxScale;
+
+	SetScale(maxScale);
+	dropCount = 0;
+	raiseCount = 0;
+
+	return true;
+}
+
+void DynamicResolution::SetScale(float newScale)
+{
+	if (newScale < scale) dropCount++;
+	if (newScale > scale) raiseCount++;
+
+	scale = newScale;
+	if (scale < lowestScale) lowestScale = scale;
+
+	renderWidth = std::max((GLint)(outputWidth * scale + 0.5f), 1);
+	renderHeight = std::max((GLint)(outputHeight * scale + 0.5f), 1);
+
+	// Frames already queued were drawn at the old size, their times say nothing about this one
+	settleFrames = SETTLE_FRAMES;
+	smoothedValid = false;
+	underCount = 0;
+}
+
+void DynamicResolution::BeginFrame()
+{
+	glBindFramebuffer(GL_FRAMEBUFFER, target.GetFramebuffer());
+	glViewport(0, 0, renderWidth, renderHeight);
+}
+
+void DynamicResolution::Present(RenderTarget* output, GpuProfiler* profiler)
+{
+	TRACE_SCOPE("DynamicResolution::Present");
+
+	{
+		GpuProfileScope upscaleScope(profiler, "Upscale");
+
+		if (output)
+		{
+			output->Bind();
+		}
+		else
+		{
+			RenderTarget::BindDefault(outputWidth, outputHeight);
+		}
+
+		glDisable(GL_DEPTH_TEST);
+
+		upscaleShader.UseShader();
+		UniformTable& uniforms = upscaleShader.GetUniforms();
+		uniforms.SetInt(Uniforms::SourceTexture, 0);
+		uniforms.SetVec4(Uniforms::SourceSize, glm::vec4((float)renderWidth, (float)renderHeight, 1.0f / target.GetWidth(), 1.0f / target.GetHeight()));
+
+		glActiveTexture(GL_TEXTURE0);
+		glBindTexture(GL_TEXTURE_2D, target.GetColourTexture());
+		glBindVertexArray(emptyVAO);
+		glDrawArrays(GL_TRIANGLES, 0, 3);
+		glBindVertexArray(0);
+		glBindTexture(GL_TEXTURE_2D, 0);
+
+		glEnable(GL_DEPTH_TEST);
+	}
+
+	frameCount++;
+	scaleSum += scale;
+	if (settleFrames > 0)
+	{
+		settleFrames--;
+	}
+
+	if (!profiler || !profiler->IsEnabled())
+	{
+		return;
+	}
+
+	if (frameScope < 0)
+	{
+		frameScope = profiler->FindScope("Frame");
+	}
+
+	// Frames resolve a few frames late and sometimes several at once, only the newest one matters
+	unsigned long long samples = frameScope >= 0 ? profiler->GetSampleCount(frameScope) : 0;
+	if (samples != lastSample)
+	{
+		lastSample = samples;
+		UpdateController(profiler->GetLatest(frameScope));
+	}
+}
+
+void DynamicResolution::UpdateController(double frameMs)
+{
+	sampleCount++;
+	if (targetMs > 0.0 && frameMs > targetMs)
+	{
+		overTargetCount++;
+	}
+
+	if (settleFrames > 0)
+	{
+		return;
+	}
+
+	smoothedMs = smoothedValid ? smoothedMs + (frameMs - smoothedMs) * SMOOTHING : frameMs;
+	smoothedValid = true;
+
+	if (targetMs <= 0.0)
+	{
+		return;
+	}
+
+	if (smoothedMs > targetMs)
+	{
+		if (overStart < 0.0)
+		{
+			overStart = Clock::Now();
+			overStartFrame = frameCount;
+		}
+
+		if (scale > minScale)
+		{
+			// Cost taken as proportional to the pixel count, so the side scales with the square root
+			float wanted = scale * (float)sqrt(targetMs * HEADROOM / smoothedMs);
+			float next = floorf(std::max(wanted, scale - MAX_DROP) / SCALE_STEP + 0.001f) * SCALE_STEP;
+			if (next >= scale) next = scale - SCALE_STEP;
+			SetScale(std::max(next, minScale));
+		}
+		return;
+	}
+
+	if (overStart >= 0.0)
+	{
+		double recoveryMs = (Clock::Now() - overStart) * 1000.0;
+		recoveryMsSum += recoveryMs;
+		recoveryMsMax = std::max(recoveryMsMax, recoveryMs);
+		recoveryFramesSum += frameCount - overStartFrame;
+		recoveryCount++;
+		overStart = -1.0;
+	}
+
+	if (smoothedMs >= targetMs * RAISE_THRESHOLD)
+	{
+		underCount = 0;
+		return;
+	}
+
+	underCount++;
+	if (underCount >= RAISE_FRAMES && scale < maxScale)
+	{
+		float wanted = scale * (float)sqrt(targetMs * HEADROOM / smoothedMs);
+		float next = ceilf(std::min(wanted, scale + MAX_RAISE) / SCALE_STEP - 0.001f) * SCALE_STEP;
+		if (next <= scale) next = scale + SCALE_STEP;
+		SetScale(std::min(next, maxScale));
+	}
+}
+
+void DynamicResolution::PrintStats()
+{
+	if (frameCount == 0)
+	{
+		return;
+	}
+
+	printf("Dynamic resolution, %dx%d output, %.2f ms target\n", outputWidth, outputHeight, targetMs);
+	printf("  scale:           %8.3f now (%dx%d), %.3f mean, %.3f lowest\n", scale, renderWidth, renderHeight, GetMeanScale(), lowestScale);
+	printf("  gpu frame:       %8.3f ms smoothed, %.1f%% of %llu samples over target\n", smoothedMs, GetOverTargetFraction() * 100.0, sampleCount);
+	printf("  changes:         %8u down, %u up\n", dropCount, raiseCount);
+	if (recoveryCount > 0)
+	{
+		printf("  time to target:  %8.1f ms mean (%.1f frames), %.1f ms max, %u episodes\n", GetMeanRecoveryMs(),
+			(double)recoveryFramesSum / recoveryCount, recoveryMsMax, recoveryCount);
+	}
+	if (overStart >= 0.0)
+	{
+		printf("  still over target after %.1f ms\n", (Clock::Now() - overStart) * 1000.0);
+	}
+}
+
+void DynamicResolution::ClearResolution()
+{
+	target.ClearTarget();
+	upscaleShader.ClearShader();
+
+	if (emptyVAO != 0)
+	{
+		glDeleteVertexArrays(1, &emptyVAO);
+		emptyVAO = 0;
+	}
+
+	scale = 1.0f;
+	frameScope = -1;
+	lastSample = 0;
+	smoothedValid = false;
+	settleFrames = 0;
+	underCount = 0;
+}
+
+DynamicResolution::~DynamicResolution()
+{
+	ClearResolution();
+}
@@ -0,0 +1,96 @@
+#pragma once
+
+#include <GL\glew.h>
+
+#include "RenderTarget.h"
+#include "Shader.h"
+
+class GpuProfiler;
+
+// Renders the scene into the corner of a full size offscreen target and upscales it to the output with a
+// Catmull-Rom filter. The rendered fraction follows the GPU frame time against a target: it drops as soon
+// as the smoothed time is over, but only climbs back after a run of frames comfortably under, and every
+// change waits for the frames already in flight before it is judged, so the scale doesn't oscillate
+class DynamicResolution
+{
+public:
+	static constexpr float DEFAULT_MIN_SCALE = 0.5f;
+	// Under this fraction of the target the scale may climb again, between it and the target it holds
+	static constexpr float RAISE_THRESHOLD = 0.8f;
+	// New scales aim this far under the target so a small increase in load doesn't put it straight back over
+	static constexpr float HEADROOM = 0.9f;
+	static constexpr float MAX_DROP = 0.15f;
+	static constexpr float MAX_RAISE = 0.05f;
+	static constexpr float SCALE_STEP = 0.025f;
+	// Frames ignored after a change, covers the profiler's readback latency
+	static const unsigned int SETTLE_FRAMES = 8;
+	// Consecutive samples under RAISE_THRESHOLD before climbing
+	static const unsigned int RAISE_FRAMES = 30;
+
+	DynamicResolution();
+
+	// Needs a current context. A target of 0 ms keeps the scale at maxScale
+	bool Initialise(GLint outputWidth, GLint outputHeight, double targetMs, float minScale = DEFAULT_MIN_SCALE, float maxScale = 1.0f);
+	bool IsInitialised() { return target.GetFramebuffer() != 0; }
+
+	// Binds the offscreen target with the viewport at the current scale, before the frame's first clear
+	void BeginFrame();
+	// Upscales into output, the window when null, then feeds the newest resolved "Frame" time to the controller
+	void Present(RenderTarget* output, GpuProfiler* profiler);
+
+	float GetScale() { return scale; }
+	GLint GetRenderWidth() { return renderWidth; }
+	GLint GetRenderHeight() { return renderHeight; }
+	double GetTargetMs() { return targetMs; }
+	// Exponential average of the measured GPU frame time
+	double GetSmoothedMs() { return smoothedMs; }
+
+	double GetMeanScale() { return frameCount > 0 ? scaleSum / frameCount : scale; }
+	float GetLowestScale() { return lowestScale; }
+	// Over-target episodes: from the first smoothed sample over the target to the first sample back under
+	unsigned int GetRecoveryCount() { return recoveryCount; }
+	double GetMeanRecoveryMs() { return recoveryCount > 0 ? recoveryMsSum / recoveryCount : 0.0; }
+	double GetMaxRecoveryMs() { return recoveryMsMax; }
+	double GetOverTargetFraction() { return sampleCount > 0 ? (double)overTargetCount / sampleCount : 0.0; }
+
+	void PrintStats();
+
+	void ClearResolution();
+
+	~DynamicResolution();
+
+private:
+	RenderTarget target;
+	Shader upscaleShader;
+	GLuint emptyVAO;
+
+	GLint outputWidth, outputHeight;
+	GLint renderWidth, renderHeight;
+
+	double targetMs;
+	float minScale, maxScale;
+	float scale;
+
+	int frameScope;
+	unsigned long long lastSample;
+	double smoothedMs;
+	bool smoothedValid;
+	unsigned int settleFrames;
+	unsigned int underCount;
+
+	unsigned long long frameCount;
+	double scaleSum;
+	float lowestScale;
+	unsigned int dropCount, raiseCount;
+	unsigned long long sampleCount, overTargetCount;
+
+	// Start of the current over-target episode in Clock::Now() seconds, negative outside one
+	double overStart;
+	unsigned long long overStartFrame;
+	unsigned int recoveryCount;
+	double recoveryMsSum, recoveryMsMax;
+	unsigned long long recoveryFramesSum;
+
+	void SetScale(float newScale);
+	void UpdateController(double frameMs);
+};
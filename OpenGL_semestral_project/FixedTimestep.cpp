@@ -0,0 +1,52 @@
+#include "FixedTimestep.h"
+
+FixedTimestep::FixedTimestep()
+{
+	step = 1.0 / 120.0;
+	maxSteps = 8;
+	accumulator = 0.0;
+	simulatedTime = 0.0;
+	stepCount = 0;
+	droppedSteps = 0;
+}
+
+FixedTimestep::FixedTimestep(double stepSeconds, unsigned int maxStepCount)
+{
+	step = stepSeconds;
+	maxSteps = maxStepCount;
+	accumulator = 0.0;
+	simulatedTime = 0.0;
+	stepCount = 0;
+	droppedSteps = 0;
+}
+
+unsigned int FixedTimestep::Advance(double frameDelta)
+{
+	if (frameDelta < 0.0)
+	{
+		frameDelta = 0.0;
+	}
+
+	accumulator += frameDelta;
+
+	unsigned int steps = (unsigned int)(accumulator / step);
+	if (steps > maxSteps)
+	{
+		droppedSteps += steps - maxSteps;
+		steps = maxSteps;
+		accumulator = 0.0;
+	}
+	else
+	{
+		accumulator -= steps * step;
+	}
+
+	simulatedTime += steps * step;
+	stepCount += steps;
+
+	return steps;
+}
+
+FixedTimestep::~FixedTimestep()
+{
+}
@@ -0,0 +1,33 @@
+#pragma once
+
+// Accumulates real frame time and hands it out in equal steps, so simulation results
+// don't depend on frame rate. The leftover fraction is the render interpolation factor
+class FixedTimestep
+{
+public:
+	FixedTimestep();
+	FixedTimestep(double stepSeconds, unsigned int maxSteps);
+
+	// Returns how many steps to simulate for frameDelta seconds of real time
+	unsigned int Advance(double frameDelta);
+
+	double GetStep() { return step; }
+	// Time not yet simulated, as a fraction of a step
+	double GetAlpha() { return accumulator / step; }
+	double GetAccumulator() { return accumulator; }
+	double GetSimulatedTime() { return simulatedTime; }
+	unsigned long long GetStepCount() { return stepCount; }
+	unsigned long long GetDroppedSteps() { return droppedSteps; }
+
+	~FixedTimestep();
+
+private:
+	double step;
+	double accumulator;
+	double simulatedTime;
+	// Cap per Advance, a long stall is dropped instead of simulated in one burst
+	unsigned int maxSteps;
+
+	unsigned long long stepCount;
+	unsigned long long droppedSteps;
+};
@@ -0,0 +1,139 @@
+#include "FrameLimiter.h"
+
+#include <stdio.h>
+#include <thread>
+
+#include <GLFW\glfw3.h>
+
+#include "Clock.h"
+
+#ifdef _WIN32
+#include <windows.h>
+#pragma comment(lib, "winmm.lib")
+#endif
+
+FrameLimiter::FrameLimiter()
+{
+	syncMode = FRAME_SYNC_OFF;
+	targetInterval = 0.0;
+	nextFrame = 0.0;
+	spinMargin = 0.002;
+
+	sleptTime = 0.0;
+	spunTime = 0.0;
+	waitCount = 0;
+	missedCount = 0;
+	timerPeriodRaised = false;
+}
+
+void FrameLimiter::SetSyncMode(FrameSyncMode mode)
+{
+	syncMode = mode;
+
+	int interval = 0;
+	if (mode == FRAME_SYNC_VSYNC)
+	{
+		interval = 1;
+	}
+	else if (mode == FRAME_SYNC_ADAPTIVE)
+	{
+		if (glfwExtensionSupported("WGL_EXT_swap_control_tear") || glfwExtensionSupported("GLX_EXT_swap_control_tear"))
+		{
+			interval = -1;
+		}
+		else
+		{
+			printf("Adaptive vsync not supported, using vsync\n");
+			syncMode = FRAME_SYNC_VSYNC;
+			interval = 1;
+		}
+	}
+
+	glfwSwapInterval(interval);
+}
+
+void FrameLimiter::SetFrameCap(double framesPerSecond)
+{
+	targetInterval = framesPerSecond > 0.0 ? 1.0 / framesPerSecond : 0.0;
+	nextFrame = 0.0;
+
+#ifdef _WIN32
+	// Default scheduler granularity is 15.6 ms, useless for sleeping part of a frame
+	if (targetInterval > 0.0 && !timerPeriodRaised)
+	{
+		timeBeginPeriod(1);
+		timerPeriodRaised = true;
+	}
+#endif
+}
+
+void FrameLimiter::Wait()
+{
+	if (targetInterval <= 0.0)
+	{
+		return;
+	}
+
+	double now = Clock::Now();
+	if (nextFrame == 0.0)
+	{
+		nextFrame = now;
+	}
+
+	nextFrame += targetInterval;
+	waitCount++;
+
+	if (now >= nextFrame)
+	{
+		// Already late, start a fresh cadence instead of rushing the next frames
+		missedCount++;
+		nextFrame = now;
+		return;
+	}
+
+	double sleepEnd = nextFrame - spinMargin;
+	if (now < sleepEnd)
+	{
+		Clock::SleepFor(sleepEnd - now);
+
+		double woke = Clock::Now();
+		double oversleep = woke - sleepEnd;
+		sleptTime += woke - now;
+		now = woke;
+
+		// Margin drifts towards 1.5x the observed oversleep, within sane bounds
+		spinMargin = spinMargin * 0.9 + oversleep * 1.5 * 0.1;
+		if (spinMargin < 0.0002) spinMargin = 0.0002;
+		if (spinMargin > 0.004) spinMargin = 0.004;
+	}
+
+	while (now < nextFrame)
+	{
+		std::this_thread::yield();
+		double spinNow = Clock::Now();
+		spunTime += spinNow - now;
+		now = spinNow;
+	}
+}
+
+void FrameLimiter::PrintStats()
+{
+	const char* modeNames[] = { "off", "vsync", "adaptive" };
+
+	printf("Frame limiter, sync %s, cap %.1f fps\n", modeNames[syncMode], GetFrameCap());
+	if (waitCount > 0)
+	{
+		printf("  waits:           %8u (%u late)\n", waitCount, missedCount);
+		printf("  slept / spun:    %8.3f / %.3f ms per frame, spin margin %.3f ms\n", sleptTime * 1000.0 / waitCount, spunTime * 1000.0 / waitCount, spinMargin * 1000.0);
+	}
+}
+
+FrameLimiter::~FrameLimiter()
+{
+#ifdef _WIN32
+	if (timerPeriodRaised)
+	{
+		timeEndPeriod(1);
+	}
+#endif
+}
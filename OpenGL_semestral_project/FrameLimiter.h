@@ -0,0 +1,44 @@
+#pragma once
+
+enum FrameSyncMode
+{
+	FRAME_SYNC_OFF,
+	FRAME_SYNC_VSYNC,
+	// Tears instead of waiting a whole refresh when a frame misses vblank, plain vsync without the extension
+	FRAME_SYNC_ADAPTIVE
+};
+
+// Swap interval plus an optional frame cap. The cap sleeps most of the wait and spins the
+// last part, the spin margin follows how late the OS actually wakes us up
+class FrameLimiter
+{
+public:
+	FrameLimiter();
+
+	// Needs a current GL context
+	void SetSyncMode(FrameSyncMode mode);
+	// 0 disables the cap
+	void SetFrameCap(double framesPerSecond);
+
+	FrameSyncMode GetSyncMode() { return syncMode; }
+	double GetFrameCap() { return targetInterval > 0.0 ? 1.0 / targetInterval : 0.0; }
+
+	// Call right before swapping buffers
+	void Wait();
+
+	void PrintStats();
+
+	~FrameLimiter();
+
+private:
+	FrameSyncMode syncMode;
+	double targetInterval;
+	double nextFrame;
+	double spinMargin;
+
+	double sleptTime;
+	double spunTime;
+	unsigned int waitCount;
+	unsigned int missedCount;
+	bool timerPeriodRaised;
+};
@@ -0,0 +1,52 @@
+#include "FrameMailbox.h"
+
+const unsigned int FrameMailbox::FRESH;
+const unsigned int FrameMailbox::INDEX_MASK;
+
+FrameMailbox::FrameMailbox()
+{
+	back = 0;
+	front = 1;
+	ready.store(2);
+	consumedSequence.store(0);
+
+	publishedCount = 0;
+	droppedCount = 0;
+	hasFront = false;
+}
+
+void FrameMailbox::Publish()
+{
+	unsigned int previous = ready.exchange(back | FRESH, std::memory_order_acq_rel);
+	publishedCount++;
+
+	if (previous & FRESH)
+	{
+		// The renderer never saw that one, a newer packet replaced it
+		droppedCount++;
+	}
+
+	back = previous & INDEX_MASK;
+}
+
+FramePacket* FrameMailbox::Acquire(bool* isNew)
+{
+	if (!(ready.load(std::memory_order_acquire) & FRESH))
+	{
+		if (isNew) *isNew = false;
+		return hasFront ? &packets[front] : nullptr;
+	}
+
+	unsigned int previous = ready.exchange(front, std::memory_order_acq_rel);
+	front = previous & INDEX_MASK;
+	hasFront = true;
+
+	consumedSequence.store(packets[front].sequence, std::memory_order_release);
+
+	if (isNew) *isNew = true;
+	return &packets[front];
+}
+
+FrameMailbox::~FrameMailbox()
+{
+}
@@ -0,0 +1,43 @@
+#pragma once
+
+#include <atomic>
+
+#include "FramePacket.h"
+
+// Triple buffer between one producer and one consumer: the producer always has a packet to fill,
+// the consumer always gets the newest published one and neither side ever waits for the other
+class FrameMailbox
+{
+public:
+	FrameMailbox();
+
+	// Producer side
+	FramePacket& BeginWrite() { return packets[back]; }
+	void Publish();
+	unsigned long long GetConsumedSequence() { return consumedSequence.load(std::memory_order_acquire); }
+
+	// Consumer side, returns the newest packet or nullptr before the first Publish.
+	// isNew is false when nothing was published since the last call and the same packet comes back
+	FramePacket* Acquire(bool* isNew = nullptr);
+
+	unsigned long long GetPublishedCount() { return publishedCount; }
+	unsigned long long GetDroppedCount() { return droppedCount; }
+
+	~FrameMailbox();
+
+private:
+	static const unsigned int FRESH = 0x4;
+	static const unsigned int INDEX_MASK = 0x3;
+
+	FramePacket packets[3];
+
+	unsigned int back;
+	unsigned int front;
+	// Index of the published packet, FRESH while the consumer hasn't picked it up
+	std::atomic<unsigned int> ready;
+	std::atomic<unsigned long long> consumedSequence;
+
+	unsigned long long publishedCount;
+	unsigned long long droppedCount;
+	bool hasFront;
+};
@@ -0,0 +1,97 @@
+#pragma once
+
+#include <vector>
+
+#include <glm\glm.hpp>
+
+#include "DirectionalLight.h"
+#include "PointLight.h"
+#include "SpotLight.h"
+#include "Material.h"
+#include "LightCuller.h"
+#include "CommonValues.h"
+
+class Model;
+class Terrain;
+class ParticleSystem;
+class AnimationSystem;
+
+struct DrawItem
+{
+	Model* model;
+	unsigned int node;
+	unsigned int transform;
+	// Index into FramePacket::materials, -1 keeps whatever was bound before
+	int material;
+	// Projected diameter of the node's bounds as a fraction of the viewport height
+	float screenCoverage;
+	// First bone of the entity's pose in FramePacket::bonePalette, NO_BONE_PALETTE when not animated
+	unsigned int palette;
+	// Point and spot lights that reach the node's bounds, indexing FramePacket::pointLights and spotLights
+	LightSelection lights;
+};
+
+// One selected terrain node, Terrain::Render looks the chunk up by id
+struct TerrainDraw
+{
+	unsigned int chunk;
+	// Bit per quadrant to draw, children cover the others
+	unsigned char quadrants;
+	float morphStart, morphEnd;
+};
+
+// Everything the GL thread needs to draw one simulated frame. The simulation thread fills it,
+// after FrameMailbox::Publish nothing writes to it until the renderer hands it back
+struct FramePacket
+{
+	unsigned long long sequence;
+	// Clock::Now() when the packet was published, for latency stats
+	double publishTime;
+
+	glm::mat4 view;
+	glm::mat4 projection;
+	glm::vec3 eyePosition;
+
+	// Camera before and after the last fixed step. The renderer blends them by how far
+	// real time has moved past stepTime, which hides the step rate from the display.
+	// Objects blend the same way from the previous* matrices and palette below when they are kept
+	glm::vec3 previousEyePosition, previousEyeDirection;
+	glm::vec3 eyeDirection;
+	double stepTime;
+	double stepInterval;
+
+	bool hasDirectionalLight;
+	DirectionalLight directionalLight;
+	std::vector<PointLight> pointLights;
+	std::vector<SpotLight> spotLights;
+
+	std::vector<Material> materials;
+	std::vector<DrawItem> draws;
+
+	Terrain* terrain;
+	std::vector<TerrainDraw> terrainDraws;
+
+	// Simulated and drawn on the GL thread, after everything opaque
+	ParticleSystem* particles;
+
+	// Copy of the animation palette for draws with a palette, uploaded through animations
+	AnimationSystem* animations;
+	std::vector<glm::vec4> bonePalette;
+	// Palette before the packet's update with Scene::SetKeepPrevious, shorter when instances were added
+	std::vector<glm::vec4> previousBonePalette;
+
+	// Full copy of the transform matrices, padded like TransformStore
+	unsigned int transformCapacity;
+	std::vector<glm::mat4> worldMatrices;
+	std::vector<glm::vec4> normalMatrices;
+	// Changed since the packet the renderer consumed before this one was built
+	unsigned int uploadBegin, uploadEnd;
+	// Transforms the packet's update moved, with their matrices from before it, with Scene::SetKeepPrevious
+	unsigned int movedBegin, movedEnd;
+	std::vector<glm::mat4> previousWorldMatrices;
+	std::vector<glm::vec4> previousNormalMatrices;
+
+	FramePacket() : sequence(0), publishTime(0.0), view(1.0f), projection(1.0f), eyePosition(0.0f),
+		previousEyePosition(0.0f), previousEyeDirection(0.0f, 0.0f, -1.0f), eyeDirection(0.0f, 0.0f, -1.0f), stepTime(0.0), stepInterval(0.0),
+		hasDirectionalLight(false), terrain(nullptr), particles(nullptr), animations(nullptr), transformCapacity(0), uploadBegin(0), uploadEnd(0), movedBegin(0), movedEnd(0) {}
+};
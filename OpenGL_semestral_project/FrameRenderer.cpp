@@ -0,0 +1,513 @@
+#include "FrameRenderer.h"
+
+#include <stdio.h>
+
+#include <glm\gtc\matrix_transform.hpp>
+
+#include "CommonValues.h"
+#include "Model.h"
+#include "Clock.h"
+#include "CpuTrace.h"
+
+const unsigned int FrameRenderer::QUERY_FRAMES;
+
+FrameRenderer::FrameRenderer()
+{
+	lastSequence = 0;
+	streamTransforms = false;
+	streamPersistent = true;
+
+	lastFrame = 0.0;
+	frameTimeSum = 0.0;
+	packetAgeSum = 0.0;
+	frameCount = 0;
+	repeatedCount = 0;
+
+	drawCallCount = 0;
+	triangleCount = 0;
+	textureBindCount = 0;
+	textureBindSum = 0;
+
+	depthPrepass = false;
+	for (unsigned int i = 0; i < QUERY_FRAMES; i++)
+	{
+		sampleQueries[i][0] = sampleQueries[i][1] = 0;
+		queryPending[i] = false;
+		queryPrepass[i] = false;
+	}
+	queryFrame = 0;
+	prepassSamples = 0;
+	prepassShadedSamples = 0;
+	shadedSamples = 0;
+	sampleFrames = 0;
+
+	lightsBound = false;
+
+	blendedBegin = 0;
+	blendedEnd = 0;
+}
+
+unsigned int FrameRenderer::Render(FramePacket& packet, Shader& shader, unsigned int features, GpuProfiler* profiler)
+{
+	TRACE_SCOPE("FrameRenderer::Render");
+
+	double now = Clock::Now();
+
+	bool isNew = packet.sequence != lastSequence;
+	// Particles run on render frames rather than simulation steps, a hitch shouldn't throw them across the sky
+	float deltaTime = 0.0f;
+	if (frameCount > 0)
+	{
+		frameTimeSum += (now - lastFrame) * 1000.0;
+		deltaTime = (float)glm::min(now - lastFrame, 0.1);
+	}
+	packetAgeSum += (now - packet.publishTime) * 1000.0;
+	lastFrame = now;
+	frameCount++;
+	if (!isNew) repeatedCount++;
+
+	GpuProfileScope passScope(profiler, "Scene");
+
+	shader.UseShader(features);
+	UniformTable& uniforms = shader.GetUniforms();
+	glm::mat4 view = InterpolateView(packet, now);
+	float alpha = StepAlpha(packet, now);
+
+	bool blend = BlendTransforms(packet, alpha);
+	unsigned int overlayBegin = blend ? packet.movedBegin : 0;
+	unsigned int overlayEnd = blend ? packet.movedEnd : 0;
+
+	bool streamed = false;
+	if (streamTransforms && packet.transformCapacity > 0)
+	{
+		GLsizeiptr needed = TransformBuffer::StreamSize(packet.transformCapacity);
+		if (streamBuffer.GetFrameSize() < needed)
+		{
+			// Grow with headroom so a growing scene doesn't recreate the ring every few frames
+			streamBuffer.CreateBuffer(GL_TEXTURE_BUFFER, needed * 2, streamPersistent);
+		}
+
+		streamBuffer.BeginFrame();
+		streamed = transforms.Stream(streamBuffer, &packet.worldMatrices[0], &packet.normalMatrices[0], packet.transformCapacity,
+			overlayBegin, overlayEnd, blend ? &blendedWorld[0] : nullptr, blend ? &blendedNormals[0] : nullptr);
+		streamBuffer.FinishWrites();
+		lastSequence = packet.sequence;
+	}
+
+	if (streamed)
+	{
+		// Every streamed frame is written in full, nothing blended is left behind
+		blendedBegin = 0;
+		blendedEnd = 0;
+	}
+	else if (packet.transformCapacity > 0)
+	{
+		if (isNew || transforms.GetCapacity() == 0)
+		{
+			// After streaming the buffer has no capacity, Upload then resends everything
+			transforms.Upload(&packet.worldMatrices[0], &packet.normalMatrices[0], packet.transformCapacity, packet.uploadBegin, packet.uploadEnd);
+			lastSequence = packet.sequence;
+		}
+
+		// Last frame's blend may cover transforms the upload range doesn't, unless this one blends over them again
+		bool covered = blend && overlayBegin <= blendedBegin && blendedEnd <= overlayEnd;
+		if (blendedBegin < blendedEnd && !covered && blendedEnd <= packet.transformCapacity)
+		{
+			transforms.UploadRange(&packet.worldMatrices[blendedBegin], &packet.normalMatrices[blendedBegin * 3], blendedBegin, blendedEnd);
+		}
+		if (blend)
+		{
+			transforms.UploadRange(&blendedWorld[0], &blendedNormals[0], overlayBegin, overlayEnd);
+		}
+		blendedBegin = overlayBegin;
+		blendedEnd = overlayEnd;
+	}
+	transforms.UseTransforms(TRANSFORM_MODEL_TEXTURE_UNIT, TRANSFORM_NORMAL_TEXTURE_UNIT);
+
+	drawCallCount = 0;
+	triangleCount = 0;
+	unsigned int firstBind = Texture::GetBindCount();
+
+	if (sampleQueries[0][0] == 0)
+	{
+		glGenQueries(QUERY_FRAMES * 2, &sampleQueries[0][0]);
+	}
+	unsigned int querySlot = queryFrame % QUERY_FRAMES;
+	bool measure = ResolveSampleQueries(querySlot);
+	queryFrame++;
+
+	bool prepass = depthPrepass && !packet.draws.empty();
+	if (prepass)
+	{
+		if (measure) glBeginQuery(GL_SAMPLES_PASSED, sampleQueries[querySlot][0]);
+		drawCallCount += RenderDepthPrepass(packet, shader, view, profiler);
+		if (measure) glEndQuery(GL_SAMPLES_PASSED);
+
+		// Only the nearest surface matches now, and it is already in the depth buffer
+		glDepthFunc(GL_EQUAL);
+		glDepthMask(GL_FALSE);
+		shader.UseShader(features);
+	}
+	SetFrameUniforms(packet, shader, view);
+
+	if (measure)
+	{
+		queryPending[querySlot] = true;
+		queryPrepass[querySlot] = prepass;
+		glBeginQuery(GL_SAMPLES_PASSED, sampleQueries[querySlot][1]);
+	}
+
+	int boundMaterial = -1;
+	Model* profiledModel = nullptr;
+	bool hasSkinned = false;
+	for (size_t i = 0; i < packet.draws.size(); i++)
+	{
+		const DrawItem& draw = packet.draws[i];
+		if (draw.palette != NO_BONE_PALETTE)
+		{
+			hasSkinned = true;
+			continue;
+		}
+
+		// Draws of one model are contiguous, so one scope covers all of its nodes
+		if (profiler && draw.model != profiledModel)
+		{
+			if (profiledModel) profiler->EndScope();
+			profiler->BeginScope(draw.model->GetName());
+			profiledModel = draw.model;
+		}
+
+		if (draw.material >= 0 && draw.material != boundMaterial)
+		{
+			packet.materials[draw.material].UseMaterial(uniforms);
+			boundMaterial = draw.material;
+		}
+
+		UseDrawLights(packet, shader, draw.lights);
+		uniforms.SetInt(Uniforms::TransformIndex, draw.transform);
+		draw.model->RenderNode(draw.node, profiler, &uniforms);
+		drawCallCount += draw.model->GetNodeMeshCount(draw.node);
+		triangleCount += draw.model->GetNodeTriangleCount(draw.node);
+	}
+
+	if (profiledModel)
+	{
+		profiler->EndScope();
+	}
+
+	if (measure)
+	{
+		glEndQuery(GL_SAMPLES_PASSED);
+	}
+
+	if (prepass)
+	{
+		glDepthFunc(GL_LESS);
+		glDepthMask(GL_TRUE);
+	}
+
+	if (hasSkinned && packet.animations && !packet.bonePalette.empty())
+	{
+		GpuProfileScope skinnedScope(profiler, "Skinned");
+
+		packet.animations->UploadPalette(BlendPalette(packet, alpha), (unsigned int)packet.bonePalette.size());
+		packet.animations->UsePalette(BONE_PALETTE_TEXTURE_UNIT);
+
+		shader.UseShader(features | SHADER_FEATURE_SKINNING);
+		SetFrameUniforms(packet, shader, view);
+		UniformTable& skinnedUniforms = shader.GetUniforms();
+
+		boundMaterial = -1;
+		for (size_t i = 0; i < packet.draws.size(); i++)
+		{
+			const DrawItem& draw = packet.draws[i];
+			if (draw.palette == NO_BONE_PALETTE)
+			{
+				continue;
+			}
+
+			if (draw.material >= 0 && draw.material != boundMaterial)
+			{
+				packet.materials[draw.material].UseMaterial(skinnedUniforms);
+				boundMaterial = draw.material;
+			}
+
+			UseDrawLights(packet, shader, draw.lights);
+			skinnedUniforms.SetInt(Uniforms::TransformIndex, draw.transform);
+			draw.model->RenderNode(draw.node, profiler, &skinnedUniforms, draw.palette);
+			drawCallCount += draw.model->GetNodeMeshCount(draw.node);
+			triangleCount += draw.model->GetNodeTriangleCount(draw.node);
+		}
+	}
+
+	if (packet.terrain)
+	{
+		// Chunks change hands every frame, even when none of them are on screen
+		packet.terrain->SyncChunks(packet.sequence);
+	}
+
+	if (packet.terrain && !packet.terrainDraws.empty())
+	{
+		GpuProfileScope terrainScope(profiler, "Terrain");
+
+		// Own variant, the per-frame uniforms have to be set for its program too
+		shader.UseShader(features | SHADER_FEATURE_TERRAIN);
+		SetFrameUniforms(packet, shader, view);
+
+		unsigned int terrainTriangles;
+		drawCallCount += packet.terrain->Render(packet, shader.GetUniforms(), terrainTriangles);
+		triangleCount += terrainTriangles;
+	}
+
+	if (packet.particles && packet.particles->IsInitialised())
+	{
+		// Blended without depth writes, so it has to come after every opaque draw
+		packet.particles->Simulate(deltaTime, packet.worldMatrices.empty() ? nullptr : &packet.worldMatrices[0], packet.transformCapacity, profiler);
+		drawCallCount += packet.particles->Render(view, packet.projection, profiler);
+	}
+
+	textureBindCount = Texture::GetBindCount() - firstBind;
+	textureBindSum += textureBindCount;
+
+	streamBuffer.EndFrame();
+
+	return (unsigned int)packet.draws.size();
+}
+
+unsigned int FrameRenderer::RenderDepthPrepass(FramePacket& packet, Shader& shader, const glm::mat4& view, GpuProfiler* profiler)
+{
+	GpuProfileScope prepassScope(profiler, "DepthPrepass");
+
+	shader.UseShader(SHADER_FEATURE_DEPTH_ONLY);
+	SetFrameUniforms(packet, shader, view);
+	UniformTable& uniforms = shader.GetUniforms();
+
+	glColorMask(GL_FALSE, GL_FALSE, GL_FALSE, GL_FALSE);
+
+	unsigned int drawCalls = 0;
+	for (size_t i = 0; i < packet.draws.size(); i++)
+	{
+		const DrawItem& draw = packet.draws[i];
+		if (draw.palette != NO_BONE_PALETTE)
+		{
+			continue;
+		}
+
+		uniforms.SetInt(Uniforms::TransformIndex, draw.transform);
+		draw.model->RenderNodeDepth(draw.node);
+		drawCalls += draw.model->GetNodeMeshCount(draw.node);
+	}
+
+	glColorMask(GL_TRUE, GL_TRUE, GL_TRUE, GL_TRUE);
+
+	return drawCalls;
+}
+
+bool FrameRenderer::ResolveSampleQueries(unsigned int slot)
+{
+	if (!queryPending[slot])
+	{
+		return true;
+	}
+
+	GLint available = 0;
+	glGetQueryObjectiv(sampleQueries[slot][1], GL_QUERY_RESULT_AVAILABLE, &available);
+	if (!available)
+	{
+		// Skips measuring this frame rather than wait for the GPU
+		return false;
+	}
+
+	GLuint64 samples = 0;
+	glGetQueryObjectui64v(sampleQueries[slot][1], GL_QUERY_RESULT, &samples);
+	shadedSamples += samples;
+	// Depth complexity only compares frames that ran the pre-pass, empty frames skip it
+	if (queryPrepass[slot])
+	{
+		prepassShadedSamples += samples;
+		glGetQueryObjectui64v(sampleQueries[slot][0], GL_QUERY_RESULT, &samples);
+		prepassSamples += samples;
+	}
+	sampleFrames++;
+	queryPending[slot] = false;
+
+	return true;
+}
+
+void FrameRenderer::SetFrameUniforms(FramePacket& packet, Shader& shader, const glm::mat4& view)
+{
+	UniformTable& uniforms = shader.GetUniforms();
+
+	uniforms.SetMat4(Uniforms::Projection, packet.projection);
+	uniforms.SetMat4(Uniforms::View, view);
+	uniforms.SetVec3(Uniforms::EyePosition, packet.eyePosition);
+
+	uniforms.SetInt(Uniforms::ModelMatrices, TRANSFORM_MODEL_TEXTURE_UNIT);
+	uniforms.SetInt(Uniforms::NormalMatrices, TRANSFORM_NORMAL_TEXTURE_UNIT);
+	uniforms.SetInt(Uniforms::TextureArray, TEXTURE_ARRAY_TEXTURE_UNIT);
+	uniforms.SetInt(Uniforms::BonePalette, BONE_PALETTE_TEXTURE_UNIT);
+
+	if (packet.hasDirectionalLight)
+	{
+		shader.SetDirectionalLight(&packet.directionalLight);
+	}
+	shader.SetPointLights(packet.pointLights.empty() ? nullptr : &packet.pointLights[0], (unsigned int)packet.pointLights.size());
+	shader.SetSpotLights(packet.spotLights.empty() ? nullptr : &packet.spotLights[0], (unsigned int)packet.spotLights.size());
+	lightsBound = false;
+}
+
+void FrameRenderer::UseDrawLights(FramePacket& packet, Shader& shader, const LightSelection& lights)
+{
+	if (lightsBound && lights == boundLights)
+	{
+		return;
+	}
+
+	shader.SetSelectedLights(packet.pointLights.empty() ? nullptr : &packet.pointLights[0],
+		packet.spotLights.empty() ? nullptr : &packet.spotLights[0], lights);
+	boundLights = lights;
+	lightsBound = true;
+}
+
+float FrameRenderer::StepAlpha(const FramePacket& packet, double now)
+{
+	if (packet.stepInterval <= 0.0)
+	{
+		return 1.0f;
+	}
+
+	float alpha = (float)((now - packet.stepTime) / packet.stepInterval);
+	if (alpha < 0.0f) alpha = 0.0f;
+	if (alpha > 1.0f) alpha = 1.0f;
+	return alpha;
+}
+
+bool FrameRenderer::BlendTransforms(const FramePacket& packet, float alpha)
+{
+	unsigned int moved = packet.movedEnd - packet.movedBegin;
+	if (alpha >= 1.0f || packet.movedBegin >= packet.movedEnd || packet.movedEnd > packet.transformCapacity ||
+		packet.previousWorldMatrices.size() != moved || packet.previousNormalMatrices.size() != moved * 3)
+	{
+		return false;
+	}
+
+	TRACE_SCOPE("FrameRenderer::BlendTransforms");
+
+	// Componentwise, a step's worth of rotation is small enough that the shear doesn't show
+	blendedWorld.resize(moved);
+	blendedNormals.resize(moved * 3);
+	const glm::mat4* world = &packet.worldMatrices[packet.movedBegin];
+	const glm::vec4* normals = &packet.normalMatrices[packet.movedBegin * 3];
+	for (unsigned int i = 0; i < moved; i++)
+	{
+		blendedWorld[i] = packet.previousWorldMatrices[i] * (1.0f - alpha) + world[i] * alpha;
+	}
+	for (unsigned int i = 0; i < moved * 3; i++)
+	{
+		blendedNormals[i] = glm::mix(packet.previousNormalMatrices[i], normals[i], alpha);
+	}
+
+	return true;
+}
+
+const glm::vec4* FrameRenderer::BlendPalette(const FramePacket& packet, float alpha)
+{
+	if (alpha >= 1.0f || packet.previousBonePalette.empty())
+	{
+		return &packet.bonePalette[0];
+	}
+
+	// Instances added by the update have no earlier pose and keep their new one
+	blendedPalette = packet.bonePalette;
+	size_t rows = glm::min(packet.previousBonePalette.size(), blendedPalette.size());
+	for (size_t i = 0; i < rows; i++)
+	{
+		blendedPalette[i] = glm::mix(packet.previousBonePalette[i], packet.bonePalette[i], alpha);
+	}
+
+	return &blendedPalette[0];
+}
+
+glm::mat4 FrameRenderer::InterpolateView(const FramePacket& packet, double now)
+{
+	if (packet.stepInterval <= 0.0)
+	{
+		return packet.view;
+	}
+
+	float alpha = StepAlpha(packet, now);
+
+	glm::vec3 position = glm::mix(packet.previousEyePosition, packet.eyePosition, alpha);
+	glm::vec3 direction = glm::normalize(glm::mix(packet.previousEyeDirection, packet.eyeDirection, alpha));
+
+	return glm::lookAt(position, position + direction, glm::vec3(0.0f, 1.0f, 0.0f));
+}
+
+void FrameRenderer::PrintLatency()
+{
+	if (frameCount < 2)
+	{
+		return;
+	}
+
+	double frameMs = frameTimeSum / (frameCount - 1);
+	double ageMs = packetAgeSum / frameCount;
+
+	printf("Frame pipeline, %u frames rendered\n", frameCount);
+	printf("  render frame:    %8.3f ms\n", frameMs);
+	printf("  packet age:      %8.3f ms (%.2f frames)\n", ageMs, ageMs / frameMs);
+	printf("  repeated:        %8u frames drawn without a new packet\n", repeatedCount);
+	printf("  texture binds:   %8.1f per frame\n", (double)textureBindSum / frameCount);
+	if (sampleFrames > 0)
+	{
+		printf("  shaded:          %8.0f fragments per frame\n", GetShadedFragments());
+	}
+	if (GetDepthComplexity() > 0.0)
+	{
+		printf("  depth pre-pass:  %8.2f depth complexity, %.1f%% of fragment shading skipped\n", GetDepthComplexity(),
+			(1.0 - 1.0 / GetDepthComplexity()) * 100.0);
+	}
+
+	streamBuffer.PrintStats();
+}
+
+void FrameRenderer::SetStreamTransforms(bool enable, bool allowPersistent)
+{
+	streamTransforms = enable && TransformBuffer::CanStream();
+	streamPersistent = allowPersistent;
+	if (enable && !streamTransforms)
+	{
+		printf("Transform streaming needs GL 4.3 or ARB_texture_buffer_range, using buffer updates\n");
+	}
+	if (!streamTransforms)
+	{
+		streamBuffer.ClearBuffer();
+	}
+}
+
+void FrameRenderer::ClearRenderer()
+{
+	transforms.ClearBuffer();
+	streamBuffer.ClearBuffer();
+	lastSequence = 0;
+
+	blendedWorld.clear();
+	blendedNormals.clear();
+	blendedPalette.clear();
+	blendedBegin = 0;
+	blendedEnd = 0;
+
+	if (sampleQueries[0][0] != 0)
+	{
+		glDeleteQueries(QUERY_FRAMES * 2, &sampleQueries[0][0]);
+		for (unsigned int i = 0; i < QUERY_FRAMES; i++)
+		{
+			sampleQueries[i][0] = sampleQueries[i][1] = 0;
+			queryPending[i] = false;
+		}
+	}
+}
+
+FrameRenderer::~FrameRenderer()
+{
+}
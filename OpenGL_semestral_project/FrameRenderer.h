@@ -0,0 +1,111 @@
+#pragma once
+
+#include "FramePacket.h"
+#include "TransformBuffer.h"
+#include "StreamBuffer.h"
+#include "Shader.h"
+#include "GpuProfiler.h"
+#include "Terrain.h"
+#include "ParticleSystem.h"
+#include "AnimationSystem.h"
+
+// GL thread half of the pipeline, draws FramePackets and keeps the GPU copy of their transforms
+class FrameRenderer
+{
+public:
+	FrameRenderer();
+
+	// Opens a "Scene" pass and one scope per model when a profiler is given
+	unsigned int Render(FramePacket& packet, Shader& shader, unsigned int features, GpuProfiler* profiler = nullptr);
+
+	// Rewrites the transforms into a StreamBuffer every frame instead of updating the changed range,
+	// ignored when TransformBuffer::CanStream is false
+	void SetStreamTransforms(bool enable, bool allowPersistent = true);
+
+	// Opaque non-skinned draws go through a depth-only pass first and are then shaded with GL_EQUAL and
+	// depth writes off, so every covered pixel runs the lighting once. Skinned draws and terrain follow as
+	// before. Models want MODEL_IMPORT_POSITION_STREAM so the pre-pass only fetches positions
+	void SetDepthPrepass(bool enable) { depthPrepass = enable; }
+
+	// Camera blended between the packet's last two steps for the current time. Render blends the moved
+	// transforms and the bone palette by the same amount when the packet kept their previous state
+	glm::mat4 InterpolateView(const FramePacket& packet, double now);
+
+	// Submitted by the last Render call
+	unsigned int GetDrawCallCount() { return drawCallCount; }
+	unsigned int GetTriangleCount() { return triangleCount; }
+	unsigned int GetTextureBindCount() { return textureBindCount; }
+	GLsizeiptr GetStreamedBytes() { return streamBuffer.GetFrameBytes(); }
+	unsigned long long GetStreamStallCount() { return streamBuffer.GetStallCount(); }
+
+	// Samples that passed the depth test in the lighting pass, per frame, from occlusion queries read a
+	// few frames late
+	double GetShadedFragments() { return sampleFrames > 0 ? (double)shadedSamples / sampleFrames : 0.0; }
+	// Pre-pass samples over lighting pass samples, how many layers the lighting would have shaded per
+	// covered pixel in draw order without the pre-pass. 0 with the pre-pass off
+	double GetDepthComplexity() { return prepassShadedSamples > 0 && prepassSamples > 0 ? (double)prepassSamples / prepassShadedSamples : 0.0; }
+
+	// Mean time from Publish to draw, in milliseconds and in render frames
+	void PrintLatency();
+
+	void ClearRenderer();
+
+	~FrameRenderer();
+
+private:
+	static const unsigned int QUERY_FRAMES = 4;
+
+	TransformBuffer transforms;
+	StreamBuffer streamBuffer;
+	bool streamTransforms;
+	bool streamPersistent;
+	unsigned long long lastSequence;
+
+	double lastFrame;
+	double frameTimeSum;
+	double packetAgeSum;
+	unsigned int frameCount;
+	unsigned int repeatedCount;
+
+	unsigned int drawCallCount;
+	unsigned int triangleCount;
+	unsigned int textureBindCount;
+	unsigned long long textureBindSum;
+
+	bool depthPrepass;
+	// GL_SAMPLES_PASSED for the pre-pass and the lighting pass, one pair per frame in flight
+	GLuint sampleQueries[QUERY_FRAMES][2];
+	bool queryPending[QUERY_FRAMES];
+	bool queryPrepass[QUERY_FRAMES];
+	unsigned int queryFrame;
+	unsigned long long prepassSamples, shadedSamples;
+	// Lighting pass samples of the frames that had a pre-pass
+	unsigned long long prepassShadedSamples;
+	unsigned long long sampleFrames;
+
+	// Moved matrices and palette between the packet's previous and current state for this frame
+	std::vector<glm::mat4> blendedWorld;
+	std::vector<glm::vec4> blendedNormals;
+	std::vector<glm::vec4> blendedPalette;
+	// Range of the uploaded transforms that holds blended matrices, the packet's own go back once it stops
+	unsigned int blendedBegin, blendedEnd;
+
+	// Lights of the bound variant, so consecutive draws with the same selection skip the upload
+	LightSelection boundLights;
+	bool lightsBound;
+
+	// How far the current time is into the packet's last step, 1 without a step interval
+	static float StepAlpha(const FramePacket& packet, double now);
+	// False when nothing moved or the step is over, the packet's matrices are then used as they are
+	bool BlendTransforms(const FramePacket& packet, float alpha);
+	const glm::vec4* BlendPalette(const FramePacket& packet, float alpha);
+
+	// Collects the slot about to be reused, false while the GPU still hasn't finished it
+	bool ResolveSampleQueries(unsigned int slot);
+	unsigned int RenderDepthPrepass(FramePacket& packet, Shader& shader, const glm::mat4& view, GpuProfiler* profiler);
+
+	// Camera, sampler units and lights, for every variant the frame draws with. The lights are the first of
+	// each list, which terrain keeps and draws replace with their own selection
+	void SetFrameUniforms(FramePacket& packet, Shader& shader, const glm::mat4& view);
+	void UseDrawLights(FramePacket& packet, Shader& shader, const LightSelection& lights);
+};
@@ -0,0 +1,129 @@
+#include "FrameStats.h"
+
+#include <stdio.h>
+#include <math.h>
+#include <algorithm>
+
+FrameStats::FrameStats()
+{
+	window.resize(1024, 0.0);
+	jitterWindow.resize(1024, 0.0);
+	totalFrames = 0;
+	lastFrame = 0.0;
+}
+
+FrameStats::FrameStats(unsigned int windowSize)
+{
+	window.resize(windowSize, 0.0);
+	jitterWindow.resize(windowSize, 0.0);
+	totalFrames = 0;
+	lastFrame = 0.0;
+}
+
+void FrameStats::AddFrame(double seconds)
+{
+	unsigned int slot = (unsigned int)(totalFrames % window.size());
+
+	window[slot] = seconds;
+	jitterWindow[slot] = totalFrames > 0 ? fabs(seconds - lastFrame) : 0.0;
+
+	lastFrame = seconds;
+	totalFrames++;
+}
+
+double FrameStats::GetMean()
+{
+	unsigned int count = GetFrameCount();
+	if (count == 0)
+	{
+		return 0.0;
+	}
+
+	double sum = 0.0;
+	for (unsigned int i = 0; i < count; i++)
+	{
+		sum += window[i];
+	}
+
+	return sum / count;
+}
+
+double FrameStats::GetStandardDeviation()
+{
+	unsigned int count = GetFrameCount();
+	if (count < 2)
+	{
+		return 0.0;
+	}
+
+	double mean = GetMean();
+	double sum = 0.0;
+	for (unsigned int i = 0; i < count; i++)
+	{
+		sum += (window[i] - mean) * (window[i] - mean);
+	}
+
+	return sqrt(sum / (count - 1));
+}
+
+double FrameStats::GetJitter()
+{
+	unsigned int count = GetFrameCount();
+	if (count < 2)
+	{
+		return 0.0;
+	}
+
+	double sum = 0.0;
+	for (unsigned int i = 0; i < count; i++)
+	{
+		sum += jitterWindow[i];
+	}
+
+	// The very first frame has no predecessor and contributes 0
+	return sum / (totalFrames < window.size() ? count - 1 : count);
+}
+
+double FrameStats::GetPercentile(double percentile)
+{
+	unsigned int count = GetFrameCount();
+	if (count == 0)
+	{
+		return 0.0;
+	}
+
+	std::vector<double> sorted(window.begin(), window.begin() + count);
+	unsigned int index = (unsigned int)(percentile / 100.0 * (count - 1) + 0.5);
+	std::nth_element(sorted.begin(), sorted.begin() + index, sorted.end());
+
+	return sorted[index];
+}
+
+double FrameStats::GetMax()
+{
+	unsigned int count = GetFrameCount();
+	double maxTime = 0.0;
+	for (unsigned int i = 0; i < count; i++)
+	{
+		if (window[i] > maxTime) maxTime = window[i];
+	}
+
+	return maxTime;
+}
+
+void FrameStats::Print(const char* label)
+{
+	if (GetFrameCount() == 0)
+	{
+		return;
+	}
+
+	printf("%s, last %u of %llu frames\n", label, GetFrameCount(), totalFrames);
+	printf("  mean:            %8.3f ms (%.1f fps), stddev %.3f ms\n", GetMean() * 1000.0, 1.0 / GetMean(), GetStandardDeviation() * 1000.0);
+	printf("  p50 / p99 / max: %8.3f / %.3f / %.3f ms\n", GetPercentile(50.0) * 1000.0, GetPercentile(99.0) * 1000.0, GetMax() * 1000.0);
+	printf("  jitter:          %8.3f ms frame to frame\n", GetJitter() * 1000.0);
+}
+
+FrameStats::~FrameStats()
+{
+}
@@ -0,0 +1,31 @@
+#pragma once
+
+#include <vector>
+
+// Rolling window of frame intervals for pacing and jitter numbers
+class FrameStats
+{
+public:
+	FrameStats();
+	FrameStats(unsigned int windowSize);
+
+	void AddFrame(double seconds);
+
+	unsigned int GetFrameCount() { return (unsigned int)(totalFrames < window.size() ? totalFrames : window.size()); }
+	double GetMean();
+	double GetStandardDeviation();
+	// Mean absolute change between consecutive frames, what is actually visible as stutter
+	double GetJitter();
+	double GetPercentile(double percentile);
+	double GetMax();
+
+	void Print(const char* label);
+
+	~FrameStats();
+
+private:
+	std::vector<double> window;
+	std::vector<double> jitterWindow;
+	unsigned long long totalFrames;
+	double lastFrame;
+};
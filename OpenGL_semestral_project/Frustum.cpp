@@ -0,0 +1,70 @@
+#include "Frustum.h"
+
+Frustum::Frustum()
+{
+	for (int i = 0; i < 6; i++)
+	{
+		planes[i] = glm::vec4(0.0f, 0.0f, 0.0f, 1.0f);
+	}
+}
+
+void Frustum::Update(const glm::mat4& viewProjection)
+{
+	glm::vec4 row[4];
+	for (int i = 0; i < 4; i++)
+	{
+		row[i] = glm::vec4(viewProjection[0][i], viewProjection[1][i], viewProjection[2][i], viewProjection[3][i]);
+	}
+
+	planes[0] = row[3] + row[0];
+	planes[1] = row[3] - row[0];
+	planes[2] = row[3] + row[1];
+	planes[3] = row[3] - row[1];
+	planes[4] = row[3] + row[2];
+	planes[5] = row[3] - row[2];
+
+	for (int i = 0; i < 6; i++)
+	{
+		planes[i] = planes[i] / glm::length(glm::vec3(planes[i]));
+	}
+}
+
+bool Frustum::TestBox(const BoundingBox& box) const
+{
+	if (!box.IsValid())
+	{
+		return false;
+	}
+
+	for (int i = 0; i < 6; i++)
+	{
+		// Corner furthest along the plane normal, if that is behind the plane the whole box is
+		glm::vec3 positive(planes[i].x >= 0.0f ? box.max.x : box.min.x,
+			planes[i].y >= 0.0f ? box.max.y : box.min.y,
+			planes[i].z >= 0.0f ? box.max.z : box.min.z);
+
+		if (glm::dot(glm::vec3(planes[i]), positive) + planes[i].w < 0.0f)
+		{
+			return false;
+		}
+	}
+
+	return true;
+}
+
+bool Frustum::TestSphere(glm::vec3 centre, float radius) const
+{
+	for (int i = 0; i < 6; i++)
+	{
+		if (glm::dot(glm::vec3(planes[i]), centre) + planes[i].w < -radius)
+		{
+			return false;
+		}
+	}
+
+	return true;
+}
+
+Frustum::~Frustum()
+{
+}
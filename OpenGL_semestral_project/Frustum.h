@@ -0,0 +1,23 @@
+#pragma once
+
+#include <glm\glm.hpp>
+
+#include "BoundingBox.h"
+
+class Frustum
+{
+public:
+	Frustum();
+
+	// Extracts the six planes from a combined projection * view matrix
+	void Update(const glm::mat4& viewProjection);
+
+	bool TestBox(const BoundingBox& box) const;
+	bool TestSphere(glm::vec3 centre, float radius) const;
+
+	~Frustum();
+
+private:
+	// xyz = inward normal, w = distance, left/right/bottom/top/near/far
+	glm::vec4 planes[6];
+};
@@ -0,0 +1,363 @@
+#include "GpuMemory.h"
+
+#include <stdio.h>
+#include <algorithm>
+
+const unsigned int GpuMemory::NO_ALLOCATION;
+
+GpuMemory::State::State() : allocations(1), names(1, "(unowned)")
+{
+	for (unsigned int i = 0; i <= GPU_MEMORY_CATEGORY_COUNT; i++)
+	{
+		usage[i] = 0;
+		highWater[i] = 0;
+		budgets[i] = 0;
+		overBudget[i] = false;
+		budgetExceeded[i] = 0;
+	}
+}
+
+GpuMemory::State& GpuMemory::GetState()
+{
+	static State* state = new State();
+	return *state;
+}
+
+thread_local unsigned int GpuMemory::currentOwner = 0;
+thread_local unsigned int GpuMemory::currentAsset = 0;
+
+// NVX_gpu_memory_info, values in kB
+#define GL_GPU_MEMORY_INFO_DEDICATED_VIDMEM_NVX 0x9047
+#define GL_GPU_MEMORY_INFO_CURRENT_AVAILABLE_VIDMEM_NVX 0x9049
+
+unsigned int GpuMemory::Allocate(GpuMemoryCategory category, size_t bytes, const char* asset)
+{
+	State& state = GetState();
+
+	std::vector<unsigned int> crossed;
+	unsigned int allocation;
+	{
+		std::lock_guard<std::mutex> lock(state.memoryMutex);
+
+		if (state.freeSlots.empty())
+		{
+			allocation = (unsigned int)state.allocations.size();
+			state.allocations.push_back(Allocation());
+		}
+		else
+		{
+			allocation = state.freeSlots.back();
+			state.freeSlots.pop_back();
+		}
+
+		Allocation& entry = state.allocations[allocation];
+		entry.category = category;
+		entry.bytes = bytes;
+		entry.owner = currentOwner;
+		entry.asset = asset ? InternName(asset) : currentAsset;
+		entry.live = true;
+
+		AddUsage(category, bytes, 0, crossed);
+	}
+
+	RunCallbacks(crossed);
+	return allocation;
+}
+
+void GpuMemory::Resize(unsigned int allocation, size_t bytes)
+{
+	State& state = GetState();
+
+	std::vector<unsigned int> crossed;
+	{
+		std::lock_guard<std::mutex> lock(state.memoryMutex);
+
+		if (allocation == NO_ALLOCATION || allocation >= state.allocations.size() || !state.allocations[allocation].live)
+		{
+			return;
+		}
+
+		Allocation& entry = state.allocations[allocation];
+		AddUsage(entry.category, bytes, entry.bytes, crossed);
+		entry.bytes = bytes;
+	}
+
+	RunCallbacks(crossed);
+}
+
+void GpuMemory::Free(unsigned int& allocation)
+{
+	// Objects that never allocated don't touch the state at all
+	if (allocation == NO_ALLOCATION)
+	{
+		return;
+	}
+
+	State& state = GetState();
+	std::lock_guard<std::mutex> lock(state.memoryMutex);
+
+	if (allocation < state.allocations.size() && state.allocations[allocation].live)
+	{
+		Allocation& entry = state.allocations[allocation];
+
+		std::vector<unsigned int> crossed;
+		AddUsage(entry.category, 0, entry.bytes, crossed);
+
+		entry.live = false;
+		entry.bytes = 0;
+		state.freeSlots.push_back(allocation);
+	}
+
+	allocation = NO_ALLOCATION;
+}
+
+void GpuMemory::SetBudget(GpuMemoryCategory category, size_t bytes, GpuBudgetCallback callback)
+{
+	State& state = GetState();
+
+	std::vector<unsigned int> crossed;
+	{
+		std::lock_guard<std::mutex> lock(state.memoryMutex);
+
+		state.budgets[category] = bytes;
+		state.callbacks[category] = callback;
+		state.overBudget[category] = false;
+
+		// Already above the new budget counts as crossing it
+		CheckBudget(category, crossed);
+	}
+
+	RunCallbacks(crossed);
+}
+
+size_t GpuMemory::GetUsage(GpuMemoryCategory category)
+{
+	State& state = GetState();
+	std::lock_guard<std::mutex> lock(state.memoryMutex);
+	return state.usage[category];
+}
+
+size_t GpuMemory::GetHighWater(GpuMemoryCategory category)
+{
+	State& state = GetState();
+	std::lock_guard<std::mutex> lock(state.memoryMutex);
+	return state.highWater[category];
+}
+
+size_t GpuMemory::GetBudget(GpuMemoryCategory category)
+{
+	State& state = GetState();
+	std::lock_guard<std::mutex> lock(state.memoryMutex);
+	return state.budgets[category];
+}
+
+size_t GpuMemory::GetOwnerUsage(const char* owner)
+{
+	State& state = GetState();
+	std::lock_guard<std::mutex> lock(state.memoryMutex);
+
+	std::unordered_map<std::string, unsigned int>::iterator found = state.nameLookup.find(owner);
+	if (found == state.nameLookup.end())
+	{
+		return 0;
+	}
+
+	size_t bytes = 0;
+	for (size_t i = 1; i < state.allocations.size(); i++)
+	{
+		if (state.allocations[i].live && state.allocations[i].owner == found->second)
+		{
+			bytes += state.allocations[i].bytes;
+		}
+	}
+	return bytes;
+}
+
+size_t GpuMemory::TextureBytes(GLsizei width, GLsizei height, unsigned int bytesPerTexel, bool mipmapped)
+{
+	// Drivers don't keep 3 byte texels, RGB8 is stored as RGBX
+	if (bytesPerTexel == 3)
+	{
+		bytesPerTexel = 4;
+	}
+
+	size_t bytes = 0;
+	while (true)
+	{
+		bytes += (size_t)width * height * bytesPerTexel;
+		if (!mipmapped || (width == 1 && height == 1))
+		{
+			break;
+		}
+		width = width > 1 ? width / 2 : 1;
+		height = height > 1 ? height / 2 : 1;
+	}
+	return bytes;
+}
+
+const char* GpuMemory::GetCategoryName(GpuMemoryCategory category)
+{
+	switch (category)
+	{
+	case GPU_MEMORY_MESH_VERTEX: return "mesh vertex";
+	case GPU_MEMORY_MESH_INDEX: return "mesh index";
+	case GPU_MEMORY_TEXTURE: return "texture";
+	case GPU_MEMORY_RENDER_TARGET: return "render target";
+	case GPU_MEMORY_UNIFORM: return "uniform";
+	default: return "total";
+	}
+}
+
+static void PrintTop(const char* label, std::vector<std::pair<size_t, unsigned int> >& totals, const std::vector<std::string>& names, unsigned int topCount)
+{
+	std::sort(totals.begin(), totals.end(), [](const std::pair<size_t, unsigned int>& a, const std::pair<size_t, unsigned int>& b) { return a.first > b.first; });
+
+	printf("  top %s:\n", label);
+	for (size_t i = 0; i < totals.size() && i < topCount; i++)
+	{
+		if (totals[i].first == 0)
+		{
+			break;
+		}
+		printf("    %10.2f MB  %s\n", totals[i].first / (1024.0 * 1024.0), names[totals[i].second].c_str());
+	}
+}
+
+void GpuMemory::PrintReport(unsigned int topCount)
+{
+	State& state = GetState();
+	std::lock_guard<std::mutex> lock(state.memoryMutex);
+
+	const double megabyte = 1024.0 * 1024.0;
+
+	printf("GPU memory\n");
+	for (unsigned int i = 0; i <= GPU_MEMORY_CATEGORY_COUNT; i++)
+	{
+		printf("  %-14s %8.2f MB, peak %8.2f MB", GetCategoryName((GpuMemoryCategory)i), state.usage[i] / megabyte, state.highWater[i] / megabyte);
+		if (state.budgets[i] > 0)
+		{
+			printf(", budget %.2f MB exceeded %u times", state.budgets[i] / megabyte, state.budgetExceeded[i]);
+		}
+		printf("\n");
+	}
+
+	if (GLEW_NVX_gpu_memory_info)
+	{
+		GLint dedicated = 0, available = 0;
+		glGetIntegerv(GL_GPU_MEMORY_INFO_DEDICATED_VIDMEM_NVX, &dedicated);
+		glGetIntegerv(GL_GPU_MEMORY_INFO_CURRENT_AVAILABLE_VIDMEM_NVX, &available);
+		printf("  driver:        %8.2f MB of %.2f MB free\n", available / 1024.0, dedicated / 1024.0);
+	}
+
+	std::vector<std::pair<size_t, unsigned int> > owners(state.names.size()), assets(state.names.size());
+	for (size_t i = 0; i < state.names.size(); i++)
+	{
+		owners[i] = std::make_pair((size_t)0, (unsigned int)i);
+		assets[i] = std::make_pair((size_t)0, (unsigned int)i);
+	}
+	for (size_t i = 1; i < state.allocations.size(); i++)
+	{
+		if (state.allocations[i].live)
+		{
+			owners[state.allocations[i].owner].first += state.allocations[i].bytes;
+			assets[state.allocations[i].asset].first += state.allocations[i].bytes;
+		}
+	}
+
+	PrintTop("owners", owners, state.names, topCount);
+	PrintTop("assets", assets, state.names, topCount);
+}
+
+unsigned int GpuMemory::InternName(const char* name)
+{
+	State& state = GetState();
+
+	std::unordered_map<std::string, unsigned int>::iterator found = state.nameLookup.find(name);
+	if (found != state.nameLookup.end())
+	{
+		return found->second;
+	}
+
+	unsigned int index = (unsigned int)state.names.size();
+	state.names.push_back(name);
+	state.nameLookup[name] = index;
+	return index;
+}
+
+void GpuMemory::AddUsage(GpuMemoryCategory category, size_t added, size_t removed, std::vector<unsigned int>& crossed)
+{
+	State& state = GetState();
+
+	state.usage[category] += added - removed;
+	state.usage[GPU_MEMORY_TOTAL] += added - removed;
+
+	CheckBudget(category, crossed);
+	CheckBudget(GPU_MEMORY_TOTAL, crossed);
+}
+
+void GpuMemory::CheckBudget(unsigned int slot, std::vector<unsigned int>& crossed)
+{
+	State& state = GetState();
+
+	if (state.usage[slot] > state.highWater[slot])
+	{
+		state.highWater[slot] = state.usage[slot];
+	}
+
+	if (state.budgets[slot] == 0)
+	{
+		return;
+	}
+
+	if (state.usage[slot] > state.budgets[slot] && !state.overBudget[slot])
+	{
+		state.overBudget[slot] = true;
+		state.budgetExceeded[slot]++;
+		if (state.callbacks[slot])
+		{
+			crossed.push_back(slot);
+		}
+	}
+	else if (state.usage[slot] <= state.budgets[slot])
+	{
+		state.overBudget[slot] = false;
+	}
+}
+
+void GpuMemory::RunCallbacks(const std::vector<unsigned int>& crossed)
+{
+	State& state = GetState();
+
+	for (size_t i = 0; i < crossed.size(); i++)
+	{
+		GpuBudgetCallback callback;
+		size_t used, budget;
+		{
+			std::lock_guard<std::mutex> lock(state.memoryMutex);
+			callback = state.callbacks[crossed[i]];
+			used = state.usage[crossed[i]];
+			budget = state.budgets[crossed[i]];
+		}
+
+		if (callback)
+		{
+			callback((GpuMemoryCategory)crossed[i], used, budget);
+		}
+	}
+}
+
+GpuMemoryOwner::GpuMemoryOwner(const char* owner, const char* asset)
+{
+	previousOwner = GpuMemory::currentOwner;
+	previousAsset = GpuMemory::currentAsset;
+
+	std::lock_guard<std::mutex> lock(GpuMemory::GetState().memoryMutex);
+	GpuMemory::currentOwner = GpuMemory::InternName(owner);
+	GpuMemory::currentAsset = GpuMemory::InternName(asset);
+}
+
+GpuMemoryOwner::~GpuMemoryOwner()
+{
+	GpuMemory::currentOwner = previousOwner;
+	GpuMemory::currentAsset = previousAsset;
+}
@@ -0,0 +1,110 @@
+#pragma once
+
+#include <stddef.h>
+#include <vector>
+#include <string>
+#include <unordered_map>
+#include <functional>
+#include <mutex>
+
+#include <GL\glew.h>
+
+enum GpuMemoryCategory
+{
+	GPU_MEMORY_MESH_VERTEX,
+	GPU_MEMORY_MESH_INDEX,
+	GPU_MEMORY_TEXTURE,
+	GPU_MEMORY_RENDER_TARGET,
+	GPU_MEMORY_UNIFORM,
+	GPU_MEMORY_CATEGORY_COUNT,
+	// Budgets only, the sum of every category
+	GPU_MEMORY_TOTAL = GPU_MEMORY_CATEGORY_COUNT
+};
+
+// Runs on the thread whose allocation crossed the budget, with no lock held so it may free memory
+typedef std::function<void(GpuMemoryCategory category, size_t used, size_t budget)> GpuBudgetCallback;
+
+// Bookkeeping for every buffer and texture we create. GL can't report what a resource really costs,
+// so sizes are what the driver most likely stores: RGB padded to 4 bytes, full mip chains, D24 as 4 bytes
+class GpuMemory
+{
+public:
+	static const unsigned int NO_ALLOCATION = 0;
+
+	// Owner and asset default to the innermost GpuMemoryOwner scope on this thread
+	static unsigned int Allocate(GpuMemoryCategory category, size_t bytes, const char* asset = nullptr);
+	static void Resize(unsigned int allocation, size_t bytes);
+	// Resets the handle to NO_ALLOCATION
+	static void Free(unsigned int& allocation);
+
+	// Callback fires once each time usage rises above the budget, 0 bytes removes the budget
+	static void SetBudget(GpuMemoryCategory category, size_t bytes, GpuBudgetCallback callback);
+
+	static size_t GetUsage(GpuMemoryCategory category);
+	static size_t GetHighWater(GpuMemoryCategory category);
+	static size_t GetBudget(GpuMemoryCategory category);
+	static size_t GetOwnerUsage(const char* owner);
+
+	static size_t TextureBytes(GLsizei width, GLsizei height, unsigned int bytesPerTexel, bool mipmapped);
+
+	// Totals per category and the largest owners and assets, plus what the driver says is free when it can
+	static void PrintReport(unsigned int topCount = 10);
+
+	static const char* GetCategoryName(GpuMemoryCategory category);
+
+private:
+	friend class GpuMemoryOwner;
+
+	struct Allocation
+	{
+		GpuMemoryCategory category;
+		size_t bytes;
+		unsigned int owner;
+		unsigned int asset;
+		bool live;
+	};
+
+	// Allocated on first use and never destroyed, so globals can still free their allocations while the
+	// other statics are being torn down
+	struct State
+	{
+		std::mutex memoryMutex;
+		// Slot 0 stays unused so NO_ALLOCATION never names a real allocation
+		std::vector<Allocation> allocations;
+		std::vector<unsigned int> freeSlots;
+		std::vector<std::string> names;
+		std::unordered_map<std::string, unsigned int> nameLookup;
+
+		size_t usage[GPU_MEMORY_CATEGORY_COUNT + 1];
+		size_t highWater[GPU_MEMORY_CATEGORY_COUNT + 1];
+		size_t budgets[GPU_MEMORY_CATEGORY_COUNT + 1];
+		bool overBudget[GPU_MEMORY_CATEGORY_COUNT + 1];
+		unsigned int budgetExceeded[GPU_MEMORY_CATEGORY_COUNT + 1];
+		GpuBudgetCallback callbacks[GPU_MEMORY_CATEGORY_COUNT + 1];
+
+		State();
+	};
+
+	static State& GetState();
+
+	static thread_local unsigned int currentOwner;
+	static thread_local unsigned int currentAsset;
+
+	// Callers hold memoryMutex
+	static unsigned int InternName(const char* name);
+	static void AddUsage(GpuMemoryCategory category, size_t added, size_t removed, std::vector<unsigned int>& crossed);
+	static void CheckBudget(unsigned int slot, std::vector<unsigned int>& crossed);
+	static void RunCallbacks(const std::vector<unsigned int>& crossed);
+};
+
+// Attributes allocations made in this block to a model and its file, nested scopes override outer ones
+class GpuMemoryOwner
+{
+public:
+	GpuMemoryOwner(const char* owner, const char* asset);
+	~GpuMemoryOwner();
+
+private:
+	unsigned int previousOwner;
+	unsigned int previousAsset;
+};
@@ -0,0 +1,539 @@
+#include "GpuProfiler.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <algorithm>
+
+#include "Clock.h"
+
+const unsigned int GpuProfiler::NO_INDEX;
+const unsigned int GpuProfiler::FRAMES_IN_FLIGHT;
+const unsigned int GpuProfiler::HISTORY_SIZE;
+const unsigned int GpuProfiler::TIMELINE_SIZE;
+const unsigned int GpuProfiler::CALIBRATION_INTERVAL;
+
+static const GLenum statisticTargets[GPU_STAT_COUNT] =
+{
+	GL_VERTICES_SUBMITTED_ARB,
+	GL_PRIMITIVES_SUBMITTED_ARB,
+	GL_VERTEX_SHADER_INVOCATIONS_ARB,
+	GL_CLIPPING_INPUT_PRIMITIVES_ARB,
+	GL_CLIPPING_OUTPUT_PRIMITIVES_ARB,
+	GL_FRAGMENT_SHADER_INVOCATIONS_ARB
+};
+
+static const char* statisticNames[GPU_STAT_COUNT] =
+{
+	"vertices", "primitives", "vs invocations", "clip in", "clip out", "fs invocations"
+};
+
+GpuProfiler::GpuProfiler()
+{
+	enabled = false;
+	statisticsSupported = false;
+	inFrame = false;
+	maxDepth = 2;
+	depth = 0;
+	currentFrame = 0;
+
+	resolvedFrames = 0;
+	droppedFrames = 0;
+
+	timelineCount = 0;
+	clockOffset = 0.0;
+
+	for (unsigned int i = 0; i < FRAMES_IN_FLIGHT; i++)
+	{
+		frames[i].usedTimestamps = 0;
+		frames[i].usedStatistics = 0;
+		frames[i].pending = false;
+	}
+}
+
+bool GpuProfiler::Initialise()
+{
+	GLint timestampBits = 0;
+	glGetQueryiv(GL_TIMESTAMP, GL_QUERY_COUNTER_BITS, &timestampBits);
+
+	if (timestampBits == 0)
+	{
+		printf("GPU profiler disabled, driver has no timestamp queries\n");
+		enabled = false;
+		return false;
+	}
+
+	statisticsSupported = GLEW_ARB_pipeline_statistics_query ? true : false;
+	enabled = true;
+
+	timeline.resize(TIMELINE_SIZE);
+	Calibrate();
+
+	printf("GPU profiler: %d bit timestamps, pipeline statistics %s\n", timestampBits, statisticsSupported ? "on" : "not supported");
+	return true;
+}
+
+void GpuProfiler::BeginFrame()
+{
+	if (!enabled)
+	{
+		return;
+	}
+
+	// Older frames first, anything the GPU has finished gets folded into the history
+	for (unsigned int i = 1; i < FRAMES_IN_FLIGHT; i++)
+	{
+		FrameQueries& older = frames[(currentFrame + i) % FRAMES_IN_FLIGHT];
+		if (older.pending)
+		{
+			TryResolve(older);
+		}
+	}
+
+	if (resolvedFrames > 0 && resolvedFrames % CALIBRATION_INTERVAL == 0)
+	{
+		Calibrate();
+	}
+
+	currentFrame = (currentFrame + 1) % FRAMES_IN_FLIGHT;
+	FrameQueries& frame = frames[currentFrame];
+
+	if (frame.pending && !TryResolve(frame))
+	{
+		// Still not done after a full ring, reading now would stall so the frame is lost
+		droppedFrames++;
+		frame.pending = false;
+	}
+
+	frame.usedTimestamps = 0;
+	frame.usedStatistics = 0;
+	frame.records.clear();
+
+	inFrame = true;
+	depth = 0;
+	openRecords.clear();
+	BeginScope("Frame");
+}
+
+void GpuProfiler::EndFrame()
+{
+	if (!enabled || !inFrame)
+	{
+		return;
+	}
+
+	while (!openRecords.empty())
+	{
+		EndScope();
+	}
+
+	frames[currentFrame].pending = true;
+	inFrame = false;
+}
+
+void GpuProfiler::FinishFrames()
+{
+	if (!enabled)
+	{
+		return;
+	}
+
+	glFinish();
+
+	for (unsigned int i = 1; i <= FRAMES_IN_FLIGHT; i++)
+	{
+		FrameQueries& frame = frames[(currentFrame + i) % FRAMES_IN_FLIGHT];
+		if (frame.pending && !TryResolve(frame))
+		{
+			droppedFrames++;
+			frame.pending = false;
+		}
+	}
+}
+
+void GpuProfiler::BeginScope(const char* name, unsigned int index)
+{
+	if (!enabled || !inFrame)
+	{
+		return;
+	}
+
+	unsigned int scopeDepth = depth++;
+	if (scopeDepth > maxDepth)
+	{
+		openRecords.push_back(-1);
+		return;
+	}
+
+	int parent = -1;
+	for (size_t i = openRecords.size(); i > 0; i--)
+	{
+		if (openRecords[i - 1] >= 0)
+		{
+			parent = (int)frames[currentFrame].records[openRecords[i - 1]].scope;
+			break;
+		}
+	}
+
+	FrameQueries& frame = frames[currentFrame];
+
+	ScopeRecord record;
+	record.scope = GetScopeId(name, index, parent, scopeDepth);
+	record.endQuery = 0;
+	record.statisticBase = -1;
+	glQueryCounter(NextTimestamp(frame, record.beginQuery), GL_TIMESTAMP);
+
+	// Passes carry the pipeline statistics, they never nest in each other so the query targets stay free
+	if (statisticsSupported && scopeDepth == 1)
+	{
+		if (frame.usedStatistics + GPU_STAT_COUNT > frame.statisticQueries.size())
+		{
+			size_t oldSize = frame.statisticQueries.size();
+			frame.statisticQueries.resize(oldSize + GPU_STAT_COUNT * 4);
+			glGenQueries(GPU_STAT_COUNT * 4, &frame.statisticQueries[oldSize]);
+		}
+
+		record.statisticBase = (int)frame.usedStatistics;
+		for (unsigned int i = 0; i < GPU_STAT_COUNT; i++)
+		{
+			glBeginQuery(statisticTargets[i], frame.statisticQueries[frame.usedStatistics + i]);
+		}
+		frame.usedStatistics += GPU_STAT_COUNT;
+	}
+
+	openRecords.push_back((int)frame.records.size());
+	frame.records.push_back(record);
+}
+
+void GpuProfiler::EndScope()
+{
+	if (!enabled || !inFrame || openRecords.empty())
+	{
+		return;
+	}
+
+	int recordIndex = openRecords.back();
+	openRecords.pop_back();
+	depth--;
+
+	if (recordIndex < 0)
+	{
+		return;
+	}
+
+	FrameQueries& frame = frames[currentFrame];
+	ScopeRecord& record = frame.records[recordIndex];
+
+	if (record.statisticBase >= 0)
+	{
+		for (unsigned int i = 0; i < GPU_STAT_COUNT; i++)
+		{
+			glEndQuery(statisticTargets[i]);
+		}
+	}
+
+	glQueryCounter(NextTimestamp(frame, record.endQuery), GL_TIMESTAMP);
+}
+
+int GpuProfiler::FindScope(const char* name, unsigned int index)
+{
+	for (size_t i = 0; i < scopes.size(); i++)
+	{
+		if (scopes[i].index == index && strcmp(scopes[i].name, name) == 0)
+		{
+			return (int)i;
+		}
+	}
+
+	return -1;
+}
+
+GpuScopeStats GpuProfiler::GetStats(unsigned int scope)
+{
+	GpuScopeStats stats = { 0, 0.0, 0.0, 0.0, 0.0, 0.0 };
+	if (scope >= scopes.size() || scopes[scope].sampleCount == 0)
+	{
+		return stats;
+	}
+
+	const ScopeInfo& info = scopes[scope];
+	unsigned int count = (unsigned int)std::min<unsigned long long>(info.sampleCount, HISTORY_SIZE);
+
+	std::vector<float> sorted(info.history.begin(), info.history.begin() + count);
+	std::sort(sorted.begin(), sorted.end());
+
+	double sum = 0.0;
+	for (unsigned int i = 0; i < count; i++)
+	{
+		sum += sorted[i];
+	}
+
+	stats.samples = count;
+	stats.average = sum / count;
+	stats.p50 = sorted[(count - 1) * 50 / 100];
+	stats.p95 = sorted[(count - 1) * 95 / 100];
+	stats.p99 = sorted[(count - 1) * 99 / 100];
+	stats.max = sorted[count - 1];
+
+	return stats;
+}
+
+double GpuProfiler::GetLatest(unsigned int scope)
+{
+	if (scope >= scopes.size() || scopes[scope].sampleCount == 0)
+	{
+		return 0.0;
+	}
+
+	return scopes[scope].history[(scopes[scope].sampleCount - 1) % HISTORY_SIZE];
+}
+
+double GpuProfiler::GetStatistic(unsigned int scope, GpuStatistic statistic)
+{
+	if (scope >= scopes.size() || scopes[scope].statisticFrames == 0)
+	{
+		return 0.0;
+	}
+
+	return scopes[scope].statisticSums[statistic] / scopes[scope].statisticFrames;
+}
+
+std::string GpuProfiler::GetScopeLabel(unsigned int scope)
+{
+	if (scope >= scopes.size())
+	{
+		return std::string();
+	}
+
+	std::string label = scopes[scope].name;
+	if (scopes[scope].index != NO_INDEX)
+	{
+		label += "[" + std::to_string(scopes[scope].index) + "]";
+	}
+
+	return label;
+}
+
+std::vector<GpuTimelineEvent> GpuProfiler::GetTimeline()
+{
+	std::vector<GpuTimelineEvent> ordered;
+	if (timelineCount == 0)
+	{
+		return ordered;
+	}
+
+	unsigned long long first = timelineCount > TIMELINE_SIZE ? timelineCount - TIMELINE_SIZE : 0;
+	ordered.reserve((size_t)(timelineCount - first));
+	for (unsigned long long i = first; i < timelineCount; i++)
+	{
+		ordered.push_back(timeline[i % TIMELINE_SIZE]);
+	}
+
+	return ordered;
+}
+
+void GpuProfiler::PrintReport()
+{
+	if (!enabled)
+	{
+		return;
+	}
+
+	printf("GPU profile, %llu frames resolved, %llu dropped\n", resolvedFrames, droppedFrames);
+	printf("  %-32s %9s %9s %9s %9s %9s\n", "scope", "avg ms", "p50", "p95", "p99", "max");
+
+	// Depth-first so children print under their parent
+	std::vector<int> stack;
+	for (int root = (int)scopes.size() - 1; root >= 0; root--)
+	{
+		if (scopes[root].parent < 0) stack.push_back(root);
+	}
+
+	while (!stack.empty())
+	{
+		int scope = stack.back();
+		stack.pop_back();
+
+		GpuScopeStats stats = GetStats(scope);
+		std::string label = std::string(scopes[scope].depth * 2, ' ') + GetScopeLabel(scope);
+		printf("  %-32s %9.3f %9.3f %9.3f %9.3f %9.3f\n", label.c_str(), stats.average, stats.p50, stats.p95, stats.p99, stats.max);
+
+		if (scopes[scope].statisticFrames > 0)
+		{
+			printf("  %-32s", "");
+			for (unsigned int i = 0; i < GPU_STAT_COUNT; i++)
+			{
+				printf(" %s %.0f", statisticNames[i], GetStatistic(scope, (GpuStatistic)i));
+			}
+			printf("\n");
+		}
+
+		for (int child = (int)scopes.size() - 1; child >= 0; child--)
+		{
+			if (scopes[child].parent == scope) stack.push_back(child);
+		}
+	}
+}
+
+void GpuProfiler::ClearProfiler()
+{
+	for (unsigned int i = 0; i < FRAMES_IN_FLIGHT; i++)
+	{
+		if (!frames[i].timestampQueries.empty())
+		{
+			glDeleteQueries((GLsizei)frames[i].timestampQueries.size(), &frames[i].timestampQueries[0]);
+		}
+		if (!frames[i].statisticQueries.empty())
+		{
+			glDeleteQueries((GLsizei)frames[i].statisticQueries.size(), &frames[i].statisticQueries[0]);
+		}
+
+		frames[i].timestampQueries.clear();
+		frames[i].statisticQueries.clear();
+		frames[i].records.clear();
+		frames[i].usedTimestamps = 0;
+		frames[i].usedStatistics = 0;
+		frames[i].pending = false;
+	}
+
+	scopes.clear();
+	scopeLookup.clear();
+	timeline.clear();
+	timelineCount = 0;
+	openRecords.clear();
+	enabled = false;
+	inFrame = false;
+}
+
+unsigned int GpuProfiler::GetScopeId(const char* name, unsigned int index, int parent, unsigned int scopeDepth)
+{
+	// FNV-1a over the name, mixed with index and parent
+	unsigned int hash = 2166136261u;
+	for (const char* c = name; *c; c++)
+	{
+		hash = (hash ^ (unsigned char)*c) * 16777619u;
+	}
+	hash ^= index * 0x9E3779B1u;
+
+	unsigned long long key = ((unsigned long long)(parent + 1) << 32) | hash;
+
+	std::unordered_map<unsigned long long, unsigned int>::iterator found = scopeLookup.find(key);
+	if (found != scopeLookup.end())
+	{
+		return found->second;
+	}
+
+	ScopeInfo info;
+	info.name = name;
+	info.index = index;
+	info.parent = parent;
+	info.depth = scopeDepth;
+	info.history.resize(HISTORY_SIZE, 0.0f);
+	info.sampleCount = 0;
+	for (unsigned int i = 0; i < GPU_STAT_COUNT; i++)
+	{
+		info.statisticSums[i] = 0.0;
+	}
+	info.statisticFrames = 0;
+
+	unsigned int id = (unsigned int)scopes.size();
+	scopes.push_back(info);
+	scopeLookup[key] = id;
+
+	return id;
+}
+
+void GpuProfiler::Calibrate()
+{
+	GLint64 gpuTime = 0;
+	glGetInteger64v(GL_TIMESTAMP, &gpuTime);
+	clockOffset = Clock::Now() - gpuTime * 1e-9;
+}
+
+GLuint GpuProfiler::NextTimestamp(FrameQueries& frame, unsigned int& queryIndex)
+{
+	if (frame.usedTimestamps == frame.timestampQueries.size())
+	{
+		size_t oldSize = frame.timestampQueries.size();
+		frame.timestampQueries.resize(oldSize + 64);
+		glGenQueries(64, &frame.timestampQueries[oldSize]);
+	}
+
+	queryIndex = frame.usedTimestamps++;
+	return frame.timestampQueries[queryIndex];
+}
+
+bool GpuProfiler::TryResolve(FrameQueries& frame)
+{
+	if (frame.usedTimestamps == 0)
+	{
+		frame.pending = false;
+		return true;
+	}
+
+	// Queries finish in submission order, the last one being ready means all of them are
+	GLint available = 0;
+	glGetQueryObjectiv(frame.timestampQueries[frame.usedTimestamps - 1], GL_QUERY_RESULT_AVAILABLE, &available);
+	if (!available)
+	{
+		return false;
+	}
+
+	if (frame.usedStatistics > 0)
+	{
+		glGetQueryObjectiv(frame.statisticQueries[frame.usedStatistics - 1], GL_QUERY_RESULT_AVAILABLE, &available);
+		if (!available)
+		{
+			return false;
+		}
+	}
+
+	for (size_t i = 0; i < frame.records.size(); i++)
+	{
+		const ScopeRecord& record = frame.records[i];
+
+		GLuint64 begin = 0, end = 0;
+		glGetQueryObjectui64v(frame.timestampQueries[record.beginQuery], GL_QUERY_RESULT, &begin);
+		glGetQueryObjectui64v(frame.timestampQueries[record.endQuery], GL_QUERY_RESULT, &end);
+
+		ScopeInfo& info = scopes[record.scope];
+		info.history[info.sampleCount % HISTORY_SIZE] = end > begin ? (float)((end - begin) / 1000000.0) : 0.0f;
+		info.sampleCount++;
+
+		GpuTimelineEvent& event = timeline[timelineCount % TIMELINE_SIZE];
+		event.scope = record.scope;
+		event.begin = begin * 1e-9 + clockOffset;
+		event.end = end * 1e-9 + clockOffset;
+		timelineCount++;
+
+		if (record.statisticBase >= 0)
+		{
+			for (unsigned int s = 0; s < GPU_STAT_COUNT; s++)
+			{
+				GLuint64 value = 0;
+				glGetQueryObjectui64v(frame.statisticQueries[record.statisticBase + s], GL_QUERY_RESULT, &value);
+				info.statisticSums[s] += (double)value;
+
+				// The frame scope reports the sum of its passes
+				if (info.parent >= 0)
+				{
+					scopes[info.parent].statisticSums[s] += (double)value;
+				}
+			}
+			info.statisticFrames++;
+		}
+	}
+
+	// A frame scope counts once per resolved frame, however many passes added to it
+	if (frame.records.size() > 0 && statisticsSupported)
+	{
+		scopes[frame.records[0].scope].statisticFrames++;
+	}
+
+	frame.pending = false;
+	resolvedFrames++;
+	return true;
+}
+
+GpuProfiler::~GpuProfiler()
+{
+}
@@ -0,0 +1,173 @@
+#pragma once
+
+#include <vector>
+#include <string>
+#include <unordered_map>
+
+#include <GL\glew.h>
+
+// Counters from ARB_pipeline_statistics_query, collected per pass when the driver has them
+enum GpuStatistic
+{
+	GPU_STAT_VERTICES_SUBMITTED,
+	GPU_STAT_PRIMITIVES_SUBMITTED,
+	GPU_STAT_VERTEX_SHADER_INVOCATIONS,
+	GPU_STAT_CLIPPING_INPUT_PRIMITIVES,
+	GPU_STAT_CLIPPING_OUTPUT_PRIMITIVES,
+	GPU_STAT_FRAGMENT_SHADER_INVOCATIONS,
+	GPU_STAT_COUNT
+};
+
+// Milliseconds over the recent history of a scope
+struct GpuScopeStats
+{
+	unsigned int samples;
+	double average;
+	double p50, p95, p99;
+	double max;
+};
+
+// One resolved scope instance, in Clock::Now() seconds so it lines up with CPU traces
+struct GpuTimelineEvent
+{
+	unsigned int scope;
+	double begin;
+	double end;
+};
+
+// Nested GPU timings from GL_TIMESTAMP queries (GL_TIME_ELAPSED can't nest). Every frame records into
+// its own set of queries and is read back FRAMES_IN_FLIGHT - 1 frames later, only once the driver reports
+// the results available, so the profiler never waits on the GPU
+class GpuProfiler
+{
+public:
+	static const unsigned int NO_INDEX = 0xFFFFFFFF;
+
+	GpuProfiler();
+
+	// Needs a current context, returns false and stays disabled without timestamp support
+	bool Initialise();
+	bool IsEnabled() { return enabled; }
+	bool HasStatistics() { return statisticsSupported; }
+
+	// Scopes nested deeper than this are ignored, 0 = frame, 1 = pass, 2 = model, 3 = mesh
+	void SetMaxDepth(unsigned int depth) { maxDepth = depth; }
+
+	void BeginFrame();
+	void EndFrame();
+	// Waits for the GPU and resolves every pending frame, for the end of benchmark runs
+	void FinishFrames();
+
+	// Scopes are identified by parent, name and index, name has to outlive the profiler
+	void BeginScope(const char* name, unsigned int index = NO_INDEX);
+	void EndScope();
+
+	// First scope with this name and index in creation order, -1 if none
+	int FindScope(const char* name, unsigned int index = NO_INDEX);
+	GpuScopeStats GetStats(unsigned int scope);
+	// Newest resolved sample in milliseconds, the count tells callers polling every frame whether it is new
+	double GetLatest(unsigned int scope);
+	unsigned long long GetSampleCount(unsigned int scope) { return scope < scopes.size() ? scopes[scope].sampleCount : 0; }
+	// Average per frame over every resolved frame the scope appeared in
+	double GetStatistic(unsigned int scope, GpuStatistic statistic);
+	unsigned int GetScopeCount() { return (unsigned int)scopes.size(); }
+	std::string GetScopeLabel(unsigned int scope);
+
+	// Most recent resolved scopes, oldest first, at most TIMELINE_SIZE of them
+	std::vector<GpuTimelineEvent> GetTimeline();
+	// Resolved scopes that were overwritten before GetTimeline could return them
+	unsigned long long GetOverwrittenEvents() { return timelineCount > TIMELINE_SIZE ? timelineCount - TIMELINE_SIZE : 0; }
+
+	unsigned long long GetResolvedFrames() { return resolvedFrames; }
+	unsigned long long GetDroppedFrames() { return droppedFrames; }
+
+	void PrintReport();
+
+	void ClearProfiler();
+
+	~GpuProfiler();
+
+private:
+	static const unsigned int FRAMES_IN_FLIGHT = 4;
+	static const unsigned int HISTORY_SIZE = 256;
+	static const unsigned int TIMELINE_SIZE = 1 << 16;
+	static const unsigned int CALIBRATION_INTERVAL = 256;
+
+	struct ScopeInfo
+	{
+		const char* name;
+		unsigned int index;
+		int parent;
+		unsigned int depth;
+
+		std::vector<float> history;
+		unsigned long long sampleCount;
+
+		double statisticSums[GPU_STAT_COUNT];
+		unsigned long long statisticFrames;
+	};
+
+	struct ScopeRecord
+	{
+		unsigned int scope;
+		unsigned int beginQuery, endQuery;
+		// First of GPU_STAT_COUNT queries in statisticQueries, -1 without statistics
+		int statisticBase;
+	};
+
+	struct FrameQueries
+	{
+		std::vector<GLuint> timestampQueries;
+		unsigned int usedTimestamps;
+		std::vector<GLuint> statisticQueries;
+		unsigned int usedStatistics;
+		std::vector<ScopeRecord> records;
+		bool pending;
+	};
+
+	bool enabled;
+	bool statisticsSupported;
+	bool inFrame;
+	unsigned int maxDepth;
+	unsigned int depth;
+
+	FrameQueries frames[FRAMES_IN_FLIGHT];
+	unsigned int currentFrame;
+
+	std::vector<ScopeInfo> scopes;
+	std::unordered_map<unsigned long long, unsigned int> scopeLookup;
+	// Record index per open scope, -1 for scopes skipped by maxDepth
+	std::vector<int> openRecords;
+
+	unsigned long long resolvedFrames;
+	unsigned long long droppedFrames;
+
+	std::vector<GpuTimelineEvent> timeline;
+	unsigned long long timelineCount;
+	// CPU seconds minus GPU seconds, refreshed now and then since the two clocks drift
+	double clockOffset;
+
+	void Calibrate();
+
+	unsigned int GetScopeId(const char* name, unsigned int index, int parent, unsigned int scopeDepth);
+	GLuint NextTimestamp(FrameQueries& frame, unsigned int& queryIndex);
+	bool TryResolve(FrameQueries& frame);
+};
+
+// Opens a GPU scope for the rest of the block, does nothing with a null profiler
+class GpuProfileScope
+{
+public:
+	GpuProfileScope(GpuProfiler* profiler, const char* name, unsigned int index = GpuProfiler::NO_INDEX) : profiler(profiler)
+	{
+		if (profiler) profiler->BeginScope(name, index);
+	}
+
+	~GpuProfileScope()
+	{
+		if (profiler) profiler->EndScope();
+	}
+
+private:
+	GpuProfiler* profiler;
+};
@@ -0,0 +1,156 @@
+#include "InputLog.h"
+
+#include <string.h>
+
+#include "CpuTrace.h"
+
+const unsigned int InputLog::MAGIC;
+const unsigned int InputLog::VERSION;
+const unsigned short InputLog::KEY_PRESSED;
+
+InputLog::InputLog()
+{
+	recordFile = NULL;
+	replayFile = NULL;
+	memset(previousKeys, 0, sizeof(previousKeys));
+	frameCount = 0;
+}
+
+bool InputLog::BeginRecording(const std::string& fileName)
+{
+	EndRecording();
+
+	recordFile = fopen(fileName.c_str(), "wb");
+	if (!recordFile)
+	{
+		printf("Failed to write %s!\n", fileName.c_str());
+		return false;
+	}
+
+	unsigned int header[2] = { MAGIC, VERSION };
+	fwrite(header, sizeof(header), 1, recordFile);
+
+	memset(previousKeys, 0, sizeof(previousKeys));
+	frameCount = 0;
+	return true;
+}
+
+void InputLog::RecordFrame(const InputFrame& frame)
+{
+	if (!recordFile)
+	{
+		return;
+	}
+
+	TRACE_SCOPE("InputLog::RecordFrame");
+
+	unsigned short changes[1024];
+	unsigned short changeCount = 0;
+	for (unsigned short key = 0; key < 1024; key++)
+	{
+		if (frame.keys[key] != previousKeys[key])
+		{
+			changes[changeCount++] = key | (frame.keys[key] ? KEY_PRESSED : 0);
+			previousKeys[key] = frame.keys[key];
+		}
+	}
+
+	unsigned char steps = (unsigned char)(frame.steps < 255 ? frame.steps : 255);
+
+	fwrite(&frame.deltaTime, sizeof(frame.deltaTime), 1, recordFile);
+	fwrite(&frame.xChange, sizeof(frame.xChange), 1, recordFile);
+	fwrite(&frame.yChange, sizeof(frame.yChange), 1, recordFile);
+	fwrite(&steps, sizeof(steps), 1, recordFile);
+	fwrite(&changeCount, sizeof(changeCount), 1, recordFile);
+	if (changeCount > 0)
+	{
+		fwrite(changes, sizeof(unsigned short), changeCount, recordFile);
+	}
+
+	frameCount++;
+}
+
+void InputLog::EndRecording()
+{
+	if (!recordFile)
+	{
+		return;
+	}
+
+	fclose(recordFile);
+	recordFile = NULL;
+}
+
+bool InputLog::LoadReplay(const std::string& fileName)
+{
+	if (replayFile)
+	{
+		fclose(replayFile);
+		replayFile = NULL;
+	}
+
+	replayFile = fopen(fileName.c_str(), "rb");
+	if (!replayFile)
+	{
+		printf("Failed to read %s! File doesn't exist.\n", fileName.c_str());
+		return false;
+	}
+
+	unsigned int header[2] = { 0, 0 };
+	if (fread(header, sizeof(header), 1, replayFile) != 1 || header[0] != MAGIC || header[1] != VERSION)
+	{
+		printf("%s is not an input log of version %u\n", fileName.c_str(), VERSION);
+		fclose(replayFile);
+		replayFile = NULL;
+		return false;
+	}
+
+	memset(previousKeys, 0, sizeof(previousKeys));
+	frameCount = 0;
+	return true;
+}
+
+bool InputLog::NextFrame(InputFrame& frame)
+{
+	if (!replayFile)
+	{
+		return false;
+	}
+
+	unsigned char steps = 0;
+	unsigned short changeCount = 0;
+	unsigned short changes[1024];
+
+	// A log cut short by a crash simply ends at its last complete frame
+	if (fread(&frame.deltaTime, sizeof(frame.deltaTime), 1, replayFile) != 1 ||
+		fread(&frame.xChange, sizeof(frame.xChange), 1, replayFile) != 1 ||
+		fread(&frame.yChange, sizeof(frame.yChange), 1, replayFile) != 1 ||
+		fread(&steps, sizeof(steps), 1, replayFile) != 1 ||
+		fread(&changeCount, sizeof(changeCount), 1, replayFile) != 1 ||
+		changeCount > 1024 ||
+		(changeCount > 0 && fread(changes, sizeof(unsigned short), changeCount, replayFile) != changeCount))
+	{
+		return false;
+	}
+
+	for (unsigned short i = 0; i < changeCount; i++)
+	{
+		previousKeys[changes[i] & ~KEY_PRESSED & 1023] = (changes[i] & KEY_PRESSED) != 0;
+	}
+
+	frame.steps = steps;
+	memcpy(frame.keys, previousKeys, sizeof(frame.keys));
+
+	frameCount++;
+	return true;
+}
+
+InputLog::~InputLog()
+{
+	EndRecording();
+
+	if (replayFile)
+	{
+		fclose(replayFile);
+	}
+}
@@ -0,0 +1,50 @@
+#pragma once
+
+#include <stdio.h>
+#include <string>
+
+#include <GL\glew.h>
+
+// Everything the simulation consumed in one tick
+struct InputFrame
+{
+	// Wall time since the previous frame, only used to pace replays
+	double deltaTime;
+	// Fixed steps the camera moved this tick
+	unsigned int steps;
+	GLfloat xChange, yChange;
+	bool keys[1024];
+};
+
+// Binary log of simulation input for reproducing sessions. A frame is its delta, step count and mouse
+// deltas plus only the keys that changed since the previous frame, usually under 20 bytes
+class InputLog
+{
+public:
+	InputLog();
+
+	bool BeginRecording(const std::string& fileName);
+	void RecordFrame(const InputFrame& frame);
+	void EndRecording();
+
+	// Frames then come back in order from NextFrame until the log runs out
+	bool LoadReplay(const std::string& fileName);
+	bool NextFrame(InputFrame& frame);
+
+	bool IsRecording() { return recordFile != NULL; }
+	bool IsReplaying() { return replayFile != NULL; }
+	unsigned long long GetFrameCount() { return frameCount; }
+
+	~InputLog();
+
+private:
+	static const unsigned int MAGIC = 0x4C504E49; // "INPL"
+	static const unsigned int VERSION = 1;
+	// Set on a key code in the log when the key went down, clear when it went up
+	static const unsigned short KEY_PRESSED = 0x8000;
+
+	FILE* recordFile;
+	FILE* replayFile;
+	bool previousKeys[1024];
+	unsigned long long frameCount;
+};
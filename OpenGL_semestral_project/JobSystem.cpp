@@ -0,0 +1,384 @@
+#include "JobSystem.h"
+
+#include <stdio.h>
+
+#include "CpuTrace.h"
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <pthread.h>
+#endif
+
+// Queue index of the current thread, only meaningful while tlsJobSystem matches
+static thread_local JobSystem* tlsJobSystem = nullptr;
+static thread_local unsigned int tlsQueueIndex = 0;
+
+JobCounter::JobCounter()
+{
+	pending.store(0);
+}
+
+JobCounter::~JobCounter()
+{
+}
+
+JobSystem::WorkQueue::WorkQueue()
+{
+	lock.clear();
+	top = 0;
+	bottom = 0;
+	ring.resize(CAPACITY);
+}
+
+JobSystem::JobSystem()
+{
+	running.store(false);
+	queuedJobs.store(0);
+	sleepingWorkers.store(0);
+	stealCount.store(0);
+
+	// Queue 0 belongs to whichever thread drives the frame
+	queues.push_back(new WorkQueue());
+}
+
+void JobSystem::Start(unsigned int workerCount, bool pinThreads)
+{
+	if (running.load())
+	{
+		Stop();
+	}
+
+	if (workerCount == 0)
+	{
+		unsigned int hardwareThreads = std::thread::hardware_concurrency();
+		workerCount = hardwareThreads > 1 ? hardwareThreads - 1 : 1;
+	}
+
+	for (unsigned int i = 0; i < workerCount; i++)
+	{
+		queues.push_back(new WorkQueue());
+	}
+
+	running.store(true);
+	for (unsigned int i = 0; i < workerCount; i++)
+	{
+		workers.push_back(std::thread(&JobSystem::WorkerLoop, this, i + 1, pinThreads));
+	}
+}
+
+void JobSystem::Stop()
+{
+	if (!running.load())
+	{
+		return;
+	}
+
+	{
+		std::lock_guard<std::mutex> lock(sleepMutex);
+		running.store(false);
+	}
+	wakeCondition.notify_all();
+
+	for (size_t i = 0; i < workers.size(); i++)
+	{
+		workers[i].join();
+	}
+	workers.clear();
+
+	// Anything left in worker queues still has to run, move it to the caller's queue
+	Job job;
+	for (unsigned int i = 1; i < queues.size(); i++)
+	{
+		while (Pop(i, job))
+		{
+			Execute(job);
+		}
+		delete queues[i];
+	}
+	queues.resize(1);
+}
+
+void JobSystem::Run(JobFunction function, JobCounter* counter)
+{
+	if (counter)
+	{
+		counter->pending.fetch_add(1, std::memory_order_relaxed);
+	}
+
+	Job job;
+	job.function = std::move(function);
+	job.counter = counter;
+	Push(job);
+}
+
+void JobSystem::RunAfter(JobCounter* dependency, JobFunction function, JobCounter* counter)
+{
+	if (counter)
+	{
+		counter->pending.fetch_add(1, std::memory_order_relaxed);
+	}
+
+	{
+		std::lock_guard<std::mutex> lock(dependency->continuationMutex);
+		if (dependency->pending.load(std::memory_order_acquire) > 0)
+		{
+			dependency->continuations.push_back(std::make_pair(std::move(function), counter));
+			return;
+		}
+	}
+
+	Job job;
+	job.function = std::move(function);
+	job.counter = counter;
+	Push(job);
+}
+
+void JobSystem::Wait(JobCounter* counter)
+{
+	unsigned int queue = CurrentQueue();
+
+	while (counter->pending.load(std::memory_order_acquire) > 0)
+	{
+		if (!TryRunOne(queue))
+		{
+			std::this_thread::yield();
+		}
+	}
+
+	// The last Finish drops the count while holding this lock, so after it the counter may be destroyed
+	std::lock_guard<std::mutex> barrier(counter->continuationMutex);
+}
+
+void JobSystem::ParallelFor(unsigned int count, unsigned int batchSize, const std::function<void(unsigned int, unsigned int)>& body)
+{
+	if (count == 0)
+	{
+		return;
+	}
+
+	if (batchSize == 0)
+	{
+		batchSize = count / (GetThreadCount() * 4);
+		if (batchSize == 0) batchSize = 1;
+	}
+
+	if (batchSize >= count || GetThreadCount() == 1)
+	{
+		body(0, count);
+		return;
+	}
+
+	JobCounter counter;
+	for (unsigned int begin = 0; begin < count; begin += batchSize)
+	{
+		unsigned int end = count - begin > batchSize ? begin + batchSize : count;
+		Run([&body, begin, end]() { body(begin, end); }, &counter);
+	}
+
+	Wait(&counter);
+}
+
+void JobSystem::Push(Job& job)
+{
+	WorkQueue* queue = queues[CurrentQueue()];
+
+	while (queue->lock.test_and_set(std::memory_order_acquire)) {}
+
+	if (queue->bottom - queue->top >= WorkQueue::CAPACITY)
+	{
+		// Queue full, running inline keeps correctness and throttles the producer
+		queue->lock.clear(std::memory_order_release);
+		Execute(job);
+		return;
+	}
+
+	queue->ring[queue->bottom & (WorkQueue::CAPACITY - 1)] = std::move(job);
+	queue->bottom++;
+	queue->lock.clear(std::memory_order_release);
+
+	queuedJobs.fetch_add(1);
+	if (sleepingWorkers.load() > 0)
+	{
+		std::lock_guard<std::mutex> lock(sleepMutex);
+		wakeCondition.notify_one();
+	}
+}
+
+bool JobSystem::Pop(unsigned int index, Job& job)
+{
+	WorkQueue* queue = queues[index];
+
+	while (queue->lock.test_and_set(std::memory_order_acquire)) {}
+
+	if (queue->bottom == queue->top)
+	{
+		queue->lock.clear(std::memory_order_release);
+		return false;
+	}
+
+	queue->bottom--;
+	job = std::move(queue->ring[queue->bottom & (WorkQueue::CAPACITY - 1)]);
+	queue->lock.clear(std::memory_order_release);
+
+	queuedJobs.fetch_sub(1);
+	return true;
+}
+
+bool JobSystem::Steal(unsigned int thief, Job& job)
+{
+	unsigned int queueCount = (unsigned int)queues.size();
+
+	for (unsigned int offset = 1; offset < queueCount; offset++)
+	{
+		WorkQueue* queue = queues[(thief + offset) % queueCount];
+
+		if (queue->bottom == queue->top)
+		{
+			continue;
+		}
+
+		if (queue->lock.test_and_set(std::memory_order_acquire))
+		{
+			// Contended, somebody is already working this queue
+			continue;
+		}
+
+		if (queue->bottom == queue->top)
+		{
+			queue->lock.clear(std::memory_order_release);
+			continue;
+		}
+
+		job = std::move(queue->ring[queue->top & (WorkQueue::CAPACITY - 1)]);
+		queue->top++;
+		queue->lock.clear(std::memory_order_release);
+
+		queuedJobs.fetch_sub(1);
+		stealCount.fetch_add(1, std::memory_order_relaxed);
+		return true;
+	}
+
+	return false;
+}
+
+bool JobSystem::TryRunOne(unsigned int queue)
+{
+	Job job;
+	if (Pop(queue, job) || Steal(queue, job))
+	{
+		Execute(job);
+		return true;
+	}
+
+	return false;
+}
+
+void JobSystem::Execute(Job& job)
+{
+	job.function();
+	job.function = nullptr;
+
+	if (job.counter)
+	{
+		Finish(job.counter);
+	}
+}
+
+void JobSystem::Finish(JobCounter* counter)
+{
+	int value = counter->pending.load(std::memory_order_relaxed);
+
+	while (true)
+	{
+		if (value > 1)
+		{
+			if (counter->pending.compare_exchange_weak(value, value - 1, std::memory_order_acq_rel))
+			{
+				return;
+			}
+			continue;
+		}
+
+		// Last job out releases the continuations, under the lock so RunAfter can't slip one in
+		std::vector<std::pair<JobFunction, JobCounter*>> ready;
+		{
+			std::lock_guard<std::mutex> lock(counter->continuationMutex);
+			if (!counter->pending.compare_exchange_strong(value, value - 1, std::memory_order_acq_rel))
+			{
+				continue;
+			}
+			ready.swap(counter->continuations);
+		}
+
+		for (size_t i = 0; i < ready.size(); i++)
+		{
+			Job job;
+			job.function = std::move(ready[i].first);
+			job.counter = ready[i].second;
+			Push(job);
+		}
+		return;
+	}
+}
+
+void JobSystem::WorkerLoop(unsigned int index, bool pinThread)
+{
+	tlsJobSystem = this;
+	tlsQueueIndex = index;
+	TRACE_THREAD_NAME("Worker");
+
+	if (pinThread)
+	{
+		unsigned int core = index % std::thread::hardware_concurrency();
+#ifdef _WIN32
+		SetThreadAffinityMask(GetCurrentThread(), (DWORD_PTR)1 << core);
+#else
+		cpu_set_t cpuSet;
+		CPU_ZERO(&cpuSet);
+		CPU_SET(core, &cpuSet);
+		pthread_setaffinity_np(pthread_self(), sizeof(cpuSet), &cpuSet);
+#endif
+	}
+
+	unsigned int idleSpins = 0;
+
+	while (running.load(std::memory_order_relaxed))
+	{
+		if (TryRunOne(index))
+		{
+			idleSpins = 0;
+			continue;
+		}
+
+		if (++idleSpins < 64)
+		{
+			std::this_thread::yield();
+			continue;
+		}
+
+		std::unique_lock<std::mutex> lock(sleepMutex);
+		sleepingWorkers.fetch_add(1);
+		wakeCondition.wait_for(lock, std::chrono::milliseconds(10), [this]() { return queuedJobs.load() > 0 || !running.load(); });
+		sleepingWorkers.fetch_sub(1);
+		idleSpins = 0;
+	}
+
+	tlsJobSystem = nullptr;
+}
+
+unsigned int JobSystem::CurrentQueue()
+{
+	return tlsJobSystem == this ? tlsQueueIndex : 0;
+}
+
+JobSystem::~JobSystem()
+{
+	Stop();
+
+	for (size_t i = 0; i < queues.size(); i++)
+	{
+		delete queues[i];
+	}
+	queues.clear();
+}
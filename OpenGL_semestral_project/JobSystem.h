@@ -0,0 +1,93 @@
+#pragma once
+
+#include <vector>
+#include <atomic>
+#include <mutex>
+#include <thread>
+#include <condition_variable>
+#include <functional>
+
+typedef std::function<void()> JobFunction;
+
+// Counts unfinished jobs, doubles as the fence other jobs can be scheduled behind
+class JobCounter
+{
+public:
+	JobCounter();
+
+	bool IsDone() { return pending.load(std::memory_order_acquire) == 0; }
+
+	~JobCounter();
+
+private:
+	friend class JobSystem;
+
+	std::atomic<int> pending;
+	std::mutex continuationMutex;
+	std::vector<std::pair<JobFunction, JobCounter*>> continuations;
+};
+
+class JobSystem
+{
+public:
+	JobSystem();
+
+	// workerCount 0 means one worker per hardware thread besides the caller
+	void Start(unsigned int workerCount = 0, bool pinThreads = false);
+	void Stop();
+
+	void Run(JobFunction function, JobCounter* counter = nullptr);
+	// Queued once dependency reaches zero, which is how job graphs are chained
+	void RunAfter(JobCounter* dependency, JobFunction function, JobCounter* counter = nullptr);
+	// Runs other jobs on the calling thread until the counter drains
+	void Wait(JobCounter* counter);
+
+	// Splits [0, count) into batches of batchSize (0 picks one), blocks until all are done
+	void ParallelFor(unsigned int count, unsigned int batchSize, const std::function<void(unsigned int, unsigned int)>& body);
+
+	unsigned int GetThreadCount() { return (unsigned int)queues.size(); }
+	unsigned long long GetStealCount() { return stealCount.load(); }
+
+	~JobSystem();
+
+private:
+	struct Job
+	{
+		JobFunction function;
+		JobCounter* counter;
+	};
+
+	// Owner pushes and pops at the bottom, thieves take from the top
+	struct WorkQueue
+	{
+		static const unsigned int CAPACITY = 4096;
+
+		std::atomic_flag lock;
+		// Written under lock, atomic so thieves can peek for work without taking it
+		std::atomic<unsigned int> top;
+		std::atomic<unsigned int> bottom;
+		std::vector<Job> ring;
+
+		WorkQueue();
+	};
+
+	std::vector<WorkQueue*> queues;
+	std::vector<std::thread> workers;
+
+	std::atomic<bool> running;
+	std::atomic<int> queuedJobs;
+	std::atomic<int> sleepingWorkers;
+	std::atomic<unsigned long long> stealCount;
+	std::mutex sleepMutex;
+	std::condition_variable wakeCondition;
+
+	void Push(Job& job);
+	bool Pop(unsigned int queue, Job& job);
+	bool Steal(unsigned int thief, Job& job);
+	bool TryRunOne(unsigned int queue);
+	void Execute(Job& job);
+	void Finish(JobCounter* counter);
+
+	void WorkerLoop(unsigned int index, bool pinThread);
+	unsigned int CurrentQueue();
+};
@@ -0,0 +1,681 @@
+#include "LightBaker.h"
+
+#include <stdio.h>
+#include <math.h>
+#include <algorithm>
+#include <utility>
+
+#include "JobSystem.h"
+#include "Clock.h"
+#include "CpuTrace.h"
+
+const unsigned int LightBaker::MAGIC;
+const unsigned int LightBaker::VERSION;
+constexpr float LightBaker::ABSOLUTE_ERROR;
+constexpr float LightBaker::SAMPLE_INSET;
+constexpr float LightBaker::NORMAL_POWER;
+constexpr float LightBaker::NOISE_SIGMAS;
+
+// Vertices handed to a job at once, a batch traces samplesPerPass paths for each of them
+static const unsigned int VERTEX_BATCH = 16;
+
+static void HashBytes(unsigned long long& hash, const void* data, size_t size)
+{
+	// FNV-1a
+	const unsigned char* bytes = (const unsigned char*)data;
+	for (size_t i = 0; i < size; i++)
+	{
+		hash ^= bytes[i];
+		hash *= 1099511628211ULL;
+	}
+}
+
+// Seed of one path, from which vertex and sample it is, so a bake repeats exactly on any number of threads
+static unsigned int HashSample(unsigned int mesh, unsigned int vertex, unsigned int sample)
+{
+	unsigned int hash = mesh * 0x9E3779B9u ^ vertex * 0x85EBCA6Bu ^ sample * 0xC2B2AE35u;
+	hash ^= hash >> 16;
+	hash *= 0x7FEB352Du;
+	hash ^= hash >> 15;
+	hash *= 0x846CA68Bu;
+	hash ^= hash >> 16;
+	return hash | 1u;
+}
+
+static void AddNeighbour(std::vector<unsigned int>& neighbours, unsigned int vertex)
+{
+	if (std::find(neighbours.begin(), neighbours.end(), vertex) == neighbours.end())
+	{
+		neighbours.push_back(vertex);
+	}
+}
+
+LightBaker::LightBaker()
+{
+	hasDirectionalLight = false;
+
+	rayOffset = 0.0f;
+	sceneSize = 0.0f;
+
+	bakeMs = 0.0;
+	passCount = 0;
+	vertexCount = 0;
+	convergedCount = 0;
+	pathCount = 0;
+	rayCount = 0;
+	fromCache = false;
+}
+
+unsigned int LightBaker::AddMesh(const GLfloat* vertices, unsigned int meshVertexCount, const unsigned int* indices, unsigned int indexCount,
+	const glm::mat4& world)
+{
+	BakeMesh* bakeMesh = new BakeMesh();
+	glm::mat3 normalMatrix = glm::transpose(glm::inverse(glm::mat3(world)));
+
+	bakeMesh->positions.resize(meshVertexCount);
+	bakeMesh->normals.resize(meshVertexCount);
+	for (unsigned int i = 0; i < meshVertexCount; i++)
+	{
+		const GLfloat* vertex = &vertices[i * 8];
+		bakeMesh->positions[i] = glm::vec3(world * glm::vec4(vertex[0], vertex[1], vertex[2], 1.0f));
+		bakeMesh->bounds.Expand(bakeMesh->positions[i]);
+
+		// Model flips the normals for shader.frag, the bake wants them pointing out of the surface again
+		glm::vec3 normal = normalMatrix * -glm::vec3(vertex[5], vertex[6], vertex[7]);
+		float length = glm::length(normal);
+		bakeMesh->normals[i] = length > 0.0f ? normal / length : glm::vec3(0.0f, 1.0f, 0.0f);
+	}
+	bakeMesh->indices.assign(indices, indices + indexCount);
+
+	meshes.push_back(bakeMesh);
+	return (unsigned int)meshes.size() - 1;
+}
+
+void LightBaker::SetDirectionalLight(const DirectionalLight& light)
+{
+	directionalLight = light;
+	hasDirectionalLight = true;
+}
+
+void LightBaker::AddPointLight(const PointLight& light)
+{
+	pointLights.push_back(light);
+}
+
+void LightBaker::AddSpotLight(const SpotLight& light)
+{
+	spotLights.push_back(light);
+}
+
+void LightBaker::Bake(JobSystem* jobs)
+{
+	TRACE_SCOPE("LightBaker::Bake");
+
+	double start = Clock::Now();
+
+	BoundingBox sceneBounds;
+	vertexCount = 0;
+	for (size_t m = 0; m < meshes.size(); m++)
+	{
+		BakeMesh& bakeMesh = *meshes[m];
+		unsigned int count = (unsigned int)bakeMesh.positions.size();
+		if (!bakeMesh.indices.empty())
+		{
+			bakeMesh.bvh.Build(&bakeMesh.positions[0].x, 3, &bakeMesh.indices[0], (unsigned int)bakeMesh.indices.size(), jobs);
+		}
+		sceneBounds.Expand(bakeMesh.bounds);
+
+		std::vector<glm::vec3> centres(count, glm::vec3(0.0f));
+		std::vector<float> weights(count, 0.0f);
+		for (size_t t = 0; t + 2 < bakeMesh.indices.size(); t += 3)
+		{
+			glm::vec3 centre = (bakeMesh.positions[bakeMesh.indices[t]] + bakeMesh.positions[bakeMesh.indices[t + 1]] +
+				bakeMesh.positions[bakeMesh.indices[t + 2]]) / 3.0f;
+			for (unsigned int corner = 0; corner < 3; corner++)
+			{
+				centres[bakeMesh.indices[t + corner]] += centre;
+				weights[bakeMesh.indices[t + corner]] += 1.0f;
+			}
+		}
+		bakeMesh.samplePoints.resize(count);
+		for (unsigned int v = 0; v < count; v++)
+		{
+			glm::vec3 position = bakeMesh.positions[v];
+			bakeMesh.samplePoints[v] = weights[v] > 0.0f ? position + (centres[v] / weights[v] - position) * SAMPLE_INSET : position;
+		}
+
+		bakeMesh.sum.assign(count, glm::vec3(0.0f));
+		bakeMesh.luminanceSquares.assign(count, 0.0f);
+		bakeMesh.samples.assign(count, 0);
+		vertexCount += count;
+	}
+
+	sceneSize = sceneBounds.IsValid() ? glm::length(sceneBounds.max - sceneBounds.min) : 0.0f;
+	rayOffset = std::max(sceneSize * 1e-4f, 1e-5f);
+
+	// One list over all meshes, so a pass splits evenly across the jobs however the meshes are sized
+	std::vector<std::pair<unsigned int, unsigned int>> active;
+	active.reserve(vertexCount);
+	for (unsigned int m = 0; m < meshes.size(); m++)
+	{
+		for (unsigned int v = 0; v < meshes[m]->positions.size(); v++)
+		{
+			active.push_back(std::make_pair(m, v));
+		}
+	}
+
+	passCount = 0;
+	pathCount = 0;
+	rayCount = 0;
+
+	auto samplePass = [this, &active](unsigned int begin, unsigned int end)
+	{
+		for (unsigned int i = begin; i < end; i++)
+		{
+			SampleVertex(active[i].first, active[i].second);
+		}
+	};
+
+	while (!active.empty())
+	{
+		if (jobs)
+		{
+			jobs->ParallelFor((unsigned int)active.size(), VERTEX_BATCH, samplePass);
+		}
+		else
+		{
+			samplePass(0, (unsigned int)active.size());
+		}
+		pathCount += (unsigned long long)active.size() * settings.samplesPerPass;
+		passCount++;
+
+		size_t kept = 0;
+		for (size_t i = 0; i < active.size(); i++)
+		{
+			if (!IsConverged(*meshes[active[i].first], active[i].second))
+			{
+				active[kept++] = active[i];
+			}
+		}
+		active.resize(kept);
+	}
+
+	convergedCount = 0;
+	for (size_t m = 0; m < meshes.size(); m++)
+	{
+		BakeMesh& bakeMesh = *meshes[m];
+		for (size_t v = 0; v < bakeMesh.samples.size(); v++)
+		{
+			if (bakeMesh.samples[v] < settings.maxSamples) convergedCount++;
+		}
+		Denoise(bakeMesh);
+	}
+
+	bakeMs = (Clock::Now() - start) * 1000.0;
+	fromCache = false;
+}
+
+void LightBaker::SampleVertex(unsigned int mesh, unsigned int vertex)
+{
+	BakeMesh& bakeMesh = *meshes[mesh];
+	glm::vec3 point = bakeMesh.samplePoints[vertex];
+	glm::vec3 normal = bakeMesh.normals[vertex];
+
+	glm::vec3 sum(0.0f);
+	float luminanceSquares = 0.0f;
+	unsigned int rays = 0;
+
+	for (unsigned int s = 0; s < settings.samplesPerPass; s++)
+	{
+		unsigned int rng = HashSample(mesh, vertex, bakeMesh.samples[vertex] + s);
+		glm::vec3 estimate = TracePath(point, normal, rng, rays);
+
+		float luminance = Luminance(estimate);
+		sum += estimate;
+		luminanceSquares += luminance * luminance;
+	}
+
+	// Only this job touches the vertex during a pass
+	bakeMesh.sum[vertex] += sum;
+	bakeMesh.luminanceSquares[vertex] += luminanceSquares;
+	bakeMesh.samples[vertex] += settings.samplesPerPass;
+	rayCount.fetch_add(rays, std::memory_order_relaxed);
+}
+
+glm::vec3 LightBaker::TracePath(glm::vec3 point, glm::vec3 normal, unsigned int& rng, unsigned int& rays)
+{
+	glm::vec3 result(0.0f);
+	glm::vec3 throughput(1.0f);
+
+	for (unsigned int bounce = 0; bounce < settings.maxBounces; bounce++)
+	{
+		// Cosine weighted, so the Lambert term and the sampling density cancel out
+		glm::vec3 direction = SampleHemisphere(normal, rng);
+		Ray ray(point + normal * rayOffset, direction);
+
+		RayHit hit;
+		unsigned int mesh = 0;
+		rays++;
+		if (!Intersect(ray, hit, mesh))
+		{
+			result += throughput * settings.skyColour;
+			break;
+		}
+
+		const BakeMesh& hitMesh = *meshes[mesh];
+		unsigned int first = hit.triangle * 3;
+		glm::vec3 hitNormal = hitMesh.normals[hitMesh.indices[first]] * (1.0f - hit.u - hit.v) +
+			hitMesh.normals[hitMesh.indices[first + 1]] * hit.u + hitMesh.normals[hitMesh.indices[first + 2]] * hit.v;
+		float length = glm::length(hitNormal);
+		hitNormal = length > 0.0f ? hitNormal / length : -direction;
+		// Both faces reflect, the one the ray arrived on is lit
+		if (glm::dot(hitNormal, direction) > 0.0f)
+		{
+			hitNormal = -hitNormal;
+		}
+
+		point = ray.origin + direction * hit.distance;
+		normal = hitNormal;
+
+		throughput *= settings.albedo;
+		result += throughput * DirectLight(point, normal, rays);
+	}
+
+	return result;
+}
+
+glm::vec3 LightBaker::DirectLight(glm::vec3 point, glm::vec3 normal, unsigned int& rays)
+{
+	// The same diffuse terms shader.frag adds, but shadowed. Ambient terms are the shader's stand-in for
+	// the bounced light being baked, so they don't bounce themselves
+	glm::vec3 light(0.0f);
+	glm::vec3 origin = point + normal * rayOffset;
+	glm::vec3 toLight;
+	GLfloat distance;
+
+	if (hasDirectionalLight)
+	{
+		glm::vec3 diffuse = directionalLight.GetDiffuse(normal, toLight);
+		if (diffuse.x + diffuse.y + diffuse.z > 0.0f)
+		{
+			rays++;
+			if (!Occluded(Ray(origin, toLight, sceneSize * 2.0f)))
+			{
+				light += diffuse;
+			}
+		}
+	}
+
+	for (size_t i = 0; i < pointLights.size(); i++)
+	{
+		glm::vec3 diffuse = pointLights[i].GetDiffuse(point, normal, toLight, distance);
+		if (diffuse.x + diffuse.y + diffuse.z > 0.0f)
+		{
+			rays++;
+			if (!Occluded(Ray(origin, toLight, distance - rayOffset * 2.0f)))
+			{
+				light += diffuse;
+			}
+		}
+	}
+
+	for (size_t i = 0; i < spotLights.size(); i++)
+	{
+		glm::vec3 diffuse = spotLights[i].GetDiffuse(point, normal, toLight, distance);
+		if (diffuse.x + diffuse.y + diffuse.z > 0.0f)
+		{
+			rays++;
+			if (!Occluded(Ray(origin, toLight, distance - rayOffset * 2.0f)))
+			{
+				light += diffuse;
+			}
+		}
+	}
+
+	return light;
+}
+
+bool LightBaker::Intersect(const Ray& ray, RayHit& hit, unsigned int& mesh)
+{
+	bool found = false;
+	for (unsigned int m = 0; m < meshes.size(); m++)
+	{
+		const BakeMesh& bakeMesh = *meshes[m];
+		if (bakeMesh.bvh.IsBuilt() && bakeMesh.bounds.IntersectRay(ray.origin, ray.direction, std::min(ray.maxDistance, hit.distance)) &&
+			bakeMesh.bvh.Intersect(ray, hit))
+		{
+			mesh = m;
+			found = true;
+		}
+	}
+
+	return found;
+}
+
+bool LightBaker::Occluded(const Ray& ray)
+{
+	for (size_t m = 0; m < meshes.size(); m++)
+	{
+		const BakeMesh& bakeMesh = *meshes[m];
+		if (bakeMesh.bvh.IsBuilt() && bakeMesh.bounds.IntersectRay(ray.origin, ray.direction, ray.maxDistance) &&
+			bakeMesh.bvh.Occluded(ray))
+		{
+			return true;
+		}
+	}
+
+	return false;
+}
+
+float LightBaker::GetError(BakeMesh& bakeMesh, unsigned int vertex)
+{
+	unsigned int samples = bakeMesh.samples[vertex];
+	if (samples < 2)
+	{
+		return 0.0f;
+	}
+
+	float mean = Luminance(bakeMesh.sum[vertex]) / samples;
+	float variance = std::max(bakeMesh.luminanceSquares[vertex] / samples - mean * mean, 0.0f) * samples / (samples - 1);
+	return sqrtf(variance / samples);
+}
+
+bool LightBaker::IsConverged(BakeMesh& bakeMesh, unsigned int vertex)
+{
+	unsigned int samples = bakeMesh.samples[vertex];
+	if (samples >= settings.maxSamples)
+	{
+		return true;
+	}
+	if (samples < settings.minSamples)
+	{
+		return false;
+	}
+
+	float mean = Luminance(bakeMesh.sum[vertex]) / samples;
+	return GetError(bakeMesh, vertex) <= settings.targetError * mean + ABSOLUTE_ERROR;
+}
+
+void LightBaker::Denoise(BakeMesh& bakeMesh)
+{
+	unsigned int count = (unsigned int)bakeMesh.positions.size();
+
+	std::vector<glm::vec3> current(count);
+	std::vector<float> variance(count);
+	for (unsigned int i = 0; i < count; i++)
+	{
+		current[i] = bakeMesh.samples[i] > 0 ? bakeMesh.sum[i] / (float)bakeMesh.samples[i] : glm::vec3(0.0f);
+		float error = GetError(bakeMesh, i);
+		variance[i] = error * error;
+	}
+
+	if (settings.denoisePasses > 0 && count > 0)
+	{
+		// Triangle edges, plus the other vertices at the same spot, which the importer splits at seams
+		std::vector<std::vector<unsigned int>> neighbours(count);
+		for (size_t t = 0; t + 2 < bakeMesh.indices.size(); t += 3)
+		{
+			for (unsigned int corner = 0; corner < 3; corner++)
+			{
+				unsigned int a = bakeMesh.indices[t + corner];
+				unsigned int b = bakeMesh.indices[t + (corner + 1) % 3];
+				AddNeighbour(neighbours[a], b);
+				AddNeighbour(neighbours[b], a);
+			}
+		}
+
+		std::vector<unsigned int> order(count);
+		for (unsigned int i = 0; i < count; i++) order[i] = i;
+		const std::vector<glm::vec3>& positions = bakeMesh.positions;
+		std::sort(order.begin(), order.end(), [&positions](unsigned int a, unsigned int b)
+		{
+			if (positions[a].x != positions[b].x) return positions[a].x < positions[b].x;
+			if (positions[a].y != positions[b].y) return positions[a].y < positions[b].y;
+			return positions[a].z < positions[b].z;
+		});
+		for (unsigned int begin = 0; begin < count;)
+		{
+			unsigned int end = begin + 1;
+			while (end < count && positions[order[end]] == positions[order[begin]]) end++;
+			for (unsigned int a = begin; a < end; a++)
+			{
+				for (unsigned int b = begin; b < end; b++)
+				{
+					if (a != b) AddNeighbour(neighbours[order[a]], order[b]);
+				}
+			}
+			begin = end;
+		}
+
+		std::vector<glm::vec3> next(count);
+		for (unsigned int pass = 0; pass < settings.denoisePasses; pass++)
+		{
+			for (unsigned int i = 0; i < count; i++)
+			{
+				glm::vec3 sum = current[i];
+				float weightSum = 1.0f;
+				float luminance = Luminance(current[i]);
+
+				for (size_t n = 0; n < neighbours[i].size(); n++)
+				{
+					unsigned int j = neighbours[i][n];
+
+					// Differences the noise can explain are averaged away, larger ones are real and kept
+					float difference = Luminance(current[j]) - luminance;
+					float spread = NOISE_SIGMAS * NOISE_SIGMAS * (variance[i] + variance[j]) + 1e-8f;
+					float weight = powf(std::max(glm::dot(bakeMesh.normals[i], bakeMesh.normals[j]), 0.0f), NORMAL_POWER) *
+						expf(-difference * difference / (2.0f * spread));
+
+					sum += current[j] * weight;
+					weightSum += weight;
+				}
+
+				next[i] = sum / weightSum;
+			}
+			current.swap(next);
+		}
+	}
+
+	bakeMesh.light.resize(count * 3);
+	for (unsigned int i = 0; i < count; i++)
+	{
+		bakeMesh.light[i * 3] = current[i].x;
+		bakeMesh.light[i * 3 + 1] = current[i].y;
+		bakeMesh.light[i * 3 + 2] = current[i].z;
+	}
+}
+
+glm::vec3 LightBaker::SampleHemisphere(glm::vec3 normal, unsigned int& rng)
+{
+	float phi = 6.2831853f * NextRandom(rng);
+	float r2 = NextRandom(rng);
+	float r = sqrtf(r2);
+	float x = r * cosf(phi);
+	float y = r * sinf(phi);
+	float z = sqrtf(std::max(1.0f - r2, 0.0f));
+
+	// Orthonormal basis around the normal without a division by zero anywhere (Duff et al.)
+	float sign = normal.z >= 0.0f ? 1.0f : -1.0f;
+	float a = -1.0f / (sign + normal.z);
+	float b = normal.x * normal.y * a;
+	glm::vec3 tangent(1.0f + sign * normal.x * normal.x * a, sign * b, -sign * normal.x);
+	glm::vec3 bitangent(b, sign + normal.y * normal.y * a, -normal.y);
+
+	return tangent * x + bitangent * y + normal * z;
+}
+
+float LightBaker::NextRandom(unsigned int& rng)
+{
+	// xorshift32, top 24 bits into [0, 1)
+	rng ^= rng << 13;
+	rng ^= rng >> 17;
+	rng ^= rng << 5;
+	return (rng >> 8) * (1.0f / 16777216.0f);
+}
+
+unsigned long long LightBaker::GetKey()
+{
+	unsigned long long hash = 14695981039346656037ULL;
+
+	unsigned int version = VERSION;
+	HashBytes(hash, &version, sizeof(version));
+	HashBytes(hash, &settings.samplesPerPass, sizeof(settings.samplesPerPass));
+	HashBytes(hash, &settings.minSamples, sizeof(settings.minSamples));
+	HashBytes(hash, &settings.maxSamples, sizeof(settings.maxSamples));
+	HashBytes(hash, &settings.targetError, sizeof(settings.targetError));
+	HashBytes(hash, &settings.maxBounces, sizeof(settings.maxBounces));
+	HashBytes(hash, &settings.albedo, sizeof(settings.albedo));
+	HashBytes(hash, &settings.skyColour, sizeof(settings.skyColour));
+	HashBytes(hash, &settings.denoisePasses, sizeof(settings.denoisePasses));
+
+	for (size_t m = 0; m < meshes.size(); m++)
+	{
+		const BakeMesh& bakeMesh = *meshes[m];
+		unsigned int count = (unsigned int)bakeMesh.positions.size();
+		HashBytes(hash, &count, sizeof(count));
+		if (count > 0)
+		{
+			HashBytes(hash, &bakeMesh.positions[0], sizeof(glm::vec3) * count);
+			HashBytes(hash, &bakeMesh.normals[0], sizeof(glm::vec3) * count);
+		}
+		if (!bakeMesh.indices.empty())
+		{
+			HashBytes(hash, &bakeMesh.indices[0], sizeof(unsigned int) * bakeMesh.indices.size());
+		}
+	}
+
+	// The light classes hold nothing but floats, their bytes are their parameters
+	HashBytes(hash, &hasDirectionalLight, sizeof(hasDirectionalLight));
+	if (hasDirectionalLight)
+	{
+		HashBytes(hash, &directionalLight, sizeof(directionalLight));
+	}
+	if (!pointLights.empty())
+	{
+		HashBytes(hash, &pointLights[0], sizeof(PointLight) * pointLights.size());
+	}
+	if (!spotLights.empty())
+	{
+		HashBytes(hash, &spotLights[0], sizeof(SpotLight) * spotLights.size());
+	}
+
+	return hash;
+}
+
+bool LightBaker::LoadCache(const char* fileName)
+{
+	FILE* file = fopen(fileName, "rb");
+	if (!file)
+	{
+		return false;
+	}
+
+	unsigned int header[3] = { 0, 0, 0 };
+	unsigned long long key = 0;
+	bool valid = fread(header, sizeof(header), 1, file) == 1 && fread(&key, sizeof(key), 1, file) == 1 &&
+		header[0] == MAGIC && header[1] == VERSION && header[2] == meshes.size() && key == GetKey();
+
+	std::vector<std::vector<GLfloat>> light(meshes.size());
+	for (size_t m = 0; valid && m < meshes.size(); m++)
+	{
+		unsigned int count = 0;
+		valid = fread(&count, sizeof(count), 1, file) == 1 && count == meshes[m]->positions.size();
+		if (valid && count > 0)
+		{
+			light[m].resize(count * 3);
+			valid = fread(&light[m][0], sizeof(GLfloat) * 3, count, file) == count;
+		}
+	}
+	fclose(file);
+
+	if (!valid)
+	{
+		return false;
+	}
+
+	vertexCount = 0;
+	for (size_t m = 0; m < meshes.size(); m++)
+	{
+		meshes[m]->light.swap(light[m]);
+		vertexCount += (unsigned int)meshes[m]->positions.size();
+	}
+	fromCache = true;
+
+	return true;
+}
+
+bool LightBaker::SaveCache(const char* fileName)
+{
+	FILE* file = fopen(fileName, "wb");
+	if (!file)
+	{
+		printf("Failed to write %s!\n", fileName);
+		return false;
+	}
+
+	unsigned int header[3] = { MAGIC, VERSION, (unsigned int)meshes.size() };
+	unsigned long long key = GetKey();
+	fwrite(header, sizeof(header), 1, file);
+	fwrite(&key, sizeof(key), 1, file);
+
+	for (size_t m = 0; m < meshes.size(); m++)
+	{
+		unsigned int count = (unsigned int)meshes[m]->light.size() / 3;
+		fwrite(&count, sizeof(count), 1, file);
+		if (count > 0)
+		{
+			fwrite(&meshes[m]->light[0], sizeof(GLfloat) * 3, count, file);
+		}
+	}
+
+	bool written = ferror(file) == 0;
+	fclose(file);
+
+	return written;
+}
+
+void LightBaker::PrintStats()
+{
+	if (meshes.empty())
+	{
+		return;
+	}
+
+	printf("Light bake, %u meshes, %u vertices\n", (unsigned int)meshes.size(), vertexCount);
+	if (fromCache)
+	{
+		printf("  loaded from the cache\n");
+		return;
+	}
+
+	double seconds = bakeMs / 1000.0;
+	printf("  time:            %8.1f ms, %u passes of %u paths\n", bakeMs, passCount, settings.samplesPerPass);
+	printf("  paths:           %8.1f per vertex, %.2f M rays/s\n", GetPathsPerVertex(),
+		seconds > 0.0 ? rayCount.load() / seconds / 1e6 : 0.0);
+	printf("  converged:       %8.1f%% of vertices before %u paths\n", vertexCount > 0 ? convergedCount * 100.0 / vertexCount : 0.0,
+		settings.maxSamples);
+}
+
+void LightBaker::ClearBaker()
+{
+	for (size_t m = 0; m < meshes.size(); m++)
+	{
+		delete meshes[m];
+	}
+	meshes.clear();
+
+	hasDirectionalLight = false;
+	pointLights.clear();
+	spotLights.clear();
+
+	vertexCount = 0;
+	passCount = 0;
+	pathCount = 0;
+	rayCount = 0;
+	fromCache = false;
+}
+
+LightBaker::~LightBaker()
+{
+	ClearBaker();
+}
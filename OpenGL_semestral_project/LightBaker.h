@@ -0,0 +1,139 @@
+#pragma once
+
+#include <vector>
+#include <atomic>
+
+#include <GL\glew.h>
+#include <glm\glm.hpp>
+
+#include "MeshBvh.h"
+#include "BoundingBox.h"
+#include "DirectionalLight.h"
+#include "PointLight.h"
+#include "SpotLight.h"
+
+class JobSystem;
+
+struct LightBakeSettings
+{
+	// Paths traced for every unconverged vertex in one pass
+	unsigned int samplesPerPass;
+	unsigned int minSamples, maxSamples;
+	// A vertex stops once the standard error of its mean luminance is under this fraction of the mean
+	float targetError;
+	unsigned int maxBounces;
+	// Diffuse reflectance of every surface, the textures only live on the GPU
+	float albedo;
+	// Light of rays that leave the scene
+	glm::vec3 skyColour;
+	// Edge-aware smoothing over neighbouring vertices once converged, 0 keeps the raw estimate
+	unsigned int denoisePasses;
+
+	LightBakeSettings() : samplesPerPass(16), minSamples(64), maxSamples(1024), targetError(0.05f), maxBounces(3),
+		albedo(0.5f), skyColour(0.0f), denoisePasses(2) {}
+};
+
+// Path traces the indirect light of static meshes on the CPU and stores it per vertex. Only light that
+// bounced at least once is baked, shader.frag still adds the direct terms of the same lights on top.
+// Meshes are copied in world space with their own BVHs, so nothing else moves or occludes the bake.
+// Vertices are sampled in passes, and each one drops out once its estimate is tight enough, then the
+// result is smoothed across neighbours with weights from normals and the measured noise
+class LightBaker
+{
+public:
+	static const unsigned int MAGIC = 0x454B4142; // "BAKE"
+	static const unsigned int VERSION = 1;
+
+	LightBaker();
+
+	// Vertices as Mesh takes them, 8 floats each, placed with world. Returns the bake's mesh index
+	unsigned int AddMesh(const GLfloat* vertices, unsigned int meshVertexCount, const unsigned int* indices, unsigned int indexCount,
+		const glm::mat4& world);
+	void SetDirectionalLight(const DirectionalLight& light);
+	void AddPointLight(const PointLight& light);
+	void AddSpotLight(const SpotLight& light);
+	void SetSettings(const LightBakeSettings& bakeSettings) { settings = bakeSettings; }
+
+	// Traces on the jobs when given, otherwise on the calling thread
+	void Bake(JobSystem* jobs = nullptr);
+
+	// Hash of the geometry, lights and settings, a cached bake only loads for the same key
+	unsigned long long GetKey();
+	bool LoadCache(const char* fileName);
+	bool SaveCache(const char* fileName);
+
+	unsigned int GetMeshCount() { return (unsigned int)meshes.size(); }
+	// 3 floats per vertex, filled by Bake or LoadCache
+	const std::vector<GLfloat>& GetBakedLight(unsigned int mesh) { return meshes[mesh]->light; }
+	double GetPathsPerVertex() { return vertexCount > 0 ? (double)pathCount / vertexCount : 0.0; }
+
+	void PrintStats();
+
+	void ClearBaker();
+
+	~LightBaker();
+
+private:
+	// Relative error is meaningless near black, vertices this dark count as converged at this absolute error
+	static constexpr float ABSOLUTE_ERROR = 0.001f;
+	// Vertices are sampled this fraction of the way towards the centre of their triangles, so a vertex on a
+	// seam where another mesh passes through isn't lit from inside that mesh
+	static constexpr float SAMPLE_INSET = 0.05f;
+	// Sharpness of the denoiser's normal weight, neighbours across a hard edge barely count
+	static constexpr float NORMAL_POWER = 16.0f;
+	// Width of the denoiser's luminance weight in standard errors of the two vertices
+	static constexpr float NOISE_SIGMAS = 2.0f;
+
+	struct BakeMesh
+	{
+		std::vector<glm::vec3> positions;
+		// Facing away from the surface, the opposite of what Model imports for shader.frag
+		std::vector<glm::vec3> normals;
+		std::vector<unsigned int> indices;
+		std::vector<glm::vec3> samplePoints;
+		BoundingBox bounds;
+		MeshBvh bvh;
+
+		// Running sums per vertex, of the estimate and of its squared luminance for the error
+		std::vector<glm::vec3> sum;
+		std::vector<float> luminanceSquares;
+		std::vector<unsigned int> samples;
+
+		std::vector<GLfloat> light;
+	};
+
+	LightBakeSettings settings;
+	std::vector<BakeMesh*> meshes;
+
+	bool hasDirectionalLight;
+	DirectionalLight directionalLight;
+	std::vector<PointLight> pointLights;
+	std::vector<SpotLight> spotLights;
+
+	// Rays start this far off their surface, scaled to the scene so they don't hit it again
+	float rayOffset;
+	float sceneSize;
+
+	double bakeMs;
+	unsigned int passCount;
+	unsigned int vertexCount, convergedCount;
+	unsigned long long pathCount;
+	std::atomic<unsigned long long> rayCount;
+	bool fromCache;
+
+	void SampleVertex(unsigned int mesh, unsigned int vertex);
+	glm::vec3 TracePath(glm::vec3 point, glm::vec3 normal, unsigned int& rng, unsigned int& rays);
+	glm::vec3 DirectLight(glm::vec3 point, glm::vec3 normal, unsigned int& rays);
+
+	// Nearest hit across every mesh, mesh receives which one
+	bool Intersect(const Ray& ray, RayHit& hit, unsigned int& mesh);
+	bool Occluded(const Ray& ray);
+
+	bool IsConverged(BakeMesh& bakeMesh, unsigned int vertex);
+	void Denoise(BakeMesh& bakeMesh);
+	// Standard error of the mean luminance
+	static float GetError(BakeMesh& bakeMesh, unsigned int vertex);
+	static float Luminance(glm::vec3 colour) { return glm::dot(colour, glm::vec3(0.2126f, 0.7152f, 0.0722f)); }
+	static glm::vec3 SampleHemisphere(glm::vec3 normal, unsigned int& rng);
+	static float NextRandom(unsigned int& rng);
+};
@@ -0,0 +1,140 @@
+#include "LightCuller.h"
+
+#include <stdio.h>
+#include <algorithm>
+
+// Light lists are indexed with unsigned shorts, anything past this is never selected
+static const unsigned int MAX_LIGHT_INDEX = 0xFFFF;
+
+bool LightSelection::operator==(const LightSelection& other) const
+{
+	if (pointCount != other.pointCount || spotCount != other.spotCount)
+	{
+		return false;
+	}
+
+	for (unsigned int i = 0; i < pointCount; i++)
+	{
+		if (pointLights[i] != other.pointLights[i]) return false;
+	}
+	for (unsigned int i = 0; i < spotCount; i++)
+	{
+		if (spotLights[i] != other.spotLights[i]) return false;
+	}
+
+	return true;
+}
+
+LightCuller::LightCuller()
+{
+	enabled = true;
+
+	selectionCount = 0;
+	pointSum = 0;
+	spotSum = 0;
+	pointInRangeSum = 0;
+	spotInRangeSum = 0;
+	overLimitCount = 0;
+	lastPointCount = 0;
+	lastSpotCount = 0;
+}
+
+template <typename LightType>
+unsigned int LightCuller::RankLights(LightType* lights, unsigned int count, glm::vec3 centre, float radius,
+	unsigned short* chosen, unsigned int maxCount, unsigned int& chosenCount)
+{
+	float influences[MAX_POINT_LIGHTS > MAX_SPOT_LIGHTS ? MAX_POINT_LIGHTS : MAX_SPOT_LIGHTS];
+	unsigned int inRange = 0;
+	chosenCount = 0;
+
+	count = std::min(count, MAX_LIGHT_INDEX + 1);
+	for (unsigned int i = 0; i < count; i++)
+	{
+		float influence = lights[i].GetInfluence(centre, radius);
+		if (influence <= 0.0f)
+		{
+			continue;
+		}
+		inRange++;
+
+		if (chosenCount == maxCount && influence <= influences[chosenCount - 1])
+		{
+			continue;
+		}
+
+		// Insertion into a list of at most a few entries, the weakest one falls off the end
+		unsigned int slot = chosenCount < maxCount ? chosenCount++ : chosenCount - 1;
+		while (slot > 0 && influences[slot - 1] < influence)
+		{
+			influences[slot] = influences[slot - 1];
+			chosen[slot] = chosen[slot - 1];
+			slot--;
+		}
+		influences[slot] = influence;
+		chosen[slot] = (unsigned short)i;
+	}
+
+	// Index order, so draws sharing most of their lights also share most of their uniform slots
+	std::sort(chosen, chosen + chosenCount);
+
+	return inRange;
+}
+
+void LightCuller::SelectLights(PointLight* pointLights, unsigned int pointCount, SpotLight* spotLights, unsigned int spotCount,
+	const BoundingBox& bounds, LightSelection& selection)
+{
+	unsigned int pointInRange, spotInRange;
+	unsigned int chosenPoints, chosenSpots;
+
+	if (enabled && bounds.IsValid())
+	{
+		glm::vec3 centre = bounds.GetCentre();
+		float radius = glm::length(bounds.GetExtents());
+
+		pointInRange = RankLights(pointLights, pointCount, centre, radius, selection.pointLights, MAX_POINT_LIGHTS, chosenPoints);
+		spotInRange = RankLights(spotLights, spotCount, centre, radius, selection.spotLights, MAX_SPOT_LIGHTS, chosenSpots);
+	}
+	else
+	{
+		pointInRange = pointCount;
+		spotInRange = spotCount;
+		chosenPoints = std::min(pointCount, (unsigned int)MAX_POINT_LIGHTS);
+		chosenSpots = std::min(spotCount, (unsigned int)MAX_SPOT_LIGHTS);
+		for (unsigned int i = 0; i < chosenPoints; i++) selection.pointLights[i] = (unsigned short)i;
+		for (unsigned int i = 0; i < chosenSpots; i++) selection.spotLights[i] = (unsigned short)i;
+	}
+
+	selection.pointCount = (unsigned char)chosenPoints;
+	selection.spotCount = (unsigned char)chosenSpots;
+
+	selectionCount++;
+	pointSum += chosenPoints;
+	spotSum += chosenSpots;
+	pointInRangeSum += pointInRange;
+	spotInRangeSum += spotInRange;
+	if (pointInRange > chosenPoints || spotInRange > chosenSpots)
+	{
+		overLimitCount++;
+	}
+	lastPointCount = pointCount;
+	lastSpotCount = spotCount;
+}
+
+void LightCuller::PrintStats()
+{
+	if (selectionCount == 0)
+	{
+		return;
+	}
+
+	printf("Light culling %s, %llu draws\n", enabled ? "on" : "off", selectionCount);
+	printf("  point lights:    %8.2f per draw, %.2f in range, of %u\n", GetMeanPointLights(),
+		(double)pointInRangeSum / selectionCount, lastPointCount);
+	printf("  spot lights:     %8.2f per draw, %.2f in range, of %u\n", GetMeanSpotLights(),
+		(double)spotInRangeSum / selectionCount, lastSpotCount);
+	printf("  over the limit:  %8.1f%% of draws ranked lights out\n", GetOverLimitFraction() * 100.0);
+}
+
+LightCuller::~LightCuller()
+{
+}
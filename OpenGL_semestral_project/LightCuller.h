@@ -0,0 +1,57 @@
+#pragma once
+
+#include "PointLight.h"
+#include "SpotLight.h"
+#include "BoundingBox.h"
+#include "CommonValues.h"
+
+// Lights one draw is shaded with, as indices into the frame's point and spot light lists
+struct LightSelection
+{
+	unsigned char pointCount, spotCount;
+	unsigned short pointLights[MAX_POINT_LIGHTS];
+	unsigned short spotLights[MAX_SPOT_LIGHTS];
+
+	bool operator==(const LightSelection& other) const;
+	bool operator!=(const LightSelection& other) const { return !(*this == other); }
+};
+
+// Picks the lights each draw is shaded with. A light whose range or cone misses the draw's bounding sphere
+// is left out, and when more reach it than the shader has slots for, the ones brightest on the sphere win.
+// Disabled, every draw gets the first lights of each list like a single global upload would
+class LightCuller
+{
+public:
+	LightCuller();
+
+	void SetEnabled(bool enable) { enabled = enable; }
+	bool IsEnabled() { return enabled; }
+
+	void SelectLights(PointLight* pointLights, unsigned int pointCount, SpotLight* spotLights, unsigned int spotCount,
+		const BoundingBox& bounds, LightSelection& selection);
+
+	unsigned long long GetSelectionCount() { return selectionCount; }
+	double GetMeanPointLights() { return selectionCount > 0 ? (double)pointSum / selectionCount : 0.0; }
+	double GetMeanSpotLights() { return selectionCount > 0 ? (double)spotSum / selectionCount : 0.0; }
+	// Selections that had to drop lights in range because the shader was out of slots
+	double GetOverLimitFraction() { return selectionCount > 0 ? (double)overLimitCount / selectionCount : 0.0; }
+
+	void PrintStats();
+
+	~LightCuller();
+
+private:
+	bool enabled;
+
+	unsigned long long selectionCount;
+	unsigned long long pointSum, spotSum;
+	unsigned long long pointInRangeSum, spotInRangeSum;
+	unsigned long long overLimitCount;
+	unsigned int lastPointCount, lastSpotCount;
+
+	// Keeps the maxCount largest influences seen so far in chosen, sorted by influence, and returns
+	// how many lights reached the sphere at all
+	template <typename LightType>
+	static unsigned int RankLights(LightType* lights, unsigned int count, glm::vec3 centre, float radius,
+		unsigned short* chosen, unsigned int maxCount, unsigned int& chosenCount);
+};
@@ -14,10 +14,10 @@ Material::Material(GLfloat sIntensity, GLfloat shine)
 	shininess = shine;
 }
 
-void Material::UseMaterial(GLuint specularIntensityLocation, GLuint shininessLocation)
+void Material::UseMaterial(UniformTable& uniforms)
 {
-	glUniform1f(specularIntensityLocation, specularIntensity);
-	glUniform1f(shininessLocation, shininess);
+	uniforms.SetFloat(Uniforms::MaterialSpecularIntensity, specularIntensity);
+	uniforms.SetFloat(Uniforms::MaterialShininess, shininess);
 }
 
 Material::~Material()
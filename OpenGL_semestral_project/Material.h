@@ -2,13 +2,15 @@
 
 #include <GL\glew.h>
 
+#include "UniformTable.h"
+
 class Material
 {
 public:
 	Material();
 	Material(GLfloat sIntensity, GLfloat shine);
 
-	void UseMaterial(GLuint specularIntensityLocation, GLuint shininessLocation);
+	void UseMaterial(UniformTable& uniforms);
 
 	~Material();
 
@@ -1,71 +1,454 @@
 #include "Mesh.h"
 
+#include <stdio.h>
+#include <string.h>
+#include <vector>
+
+#include "GpuMemory.h"
+
+const unsigned int Mesh::MESH_BUFFER_COUNT;
+
 Mesh::Mesh()
 {
-	VAO = 0;
-	VBO = 0;
+	for (unsigned int i = 0; i < MESH_BUFFER_COUNT; i++)
+	{
+		VAO[i] = 0;
+		VBO[i] = 0;
+		fences[i] = 0;
+	}
 	IBO = 0;
+	skinVBO = 0;
+	bakedVBO = 0;
+	positionVAO = 0;
+	positionVBO = 0;
+	currentBuffer = 0;
 	indexCount = 0;
+
+	usage = MESH_USAGE_STATIC;
+	strategy = MESH_UPDATE_SUBDATA;
+	vertexBytes = 0;
+	indexBytes = 0;
+
+	vertexAllocation = GpuMemory::NO_ALLOCATION;
+	indexAllocation = GpuMemory::NO_ALLOCATION;
+	skinAllocation = GpuMemory::NO_ALLOCATION;
+	bakedAllocation = GpuMemory::NO_ALLOCATION;
+	positionAllocation = GpuMemory::NO_ALLOCATION;
 }
 
-void Mesh::CreateMesh(GLfloat* vertices, unsigned int* indices, unsigned int numOfVertices, unsigned int numOfIndices)
+void Mesh::CreateMesh(GLfloat* vertices, unsigned int* indices, unsigned int numOfVertices, unsigned int numOfIndices,
+	MeshUsage meshUsage, MeshUpdateStrategy updateStrategy)
 {
 	indexCount = numOfIndices;
+	usage = meshUsage;
+	strategy = updateStrategy;
+	currentBuffer = 0;
 
-	glGenVertexArrays(1, &VAO);
-	glBindVertexArray(VAO);
+	indexBytes = sizeof(indices[0]) * numOfIndices;
+	vertexBytes = sizeof(vertices[0]) * numOfVertices;
 
 	glGenBuffers(1, &IBO);
-	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, IBO);
-	glBufferData(GL_ELEMENT_ARRAY_BUFFER, sizeof(indices[0]) * numOfIndices, indices, GL_STATIC_DRAW);
+	glBindBuffer(GL_COPY_WRITE_BUFFER, IBO);
+	glBufferData(GL_COPY_WRITE_BUFFER, indexBytes, indices, GetUsageHint());
+
+	glGenBuffers(GetBufferCount(), VBO);
+	for (unsigned int i = 0; i < GetBufferCount(); i++)
+	{
+		glBindBuffer(GL_COPY_WRITE_BUFFER, VBO[i]);
+		glBufferData(GL_COPY_WRITE_BUFFER, vertexBytes, vertices, GetUsageHint());
+	}
+	glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+
+	indexAllocation = GpuMemory::Allocate(GPU_MEMORY_MESH_INDEX, indexBytes);
+	vertexAllocation = GpuMemory::Allocate(GPU_MEMORY_MESH_VERTEX, vertexBytes * GetBufferCount());
+
+	glGenVertexArrays(GetBufferCount(), VAO);
+	SetupAttributes();
+}
+
+void Mesh::SetupAttributes()
+{
+	for (unsigned int i = 0; i < GetBufferCount(); i++)
+	{
+		glBindVertexArray(VAO[i]);
+		glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, IBO);
+		glBindBuffer(GL_ARRAY_BUFFER, VBO[i]);
+
+		glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(GLfloat) * 8, 0);
+		glEnableVertexAttribArray(0);
+		glVertexAttribPointer(1, 2, GL_FLOAT, GL_FALSE, sizeof(GLfloat) * 8, (void*)(sizeof(GLfloat) * 3));
+		glEnableVertexAttribArray(1);
+		glVertexAttribPointer(2, 3, GL_FLOAT, GL_FALSE, sizeof(GLfloat) * 8, (void*)(sizeof(GLfloat) * 5));
+		glEnableVertexAttribArray(2);
+
+		glBindVertexArray(0);
+		glBindBuffer(GL_ARRAY_BUFFER, 0);
+		glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
+	}
+}
+
+void Mesh::SetSkinning(const unsigned char* joints, const unsigned char* weights, unsigned int vertexCount)
+{
+	std::vector<unsigned char> interleaved(vertexCount * 8);
+	for (unsigned int i = 0; i < vertexCount; i++)
+	{
+		memcpy(&interleaved[i * 8], &joints[i * 4], 4);
+		memcpy(&interleaved[i * 8 + 4], &weights[i * 4], 4);
+	}
+
+	if (skinVBO == 0)
+	{
+		glGenBuffers(1, &skinVBO);
+		skinAllocation = GpuMemory::Allocate(GPU_MEMORY_MESH_VERTEX, interleaved.size());
+	}
+	else
+	{
+		GpuMemory::Resize(skinAllocation, interleaved.size());
+	}
+
+	glBindBuffer(GL_ARRAY_BUFFER, skinVBO);
+	glBufferData(GL_ARRAY_BUFFER, interleaved.size(), &interleaved[0], GL_STATIC_DRAW);
+
+	// Shared by every copy of the vertex buffer, skinning data never changes with the positions
+	for (unsigned int i = 0; i < GetBufferCount(); i++)
+	{
+		glBindVertexArray(VAO[i]);
+		glVertexAttribIPointer(4, 4, GL_UNSIGNED_BYTE, 8, 0);
+		glEnableVertexAttribArray(4);
+		glVertexAttribPointer(5, 4, GL_UNSIGNED_BYTE, GL_TRUE, 8, (void*)4);
+		glEnableVertexAttribArray(5);
+	}
+
+	glBindVertexArray(0);
+	glBindBuffer(GL_ARRAY_BUFFER, 0);
+}
+
+void Mesh::SetBakedLight(const GLfloat* light, unsigned int vertexCount)
+{
+	GLsizeiptr size = sizeof(GLfloat) * 3 * vertexCount;
 
-	glGenBuffers(1, &VBO);
-	glBindBuffer(GL_ARRAY_BUFFER, VBO);
-	glBufferData(GL_ARRAY_BUFFER, sizeof(vertices[0]) * numOfVertices, vertices, GL_STATIC_DRAW);
+	if (bakedVBO == 0)
+	{
+		glGenBuffers(1, &bakedVBO);
+		bakedAllocation = GpuMemory::Allocate(GPU_MEMORY_MESH_VERTEX, size);
+	}
+	else
+	{
+		GpuMemory::Resize(bakedAllocation, size);
+	}
+
+	glBindBuffer(GL_ARRAY_BUFFER, bakedVBO);
+	glBufferData(GL_ARRAY_BUFFER, size, light, GL_STATIC_DRAW);
+
+	for (unsigned int i = 0; i < GetBufferCount(); i++)
+	{
+		glBindVertexArray(VAO[i]);
+		glVertexAttribPointer(6, 3, GL_FLOAT, GL_FALSE, sizeof(GLfloat) * 3, 0);
+		glEnableVertexAttribArray(6);
+	}
+
+	glBindVertexArray(0);
+	glBindBuffer(GL_ARRAY_BUFFER, 0);
+}
+
+void Mesh::CreatePositionStream(const GLfloat* vertices, unsigned int numOfVertices)
+{
+	if (usage != MESH_USAGE_STATIC || strategy == MESH_UPDATE_MULTI_BUFFER)
+	{
+		return;
+	}
+
+	unsigned int vertexCount = numOfVertices / 8;
+	std::vector<GLfloat> positions(vertexCount * 3);
+	for (unsigned int i = 0; i < vertexCount; i++)
+	{
+		memcpy(&positions[i * 3], &vertices[i * 8], sizeof(GLfloat) * 3);
+	}
+
+	GLsizeiptr size = sizeof(GLfloat) * positions.size();
+	if (positionVBO == 0)
+	{
+		glGenBuffers(1, &positionVBO);
+		glGenVertexArrays(1, &positionVAO);
+		positionAllocation = GpuMemory::Allocate(GPU_MEMORY_MESH_VERTEX, size);
+	}
+	else
+	{
+		GpuMemory::Resize(positionAllocation, size);
+	}
 
-	glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(vertices[0]) * 8, 0);
+	glBindVertexArray(positionVAO);
+	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, IBO);
+	glBindBuffer(GL_ARRAY_BUFFER, positionVBO);
+	glBufferData(GL_ARRAY_BUFFER, size, positions.empty() ? nullptr : &positions[0], GL_STATIC_DRAW);
+	glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(GLfloat) * 3, 0);
 	glEnableVertexAttribArray(0);
-	glVertexAttribPointer(1, 2, GL_FLOAT, GL_FALSE, sizeof(vertices[0]) * 8, (void*)(sizeof(vertices[0]) * 3));
-	glEnableVertexAttribArray(1);
-	glVertexAttribPointer(2, 3, GL_FLOAT, GL_FALSE, sizeof(vertices[0]) * 8, (void*)(sizeof(vertices[0]) * 5));
-	glEnableVertexAttribArray(2);
 
+	glBindVertexArray(0);
 	glBindBuffer(GL_ARRAY_BUFFER, 0);
 	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
+}
 
-	glBindVertexArray(0);
+void Mesh::ClearPositionStream()
+{
+	if (positionVAO != 0)
+	{
+		glDeleteVertexArrays(1, &positionVAO);
+		positionVAO = 0;
+	}
+
+	if (positionVBO != 0)
+	{
+		glDeleteBuffers(1, &positionVBO);
+		positionVBO = 0;
+	}
+
+	GpuMemory::Free(positionAllocation);
+}
+
+void Mesh::UpdateVertices(const GLfloat* vertices, unsigned int numOfVertices)
+{
+	GLsizeiptr size = sizeof(vertices[0]) * numOfVertices;
+
+	if (size != vertexBytes)
+	{
+		// New size: respecify every copy, nothing in flight can depend on the old stores
+		for (unsigned int i = 0; i < GetBufferCount(); i++)
+		{
+			glBindBuffer(GL_COPY_WRITE_BUFFER, VBO[i]);
+			glBufferData(GL_COPY_WRITE_BUFFER, size, vertices, GetUsageHint());
+		}
+		glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+
+		vertexBytes = size;
+		GpuMemory::Resize(vertexAllocation, vertexBytes * GetBufferCount());
+		if (positionVBO != 0)
+		{
+			CreatePositionStream(vertices, numOfVertices);
+		}
+		return;
+	}
+
+	if (positionVBO != 0)
+	{
+		CreatePositionStream(vertices, numOfVertices);
+	}
+
+	if (strategy == MESH_UPDATE_MULTI_BUFFER)
+	{
+		NextBuffer(false);
+	}
+
+	glBindBuffer(GL_COPY_WRITE_BUFFER, VBO[currentBuffer]);
+	WriteBuffer(GL_COPY_WRITE_BUFFER, 0, size, vertices, true);
+	glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+}
+
+void Mesh::UpdateIndices(const unsigned int* indices, unsigned int numOfIndices)
+{
+	GLsizeiptr size = sizeof(indices[0]) * numOfIndices;
+	indexCount = numOfIndices;
+
+	glBindBuffer(GL_COPY_WRITE_BUFFER, IBO);
+	if (size != indexBytes)
+	{
+		glBufferData(GL_COPY_WRITE_BUFFER, size, indices, GetUsageHint());
+		indexBytes = size;
+		GpuMemory::Resize(indexAllocation, indexBytes);
+	}
+	else
+	{
+		WriteBuffer(GL_COPY_WRITE_BUFFER, 0, size, indices, true);
+	}
+	glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+}
+
+void Mesh::UpdateVertexRange(const GLfloat* vertices, unsigned int first, unsigned int count)
+{
+	GLintptr offset = sizeof(vertices[0]) * first;
+	GLsizeiptr size = sizeof(vertices[0]) * count;
+	if (count == 0 || offset + size > vertexBytes)
+	{
+		printf("Mesh vertex update [%u, %u) is out of range\n", first, first + count);
+		return;
+	}
+
+	// A range needn't start or end on a vertex, so the positions can't be patched from it alone
+	ClearPositionStream();
+
+	if (strategy == MESH_UPDATE_MULTI_BUFFER)
+	{
+		NextBuffer(true);
+	}
+
+	glBindBuffer(GL_COPY_WRITE_BUFFER, VBO[currentBuffer]);
+	WriteBuffer(GL_COPY_WRITE_BUFFER, offset, size, vertices, size == vertexBytes);
+	glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+}
+
+void Mesh::UpdateIndexRange(const unsigned int* indices, unsigned int first, unsigned int count)
+{
+	GLintptr offset = sizeof(indices[0]) * first;
+	GLsizeiptr size = sizeof(indices[0]) * count;
+	if (count == 0 || offset + size > indexBytes)
+	{
+		printf("Mesh index update [%u, %u) is out of range\n", first, first + count);
+		return;
+	}
+
+	glBindBuffer(GL_COPY_WRITE_BUFFER, IBO);
+	WriteBuffer(GL_COPY_WRITE_BUFFER, offset, size, indices, size == indexBytes);
+	glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+}
+
+void Mesh::NextBuffer(bool keepContents)
+{
+	unsigned int previous = currentBuffer;
+
+	// Everything drawn from the current copy so far has been submitted, fence it before moving on
+	if (fences[previous])
+	{
+		glDeleteSync(fences[previous]);
+	}
+	fences[previous] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+
+	currentBuffer = (currentBuffer + 1) % MESH_BUFFER_COUNT;
+
+	if (fences[currentBuffer])
+	{
+		GLenum result;
+		do
+		{
+			result = glClientWaitSync(fences[currentBuffer], GL_SYNC_FLUSH_COMMANDS_BIT, 1000000000);
+		} while (result == GL_TIMEOUT_EXPIRED);
+
+		glDeleteSync(fences[currentBuffer]);
+		fences[currentBuffer] = 0;
+	}
+
+	if (keepContents)
+	{
+		// A partial update only brings the changed range, the rest comes from the newest copy
+		glBindBuffer(GL_COPY_READ_BUFFER, VBO[previous]);
+		glBindBuffer(GL_COPY_WRITE_BUFFER, VBO[currentBuffer]);
+		glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, 0, 0, vertexBytes);
+		glBindBuffer(GL_COPY_READ_BUFFER, 0);
+		glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+	}
+}
+
+void Mesh::WriteBuffer(GLenum target, GLintptr offset, GLsizeiptr size, const void* data, bool whole)
+{
+	if (strategy == MESH_UPDATE_ORPHAN && whole)
+	{
+		glBufferData(target, size, nullptr, GetUsageHint());
+		glBufferSubData(target, 0, size, data);
+	}
+	else if (strategy == MESH_UPDATE_MAP_RANGE)
+	{
+		GLbitfield access = GL_MAP_WRITE_BIT | (whole ? GL_MAP_INVALIDATE_BUFFER_BIT : GL_MAP_INVALIDATE_RANGE_BIT);
+		void* mapped = glMapBufferRange(target, offset, size, access);
+		if (!mapped)
+		{
+			glBufferSubData(target, offset, size, data);
+			return;
+		}
+
+		memcpy(mapped, data, size);
+		if (!glUnmapBuffer(target))
+		{
+			// Store got corrupted while mapped (mode switch and such), write it again
+			glBufferSubData(target, offset, size, data);
+		}
+	}
+	else
+	{
+		glBufferSubData(target, offset, size, data);
+	}
+}
+
+GLenum Mesh::GetUsageHint()
+{
+	switch (usage)
+	{
+	case MESH_USAGE_DYNAMIC: return GL_DYNAMIC_DRAW;
+	case MESH_USAGE_STREAM: return GL_STREAM_DRAW;
+	default: return GL_STATIC_DRAW;
+	}
+}
+
+const char* Mesh::GetStrategyName(MeshUpdateStrategy updateStrategy)
+{
+	static const char* names[MESH_UPDATE_COUNT] = { "sub-data", "orphan", "map range", "multi-buffer" };
+	return updateStrategy < MESH_UPDATE_COUNT ? names[updateStrategy] : "unknown";
 }
 
 void Mesh::RenderMesh()
 {
-	glBindVertexArray(VAO);
-	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, IBO);
+	glBindVertexArray(VAO[currentBuffer]);
+	glDrawElements(GL_TRIANGLES, indexCount, GL_UNSIGNED_INT, 0);
+	glBindVertexArray(0);
+}
+
+void Mesh::RenderDepth()
+{
+	glBindVertexArray(positionVAO != 0 ? positionVAO : VAO[currentBuffer]);
 	glDrawElements(GL_TRIANGLES, indexCount, GL_UNSIGNED_INT, 0);
-	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
 	glBindVertexArray(0);
 }
 
 void Mesh::ClearMesh()
 {
+	ClearPositionStream();
+
+	for (unsigned int i = 0; i < MESH_BUFFER_COUNT; i++)
+	{
+		if (fences[i])
+		{
+			glDeleteSync(fences[i]);
+			fences[i] = 0;
+		}
+
+		if (VBO[i] != 0)
+		{
+			glDeleteBuffers(1, &VBO[i]);
+			VBO[i] = 0;
+		}
+
+		if (VAO[i] != 0)
+		{
+			glDeleteVertexArrays(1, &VAO[i]);
+			VAO[i] = 0;
+		}
+	}
+
 	if (IBO != 0)
 	{
 		glDeleteBuffers(1, &IBO);
 		IBO = 0;
 	}
 
-	if (VBO != 0)
+	if (skinVBO != 0)
 	{
-		glDeleteBuffers(1, &VBO);
-		VBO = 0;
+		glDeleteBuffers(1, &skinVBO);
+		skinVBO = 0;
 	}
 
-	if (VAO != 0)
+	if (bakedVBO != 0)
 	{
-		glDeleteVertexArrays(1, &VAO);
-		VAO = 0;
+		glDeleteBuffers(1, &bakedVBO);
+		bakedVBO = 0;
 	}
 
+	GpuMemory::Free(vertexAllocation);
+	GpuMemory::Free(indexAllocation);
+	GpuMemory::Free(skinAllocation);
+	GpuMemory::Free(bakedAllocation);
+
+	currentBuffer = 0;
 	indexCount = 0;
+	vertexBytes = 0;
+	indexBytes = 0;
 }
 
 
@@ -2,19 +2,93 @@
 
 #include <GL\glew.h>
 
+// Buffer usage hint given to glBufferData
+enum MeshUsage
+{
+	MESH_USAGE_STATIC,
+	MESH_USAGE_DYNAMIC,
+	MESH_USAGE_STREAM
+};
+
+// How Update* calls reach the GPU
+enum MeshUpdateStrategy
+{
+	// glBufferSubData into the one buffer, may wait for draws still reading it
+	MESH_UPDATE_SUBDATA,
+	// Full updates respecify the store with glBufferData(nullptr) first, partial ones fall back to sub-data
+	MESH_UPDATE_ORPHAN,
+	// glMapBufferRange with the range (or whole buffer) invalidated, then a memcpy
+	MESH_UPDATE_MAP_RANGE,
+	// MESH_BUFFER_COUNT vertex buffers written round robin, each fenced before it's reused.
+	// Indices use sub-data
+	MESH_UPDATE_MULTI_BUFFER,
+	MESH_UPDATE_COUNT
+};
+
 class Mesh
 {
 public:
+	static const unsigned int MESH_BUFFER_COUNT = 3;
+
 	Mesh();
 
-	void CreateMesh(GLfloat* vertices, unsigned int* indices, unsigned int numOfVertices, unsigned int numOfIndices);
+	// Counts are in floats and indices, 8 floats per vertex
+	void CreateMesh(GLfloat* vertices, unsigned int* indices, unsigned int numOfVertices, unsigned int numOfIndices,
+		MeshUsage usage = MESH_USAGE_STATIC, MeshUpdateStrategy strategy = MESH_UPDATE_SUBDATA);
+
+	// Second vertex stream for GPU skinning, 4 joint indices then 4 unorm weights per vertex. Joints index
+	// the mesh's own bones, shader.vert (USE_SKINNING) reads them at locations 4 and 5
+	void SetSkinning(const unsigned char* joints, const unsigned char* weights, unsigned int vertexCount);
+	bool IsSkinned() { return skinVBO != 0; }
+
+	// Indirect light LightBaker computed for every vertex, 3 floats each. shader.vert (USE_BAKED_LIGHTING)
+	// reads it at location 6, meshes without one read 0
+	void SetBakedLight(const GLfloat* light, unsigned int vertexCount);
+	bool HasBakedLight() { return bakedVBO != 0; }
+
+	// Tightly packed copy of the positions for depth-only passes, 12 bytes a vertex instead of 32.
+	// Static meshes only, the others keep drawing depth from their interleaved buffer
+	void CreatePositionStream(const GLfloat* vertices, unsigned int numOfVertices);
+	bool HasPositionStream() { return positionVBO != 0; }
+
+	// Replace everything, the buffers are reallocated when the size changes
+	void UpdateVertices(const GLfloat* vertices, unsigned int numOfVertices);
+	void UpdateIndices(const unsigned int* indices, unsigned int numOfIndices);
+	// Replace [first, first + count) with data, which holds only that range
+	void UpdateVertexRange(const GLfloat* vertices, unsigned int first, unsigned int count);
+	void UpdateIndexRange(const unsigned int* indices, unsigned int first, unsigned int count);
+
 	void RenderMesh();
+	// Binds only position data when there is a position stream
+	void RenderDepth();
 	void ClearMesh();
 
+	GLsizei GetIndexCount() { return indexCount; }
+	MeshUpdateStrategy GetUpdateStrategy() { return strategy; }
+	static const char* GetStrategyName(MeshUpdateStrategy strategy);
+
 	~Mesh();
 
 private:
-	GLuint VAO, VBO, IBO;
+	GLuint VAO[MESH_BUFFER_COUNT], VBO[MESH_BUFFER_COUNT], IBO;
+	GLuint skinVBO;
+	GLuint bakedVBO;
+	GLuint positionVAO, positionVBO;
+	GLsync fences[MESH_BUFFER_COUNT];
+	unsigned int currentBuffer;
 	GLsizei indexCount;
-};
 
+	MeshUsage usage;
+	MeshUpdateStrategy strategy;
+	GLsizeiptr vertexBytes, indexBytes;
+
+	unsigned int vertexAllocation, indexAllocation, skinAllocation, bakedAllocation, positionAllocation;
+
+	unsigned int GetBufferCount() { return strategy == MESH_UPDATE_MULTI_BUFFER ? MESH_BUFFER_COUNT : 1; }
+	GLenum GetUsageHint();
+	void SetupAttributes();
+	void ClearPositionStream();
+	// Moves to the next vertex buffer, waits for draws still reading it and copies the latest contents when keepContents
+	void NextBuffer(bool keepContents);
+	void WriteBuffer(GLenum target, GLintptr offset, GLsizeiptr size, const void* data, bool whole);
+};
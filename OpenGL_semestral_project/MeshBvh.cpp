@@ -0,0 +1,550 @@
+#include "MeshBvh.h"
+
+#include <stdio.h>
+#include <math.h>
+#include <algorithm>
+
+#include "CpuTrace.h"
+#include "JobSystem.h"
+
+#if defined(_M_X64) || defined(_M_IX86) || defined(__SSE2__)
+#define BVH_SIMD 1
+#include <xmmintrin.h>
+#endif
+
+const unsigned int MeshBvh::BIN_COUNT;
+const unsigned int MeshBvh::MAX_LEAF_TRIANGLES;
+const unsigned int MeshBvh::PARALLEL_THRESHOLD;
+const unsigned int MeshBvh::LEAF_BIT;
+const unsigned int MeshBvh::EMPTY_CHILD;
+const unsigned int MeshBvh::MAX_BUILD_DEPTH;
+const unsigned int MeshBvh::STACK_SIZE;
+
+// Relative cost of visiting a node against testing one triangle
+static const float TRAVERSAL_COST = 1.0f;
+
+static float SurfaceArea(const BoundingBox& box)
+{
+	glm::vec3 size = box.max - box.min;
+	return 2.0f * (size.x * size.y + size.y * size.z + size.z * size.x);
+}
+
+static glm::vec3 VertexPosition(const float* vertices, unsigned int vertexStride, unsigned int index)
+{
+	const float* position = vertices + (size_t)index * vertexStride;
+	return glm::vec3(position[0], position[1], position[2]);
+}
+
+MeshBvh::MeshBvh()
+{
+}
+
+void MeshBvh::Build(const float* vertices, unsigned int vertexStride, const unsigned int* indices, unsigned int indexCount, JobSystem* jobs)
+{
+	TRACE_SCOPE("MeshBvh::Build");
+
+	ClearBvh();
+
+	unsigned int triangleCount = indexCount / 3;
+	if (triangleCount == 0)
+	{
+		return;
+	}
+
+	if (triangleCount >= ((~LEAF_BIT) >> 4))
+	{
+		printf("Mesh has too many triangles for a BVH: %u\n", triangleCount);
+		return;
+	}
+
+	std::vector<BuildReference> references(triangleCount);
+	triangles.resize(triangleCount);
+
+	auto prepare = [&](unsigned int begin, unsigned int end)
+	{
+		for (unsigned int i = begin; i < end; i++)
+		{
+			glm::vec3 p0 = VertexPosition(vertices, vertexStride, indices[i * 3]);
+			glm::vec3 p1 = VertexPosition(vertices, vertexStride, indices[i * 3 + 1]);
+			glm::vec3 p2 = VertexPosition(vertices, vertexStride, indices[i * 3 + 2]);
+
+			BuildReference& reference = references[i];
+			reference.bounds = BoundingBox(glm::min(p0, glm::min(p1, p2)), glm::max(p0, glm::max(p1, p2)));
+			reference.centroid = reference.bounds.GetCentre();
+			reference.index = i;
+
+			Triangle& triangle = triangles[i];
+			triangle.v0 = p0;
+			triangle.edge1 = p1 - p0;
+			triangle.edge2 = p2 - p0;
+			triangle.index = i;
+		}
+	};
+
+	if (jobs)
+	{
+		jobs->ParallelFor(triangleCount, 0, prepare);
+	}
+	else
+	{
+		prepare(0, triangleCount);
+	}
+
+	BuildNode* root = BuildRange(references, 0, triangleCount, 0, jobs);
+	bounds = root->bounds;
+
+	// Leaves point at runs of triangles, lay them out in build order
+	std::vector<Triangle> ordered(triangleCount);
+	for (unsigned int i = 0; i < triangleCount; i++)
+	{
+		ordered[i] = triangles[references[i].index];
+	}
+	triangles.swap(ordered);
+
+	nodes.reserve(triangleCount / 8 + 1);
+	Flatten(root);
+	DeleteBuildNode(root);
+}
+
+MeshBvh::BuildNode* MeshBvh::BuildRange(std::vector<BuildReference>& references, unsigned int first, unsigned int count, unsigned int depth, JobSystem* jobs)
+{
+	BuildNode* node = new BuildNode();
+	node->children[0] = nullptr;
+	node->children[1] = nullptr;
+	node->first = first;
+	node->count = count;
+
+	BoundingBox centroidBounds;
+	for (unsigned int i = first; i < first + count; i++)
+	{
+		node->bounds.Expand(references[i].bounds);
+		centroidBounds.Expand(references[i].centroid);
+	}
+
+	unsigned int leftCount = count > 1 ? Partition(references, first, count, centroidBounds, SurfaceArea(node->bounds), depth) : 0;
+	if (leftCount == 0)
+	{
+		return node;
+	}
+
+	if (jobs && count > PARALLEL_THRESHOLD)
+	{
+		// Halves work on disjoint ranges of references, the left one goes to another thread
+		JobCounter counter;
+		jobs->Run([&]() { node->children[0] = BuildRange(references, first, leftCount, depth + 1, jobs); }, &counter);
+		node->children[1] = BuildRange(references, first + leftCount, count - leftCount, depth + 1, jobs);
+		jobs->Wait(&counter);
+	}
+	else
+	{
+		node->children[0] = BuildRange(references, first, leftCount, depth + 1, jobs);
+		node->children[1] = BuildRange(references, first + leftCount, count - leftCount, depth + 1, jobs);
+	}
+
+	return node;
+}
+
+unsigned int MeshBvh::Partition(std::vector<BuildReference>& references, unsigned int first, unsigned int count, const BoundingBox& centroidBounds, float parentArea, unsigned int depth)
+{
+	glm::vec3 extent = centroidBounds.max - centroidBounds.min;
+
+	int bestAxis = -1;
+	unsigned int bestBin = 0;
+	float bestCost = FLT_MAX;
+
+	if (depth < MAX_BUILD_DEPTH)
+	{
+		// All three axes binned in one pass over the references
+		BoundingBox binBounds[3][BIN_COUNT];
+		unsigned int binCounts[3][BIN_COUNT] = {};
+		glm::vec3 scale;
+		for (int axis = 0; axis < 3; axis++)
+		{
+			scale[axis] = extent[axis] > 0.0f ? BIN_COUNT / extent[axis] : 0.0f;
+		}
+
+		for (unsigned int i = first; i < first + count; i++)
+		{
+			const BuildReference& reference = references[i];
+			for (int axis = 0; axis < 3; axis++)
+			{
+				unsigned int bin = (unsigned int)((reference.centroid[axis] - centroidBounds.min[axis]) * scale[axis]);
+				if (bin >= BIN_COUNT) bin = BIN_COUNT - 1;
+
+				BoundingBox& box = binBounds[axis][bin];
+				box.min = glm::min(box.min, reference.bounds.min);
+				box.max = glm::max(box.max, reference.bounds.max);
+				binCounts[axis][bin]++;
+			}
+		}
+
+		for (int axis = 0; axis < 3; axis++)
+		{
+			if (extent[axis] <= 0.0f)
+			{
+				continue;
+			}
+
+			// Right side of every split plane swept in from the end, the left side swept in alongside the costs
+			float rightArea[BIN_COUNT];
+			unsigned int rightCount[BIN_COUNT];
+			BoundingBox side;
+			unsigned int sideCount = 0;
+			for (unsigned int bin = BIN_COUNT - 1; bin > 0; bin--)
+			{
+				side.Expand(binBounds[axis][bin]);
+				sideCount += binCounts[axis][bin];
+				rightArea[bin] = sideCount ? SurfaceArea(side) : 0.0f;
+				rightCount[bin] = sideCount;
+			}
+
+			side = BoundingBox();
+			sideCount = 0;
+			for (unsigned int bin = 0; bin + 1 < BIN_COUNT; bin++)
+			{
+				side.Expand(binBounds[axis][bin]);
+				sideCount += binCounts[axis][bin];
+				if (sideCount == 0 || rightCount[bin + 1] == 0)
+				{
+					continue;
+				}
+
+				float cost = sideCount * SurfaceArea(side) + rightCount[bin + 1] * rightArea[bin + 1];
+				if (cost < bestCost)
+				{
+					bestCost = cost;
+					bestAxis = axis;
+					bestBin = bin;
+				}
+			}
+		}
+	}
+
+	if (bestAxis >= 0)
+	{
+		float splitCost = TRAVERSAL_COST + bestCost / parentArea;
+		if (count <= MAX_LEAF_TRIANGLES && (parentArea <= 0.0f || splitCost >= (float)count))
+		{
+			return 0;
+		}
+
+		float scale = BIN_COUNT / extent[bestAxis];
+		float minimum = centroidBounds.min[bestAxis];
+		auto middle = std::partition(references.begin() + first, references.begin() + first + count,
+			[=](const BuildReference& reference)
+			{
+				unsigned int bin = (unsigned int)((reference.centroid[bestAxis] - minimum) * scale);
+				return (bin >= BIN_COUNT ? BIN_COUNT - 1 : bin) <= bestBin;
+			});
+
+		return (unsigned int)(middle - (references.begin() + first));
+	}
+
+	if (count <= MAX_LEAF_TRIANGLES)
+	{
+		return 0;
+	}
+
+	// Centroids all coincide, or the tree got too deep: halve along the longest axis
+	int axis = extent.x > extent.y ? (extent.x > extent.z ? 0 : 2) : (extent.y > extent.z ? 1 : 2);
+	unsigned int half = count / 2;
+	std::nth_element(references.begin() + first, references.begin() + first + half, references.begin() + first + count,
+		[axis](const BuildReference& a, const BuildReference& b) { return a.centroid[axis] < b.centroid[axis]; });
+
+	return half;
+}
+
+unsigned int MeshBvh::Flatten(const BuildNode* node)
+{
+	unsigned int index = (unsigned int)nodes.size();
+	nodes.push_back(Node());
+
+	const BuildNode* lanes[4];
+	unsigned int laneCount = 0;
+	if (!node->children[0])
+	{
+		// Only a root can be a leaf here
+		lanes[laneCount++] = node;
+	}
+	else
+	{
+		lanes[laneCount++] = node->children[0];
+		lanes[laneCount++] = node->children[1];
+	}
+
+	// Pull grandchildren up until the four lanes are used, the largest boxes first as rays hit them most
+	while (laneCount < 4)
+	{
+		int widest = -1;
+		float widestArea = -1.0f;
+		for (unsigned int lane = 0; lane < laneCount; lane++)
+		{
+			if (lanes[lane]->children[0] && SurfaceArea(lanes[lane]->bounds) > widestArea)
+			{
+				widest = lane;
+				widestArea = SurfaceArea(lanes[lane]->bounds);
+			}
+		}
+
+		if (widest < 0)
+		{
+			break;
+		}
+
+		const BuildNode* opened = lanes[widest];
+		lanes[widest] = opened->children[0];
+		lanes[laneCount++] = opened->children[1];
+	}
+
+	unsigned int children[4];
+	for (unsigned int lane = 0; lane < 4; lane++)
+	{
+		if (lane >= laneCount)
+		{
+			children[lane] = EMPTY_CHILD;
+		}
+		else if (!lanes[lane]->children[0])
+		{
+			children[lane] = LEAF_BIT | (lanes[lane]->first << 4) | lanes[lane]->count;
+		}
+		else
+		{
+			children[lane] = Flatten(lanes[lane]);
+		}
+	}
+
+	// Recursion grew the vector, only index it now
+	Node& flat = nodes[index];
+	for (unsigned int lane = 0; lane < 4; lane++)
+	{
+		BoundingBox box = lane < laneCount ? lanes[lane]->bounds : BoundingBox();
+		flat.minX[lane] = box.min.x;
+		flat.minY[lane] = box.min.y;
+		flat.minZ[lane] = box.min.z;
+		flat.maxX[lane] = box.max.x;
+		flat.maxY[lane] = box.max.y;
+		flat.maxZ[lane] = box.max.z;
+		flat.children[lane] = children[lane];
+	}
+
+	return index;
+}
+
+void MeshBvh::DeleteBuildNode(BuildNode* node)
+{
+	if (node->children[0])
+	{
+		DeleteBuildNode(node->children[0]);
+		DeleteBuildNode(node->children[1]);
+	}
+	delete node;
+}
+
+int MeshBvh::IntersectLanes(const Node& node, const glm::vec3& origin, const glm::vec3& inverse, float closest, float* entry)
+{
+#ifdef BVH_SIMD
+	__m128 originX = _mm_set1_ps(origin.x), originY = _mm_set1_ps(origin.y), originZ = _mm_set1_ps(origin.z);
+	__m128 inverseX = _mm_set1_ps(inverse.x), inverseY = _mm_set1_ps(inverse.y), inverseZ = _mm_set1_ps(inverse.z);
+
+	__m128 x0 = _mm_mul_ps(_mm_sub_ps(_mm_loadu_ps(node.minX), originX), inverseX);
+	__m128 x1 = _mm_mul_ps(_mm_sub_ps(_mm_loadu_ps(node.maxX), originX), inverseX);
+	__m128 y0 = _mm_mul_ps(_mm_sub_ps(_mm_loadu_ps(node.minY), originY), inverseY);
+	__m128 y1 = _mm_mul_ps(_mm_sub_ps(_mm_loadu_ps(node.maxY), originY), inverseY);
+	__m128 z0 = _mm_mul_ps(_mm_sub_ps(_mm_loadu_ps(node.minZ), originZ), inverseZ);
+	__m128 z1 = _mm_mul_ps(_mm_sub_ps(_mm_loadu_ps(node.maxZ), originZ), inverseZ);
+
+	__m128 enter = _mm_max_ps(_mm_max_ps(_mm_min_ps(x0, x1), _mm_min_ps(y0, y1)), _mm_max_ps(_mm_min_ps(z0, z1), _mm_setzero_ps()));
+	__m128 exit = _mm_min_ps(_mm_min_ps(_mm_max_ps(x0, x1), _mm_max_ps(y0, y1)), _mm_min_ps(_mm_max_ps(z0, z1), _mm_set1_ps(closest)));
+
+	_mm_storeu_ps(entry, enter);
+	return _mm_movemask_ps(_mm_cmple_ps(enter, exit));
+#else
+	int mask = 0;
+	for (int lane = 0; lane < 4; lane++)
+	{
+		float x0 = (node.minX[lane] - origin.x) * inverse.x, x1 = (node.maxX[lane] - origin.x) * inverse.x;
+		float y0 = (node.minY[lane] - origin.y) * inverse.y, y1 = (node.maxY[lane] - origin.y) * inverse.y;
+		float z0 = (node.minZ[lane] - origin.z) * inverse.z, z1 = (node.maxZ[lane] - origin.z) * inverse.z;
+
+		float enter = std::max(std::max(std::min(x0, x1), std::min(y0, y1)), std::max(std::min(z0, z1), 0.0f));
+		float exit = std::min(std::min(std::max(x0, x1), std::max(y0, y1)), std::min(std::max(z0, z1), closest));
+
+		entry[lane] = enter;
+		if (enter <= exit) mask |= 1 << lane;
+	}
+	return mask;
+#endif
+}
+
+bool MeshBvh::Traverse(const Ray& ray, RayHit& hit, bool anyHit) const
+{
+	if (nodes.empty())
+	{
+		return false;
+	}
+
+	// Finite stand-ins for 1/0 keep the slab products free of NaN
+	glm::vec3 inverse;
+	for (int axis = 0; axis < 3; axis++)
+	{
+		float d = ray.direction[axis];
+		inverse[axis] = 1.0f / (fabsf(d) > 1e-20f ? d : (d < 0.0f ? -1e-20f : 1e-20f));
+	}
+
+	float closest = std::min(hit.distance, ray.maxDistance);
+	bool found = false;
+
+	unsigned int stack[STACK_SIZE];
+	float stackEntry[STACK_SIZE];
+	unsigned int top = 0;
+	stack[top] = 0;
+	stackEntry[top] = 0.0f;
+	top++;
+
+	while (top > 0)
+	{
+		top--;
+		if (stackEntry[top] > closest)
+		{
+			continue;
+		}
+
+		unsigned int item = stack[top];
+		if (item & LEAF_BIT)
+		{
+			unsigned int begin = (item & ~LEAF_BIT) >> 4;
+			unsigned int end = begin + (item & 15);
+
+			// Moller-Trumbore
+			for (unsigned int i = begin; i < end; i++)
+			{
+				const Triangle& triangle = triangles[i];
+
+				glm::vec3 p = glm::cross(ray.direction, triangle.edge2);
+				float determinant = glm::dot(triangle.edge1, p);
+				if (fabsf(determinant) < 1e-12f)
+				{
+					continue;
+				}
+
+				float inverseDeterminant = 1.0f / determinant;
+				glm::vec3 toOrigin = ray.origin - triangle.v0;
+				float u = glm::dot(toOrigin, p) * inverseDeterminant;
+				if (u < 0.0f || u > 1.0f)
+				{
+					continue;
+				}
+
+				glm::vec3 q = glm::cross(toOrigin, triangle.edge1);
+				float v = glm::dot(ray.direction, q) * inverseDeterminant;
+				if (v < 0.0f || u + v > 1.0f)
+				{
+					continue;
+				}
+
+				float distance = glm::dot(triangle.edge2, q) * inverseDeterminant;
+				if (distance < 0.0f || distance >= closest)
+				{
+					continue;
+				}
+
+				closest = distance;
+				hit.distance = distance;
+				hit.u = u;
+				hit.v = v;
+				hit.triangle = triangle.index;
+				found = true;
+
+				if (anyHit)
+				{
+					return true;
+				}
+			}
+			continue;
+		}
+
+		const Node& node = nodes[item];
+		float entry[4];
+		int mask = IntersectLanes(node, ray.origin, inverse, closest, entry);
+
+		// Sorted far to near so the nearest child is popped first and shrinks closest for the rest
+		unsigned int order[4];
+		unsigned int hitCount = 0;
+		for (unsigned int lane = 0; lane < 4; lane++)
+		{
+			if (!(mask & (1 << lane)) || node.children[lane] == EMPTY_CHILD)
+			{
+				continue;
+			}
+
+			unsigned int slot = hitCount++;
+			while (slot > 0 && entry[order[slot - 1]] < entry[lane])
+			{
+				order[slot] = order[slot - 1];
+				slot--;
+			}
+			order[slot] = lane;
+		}
+
+		for (unsigned int i = 0; i < hitCount; i++)
+		{
+			stack[top] = node.children[order[i]];
+			stackEntry[top] = entry[order[i]];
+			top++;
+		}
+	}
+
+	return found;
+}
+
+bool MeshBvh::Intersect(const Ray& ray, RayHit& hit) const
+{
+	return Traverse(ray, hit, false);
+}
+
+bool MeshBvh::Occluded(const Ray& ray) const
+{
+	RayHit hit;
+	return Traverse(ray, hit, true);
+}
+
+unsigned int MeshBvh::IntersectBatch(const Ray* rays, RayHit* hits, unsigned int count, JobSystem* jobs) const
+{
+	auto trace = [&](unsigned int begin, unsigned int end)
+	{
+		for (unsigned int i = begin; i < end; i++)
+		{
+			Traverse(rays[i], hits[i], false);
+		}
+	};
+
+	if (jobs)
+	{
+		jobs->ParallelFor(count, 256, trace);
+	}
+	else
+	{
+		trace(0, count);
+	}
+
+	unsigned int hitCount = 0;
+	for (unsigned int i = 0; i < count; i++)
+	{
+		if (hits[i].IsHit()) hitCount++;
+	}
+	return hitCount;
+}
+
+void MeshBvh::ClearBvh()
+{
+	nodes.clear();
+	nodes.shrink_to_fit();
+	triangles.clear();
+	triangles.shrink_to_fit();
+	bounds = BoundingBox();
+}
+
+MeshBvh::~MeshBvh()
+{
+	ClearBvh();
+}
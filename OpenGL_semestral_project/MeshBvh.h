@@ -0,0 +1,126 @@
+#pragma once
+
+#include <vector>
+#include <float.h>
+
+#include <glm\glm.hpp>
+
+#include "BoundingBox.h"
+
+class JobSystem;
+
+const unsigned int NO_HIT = 0xFFFFFFFF;
+
+struct Ray
+{
+	glm::vec3 origin;
+	// Hit distances are in multiples of its length, normalise it to get world units
+	glm::vec3 direction;
+	float maxDistance;
+
+	Ray() : origin(0.0f, 0.0f, 0.0f), direction(0.0f, 0.0f, -1.0f), maxDistance(FLT_MAX) {}
+	Ray(glm::vec3 rayOrigin, glm::vec3 rayDirection, float rayMaxDistance = FLT_MAX)
+		: origin(rayOrigin), direction(rayDirection), maxDistance(rayMaxDistance) {}
+};
+
+// Nearest hit so far. Queries only take hits closer than distance, so one RayHit carries across meshes
+struct RayHit
+{
+	float distance;
+	// Barycentrics of the triangle's second and third vertex, the first weighs 1 - u - v
+	float u, v;
+	unsigned int triangle;
+	// Filled by Model::Raycast
+	unsigned int mesh;
+	unsigned int node;
+
+	RayHit() : distance(FLT_MAX), u(0.0f), v(0.0f), triangle(NO_HIT), mesh(NO_HIT), node(NO_HIT) {}
+
+	bool IsHit() const { return triangle != NO_HIT; }
+};
+
+// Triangle BVH of one mesh for ray casts on the CPU. Built with binned SAH, then collapsed into 4-wide
+// nodes whose child boxes are tested together (SSE where the target has it). Triangles are copied in
+// as vertex + two edges, the GPU buffers of the mesh are never read back
+class MeshBvh
+{
+public:
+	static const unsigned int BIN_COUNT = 16;
+	static const unsigned int MAX_LEAF_TRIANGLES = 8;
+	// Binary subtrees with more triangles than this are built as separate jobs
+	static const unsigned int PARALLEL_THRESHOLD = 8192;
+
+	MeshBvh();
+
+	// vertexStride is in floats, positions are the first three of every vertex
+	void Build(const float* vertices, unsigned int vertexStride, const unsigned int* indices, unsigned int indexCount, JobSystem* jobs = nullptr);
+
+	// Nearest triangle within ray.maxDistance closer than hit.distance, fills triangle, u, v and distance.
+	// Both faces count
+	bool Intersect(const Ray& ray, RayHit& hit) const;
+	// Any triangle within ray.maxDistance, stops at the first one. For line of sight checks
+	bool Occluded(const Ray& ray) const;
+	// Independent closest hit queries, split across the jobs when given. Returns how many hit
+	unsigned int IntersectBatch(const Ray* rays, RayHit* hits, unsigned int count, JobSystem* jobs = nullptr) const;
+
+	bool IsBuilt() const { return !nodes.empty(); }
+	unsigned int GetTriangleCount() const { return (unsigned int)triangles.size(); }
+	unsigned int GetNodeCount() const { return (unsigned int)nodes.size(); }
+	size_t GetMemoryBytes() const { return nodes.size() * sizeof(Node) + triangles.size() * sizeof(Triangle); }
+	const BoundingBox& GetBounds() const { return bounds; }
+
+	void ClearBvh();
+
+	~MeshBvh();
+
+private:
+	// Child slots: inner node index, or LEAF_BIT | first triangle << 4 | triangle count
+	static const unsigned int LEAF_BIT = 0x80000000;
+	static const unsigned int EMPTY_CHILD = 0xFFFFFFFF;
+	// Deeper binary builds fall back to median splits so traversal stacks stay bounded
+	static const unsigned int MAX_BUILD_DEPTH = 64;
+	// Every popped node pushes at most three more than it takes off
+	static const unsigned int STACK_SIZE = 3 * (MAX_BUILD_DEPTH + 32) + 4;
+
+	struct Node
+	{
+		// Child boxes as structure of arrays, one lane per child
+		float minX[4], minY[4], minZ[4];
+		float maxX[4], maxY[4], maxZ[4];
+		unsigned int children[4];
+	};
+
+	struct Triangle
+	{
+		glm::vec3 v0, edge1, edge2;
+		unsigned int index;
+	};
+
+	struct BuildReference
+	{
+		BoundingBox bounds;
+		glm::vec3 centroid;
+		unsigned int index;
+	};
+
+	// Binary tree the SAH build produces, freed once it's collapsed into nodes
+	struct BuildNode
+	{
+		BoundingBox bounds;
+		BuildNode* children[2];
+		unsigned int first, count;
+	};
+
+	std::vector<Node> nodes;
+	std::vector<Triangle> triangles;
+	BoundingBox bounds;
+
+	BuildNode* BuildRange(std::vector<BuildReference>& references, unsigned int first, unsigned int count, unsigned int depth, JobSystem* jobs);
+	unsigned int Partition(std::vector<BuildReference>& references, unsigned int first, unsigned int count, const BoundingBox& centroidBounds, float parentArea, unsigned int depth);
+	unsigned int Flatten(const BuildNode* node);
+	static void DeleteBuildNode(BuildNode* node);
+
+	bool Traverse(const Ray& ray, RayHit& hit, bool anyHit) const;
+	// Bit per child lane whose box the ray enters before closest, entry receives the entry distances
+	static int IntersectLanes(const Node& node, const glm::vec3& origin, const glm::vec3& inverse, float closest, float* entry);
+};
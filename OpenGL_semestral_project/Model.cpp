@@ -1,28 +1,176 @@
 #include "Model.h"
 
+#include <unordered_map>
+
+#include <glm\gtc\matrix_transform.hpp>
+
+#include "CommonValues.h"
+#include "CpuTrace.h"
+#include "GpuMemory.h"
+#include "TextureStreamer.h"
+
 Model::Model()
 {
+	hierarchyDirty = false;
+	boundsVersion = 0;
+	importFlags = MODEL_IMPORT_DEFAULT;
+
+	skeleton = nullptr;
+
+	transformStore = nullptr;
 }
 
 void Model::RenderModel()
 {
 	for (size_t i = 0; i < meshList.size(); i++)
 	{
-		unsigned int materialIndex = meshToTex[i];
+		UseMeshTexture((unsigned int)i, nullptr);
+		meshList[i]->RenderMesh();
+	}
+}
+
+unsigned int Model::RenderModel(UniformTable& uniforms, const Frustum& frustum, const glm::mat4& objectWorld, unsigned int nodeBase)
+{
+	UpdateHierarchy();
+
+	unsigned int meshesDrawn = 0;
+
+	for (unsigned int i = 0; i < nodes.size();)
+	{
+		if (!frustum.TestBox(nodeBounds[i].Transform(objectWorld)))
+		{
+			i = nodes[i].subtreeEnd;
+			continue;
+		}
+
+		if (nodes[i].meshBegin != nodes[i].meshEnd)
+		{
+			uniforms.SetInt(Uniforms::TransformIndex, GetNodeTransform(nodeBase, i));
+			RenderNodeMeshes(i, &uniforms);
+			meshesDrawn += nodes[i].meshEnd - nodes[i].meshBegin;
+		}
+
+		i++;
+	}
+
+	return meshesDrawn;
+}
+
+void Model::CollectVisibleNodes(const Frustum& frustum, const glm::mat4& objectWorld, std::vector<unsigned int>& visibleNodes)
+{
+	UpdateHierarchy();
+
+	for (unsigned int i = 0; i < nodes.size();)
+	{
+		if (!frustum.TestBox(nodeBounds[i].Transform(objectWorld)))
+		{
+			i = nodes[i].subtreeEnd;
+			continue;
+		}
+
+		if (nodes[i].meshBegin != nodes[i].meshEnd)
+		{
+			visibleNodes.push_back(i);
+		}
+
+		i++;
+	}
+}
+
+void Model::RenderNode(unsigned int node, GpuProfiler* profiler, UniformTable* uniforms, unsigned int boneBase)
+{
+	RenderNodeMeshes(node, uniforms, profiler, boneBase);
+}
+
+void Model::RenderNodeDepth(unsigned int node)
+{
+	for (unsigned int i = nodes[node].meshBegin; i < nodes[node].meshEnd; i++)
+	{
+		meshList[i]->RenderDepth();
+	}
+}
+
+unsigned int Model::GetNodeTriangleCount(unsigned int node)
+{
+	unsigned int triangles = 0;
+	for (unsigned int i = nodes[node].meshBegin; i < nodes[node].meshEnd; i++)
+	{
+		triangles += meshList[i]->GetIndexCount() / 3;
+	}
+	return triangles;
+}
+
+BoundingBox Model::GetNodeWorldBounds(unsigned int node, const glm::mat4& objectWorld)
+{
+	return nodeBounds[node].Transform(objectWorld);
+}
 
+void Model::RequestNodeTextures(unsigned int node, float screenPixels, TextureStreamer& streamer)
+{
+	for (unsigned int i = nodes[node].meshBegin; i < nodes[node].meshEnd; i++)
+	{
+		unsigned int materialIndex = meshToTex[i];
 		if (materialIndex < textureList.size() && textureList[materialIndex])
 		{
-			textureList[materialIndex]->UseTexture();
+			streamer.RequestLevel(textureList[materialIndex], screenPixels);
 		}
+	}
+}
 
+void Model::RenderNodeMeshes(unsigned int node, UniformTable* uniforms, GpuProfiler* profiler, unsigned int boneBase)
+{
+	for (unsigned int i = nodes[node].meshBegin; i < nodes[node].meshEnd; i++)
+	{
+		GpuProfileScope meshScope(profiler, "Mesh", i);
+
+		if (boneBase != NO_BONE_PALETTE && uniforms)
+		{
+			uniforms->SetInt(Uniforms::BoneBase, meshBoneFirst[i] >= 0 ? (GLint)boneBase + meshBoneFirst[i] : -1);
+		}
+
+		UseMeshTexture(i, uniforms);
 		meshList[i]->RenderMesh();
 	}
 }
 
-void Model::LoadModel(const std::string& fileName)
+void Model::UseMeshTexture(unsigned int mesh, UniformTable* uniforms)
+{
+	if (!meshArray.empty())
+	{
+		// Same array for most meshes of a model, then only the layer uniform changes
+		textureArrays[meshArray[mesh]]->UseArray(TEXTURE_ARRAY_TEXTURE_UNIT);
+		if (uniforms)
+		{
+			uniforms->SetInt(Uniforms::TextureLayer, meshLayer[mesh]);
+		}
+		return;
+	}
+
+	if (uniforms)
+	{
+		uniforms->SetInt(Uniforms::TextureLayer, -1);
+	}
+
+	unsigned int materialIndex = meshToTex[mesh];
+
+	if (materialIndex < textureList.size() && textureList[materialIndex])
+	{
+		textureList[materialIndex]->UseTexture();
+	}
+}
+
+void Model::LoadModel(const std::string& fileName, TextureStreamer* streamer, unsigned int flags, JobSystem* jobs)
 {
+	TRACE_SCOPE("Model::LoadModel");
+
 	Assimp::Importer importer;
-	const aiScene* scene = importer.ReadFile(fileName, aiProcess_Triangulate | aiProcess_FlipUVs | aiProcess_GenSmoothNormals | aiProcess_JoinIdenticalVertices);
+	const aiScene* scene;
+	{
+		TRACE_SCOPE("Assimp::ReadFile");
+		// Skinned meshes come out with at most 4 weights per vertex and few enough bones for 8-bit joint indices
+		scene = importer.ReadFile(fileName, aiProcess_Triangulate | aiProcess_FlipUVs | aiProcess_GenSmoothNormals | aiProcess_JoinIdenticalVertices |
+			aiProcess_LimitBoneWeights | aiProcess_SplitByBoneCount);
+	}
 
 	if (!scene)
 	{
@@ -30,32 +178,288 @@ void Model::LoadModel(const std::string& fileName)
 		return;
 	}
 
-	LoadNode(scene->mRootNode, scene);
+	size_t nameBegin = fileName.find_last_of("/\\");
+	nameBegin = nameBegin == std::string::npos ? 0 : nameBegin + 1;
+	name = fileName.substr(nameBegin, fileName.find_last_of('.') - nameBegin);
+
+	GpuMemoryOwner memoryOwner(name.c_str(), fileName.c_str());
+	importFlags = flags;
 
-	LoadMaterials(scene);
+	LoadNode(scene->mRootNode, scene, TransformStore::NO_PARENT, jobs);
+	if (!meshSkins.empty())
+	{
+		LoadSkeleton();
+		LoadAnimations(scene);
+	}
+
+	nodeWorld.assign(nodes.size(), glm::mat4(1.0f));
+	nodeBounds.assign(nodes.size(), BoundingBox());
+	nodeDirty.assign(nodes.size(), 1);
+	hierarchyDirty = true;
+	UpdateHierarchy();
+
+	if (importFlags & MODEL_IMPORT_TEXTURE_ARRAYS)
+	{
+		LoadMaterialArrays(scene);
+	}
+	else
+	{
+		LoadMaterials(scene, streamer);
+	}
 }
 
-void Model::LoadNode(aiNode* node, const aiScene* scene)
+void Model::LoadNode(aiNode* node, const aiScene* scene, unsigned int parent, JobSystem* jobs)
 {
+	unsigned int index = (unsigned int)nodes.size();
+
+	aiVector3D scaling, position;
+	aiQuaternion rotation;
+	node->mTransformation.Decompose(scaling, rotation, position);
+
+	ModelNode entry;
+	entry.parent = parent;
+	entry.subtreeEnd = index + 1;
+	entry.meshBegin = (unsigned int)meshList.size();
+	entry.meshEnd = entry.meshBegin;
+	nodes.push_back(entry);
+
+	nodeNames.push_back(node->mName.C_Str());
+	nodePosition.push_back(glm::vec3(position.x, position.y, position.z));
+	nodeRotation.push_back(glm::quat(rotation.w, rotation.x, rotation.y, rotation.z));
+	nodeScale.push_back(glm::vec3(scaling.x, scaling.y, scaling.z));
+
 	for (size_t i = 0; i < node->mNumMeshes; i++)
 	{
-		LoadMesh(scene->mMeshes[node->mMeshes[i]], scene);
+		LoadMesh(scene->mMeshes[node->mMeshes[i]], index, jobs);
 	}
+	nodes[index].meshEnd = (unsigned int)meshList.size();
 
 	for (size_t i = 0; i < node->mNumChildren; i++)
 	{
-		LoadNode(node->mChildren[i], scene);
+		LoadNode(node->mChildren[i], scene, index, jobs);
+	}
+	nodes[index].subtreeEnd = (unsigned int)nodes.size();
+}
+
+int Model::FindNode(const std::string& name)
+{
+	for (size_t i = 0; i < nodeNames.size(); i++)
+	{
+		if (nodeNames[i] == name)
+		{
+			return (int)i;
+		}
+	}
+
+	return -1;
+}
+
+void Model::SetNodeTransform(unsigned int node, glm::vec3 position, glm::quat rotation, glm::vec3 scale)
+{
+	nodePosition[node] = position;
+	nodeRotation[node] = rotation;
+	nodeScale[node] = scale;
+
+	nodeDirty[node] = 1;
+	hierarchyDirty = true;
+
+	// The hierarchy is shared, so every renderable's copy of the node moves with it
+	for (size_t i = 0; i < nodeBases.size(); i++)
+	{
+		transformStore->SetPosition(GetNodeTransform(nodeBases[i], node), position);
+		transformStore->SetRotation(GetNodeTransform(nodeBases[i], node), rotation);
+		transformStore->SetScale(GetNodeTransform(nodeBases[i], node), scale);
+	}
+}
+
+void Model::UpdateHierarchy()
+{
+	TRACE_SCOPE("Model::UpdateHierarchy");
+
+	if (!hierarchyDirty)
+	{
+		return;
+	}
+
+	for (unsigned int i = 0; i < nodes.size();)
+	{
+		if (nodeDirty[i])
+		{
+			UpdateSubtree(i);
+			i = nodes[i].subtreeEnd;
+		}
+		else
+		{
+			i++;
+		}
+	}
+
+	hierarchyDirty = false;
+	boundsVersion++;
+}
+
+void Model::UpdateSubtree(unsigned int node)
+{
+	unsigned int end = nodes[node].subtreeEnd;
+
+	// Pre-order means every parent in the range is finished before its children
+	for (unsigned int i = node; i < end; i++)
+	{
+		glm::mat4 local = glm::translate(glm::mat4(1.0f), nodePosition[i]) * glm::mat4_cast(nodeRotation[i]);
+		local = glm::scale(local, nodeScale[i]);
+
+		unsigned int parent = nodes[i].parent;
+		nodeWorld[i] = parent == TransformStore::NO_PARENT ? local : nodeWorld[parent] * local;
+		nodeDirty[i] = 0;
+	}
+
+	// Bounds go the other way, children before parents, then up through the untouched ancestors
+	for (unsigned int i = end; i > node; i--)
+	{
+		UpdateNodeBounds(i - 1);
+	}
+
+	for (unsigned int parent = nodes[node].parent; parent != TransformStore::NO_PARENT; parent = nodes[parent].parent)
+	{
+		UpdateNodeBounds(parent);
+	}
+}
+
+void Model::UpdateNodeBounds(unsigned int node)
+{
+	BoundingBox bounds;
+
+	for (unsigned int i = nodes[node].meshBegin; i < nodes[node].meshEnd; i++)
+	{
+		bounds.Expand(meshBounds[i].Transform(nodeWorld[node]));
+	}
+
+	for (unsigned int child = node + 1; child < nodes[node].subtreeEnd; child = nodes[child].subtreeEnd)
+	{
+		bounds.Expand(nodeBounds[child]);
+	}
+
+	nodeBounds[node] = bounds;
+}
+
+BoundingBox Model::GetBounds()
+{
+	if (nodes.empty())
+	{
+		return BoundingBox();
+	}
+
+	UpdateHierarchy();
+	return nodeBounds[0];
+}
+
+bool Model::Raycast(const Ray& ray, const glm::mat4& objectWorld, RayHit& hit)
+{
+	UpdateHierarchy();
+
+	bool found = false;
+
+	for (unsigned int i = 0; i < nodes.size();)
+	{
+		if (!nodeBounds[i].Transform(objectWorld).IntersectRay(ray.origin, ray.direction, glm::min(hit.distance, ray.maxDistance)))
+		{
+			i = nodes[i].subtreeEnd;
+			continue;
+		}
+
+		if (nodes[i].meshBegin != nodes[i].meshEnd)
+		{
+			// An affine transform keeps distances along the ray, so hits need no converting back
+			glm::mat4 toLocal = glm::inverse(objectWorld * nodeWorld[i]);
+			Ray localRay(glm::vec3(toLocal * glm::vec4(ray.origin, 1.0f)), glm::vec3(toLocal * glm::vec4(ray.direction, 0.0f)), ray.maxDistance);
+
+			for (unsigned int mesh = nodes[i].meshBegin; mesh < nodes[i].meshEnd; mesh++)
+			{
+				if (meshBvhs[mesh]->Intersect(localRay, hit))
+				{
+					hit.mesh = mesh;
+					hit.node = i;
+					found = true;
+				}
+			}
+		}
+
+		i++;
+	}
+
+	return found;
+}
+
+bool Model::Occluded(const Ray& ray, const glm::mat4& objectWorld)
+{
+	UpdateHierarchy();
+
+	for (unsigned int i = 0; i < nodes.size();)
+	{
+		if (!nodeBounds[i].Transform(objectWorld).IntersectRay(ray.origin, ray.direction, ray.maxDistance))
+		{
+			i = nodes[i].subtreeEnd;
+			continue;
+		}
+
+		if (nodes[i].meshBegin != nodes[i].meshEnd)
+		{
+			glm::mat4 toLocal = glm::inverse(objectWorld * nodeWorld[i]);
+			Ray localRay(glm::vec3(toLocal * glm::vec4(ray.origin, 1.0f)), glm::vec3(toLocal * glm::vec4(ray.direction, 0.0f)), ray.maxDistance);
+
+			for (unsigned int mesh = nodes[i].meshBegin; mesh < nodes[i].meshEnd; mesh++)
+			{
+				if (meshBvhs[mesh]->Occluded(localRay))
+				{
+					return true;
+				}
+			}
+		}
+
+		i++;
+	}
+
+	return false;
+}
+
+unsigned int Model::CreateNodeTransforms(TransformStore* store, unsigned int objectTransform)
+{
+	transformStore = store;
+
+	unsigned int nodeBase = TransformStore::NO_PARENT;
+	for (unsigned int i = 0; i < nodes.size(); i++)
+	{
+		unsigned int parent = nodes[i].parent == TransformStore::NO_PARENT ? objectTransform : GetNodeTransform(nodeBase, nodes[i].parent);
+		unsigned int id = store->CreateTransform(parent);
+		if (i == 0)
+		{
+			nodeBase = id;
+		}
+
+		store->SetPosition(id, nodePosition[i]);
+		store->SetRotation(id, nodeRotation[i]);
+		store->SetScale(id, nodeScale[i]);
+	}
+
+	if (nodeBase != TransformStore::NO_PARENT)
+	{
+		nodeBases.push_back(nodeBase);
 	}
+	return nodeBase;
 }
 
-void Model::LoadMesh(aiMesh* mesh, const aiScene* scene)
+void Model::LoadMesh(aiMesh* mesh, unsigned int node, JobSystem* jobs)
 {
+	TRACE_SCOPE("Model::LoadMesh");
+
 	std::vector<GLfloat> vertices;
 	std::vector<unsigned int> indices;
+	BoundingBox bounds;
 
 	for (size_t i = 0; i < mesh->mNumVertices; i++)
 	{
 		vertices.insert(vertices.end(), { mesh->mVertices[i].x, mesh->mVertices[i].y, mesh->mVertices[i].z });
+		bounds.Expand(glm::vec3(mesh->mVertices[i].x, mesh->mVertices[i].y, mesh->mVertices[i].z));
 		if (mesh->mTextureCoords[0])
 		{
 			vertices.insert(vertices.end(), { mesh->mTextureCoords[0][i].x, mesh->mTextureCoords[0][i].y });
@@ -77,12 +481,225 @@ void Model::LoadMesh(aiMesh* mesh, const aiScene* scene)
 
 	Mesh* newMesh = new Mesh();
 	newMesh->CreateMesh(&vertices[0], &indices[0], vertices.size(), indices.size());
+
+	if (mesh->HasBones() && mesh->mNumBones <= 256)
+	{
+		LoadMeshSkin(mesh, newMesh, node, bounds);
+	}
+	else if (mesh->HasBones())
+	{
+		printf("Mesh %s of %s has %u bones, more than 8-bit joints address. Drawn in its bind pose\n", mesh->mName.C_Str(), name.c_str(), mesh->mNumBones);
+	}
+
+	// Skinned positions move on the GPU, those meshes keep drawing depth from their own buffers
+	if ((importFlags & MODEL_IMPORT_POSITION_STREAM) && !newMesh->IsSkinned())
+	{
+		newMesh->CreatePositionStream(&vertices[0], vertices.size());
+	}
+
 	meshList.push_back(newMesh);
 	meshToTex.push_back(mesh->mMaterialIndex);
+	meshBounds.push_back(bounds);
+
+	MeshBvh* bvh = new MeshBvh();
+	bvh->Build(&vertices[0], 8, &indices[0], (unsigned int)indices.size(), jobs);
+	meshBvhs.push_back(bvh);
+
+	meshNode.push_back(node);
+	meshVertices.push_back(std::vector<GLfloat>());
+	meshIndices.push_back(std::vector<unsigned int>());
+	// Baked light only holds for geometry that stays where it was baked
+	if ((importFlags & MODEL_IMPORT_BAKE_LIGHTING) && !newMesh->IsSkinned())
+	{
+		meshVertices.back().swap(vertices);
+		meshIndices.back().swap(indices);
+	}
+}
+
+void Model::SetMeshBakedLight(unsigned int mesh, const GLfloat* light)
+{
+	if (!meshVertices[mesh].empty())
+	{
+		meshList[mesh]->SetBakedLight(light, (unsigned int)meshVertices[mesh].size() / 8);
+	}
+}
+
+static glm::mat4 ToMat4(const aiMatrix4x4& m)
+{
+	// Assimp stores rows, glm columns
+	return glm::mat4(m.a1, m.b1, m.c1, m.d1,
+		m.a2, m.b2, m.c2, m.d2,
+		m.a3, m.b3, m.c3, m.d3,
+		m.a4, m.b4, m.c4, m.d4);
+}
+
+void Model::LoadMeshSkin(aiMesh* mesh, Mesh* target, unsigned int node, BoundingBox& bounds)
+{
+	TRACE_SCOPE("Model::LoadMeshSkin");
+
+	unsigned int vertexCount = mesh->mNumVertices;
+	std::vector<unsigned char> joints(vertexCount * 4, 0);
+	std::vector<float> weights(vertexCount * 4, 0.0f);
+
+	MeshSkin skin;
+	skin.mesh = (unsigned int)meshList.size();
+	skin.node = node;
+
+	for (unsigned int b = 0; b < mesh->mNumBones; b++)
+	{
+		const aiBone* bone = mesh->mBones[b];
+		skin.boneNames.push_back(bone->mName.C_Str());
+		skin.offsets.push_back(ToMat4(bone->mOffsetMatrix));
+
+		for (unsigned int w = 0; w < bone->mNumWeights; w++)
+		{
+			unsigned int vertex = bone->mWeights[w].mVertexId;
+			float weight = bone->mWeights[w].mWeight;
+
+			// aiProcess_LimitBoneWeights leaves 4 at most, the smallest slot goes if a file still has more
+			unsigned int slot = 0;
+			for (unsigned int k = 1; k < 4; k++)
+			{
+				if (weights[vertex * 4 + k] < weights[vertex * 4 + slot]) slot = k;
+			}
+			if (weight > weights[vertex * 4 + slot])
+			{
+				weights[vertex * 4 + slot] = weight;
+				joints[vertex * 4 + slot] = (unsigned char)b;
+			}
+		}
+	}
+
+	// Unorm8 weights that still sum to exactly 255, the rounding error goes to the largest one
+	std::vector<unsigned char> quantised(vertexCount * 4, 0);
+	for (unsigned int v = 0; v < vertexCount; v++)
+	{
+		float* vertexWeights = &weights[v * 4];
+		float sum = vertexWeights[0] + vertexWeights[1] + vertexWeights[2] + vertexWeights[3];
+		if (sum <= 0.0f)
+		{
+			// Unweighted vertices follow the mesh's first bone
+			quantised[v * 4] = 255;
+			continue;
+		}
+
+		int total = 0;
+		unsigned int largest = 0;
+		for (unsigned int k = 0; k < 4; k++)
+		{
+			quantised[v * 4 + k] = (unsigned char)(vertexWeights[k] / sum * 255.0f + 0.5f);
+			total += quantised[v * 4 + k];
+			if (vertexWeights[k] > vertexWeights[largest]) largest = k;
+		}
+		quantised[v * 4 + largest] = (unsigned char)(quantised[v * 4 + largest] + 255 - total);
+	}
+
+	target->SetSkinning(&joints[0], &quantised[0], vertexCount);
+	meshSkins.push_back(skin);
+
+	// Poses reach past the bind pose, culling gets some slack rather than tracking every frame's extent
+	glm::vec3 slack = bounds.GetExtents() * 0.5f;
+	bounds.Expand(bounds.GetCentre() + bounds.GetExtents() + slack);
+	bounds.Expand(bounds.GetCentre() - bounds.GetExtents() - slack);
+}
+
+void Model::LoadSkeleton()
+{
+	TRACE_SCOPE("Model::LoadSkeleton");
+
+	skeleton = new Skeleton();
+	for (size_t i = 0; i < nodes.size(); i++)
+	{
+		skeleton->AddJoint(nodeNames[i], nodes[i].parent, nodePosition[i], nodeRotation[i], nodeScale[i]);
+	}
+
+	meshBoneFirst.assign(meshList.size(), -1);
+	for (size_t s = 0; s < meshSkins.size(); s++)
+	{
+		const MeshSkin& skin = meshSkins[s];
+		meshBoneFirst[skin.mesh] = (int)skeleton->GetBoneCount();
+
+		for (size_t b = 0; b < skin.boneNames.size(); b++)
+		{
+			unsigned int joint = skeleton->FindJoint(skin.boneNames[b]);
+			if (joint == Skeleton::NO_JOINT)
+			{
+				printf("Bone %s of %s has no node, it stays at the mesh\n", skin.boneNames[b].c_str(), name.c_str());
+				joint = skin.node;
+			}
+			skeleton->AddBone(joint, skin.node, skin.offsets[b]);
+		}
+	}
+	meshSkins.clear();
 }
 
-void Model::LoadMaterials(const aiScene* scene)
+void Model::LoadAnimations(const aiScene* scene)
 {
+	TRACE_SCOPE("Model::LoadAnimations");
+
+	for (unsigned int a = 0; a < scene->mNumAnimations; a++)
+	{
+		const aiAnimation* animation = scene->mAnimations[a];
+		// Files that leave the tick rate out are usually authored at 25
+		double ticksPerSecond = animation->mTicksPerSecond > 0.0 ? animation->mTicksPerSecond : 25.0;
+
+		std::vector<JointTrack> tracks;
+		for (unsigned int c = 0; c < animation->mNumChannels; c++)
+		{
+			const aiNodeAnim* channel = animation->mChannels[c];
+
+			JointTrack track;
+			track.joint = skeleton->FindJoint(channel->mNodeName.C_Str());
+			if (track.joint == Skeleton::NO_JOINT)
+			{
+				continue;
+			}
+
+			for (unsigned int k = 0; k < channel->mNumPositionKeys; k++)
+			{
+				const aiVectorKey& key = channel->mPositionKeys[k];
+				track.positionTimes.push_back((float)(key.mTime / ticksPerSecond));
+				track.positions.push_back(glm::vec3(key.mValue.x, key.mValue.y, key.mValue.z));
+			}
+			for (unsigned int k = 0; k < channel->mNumRotationKeys; k++)
+			{
+				const aiQuatKey& key = channel->mRotationKeys[k];
+				track.rotationTimes.push_back((float)(key.mTime / ticksPerSecond));
+				track.rotations.push_back(glm::quat(key.mValue.w, key.mValue.x, key.mValue.y, key.mValue.z));
+			}
+			for (unsigned int k = 0; k < channel->mNumScalingKeys; k++)
+			{
+				const aiVectorKey& key = channel->mScalingKeys[k];
+				track.scaleTimes.push_back((float)(key.mTime / ticksPerSecond));
+				track.scales.push_back(glm::vec3(key.mValue.x, key.mValue.y, key.mValue.z));
+			}
+			tracks.push_back(track);
+		}
+
+		std::string clipName = animation->mName.length > 0 ? animation->mName.C_Str() : name + "_" + std::to_string(a);
+		AnimationClip* clip = new AnimationClip();
+		clip->Build(clipName, *skeleton, tracks, (float)(animation->mDuration / ticksPerSecond));
+		clips.push_back(clip);
+	}
+}
+
+int Model::FindClip(const std::string& clipName)
+{
+	for (size_t i = 0; i < clips.size(); i++)
+	{
+		if (clips[i]->GetName() == clipName)
+		{
+			return (int)i;
+		}
+	}
+
+	return -1;
+}
+
+void Model::LoadMaterials(const aiScene* scene, TextureStreamer* streamer)
+{
+	TRACE_SCOPE("Model::LoadMaterials");
+
 	textureList.resize(scene->mNumMaterials);
 
 	for (size_t i = 0; i < scene->mNumMaterials; i++)
@@ -91,24 +708,17 @@ void Model::LoadMaterials(const aiScene* scene)
 
 		textureList[i] = nullptr;
 
-		if (material->GetTextureCount(aiTextureType_DIFFUSE))
+		std::string texPath = GetTexturePath(material);
+		if (!texPath.empty())
 		{
-			aiString path;
-			if (material->GetTexture(aiTextureType_DIFFUSE, 0, &path) == AI_SUCCESS)
-			{
-				int idx = std::string(path.data).rfind("\\");
-				std::string filename = std::string(path.data).substr(idx + 1);
+			textureList[i] = new Texture(texPath.c_str());
 
-				std::string texPath = std::string("Textures/") + filename;
-
-				textureList[i] = new Texture(texPath.c_str());
-
-				if (!textureList[i]->LoadTexture())
-				{
-					printf("Failed to load texture at: %s\n", texPath);
-					delete textureList[i];
-					textureList[i] = nullptr;
-				}
+			bool loaded = streamer && streamer->IsRunning() ? streamer->AddTexture(textureList[i], texPath) : textureList[i]->LoadTexture();
+			if (!loaded)
+			{
+				printf("Failed to load texture at: %s\n", texPath.c_str());
+				delete textureList[i];
+				textureList[i] = nullptr;
 			}
 		}
 
@@ -120,6 +730,142 @@ void Model::LoadMaterials(const aiScene* scene)
 	}
 }
 
+void Model::LoadMaterialArrays(const aiScene* scene)
+{
+	TRACE_SCOPE("Model::LoadMaterialArrays");
+
+	struct ArrayBucket
+	{
+		int width, height;
+		unsigned int layers;
+		std::vector<unsigned char> pixels;
+	};
+
+	GLint maxLayers = 256, maxSize = 1024;
+	glGetIntegerv(GL_MAX_ARRAY_TEXTURE_LAYERS, &maxLayers);
+	glGetIntegerv(GL_MAX_TEXTURE_SIZE, &maxSize);
+	// Bigger layers would make every small texture sharing the array pay for them
+	if (maxSize > 1024) maxSize = 1024;
+
+	std::vector<ArrayBucket> buckets;
+	std::vector<int> materialArray(scene->mNumMaterials, 0);
+	std::vector<int> materialLayer(scene->mNumMaterials, 0);
+	// Materials sharing a file share the layer
+	std::unordered_map<std::string, std::pair<int, int> > loaded;
+	const std::string fallbackPath = "Textures/plain.png";
+
+	auto useLoaded = [&](const std::string& path, size_t material)
+	{
+		std::unordered_map<std::string, std::pair<int, int> >::iterator found = loaded.find(path);
+		if (found == loaded.end())
+		{
+			return false;
+		}
+
+		materialArray[material] = found->second.first;
+		materialLayer[material] = found->second.second;
+		return true;
+	};
+
+	for (size_t i = 0; i < scene->mNumMaterials; i++)
+	{
+		std::string texPath = GetTexturePath(scene->mMaterials[i]);
+		if (texPath.empty())
+		{
+			texPath = fallbackPath;
+		}
+		if (useLoaded(texPath, i))
+		{
+			continue;
+		}
+
+		int width = 0, height = 0, channels = 0;
+		unsigned char* texData = stbi_load(texPath.c_str(), &width, &height, &channels, 4);
+		if (!texData && texPath != fallbackPath)
+		{
+			printf("Failed to load texture at: %s\n", texPath.c_str());
+
+			// The fallback is looked up like any other file, so every broken material shares its layer
+			texPath = fallbackPath;
+			if (useLoaded(texPath, i))
+			{
+				continue;
+			}
+			texData = stbi_load(texPath.c_str(), &width, &height, &channels, 4);
+		}
+		if (!texData)
+		{
+			printf("Failed to find: %s\n", texPath.c_str());
+			continue;
+		}
+
+		int layerWidth = TextureArray::LayerSize(width, maxSize);
+		int layerHeight = TextureArray::LayerSize(height, maxSize);
+
+		size_t bucket = 0;
+		while (bucket < buckets.size() && (buckets[bucket].width != layerWidth || buckets[bucket].height != layerHeight || buckets[bucket].layers >= (unsigned int)maxLayers))
+		{
+			bucket++;
+		}
+		if (bucket == buckets.size())
+		{
+			ArrayBucket newBucket;
+			newBucket.width = layerWidth;
+			newBucket.height = layerHeight;
+			newBucket.layers = 0;
+			buckets.push_back(newBucket);
+		}
+
+		ArrayBucket& target = buckets[bucket];
+		size_t layerBytes = (size_t)layerWidth * layerHeight * 4;
+		target.pixels.resize(layerBytes * (target.layers + 1));
+		TextureArray::ResizeImage(texData, width, height, &target.pixels[layerBytes * target.layers], layerWidth, layerHeight);
+		stbi_image_free(texData);
+
+		materialArray[i] = (int)bucket;
+		materialLayer[i] = (int)target.layers;
+		loaded[texPath] = std::make_pair((int)bucket, (int)target.layers);
+		target.layers++;
+	}
+
+	if (buckets.empty())
+	{
+		return;
+	}
+
+	for (size_t i = 0; i < buckets.size(); i++)
+	{
+		TextureArray* textureArray = new TextureArray();
+		textureArray->CreateArray(buckets[i].width, buckets[i].height, buckets[i].layers, &buckets[i].pixels[0], nullptr);
+		textureArrays.push_back(textureArray);
+	}
+
+	meshArray.resize(meshList.size());
+	meshLayer.resize(meshList.size());
+	for (size_t i = 0; i < meshList.size(); i++)
+	{
+		unsigned int materialIndex = meshToTex[i] < materialArray.size() ? meshToTex[i] : 0;
+		meshArray[i] = materialArray[materialIndex];
+		meshLayer[i] = materialLayer[materialIndex];
+	}
+
+	printf("%s: %u textures in %u arrays\n", name.c_str(), (unsigned int)loaded.size(), (unsigned int)buckets.size());
+}
+
+std::string Model::GetTexturePath(aiMaterial* material)
+{
+	aiString path;
+	if (!material->GetTextureCount(aiTextureType_DIFFUSE) || material->GetTexture(aiTextureType_DIFFUSE, 0, &path) != AI_SUCCESS)
+	{
+		return std::string();
+	}
+
+	int idx = std::string(path.data).rfind("\\");
+	std::string filename = std::string(path.data).substr(idx + 1);
+
+	return std::string("Textures/") + filename;
+}
+
 void Model::ClearModel()
 {
 	for (size_t i = 0; i < meshList.size(); i++)
@@ -139,6 +885,50 @@ void Model::ClearModel()
 			textureList[i] = nullptr;
 		}
 	}
+
+	for (size_t i = 0; i < textureArrays.size(); i++)
+	{
+		delete textureArrays[i];
+	}
+	textureArrays.clear();
+
+	for (size_t i = 0; i < meshBvhs.size(); i++)
+	{
+		delete meshBvhs[i];
+	}
+	meshBvhs.clear();
+	meshNode.clear();
+	meshVertices.clear();
+	meshIndices.clear();
+
+	for (size_t i = 0; i < clips.size(); i++)
+	{
+		delete clips[i];
+	}
+	clips.clear();
+	if (skeleton)
+	{
+		delete skeleton;
+		skeleton = nullptr;
+	}
+	meshSkins.clear();
+	meshBoneFirst.clear();
+
+	meshArray.clear();
+	meshLayer.clear();
+
+	meshBounds.clear();
+	nodes.clear();
+	nodeNames.clear();
+	nodePosition.clear();
+	nodeRotation.clear();
+	nodeScale.clear();
+	nodeWorld.clear();
+	nodeBounds.clear();
+	nodeDirty.clear();
+	hierarchyDirty = false;
+	transformStore = nullptr;
+	nodeBases.clear();
 }
 
 Model::~Model()
@@ -7,28 +7,177 @@
 #include <assimp\scene.h>
 #include <assimp\postprocess.h>
 
+#include <glm\glm.hpp>
+#include <glm\gtc\quaternion.hpp>
+
 #include "Mesh.h"
 #include "Texture.h"
+#include "TextureArray.h"
+#include "BoundingBox.h"
+#include "Frustum.h"
+#include "TransformStore.h"
+#include "UniformTable.h"
+#include "GpuProfiler.h"
+#include "MeshBvh.h"
+#include "Skeleton.h"
+#include "AnimationClip.h"
+#include "CommonValues.h"
+
+class TextureStreamer;
+class JobSystem;
+
+enum ModelImportFlags
+{
+	MODEL_IMPORT_DEFAULT = 0,
+	// Textures grouped by size into GL_TEXTURE_2D_ARRAYs, meshes pick their layer with a uniform.
+	// Needs SHADER_FEATURE_TEXTURE_ARRAY, array textures load in full and don't stream
+	MODEL_IMPORT_TEXTURE_ARRAYS = 1 << 0,
+	// Every static mesh without bones also gets a position-only stream for depth pre-passes
+	MODEL_IMPORT_POSITION_STREAM = 1 << 1,
+	// Meshes without bones keep their vertices and indices on the CPU for LightBaker
+	MODEL_IMPORT_BAKE_LIGHTING = 1 << 2
+};
 
 class Model
 {
 public:
 	Model();
 
-	void LoadModel(const std::string& fileName);
+	// Textures go through the streamer when one is given, otherwise they load in full right away.
+	// Every mesh gets a ray cast BVH, built on the jobs when given
+	void LoadModel(const std::string& fileName, TextureStreamer* streamer = nullptr, unsigned int importFlags = MODEL_IMPORT_DEFAULT,
+		JobSystem* jobs = nullptr);
 	void RenderModel();
 	void ClearModel();
 
+	// File name without directory and extension, for profiler scopes and logs
+	const char* GetName() { return name.c_str(); }
+
+	// Node hierarchy, flattened in pre-order so a node's subtree is [node, subtreeEnd)
+	unsigned int GetNodeCount() { return (unsigned int)nodes.size(); }
+	int FindNode(const std::string& name);
+	const std::string& GetNodeName(unsigned int node) { return nodeNames[node]; }
+	void SetNodeTransform(unsigned int node, glm::vec3 position, glm::quat rotation, glm::vec3 scale);
+	const glm::mat4& GetNodeWorldMatrix(unsigned int node) { return nodeWorld[node]; }
+
+	// Recomputes world matrices and bounds of changed subtrees only
+	void UpdateHierarchy();
+	BoundingBox GetBounds();
+	// Bumped by every UpdateHierarchy that moved a node, so copies of GetBounds know when they're stale
+	unsigned int GetBoundsVersion() { return boundsVersion; }
+
+	// Gives every node a slot under objectTransform so sub-parts can move on the GPU, once for each renderable
+	// of the model. Returns the first slot, what the node functions below take as nodeBase
+	unsigned int CreateNodeTransforms(TransformStore* store, unsigned int objectTransform);
+
+	// Draws visible nodes, skipping whole subtrees whose bounds fall outside the frustum
+	unsigned int RenderModel(UniformTable& uniforms, const Frustum& frustum, const glm::mat4& objectWorld, unsigned int nodeBase);
+
+	// Same culling as RenderModel without touching GL, so draw lists can be built on another thread
+	void CollectVisibleNodes(const Frustum& frustum, const glm::mat4& objectWorld, std::vector<unsigned int>& visibleNodes);
+	static unsigned int GetNodeTransform(unsigned int nodeBase, unsigned int node) { return nodeBase + node; }
+	// Only reads the meshes and textures, safe while another thread runs UpdateHierarchy.
+	// Texture array layers go through uniforms, without them every mesh samples layer 0.
+	// boneBase is the instance's first palette bone, skinned meshes need it and SHADER_FEATURE_SKINNING
+	void RenderNode(unsigned int node, GpuProfiler* profiler = nullptr, UniformTable* uniforms = nullptr, unsigned int boneBase = NO_BONE_PALETTE);
+	// Positions only for depth-only programs, no textures or bones, with whatever program is bound
+	void RenderNodeDepth(unsigned int node);
+	// What RenderNode submits, for draw call and triangle statistics
+	unsigned int GetNodeMeshCount(unsigned int node) { return nodes[node].meshEnd - nodes[node].meshBegin; }
+	unsigned int GetNodeTriangleCount(unsigned int node);
+	BoundingBox GetNodeWorldBounds(unsigned int node, const glm::mat4& objectWorld);
+	// Tells the streamer how large the node's textures appear on screen
+	void RequestNodeTextures(unsigned int node, float screenPixels, TextureStreamer& streamer);
+
+	// Nearest triangle of the model placed at objectWorld, fills hit.mesh and hit.node too. Runs
+	// UpdateHierarchy, so it belongs on the thread that moves the nodes
+	bool Raycast(const Ray& ray, const glm::mat4& objectWorld, RayHit& hit);
+	bool Occluded(const Ray& ray, const glm::mat4& objectWorld);
+	const MeshBvh* GetMeshBvh(unsigned int mesh) { return meshBvhs[mesh]; }
+
+	unsigned int GetMeshCount() { return (unsigned int)meshList.size(); }
+	unsigned int GetMeshNode(unsigned int mesh) { return meshNode[mesh]; }
+	// Vertices as Mesh takes them, 8 floats each, empty unless imported with MODEL_IMPORT_BAKE_LIGHTING
+	const std::vector<GLfloat>& GetMeshVertices(unsigned int mesh) { return meshVertices[mesh]; }
+	const std::vector<unsigned int>& GetMeshIndices(unsigned int mesh) { return meshIndices[mesh]; }
+	// 3 floats per vertex, for meshes that kept their vertices
+	void SetMeshBakedLight(unsigned int mesh, const GLfloat* light);
+
+	// Set when any mesh has bones. Every node is a joint, so bones can hang anywhere in the hierarchy
+	bool IsSkinned() { return skeleton != nullptr; }
+	const Skeleton* GetSkeleton() { return skeleton; }
+	unsigned int GetClipCount() { return (unsigned int)clips.size(); }
+	const AnimationClip* GetClip(unsigned int clip) { return clips[clip]; }
+	int FindClip(const std::string& clipName);
+
 	~Model();
 
 private:
+	struct ModelNode
+	{
+		unsigned int parent;
+		unsigned int subtreeEnd;
+		unsigned int meshBegin, meshEnd;
+	};
+
+	void LoadNode(aiNode* node, const aiScene* scene, unsigned int parent, JobSystem* jobs);
+	void LoadMesh(aiMesh* mesh, unsigned int node, JobSystem* jobs);
+	// Quantised bone weights into the mesh's skinning stream, bone names and offsets into meshSkins
+	void LoadMeshSkin(aiMesh* mesh, Mesh* target, unsigned int node, BoundingBox& bounds);
+	void LoadSkeleton();
+	void LoadAnimations(const aiScene* scene);
+	void LoadMaterials(const aiScene* scene, TextureStreamer* streamer);
+	void LoadMaterialArrays(const aiScene* scene);
+	static std::string GetTexturePath(aiMaterial* material);
+
+	void UpdateSubtree(unsigned int node);
+	void UpdateNodeBounds(unsigned int node);
+	void RenderNodeMeshes(unsigned int node, UniformTable* uniforms, GpuProfiler* profiler = nullptr, unsigned int boneBase = NO_BONE_PALETTE);
+	void UseMeshTexture(unsigned int mesh, UniformTable* uniforms);
 
-	void LoadNode(aiNode* node, const aiScene* scene);
-	void LoadMesh(aiMesh* mesh, const aiScene* scene);
-	void LoadMaterials(const aiScene* scene);
+	std::string name;
+	unsigned int importFlags;
 
 	std::vector<Mesh*> meshList;
 	std::vector<Texture*> textureList;
 	std::vector<unsigned int> meshToTex;
-};
+	std::vector<BoundingBox> meshBounds;
+	std::vector<MeshBvh*> meshBvhs;
+	std::vector<unsigned int> meshNode;
+	std::vector<std::vector<GLfloat>> meshVertices;
+	std::vector<std::vector<unsigned int>> meshIndices;
+
+	// Bones of a mesh as LoadMesh finds them, resolved to joints once the whole hierarchy is loaded
+	struct MeshSkin
+	{
+		unsigned int mesh;
+		unsigned int node;
+		std::vector<std::string> boneNames;
+		std::vector<glm::mat4> offsets;
+	};
+	std::vector<MeshSkin> meshSkins;
+	Skeleton* skeleton;
+	std::vector<AnimationClip*> clips;
+	// First skeleton bone of every mesh, -1 for meshes without bones
+	std::vector<int> meshBoneFirst;
+
+	// Filled instead of textureList when imported with MODEL_IMPORT_TEXTURE_ARRAYS
+	std::vector<TextureArray*> textureArrays;
+	std::vector<int> meshArray;
+	std::vector<int> meshLayer;
 
+	std::vector<ModelNode> nodes;
+	std::vector<std::string> nodeNames;
+	std::vector<glm::vec3> nodePosition;
+	std::vector<glm::quat> nodeRotation;
+	std::vector<glm::vec3> nodeScale;
+	std::vector<glm::mat4> nodeWorld;
+	std::vector<BoundingBox> nodeBounds;
+	std::vector<unsigned char> nodeDirty;
+	bool hierarchyDirty;
+	unsigned int boundsVersion;
+
+	// First node slot of every renderable, SetNodeTransform writes all of them
+	TransformStore* transformStore;
+	std::vector<unsigned int> nodeBases;
+};
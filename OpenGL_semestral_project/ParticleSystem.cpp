@@ -0,0 +1,546 @@
+#include "ParticleSystem.h"
+
+#include <stdio.h>
+#include <fstream>
+
+#include "GpuMemory.h"
+#include "CpuTrace.h"
+
+const unsigned int ParticleSystem::NO_EMITTER;
+const unsigned int ParticleSystem::PARTICLE_STRIDE;
+const unsigned int ParticleSystem::TIMER_FRAMES;
+
+ParticleSystem::ParticleSystem()
+{
+	capacity = 0;
+	usedParticles = 0;
+
+	buffers[0] = buffers[1] = 0;
+	updateVAO[0] = updateVAO[1] = 0;
+	renderVAO = 0;
+	current = 0;
+	allocation = GpuMemory::NO_ALLOCATION;
+
+	useCompute = false;
+	updateProgram = 0;
+	renderPrograms[0] = renderPrograms[1] = 0;
+	renderMode = PARTICLE_RENDER_QUADS;
+
+	frameSeed = 0;
+
+	for (unsigned int i = 0; i < TIMER_FRAMES; i++)
+	{
+		timers[i].simulate = timers[i].render = 0;
+		timers[i].pending = false;
+	}
+	timerFrame = 0;
+	frameTimed = false;
+	timedFrames = 0;
+	simulateNsSum = renderNsSum = 0.0;
+}
+
+bool ParticleSystem::Initialise(unsigned int particleCapacity, bool allowCompute)
+{
+	TRACE_SCOPE("ParticleSystem::Initialise");
+
+	ClearParticles();
+
+	std::string simulateCode = ReadSource("Shaders/particle_simulate.glsl");
+	if (simulateCode.empty())
+	{
+		return false;
+	}
+
+	// The compute path needs shader storage buffers as well, both are core from 4.3
+	bool computeSupported = GLEW_VERSION_4_3 || (GLEW_ARB_compute_shader && GLEW_ARB_shader_storage_buffer_object);
+	if (allowCompute && computeSupported)
+	{
+		std::string computeCode = Splice(ReadSource("Shaders/particle_update.comp"), simulateCode);
+		updateProgram = LinkProgram(nullptr, nullptr, computeCode.c_str(), false);
+		useCompute = updateProgram != 0;
+		if (!useCompute)
+		{
+			printf("Particle compute shader failed, falling back to transform feedback\n");
+		}
+	}
+
+	if (!updateProgram)
+	{
+		std::string vertexCode = Splice(ReadSource("Shaders/particle_update.vert"), simulateCode);
+		updateProgram = LinkProgram(vertexCode.c_str(), nullptr, nullptr, true);
+	}
+
+	std::string renderVertex = ReadSource("Shaders/particle.vert");
+	std::string renderFragment = ReadSource("Shaders/particle.frag");
+	for (unsigned int mode = 0; mode < 2; mode++)
+	{
+		std::string defines = mode == PARTICLE_RENDER_POINTS ? "#define USE_POINTS\n" : "";
+		std::string vertexCode = Splice(renderVertex, defines);
+		std::string fragmentCode = Splice(renderFragment, defines);
+		renderPrograms[mode] = LinkProgram(vertexCode.c_str(), fragmentCode.c_str(), nullptr, false);
+	}
+
+	if (!updateProgram || !renderPrograms[0] || !renderPrograms[1])
+	{
+		printf("Failed to create the particle shaders!\n");
+		ClearParticles();
+		return false;
+	}
+
+	updateUniforms.Build(updateProgram);
+	renderUniforms[0].Build(renderPrograms[0]);
+	renderUniforms[1].Build(renderPrograms[1]);
+
+	capacity = particleCapacity;
+	GLsizeiptr size = (GLsizeiptr)capacity * PARTICLE_STRIDE;
+
+	glGenBuffers(2, buffers);
+	glGenVertexArrays(2, updateVAO);
+	for (unsigned int i = 0; i < 2; i++)
+	{
+		// Written by the GPU and read by the GPU, never touched by the CPU after the emitters are added
+		glBindBuffer(GL_ARRAY_BUFFER, buffers[i]);
+		glBufferData(GL_ARRAY_BUFFER, size, nullptr, GL_DYNAMIC_COPY);
+
+		glBindVertexArray(updateVAO[i]);
+		SetupAttributes(buffers[i], 0, false);
+	}
+	glGenVertexArrays(1, &renderVAO);
+
+	glBindVertexArray(0);
+	glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+	allocation = GpuMemory::Allocate(GPU_MEMORY_MESH_VERTEX, (size_t)size * 2, "Particles");
+
+	for (unsigned int i = 0; i < TIMER_FRAMES; i++)
+	{
+		glGenQueries(1, &timers[i].simulate);
+		glGenQueries(1, &timers[i].render);
+	}
+
+	printf("Particles: %u capacity, %s update\n", capacity, useCompute ? "compute shader" : "transform feedback");
+
+	return true;
+}
+
+unsigned int ParticleSystem::AddEmitter(const ParticleEmitter& emitter)
+{
+	if (!updateProgram || emitter.count == 0 || emitter.count > capacity - usedParticles)
+	{
+		printf("Particle emitter of %u doesn't fit, %u of %u particles used\n", emitter.count, usedParticles, capacity);
+		return NO_EMITTER;
+	}
+
+	EmitterRange range;
+	range.settings = emitter;
+	range.first = usedParticles;
+
+	// Everything starts unborn with staggered negative ages, lifetime 0 makes each respawn as its age crosses 0
+	float averageLife = (emitter.lifeMin + emitter.lifeMax) * 0.5f;
+	std::vector<GLfloat> data(emitter.count * 8, 0.0f);
+	for (unsigned int i = 0; i < emitter.count; i++)
+	{
+		data[i * 8 + 3] = -averageLife * (i + 0.5f) / emitter.count;
+	}
+
+	for (unsigned int i = 0; i < 2; i++)
+	{
+		glBindBuffer(GL_ARRAY_BUFFER, buffers[i]);
+		glBufferSubData(GL_ARRAY_BUFFER, (GLintptr)range.first * PARTICLE_STRIDE, (GLsizeiptr)emitter.count * PARTICLE_STRIDE, &data[0]);
+	}
+	glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+	usedParticles += emitter.count;
+	emitters.push_back(range);
+
+	return (unsigned int)emitters.size() - 1;
+}
+
+void ParticleSystem::SetEmitterUniforms(const ParticleEmitter& emitter, const glm::mat4* worldMatrices, unsigned int matrixCount)
+{
+	glm::mat4 world(1.0f);
+	if (worldMatrices && emitter.transform < matrixCount)
+	{
+		world = worldMatrices[emitter.transform];
+	}
+
+	glm::vec3 direction = glm::length(emitter.direction) > 0.0f ? glm::normalize(emitter.direction) : glm::vec3(0.0f, 1.0f, 0.0f);
+
+	updateUniforms.SetMat4(Uniforms::EmitterWorld, world);
+	updateUniforms.SetVec3(Uniforms::EmitterOrigin, emitter.position);
+	updateUniforms.SetVec3(Uniforms::EmitterDirection, direction);
+	updateUniforms.SetFloat(Uniforms::EmitterSpread, emitter.spread);
+	updateUniforms.SetVec4(Uniforms::EmitterRanges, glm::vec4(emitter.speedMin, emitter.speedMax, emitter.lifeMin, emitter.lifeMax));
+	updateUniforms.SetVec4(Uniforms::EmitterForces, glm::vec4(emitter.acceleration, emitter.drag));
+	updateUniforms.SetInt(Uniforms::EmitterActive, emitter.active ? 1 : 0);
+}
+
+void ParticleSystem::Simulate(float deltaTime, const glm::mat4* worldMatrices, unsigned int matrixCount, GpuProfiler* profiler)
+{
+	TRACE_SCOPE("ParticleSystem::Simulate");
+
+	if (!updateProgram || emitters.empty())
+	{
+		return;
+	}
+
+	GpuProfileScope gpuScope(profiler, "Particle simulate");
+
+	ResolveTimers();
+	frameTimed = !timers[timerFrame].pending;
+	if (frameTimed)
+	{
+		glBeginQuery(GL_TIME_ELAPSED, timers[timerFrame].simulate);
+	}
+
+	unsigned int target = 1 - current;
+
+	glUseProgram(updateProgram);
+	updateUniforms.SetFloat(Uniforms::DeltaTime, deltaTime);
+	updateUniforms.SetInt(Uniforms::FrameSeed, (GLint)frameSeed++);
+
+	if (useCompute)
+	{
+		glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 0, buffers[current]);
+		glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 1, buffers[target]);
+
+		for (size_t i = 0; i < emitters.size(); i++)
+		{
+			const EmitterRange& range = emitters[i];
+			SetEmitterUniforms(range.settings, worldMatrices, matrixCount);
+			updateUniforms.SetInt(Uniforms::ParticleFirst, (GLint)range.first);
+			updateUniforms.SetInt(Uniforms::ParticleCount, (GLint)range.settings.count);
+			glDispatchCompute((range.settings.count + 255) / 256, 1, 1);
+		}
+
+		// Next frame's dispatch reads it as storage, this frame's draws as vertex attributes
+		glMemoryBarrier(GL_VERTEX_ATTRIB_ARRAY_BARRIER_BIT | GL_SHADER_STORAGE_BARRIER_BIT);
+
+		glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 0, 0);
+		glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 1, 0);
+	}
+	else
+	{
+		glEnable(GL_RASTERIZER_DISCARD);
+		glBindVertexArray(updateVAO[current]);
+
+		// One capture per emitter, gl_VertexID starts at the emitter's first particle so ids match the compute path
+		for (size_t i = 0; i < emitters.size(); i++)
+		{
+			const EmitterRange& range = emitters[i];
+			SetEmitterUniforms(range.settings, worldMatrices, matrixCount);
+
+			glBindBufferRange(GL_TRANSFORM_FEEDBACK_BUFFER, 0, buffers[target],
+				(GLintptr)range.first * PARTICLE_STRIDE, (GLsizeiptr)range.settings.count * PARTICLE_STRIDE);
+			glBeginTransformFeedback(GL_POINTS);
+			glDrawArrays(GL_POINTS, (GLint)range.first, (GLsizei)range.settings.count);
+			glEndTransformFeedback();
+		}
+
+		glBindBufferBase(GL_TRANSFORM_FEEDBACK_BUFFER, 0, 0);
+		glBindVertexArray(0);
+		glDisable(GL_RASTERIZER_DISCARD);
+	}
+
+	glUseProgram(0);
+
+	current = target;
+
+	if (frameTimed)
+	{
+		glEndQuery(GL_TIME_ELAPSED);
+	}
+}
+
+unsigned int ParticleSystem::Render(const glm::mat4& view, const glm::mat4& projection, GpuProfiler* profiler)
+{
+	TRACE_SCOPE("ParticleSystem::Render");
+
+	if (!updateProgram || emitters.empty())
+	{
+		return 0;
+	}
+
+	GpuProfileScope gpuScope(profiler, "Particles");
+
+	if (frameTimed)
+	{
+		glBeginQuery(GL_TIME_ELAPSED, timers[timerFrame].render);
+	}
+
+	bool points = renderMode == PARTICLE_RENDER_POINTS;
+	UniformTable& uniforms = renderUniforms[renderMode];
+
+	GLint viewport[4];
+	glGetIntegerv(GL_VIEWPORT, viewport);
+
+	// Additive, so no sorting: tested against the scene's depth but never written to it
+	glEnable(GL_BLEND);
+	glBlendFunc(GL_ONE, GL_ONE);
+	glDepthMask(GL_FALSE);
+	if (points)
+	{
+		glEnable(GL_PROGRAM_POINT_SIZE);
+	}
+
+	glUseProgram(renderPrograms[renderMode]);
+	uniforms.SetMat4(Uniforms::View, view);
+	uniforms.SetMat4(Uniforms::Projection, projection);
+
+	glBindVertexArray(renderVAO);
+
+	unsigned int drawCalls = 0;
+	for (size_t i = 0; i < emitters.size(); i++)
+	{
+		const EmitterRange& range = emitters[i];
+		const ParticleEmitter& emitter = range.settings;
+
+		uniforms.SetVec4(Uniforms::ParticleColourStart, emitter.colourStart);
+		uniforms.SetVec4(Uniforms::ParticleColourEnd, emitter.colourEnd);
+		uniforms.SetVec3(Uniforms::ParticleShape, glm::vec3(emitter.sizeStart, emitter.sizeEnd, (float)viewport[3]));
+
+		// Quads step the particle attributes once per instance and take their corner from gl_VertexID
+		SetupAttributes(buffers[current], (GLintptr)range.first * PARTICLE_STRIDE, !points);
+		if (points)
+		{
+			glDrawArrays(GL_POINTS, 0, (GLsizei)emitter.count);
+		}
+		else
+		{
+			glDrawArraysInstanced(GL_TRIANGLE_STRIP, 0, 4, (GLsizei)emitter.count);
+		}
+		drawCalls++;
+	}
+
+	glBindVertexArray(0);
+	glUseProgram(0);
+
+	if (points)
+	{
+		glDisable(GL_PROGRAM_POINT_SIZE);
+	}
+	glDepthMask(GL_TRUE);
+	glDisable(GL_BLEND);
+
+	if (frameTimed)
+	{
+		glEndQuery(GL_TIME_ELAPSED);
+		timers[timerFrame].pending = true;
+		timerFrame = (timerFrame + 1) % TIMER_FRAMES;
+		frameTimed = false;
+	}
+
+	return drawCalls;
+}
+
+void ParticleSystem::SetupAttributes(GLuint buffer, GLintptr offset, bool instanced)
+{
+	glBindBuffer(GL_ARRAY_BUFFER, buffer);
+	glVertexAttribPointer(0, 4, GL_FLOAT, GL_FALSE, PARTICLE_STRIDE, (void*)offset);
+	glEnableVertexAttribArray(0);
+	glVertexAttribPointer(1, 4, GL_FLOAT, GL_FALSE, PARTICLE_STRIDE, (void*)(offset + sizeof(GLfloat) * 4));
+	glEnableVertexAttribArray(1);
+	glVertexAttribDivisor(0, instanced ? 1 : 0);
+	glVertexAttribDivisor(1, instanced ? 1 : 0);
+	glBindBuffer(GL_ARRAY_BUFFER, 0);
+}
+
+void ParticleSystem::ResolveTimers()
+{
+	for (unsigned int i = 0; i < TIMER_FRAMES; i++)
+	{
+		FrameTimers& frame = timers[i];
+		if (!frame.pending)
+		{
+			continue;
+		}
+
+		// The render query ends last, once it's available so is the simulate one
+		GLint available = 0;
+		glGetQueryObjectiv(frame.render, GL_QUERY_RESULT_AVAILABLE, &available);
+		if (!available)
+		{
+			continue;
+		}
+
+		GLuint64 simulateNs = 0, renderNs = 0;
+		glGetQueryObjectui64v(frame.simulate, GL_QUERY_RESULT, &simulateNs);
+		glGetQueryObjectui64v(frame.render, GL_QUERY_RESULT, &renderNs);
+		simulateNsSum += (double)simulateNs;
+		renderNsSum += (double)renderNs;
+		timedFrames++;
+		frame.pending = false;
+	}
+}
+
+void ParticleSystem::PrintStats()
+{
+	if (!updateProgram)
+	{
+		return;
+	}
+
+	printf("Particles, %s update, %s\n", useCompute ? "compute" : "transform feedback", renderMode == PARTICLE_RENDER_POINTS ? "points" : "quads");
+	printf("  particles:       %8u in %u emitters, capacity %u\n", usedParticles, (unsigned int)emitters.size(), capacity);
+	printf("  simulate:        %8.3f ms GPU per frame\n", GetSimulateMs());
+	printf("  render:          %8.3f ms GPU per frame (%llu frames timed)\n", GetRenderMs(), timedFrames);
+}
+
+void ParticleSystem::ResetStats()
+{
+	ResolveTimers();
+	timedFrames = 0;
+	simulateNsSum = renderNsSum = 0.0;
+}
+
+void ParticleSystem::ClearParticles()
+{
+	for (unsigned int i = 0; i < TIMER_FRAMES; i++)
+	{
+		if (timers[i].simulate != 0)
+		{
+			glDeleteQueries(1, &timers[i].simulate);
+			glDeleteQueries(1, &timers[i].render);
+		}
+		timers[i].simulate = timers[i].render = 0;
+		timers[i].pending = false;
+	}
+	timerFrame = 0;
+	frameTimed = false;
+	timedFrames = 0;
+	simulateNsSum = renderNsSum = 0.0;
+
+	if (renderVAO != 0)
+	{
+		glDeleteVertexArrays(1, &renderVAO);
+		renderVAO = 0;
+	}
+
+	if (updateVAO[0] != 0)
+	{
+		glDeleteVertexArrays(2, updateVAO);
+		updateVAO[0] = updateVAO[1] = 0;
+	}
+
+	if (buffers[0] != 0)
+	{
+		glDeleteBuffers(2, buffers);
+		buffers[0] = buffers[1] = 0;
+	}
+	GpuMemory::Free(allocation);
+
+	for (unsigned int i = 0; i < 2; i++)
+	{
+		if (renderPrograms[i] != 0)
+		{
+			glDeleteProgram(renderPrograms[i]);
+			renderPrograms[i] = 0;
+		}
+	}
+
+	if (updateProgram != 0)
+	{
+		glDeleteProgram(updateProgram);
+		updateProgram = 0;
+	}
+
+	useCompute = false;
+	emitters.clear();
+	capacity = 0;
+	usedParticles = 0;
+	current = 0;
+}
+
+std::string ParticleSystem::ReadSource(const char* fileName)
+{
+	std::ifstream fileStream(fileName, std::ios::in | std::ios::binary);
+	if (!fileStream.is_open())
+	{
+		printf("Failed to read %s! File doesn't exist.\n", fileName);
+		return "";
+	}
+
+	return std::string(std::istreambuf_iterator<char>(fileStream), std::istreambuf_iterator<char>());
+}
+
+std::string ParticleSystem::Splice(const std::string& source, const std::string& insert)
+{
+	size_t versionPos = source.find("#version");
+	if (versionPos == std::string::npos)
+	{
+		return insert + source;
+	}
+
+	size_t lineEnd = source.find('\n', versionPos);
+	if (lineEnd == std::string::npos)
+	{
+		return source + "\n" + insert;
+	}
+
+	return source.substr(0, lineEnd + 1) + insert + source.substr(lineEnd + 1);
+}
+
+GLuint ParticleSystem::LinkProgram(const char* vertexCode, const char* fragmentCode, const char* computeCode, bool captureVaryings)
+{
+	GLuint program = glCreateProgram();
+	if (!program)
+	{
+		printf("Error creating shader program!\n");
+		return 0;
+	}
+
+	GLint result = 0;
+	GLchar eLog[1024] = { 0 };
+
+	const char* sources[3] = { vertexCode, fragmentCode, computeCode };
+	const GLenum types[3] = { GL_VERTEX_SHADER, GL_FRAGMENT_SHADER, GL_COMPUTE_SHADER };
+	for (unsigned int i = 0; i < 3; i++)
+	{
+		if (!sources[i])
+		{
+			continue;
+		}
+
+		GLuint shader = glCreateShader(types[i]);
+		glShaderSource(shader, 1, &sources[i], NULL);
+		glCompileShader(shader);
+
+		glGetShaderiv(shader, GL_COMPILE_STATUS, &result);
+		if (!result)
+		{
+			glGetShaderInfoLog(shader, sizeof(eLog), NULL, eLog);
+			printf("Error compiling the %d particle shader: '%s'\n", types[i], eLog);
+			glDeleteShader(shader);
+			glDeleteProgram(program);
+			return 0;
+		}
+
+		glAttachShader(program, shader);
+		// Only flagged for deletion, it goes with the program
+		glDeleteShader(shader);
+	}
+
+	if (captureVaryings)
+	{
+		// Interleaved in the same order as the buffer layout, so the captured buffer is next frame's input
+		const GLchar* varyings[2] = { "outPositionAge", "outVelocityLife" };
+		glTransformFeedbackVaryings(program, 2, varyings, GL_INTERLEAVED_ATTRIBS);
+	}
+
+	glLinkProgram(program);
+	glGetProgramiv(program, GL_LINK_STATUS, &result);
+	if (!result)
+	{
+		glGetProgramInfoLog(program, sizeof(eLog), NULL, eLog);
+		printf("Error linking particle program: '%s'\n", eLog);
+		glDeleteProgram(program);
+		return 0;
+	}
+
+	return program;
+}
+
+ParticleSystem::~ParticleSystem()
+{
+	ClearParticles();
+}
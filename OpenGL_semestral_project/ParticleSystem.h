@@ -0,0 +1,146 @@
+#pragma once
+
+#include <vector>
+#include <string>
+
+#include <GL\glew.h>
+#include <glm\glm.hpp>
+
+#include "UniformTable.h"
+#include "GpuProfiler.h"
+
+enum ParticleRenderMode
+{
+	// Camera facing quads, four instanced vertices per particle
+	PARTICLE_RENDER_QUADS,
+	// GL_POINTS with a computed gl_PointSize, cheaper but drivers cap the size
+	PARTICLE_RENDER_POINTS
+};
+
+struct ParticleEmitter
+{
+	// TransformStore slot the emitter rides on, TransformStore::NO_PARENT for world space
+	unsigned int transform;
+	// In the transform's space
+	glm::vec3 position;
+	glm::vec3 direction;
+	// Half angle of the emission cone, radians
+	float spread;
+	float speedMin, speedMax;
+	float lifeMin, lifeMax;
+	// World space, gravity for debris
+	glm::vec3 acceleration;
+	// Fraction of the velocity lost per second
+	float drag;
+	float sizeStart, sizeEnd;
+	// Added to the framebuffer, alpha is ignored
+	glm::vec4 colourStart, colourEnd;
+	// Particles reserved for the emitter, it emits count / average lifetime per second
+	unsigned int count;
+	bool active;
+
+	ParticleEmitter() : transform(0xFFFFFFFF), position(0.0f), direction(0.0f, 1.0f, 0.0f), spread(0.3f),
+		speedMin(1.0f), speedMax(2.0f), lifeMin(0.5f), lifeMax(1.0f), acceleration(0.0f), drag(0.0f),
+		sizeStart(0.1f), sizeEnd(0.0f), colourStart(1.0f), colourEnd(0.0f), count(1000), active(true) {}
+};
+
+// Particles that live entirely on the GPU: two buffers of position + age / velocity + lifetime, read from
+// one and written to the other every frame. The update runs as a compute shader on GL 4.3 and as a vertex
+// shader captured with transform feedback on GL 3.3, both from Shaders/particle_simulate.glsl. Each emitter
+// owns a fixed range of the buffers, dead particles respawn in place, so nothing is ever read back.
+// Drawn additively without sorting
+class ParticleSystem
+{
+public:
+	static const unsigned int NO_EMITTER = 0xFFFFFFFF;
+	// Two vec4s per particle
+	static const unsigned int PARTICLE_STRIDE = sizeof(GLfloat) * 8;
+	static const unsigned int TIMER_FRAMES = 4;
+
+	ParticleSystem();
+
+	// GL thread. capacity is the total over all emitters, allowCompute false forces transform feedback
+	bool Initialise(unsigned int capacity, bool allowCompute = true);
+	bool IsInitialised() { return updateProgram != 0; }
+	bool IsUsingCompute() { return useCompute; }
+
+	void SetRenderMode(ParticleRenderMode mode) { renderMode = mode; }
+
+	// Reserves the next emitter.count particles, NO_EMITTER when the capacity is used up.
+	// The particles are born evenly over the first lifetime so the emitter starts at its steady rate
+	unsigned int AddEmitter(const ParticleEmitter& emitter);
+	// Parameters other than count can change between frames
+	ParticleEmitter& GetEmitter(unsigned int emitter) { return emitters[emitter].settings; }
+	unsigned int GetEmitterCount() { return (unsigned int)emitters.size(); }
+
+	unsigned int GetCapacity() { return capacity; }
+	unsigned int GetParticleCount() { return usedParticles; }
+
+	// GL thread, once per frame. worldMatrices places the emitters, indexed by their transform
+	void Simulate(float deltaTime, const glm::mat4* worldMatrices, unsigned int matrixCount, GpuProfiler* profiler = nullptr);
+	// Depth tested against the scene without writing depth. Returns draw calls
+	unsigned int Render(const glm::mat4& view, const glm::mat4& projection, GpuProfiler* profiler = nullptr);
+
+	// Average GPU milliseconds per frame from GL_TIME_ELAPSED queries, read a few frames late
+	double GetSimulateMs() { return timedFrames ? simulateNsSum / timedFrames / 1e6 : 0.0; }
+	double GetRenderMs() { return timedFrames ? renderNsSum / timedFrames / 1e6 : 0.0; }
+	void PrintStats();
+	// Drops the timings so far, after a warm up
+	void ResetStats();
+
+	void ClearParticles();
+
+	~ParticleSystem();
+
+private:
+	struct EmitterRange
+	{
+		ParticleEmitter settings;
+		unsigned int first;
+	};
+
+	// GL_TIME_ELAPSED can't nest, so simulate and render each get their own query
+	struct FrameTimers
+	{
+		GLuint simulate, render;
+		bool pending;
+	};
+
+	unsigned int capacity;
+	unsigned int usedParticles;
+	std::vector<EmitterRange> emitters;
+
+	// buffers[current] holds the latest state
+	GLuint buffers[2];
+	// Transform feedback input, one per source buffer
+	GLuint updateVAO[2];
+	// Pointed at each emitter's range before its draw
+	GLuint renderVAO;
+	unsigned int current;
+	unsigned int allocation;
+
+	bool useCompute;
+	GLuint updateProgram;
+	GLuint renderPrograms[2];
+	UniformTable updateUniforms;
+	UniformTable renderUniforms[2];
+	ParticleRenderMode renderMode;
+
+	unsigned int frameSeed;
+
+	FrameTimers timers[TIMER_FRAMES];
+	unsigned int timerFrame;
+	// Skipped while the slot's previous results are still in flight
+	bool frameTimed;
+	unsigned long long timedFrames;
+	double simulateNsSum, renderNsSum;
+
+	void SetupAttributes(GLuint buffer, GLintptr offset, bool instanced);
+	void SetEmitterUniforms(const ParticleEmitter& emitter, const glm::mat4* worldMatrices, unsigned int matrixCount);
+	void ResolveTimers();
+
+	static std::string ReadSource(const char* fileName);
+	// Puts defines and shared code after the #version line
+	static std::string Splice(const std::string& source, const std::string& insert);
+	static GLuint LinkProgram(const char* vertexCode, const char* fragmentCode, const char* computeCode, bool captureVaryings);
+};
@@ -1,6 +1,10 @@
 #include "PointLight.h"
 
+#include <float.h>
+#include <math.h>
+#include <algorithm>
 
+constexpr GLfloat PointLight::CUTOFF;
 
 PointLight::PointLight() : Light()
 {
@@ -8,6 +12,7 @@ PointLight::PointLight() : Light()
 	constant = 1.0f;
 	linear = 0.0f;
 	exponent = 0.0f;
+	CalcRange();
 }
 
 PointLight::PointLight(GLfloat red, GLfloat green, GLfloat blue,
@@ -19,20 +24,74 @@ PointLight::PointLight(GLfloat red, GLfloat green, GLfloat blue,
 	constant = con;
 	linear = lin;
 	exponent = exp;
+	CalcRange();
 }
 
-void PointLight::UseLight(GLuint ambientIntensityLocation, GLuint ambientColourLocation,
-	GLuint diffuseIntensityLocation, GLuint positionLocation,
-	GLuint constantLocation, GLuint linearLocation, GLuint exponentLocation)
+void PointLight::UseLight(UniformTable& uniforms, unsigned int index)
 {
-	glUniform3f(ambientColourLocation, colour.x, colour.y, colour.z);
-	glUniform1f(ambientIntensityLocation, ambientIntensity);
-	glUniform1f(diffuseIntensityLocation, diffuseIntensity);
+	uniforms.SetVec3(UniformElement(Uniforms::PointColour, index), colour);
+	uniforms.SetFloat(UniformElement(Uniforms::PointAmbientIntensity, index), ambientIntensity);
+	uniforms.SetFloat(UniformElement(Uniforms::PointDiffuseIntensity, index), diffuseIntensity);
 
-	glUniform3f(positionLocation, position.x, position.y, position.z);
-	glUniform1f(constantLocation, constant);
-	glUniform1f(linearLocation, linear);
-	glUniform1f(exponentLocation, exponent);
+	uniforms.SetVec3(UniformElement(Uniforms::PointPosition, index), position);
+	uniforms.SetFloat(UniformElement(Uniforms::PointConstant, index), constant);
+	uniforms.SetFloat(UniformElement(Uniforms::PointLinear, index), linear);
+	uniforms.SetFloat(UniformElement(Uniforms::PointExponent, index), exponent);
+}
+
+GLfloat PointLight::GetPeak()
+{
+	// The shader divides ambient, diffuse and specular alike by the attenuation
+	return std::max(std::max(colour.x, colour.y), colour.z) * (ambientIntensity + diffuseIntensity);
+}
+
+void PointLight::CalcRange()
+{
+	GLfloat limit = GetPeak() / CUTOFF;
+
+	if (limit <= constant)
+	{
+		range = 0.0f;
+	}
+	else if (exponent > 0.0f)
+	{
+		// exponent * d^2 + linear * d + constant = limit
+		range = (-linear + sqrtf(linear * linear + 4.0f * exponent * (limit - constant))) / (2.0f * exponent);
+	}
+	else if (linear > 0.0f)
+	{
+		range = (limit - constant) / linear;
+	}
+	else
+	{
+		range = FLT_MAX;
+	}
+}
+
+GLfloat PointLight::GetInfluence(glm::vec3 centre, GLfloat radius)
+{
+	GLfloat distance = std::max(glm::length(centre - position) - radius, 0.0f);
+	if (range <= 0.0f || distance > range)
+	{
+		return 0.0f;
+	}
+
+	GLfloat attenuation = exponent * distance * distance + linear * distance + constant;
+	return attenuation > 0.0f ? GetPeak() / attenuation : FLT_MAX;
+}
+
+glm::vec3 PointLight::GetDiffuse(glm::vec3 point, glm::vec3 normal, glm::vec3& toLight, GLfloat& distance)
+{
+	toLight = position - point;
+	distance = glm::length(toLight);
+	if (distance <= 0.0f || distance > range)
+	{
+		return glm::vec3(0.0f);
+	}
+	toLight /= distance;
+
+	GLfloat attenuation = exponent * distance * distance + linear * distance + constant;
+	return colour * diffuseIntensity * glm::max(glm::dot(normal, toLight), 0.0f) / attenuation;
 }
 
 PointLight::~PointLight()
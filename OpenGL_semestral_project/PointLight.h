@@ -1,5 +1,6 @@
 #pragma once
 #include "Light.h"
+#include "UniformTable.h"
 
 class PointLight :
 	public Light
@@ -11,9 +12,20 @@ public:
 		GLfloat xPos, GLfloat yPos, GLfloat zPos,
 		GLfloat con, GLfloat lin, GLfloat exp);
 
-	void UseLight(GLuint ambientIntensityLocation, GLuint ambientColourLocation,
-		GLuint diffuseIntensityLocation, GLuint positionLocation,
-		GLuint constantLocation, GLuint linearLocation, GLuint exponentLocation);
+	// Attenuated brightness, with 1 being full intensity on screen, below which the light no longer counts as
+	// reaching a surface. An absolute level, so brighter lights reach proportionally further
+	static constexpr GLfloat CUTOFF = 1.0f / 256.0f;
+
+	void UseLight(UniformTable& uniforms, unsigned int index);
+
+	glm::vec3 GetPosition() { return position; }
+	// Distance where the attenuated light falls under CUTOFF, FLT_MAX when it doesn't fall off
+	GLfloat GetRange() { return range; }
+	// Brightest the light gets on a sphere, 0 when the sphere is out of range. Ranks lights per draw
+	GLfloat GetInfluence(glm::vec3 centre, GLfloat radius);
+	// Attenuated diffuse term shader.frag adds at point for a surface facing normal, for bakes on the CPU.
+	// toLight and distance receive the unit direction and distance to the light
+	glm::vec3 GetDiffuse(glm::vec3 point, glm::vec3 normal, glm::vec3& toLight, GLfloat& distance);
 
 	~PointLight();
 
@@ -21,5 +33,10 @@ protected:
 	glm::vec3 position;
 
 	GLfloat constant, linear, exponent;
+	GLfloat range;
+
+	// Brightest channel before attenuation
+	GLfloat GetPeak();
+	void CalcRange();
 };
 
@@ -0,0 +1,102 @@
+#include "RenderTarget.h"
+
+#include <stdio.h>
+
+#include "GpuMemory.h"
+
+RenderTarget::RenderTarget()
+{
+	framebuffer = 0;
+	colourTexture = 0;
+	depthBuffer = 0;
+
+	width = 0;
+	height = 0;
+
+	allocation = GpuMemory::NO_ALLOCATION;
+}
+
+bool RenderTarget::CreateTarget(GLint targetWidth, GLint targetHeight)
+{
+	ClearTarget();
+
+	width = targetWidth;
+	height = targetHeight;
+
+	glGenTextures(1, &colourTexture);
+	glBindTexture(GL_TEXTURE_2D, colourTexture);
+	glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, width, height, 0, GL_RGBA, GL_UNSIGNED_BYTE, NULL);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+	glBindTexture(GL_TEXTURE_2D, 0);
+
+	glGenRenderbuffers(1, &depthBuffer);
+	glBindRenderbuffer(GL_RENDERBUFFER, depthBuffer);
+	glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH_COMPONENT24, width, height);
+	glBindRenderbuffer(GL_RENDERBUFFER, 0);
+
+	glGenFramebuffers(1, &framebuffer);
+	glBindFramebuffer(GL_FRAMEBUFFER, framebuffer);
+	glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, colourTexture, 0);
+	glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_RENDERBUFFER, depthBuffer);
+
+	GLenum status = glCheckFramebufferStatus(GL_FRAMEBUFFER);
+	glBindFramebuffer(GL_FRAMEBUFFER, 0);
+
+	if (status != GL_FRAMEBUFFER_COMPLETE)
+	{
+		printf("Render target %dx%d incomplete: 0x%x\n", width, height, status);
+		ClearTarget();
+		return false;
+	}
+
+	// RGBA8 colour plus D24, which drivers pad to 4 bytes
+	allocation = GpuMemory::Allocate(GPU_MEMORY_RENDER_TARGET, (size_t)width * height * 8, "RenderTarget");
+
+	return true;
+}
+
+void RenderTarget::Bind()
+{
+	glBindFramebuffer(GL_FRAMEBUFFER, framebuffer);
+	glViewport(0, 0, width, height);
+}
+
+void RenderTarget::BindDefault(GLint viewportWidth, GLint viewportHeight)
+{
+	glBindFramebuffer(GL_FRAMEBUFFER, 0);
+	glViewport(0, 0, viewportWidth, viewportHeight);
+}
+
+void RenderTarget::ClearTarget()
+{
+	if (framebuffer != 0)
+	{
+		glDeleteFramebuffers(1, &framebuffer);
+		framebuffer = 0;
+	}
+
+	if (colourTexture != 0)
+	{
+		glDeleteTextures(1, &colourTexture);
+		colourTexture = 0;
+	}
+
+	if (depthBuffer != 0)
+	{
+		glDeleteRenderbuffers(1, &depthBuffer);
+		depthBuffer = 0;
+	}
+
+	GpuMemory::Free(allocation);
+
+	width = 0;
+	height = 0;
+}
+
+RenderTarget::~RenderTarget()
+{
+	ClearTarget();
+}
@@ -0,0 +1,33 @@
+#pragma once
+
+#include <GL\glew.h>
+
+// Offscreen framebuffer: RGBA8 colour texture plus a 24-bit depth renderbuffer
+class RenderTarget
+{
+public:
+	RenderTarget();
+
+	bool CreateTarget(GLint targetWidth, GLint targetHeight);
+	// Binds for drawing and sets the viewport to the target size
+	void Bind();
+	static void BindDefault(GLint viewportWidth, GLint viewportHeight);
+
+	GLint GetWidth() { return width; }
+	GLint GetHeight() { return height; }
+	GLuint GetFramebuffer() { return framebuffer; }
+	GLuint GetColourTexture() { return colourTexture; }
+
+	void ClearTarget();
+
+	~RenderTarget();
+
+private:
+	GLuint framebuffer;
+	GLuint colourTexture;
+	GLuint depthBuffer;
+
+	GLint width, height;
+
+	unsigned int allocation;
+};
@@ -0,0 +1,650 @@
+#include "Scene.h"
+
+#include <stdio.h>
+#include <string.h>
+
+#include "CpuTrace.h"
+
+Scene::Scene()
+{
+	aliveCount = 0;
+	textureStreamer = nullptr;
+	loadJobs = nullptr;
+	terrain = nullptr;
+	particles = nullptr;
+	animations = nullptr;
+	modelImportFlags = MODEL_IMPORT_DEFAULT;
+
+	historyStart = 0;
+	packetSequence = 0;
+	packetCapacity = 0;
+	keepPrevious = false;
+}
+
+Entity Scene::CreateEntity()
+{
+	unsigned int index;
+
+	if (!freeIndices.empty())
+	{
+		index = freeIndices.back();
+		freeIndices.pop_back();
+	}
+	else
+	{
+		index = (unsigned int)generations.size();
+		if (index > 0x00FFFFFF)
+		{
+			printf("Scene is out of entity indices!\n");
+			return NULL_ENTITY;
+		}
+		generations.push_back(0);
+	}
+
+	aliveCount++;
+	return index | ((Entity)generations[index] << 24);
+}
+
+void Scene::DestroyEntity(Entity entity)
+{
+	if (!IsAlive(entity))
+	{
+		return;
+	}
+
+	unsigned int index = EntityIndex(entity);
+
+	transformComponents.Remove(index);
+	renderables.Remove(index);
+	materials.Remove(index);
+	directionalLights.Remove(index);
+	pointLights.Remove(index);
+	spotLights.Remove(index);
+
+	generations[index]++;
+	freeIndices.push_back(index);
+	aliveCount--;
+}
+
+bool Scene::IsAlive(Entity entity)
+{
+	unsigned int index = EntityIndex(entity);
+	return entity != NULL_ENTITY && index < generations.size() && generations[index] == (entity >> 24);
+}
+
+void Scene::Reserve(unsigned int entityCount)
+{
+	generations.reserve(entityCount);
+	transforms.Reserve(entityCount);
+	transformComponents.Reserve(entityCount);
+	renderables.Reserve(entityCount);
+	visibleSlots.reserve(entityCount);
+}
+
+Model* Scene::LoadModel(const std::string& fileName)
+{
+	Model* model = new Model();
+	model->LoadModel(fileName, textureStreamer, modelImportFlags, loadJobs);
+	models.push_back(model);
+	return model;
+}
+
+unsigned int Scene::AddTransform(Entity entity, glm::vec3 position, glm::quat rotation, glm::vec3 scale, Entity parent)
+{
+	unsigned int parentTransform = TransformStore::NO_PARENT;
+	if (parent != NULL_ENTITY && IsAlive(parent) && transformComponents.Has(EntityIndex(parent)))
+	{
+		parentTransform = transformComponents.Get(EntityIndex(parent));
+	}
+
+	unsigned int transform = transforms.CreateTransform(parentTransform);
+	transforms.SetPosition(transform, position);
+	transforms.SetRotation(transform, rotation);
+	transforms.SetScale(transform, scale);
+
+	transformComponents.Add(EntityIndex(entity), transform);
+	return transform;
+}
+
+void Scene::AddRenderable(Entity entity, Model* model)
+{
+	AddRenderable(entity, model, model->GetBounds());
+}
+
+void Scene::AddRenderable(Entity entity, Model* model, const BoundingBox& localBounds)
+{
+	unsigned int index = EntityIndex(entity);
+	if (!transformComponents.Has(index))
+	{
+		printf("Renderable entity %u needs a transform first!\n", index);
+		return;
+	}
+
+	RenderableComponent renderable;
+	renderable.model = model;
+	renderable.transform = transformComponents.Get(index);
+	// Shared models get a set of node slots per renderable, so each one draws and culls at its own transform
+	renderable.nodeBase = model ? model->CreateNodeTransforms(&transforms, renderable.transform) : TransformStore::NO_PARENT;
+	renderable.localBounds = localBounds;
+	renderable.boundsVersion = model ? model->GetBoundsVersion() : 0;
+	renderable.palette = NO_BONE_PALETTE;
+	renderables.Add(index, renderable);
+}
+
+void Scene::AddMaterial(Entity entity, const Material& material)
+{
+	materials.Add(EntityIndex(entity), material);
+}
+
+unsigned int Scene::AddAnimation(Entity entity, unsigned int clip, float startTime, float speed)
+{
+	RenderableComponent* renderable = renderables.Find(EntityIndex(entity));
+	if (!renderable || !animations || !renderable->model->IsSkinned())
+	{
+		printf("Animated entity %u needs a skinned renderable and Scene::SetAnimations first!\n", EntityIndex(entity));
+		return AnimationSystem::NO_INSTANCE;
+	}
+
+	Model* model = renderable->model;
+	const AnimationClip* animationClip = clip < model->GetClipCount() ? model->GetClip(clip) : nullptr;
+	unsigned int instance = animations->AddInstance(model->GetSkeleton(), animationClip, startTime, speed);
+	if (instance != AnimationSystem::NO_INSTANCE)
+	{
+		renderable->palette = animations->GetPaletteBase(instance);
+	}
+
+	return instance;
+}
+
+void Scene::AddDirectionalLight(Entity entity, const DirectionalLight& light)
+{
+	directionalLights.Add(EntityIndex(entity), light);
+}
+
+void Scene::AddPointLight(Entity entity, const PointLight& light)
+{
+	pointLights.Add(EntityIndex(entity), light);
+}
+
+void Scene::AddSpotLight(Entity entity, const SpotLight& light)
+{
+	spotLights.Add(EntityIndex(entity), light);
+}
+
+unsigned int Scene::GetTransform(Entity entity)
+{
+	unsigned int* transform = transformComponents.Find(EntityIndex(entity));
+	return transform ? *transform : TransformStore::NO_PARENT;
+}
+
+void Scene::Update(JobSystem* jobs)
+{
+	TRACE_SCOPE("Scene::Update");
+
+	transforms.UpdateWorldMatrices(jobs);
+
+	// Node animation changes model bounds, bring them up to date here so the parallel pass only reads them
+	for (size_t i = 0; i < models.size(); i++)
+	{
+		models[i]->UpdateHierarchy();
+	}
+
+	unsigned int count = renderables.Size();
+	if (jobs)
+	{
+		jobs->ParallelFor(count, 4096, [this](unsigned int begin, unsigned int end) { UpdateBounds(begin, end); });
+	}
+	else
+	{
+		UpdateBounds(0, count);
+	}
+}
+
+void Scene::UpdateBounds(unsigned int begin, unsigned int end)
+{
+	TRACE_SCOPE("Scene::UpdateBounds");
+
+	// Only renderables whose transform or model's nodes actually moved this frame need new world bounds
+	for (unsigned int i = begin; i < end; i++)
+	{
+		RenderableComponent& renderable = renderables.At(i);
+		bool boundsChanged = renderable.model && renderable.model->GetBoundsVersion() != renderable.boundsVersion;
+		if (boundsChanged)
+		{
+			renderable.localBounds = renderable.model->GetBounds();
+			renderable.boundsVersion = renderable.model->GetBoundsVersion();
+		}
+		else if (!transforms.WasUpdated(renderable.transform))
+		{
+			continue;
+		}
+
+		renderable.worldBounds = renderable.localBounds.Transform(transforms.GetWorldMatrix(renderable.transform));
+	}
+}
+
+const std::vector<unsigned int>& Scene::QueryVisible(const Frustum& frustum, JobSystem* jobs)
+{
+	TRACE_SCOPE("Scene::QueryVisible");
+
+	visibleSlots.clear();
+
+	unsigned int count = renderables.Size();
+	const unsigned int batchSize = 4096;
+
+	if (!jobs || count <= batchSize)
+	{
+		for (unsigned int i = 0; i < count; i++)
+		{
+			if (frustum.TestBox(renderables.At(i).worldBounds))
+			{
+				visibleSlots.push_back(i);
+			}
+		}
+
+		return visibleSlots;
+	}
+
+	// Each batch fills its own list, concatenating them keeps the slot order of the serial path
+	unsigned int batchCount = (count + batchSize - 1) / batchSize;
+	if (visibleBatches.size() < batchCount)
+	{
+		visibleBatches.resize(batchCount);
+	}
+
+	jobs->ParallelFor(count, batchSize, [this, &frustum, batchSize](unsigned int begin, unsigned int end)
+	{
+		std::vector<unsigned int>& batch = visibleBatches[begin / batchSize];
+		batch.clear();
+		for (unsigned int i = begin; i < end; i++)
+		{
+			if (frustum.TestBox(renderables.At(i).worldBounds))
+			{
+				batch.push_back(i);
+			}
+		}
+	});
+
+	for (unsigned int i = 0; i < batchCount; i++)
+	{
+		visibleSlots.insert(visibleSlots.end(), visibleBatches[i].begin(), visibleBatches[i].end());
+	}
+
+	return visibleSlots;
+}
+
+void Scene::ScheduleUpdate(JobSystem& jobs, const Frustum& frustum, JobCounter& counter)
+{
+	JobSystem* jobSystem = &jobs;
+	Frustum cullFrustum = frustum;
+
+	jobs.Run([this, jobSystem]() { Update(jobSystem); }, &transformsDone);
+	jobs.RunAfter(&transformsDone, [this, jobSystem, cullFrustum]() { QueryVisible(cullFrustum, jobSystem); }, &counter);
+}
+
+Entity Scene::Raycast(const Ray& ray, RayHit& hit, Model** hitModel)
+{
+	TRACE_SCOPE("Scene::Raycast");
+
+	Entity hitEntity = NULL_ENTITY;
+
+	for (unsigned int i = 0; i < renderables.Size(); i++)
+	{
+		RenderableComponent& renderable = renderables.At(i);
+		if (!renderable.model || !renderable.worldBounds.IntersectRay(ray.origin, ray.direction, glm::min(hit.distance, ray.maxDistance)))
+		{
+			continue;
+		}
+
+		if (renderable.model->Raycast(ray, transforms.GetWorldMatrix(renderable.transform), hit))
+		{
+			unsigned int index = renderables.EntityAt(i);
+			hitEntity = index | ((Entity)generations[index] << 24);
+			if (hitModel) *hitModel = renderable.model;
+		}
+	}
+
+	return hitEntity;
+}
+
+bool Scene::Occluded(const Ray& ray)
+{
+	for (unsigned int i = 0; i < renderables.Size(); i++)
+	{
+		RenderableComponent& renderable = renderables.At(i);
+		if (renderable.model && renderable.worldBounds.IntersectRay(ray.origin, ray.direction, ray.maxDistance) &&
+			renderable.model->Occluded(ray, transforms.GetWorldMatrix(renderable.transform)))
+		{
+			return true;
+		}
+	}
+
+	return false;
+}
+
+unsigned int Scene::BakeLighting(LightBaker& baker, JobSystem* jobs, const char* cacheFile)
+{
+	TRACE_SCOPE("Scene::BakeLighting");
+
+	baker.ClearBaker();
+
+	std::vector<std::pair<Model*, unsigned int>> targets;
+	for (unsigned int i = 0; i < renderables.Size(); i++)
+	{
+		RenderableComponent& renderable = renderables.At(i);
+		if (!renderable.model || renderable.palette != NO_BONE_PALETTE)
+		{
+			continue;
+		}
+
+		unsigned int users = 0;
+		for (unsigned int j = 0; j < renderables.Size(); j++)
+		{
+			if (renderables.At(j).model == renderable.model) users++;
+		}
+		if (users > 1)
+		{
+			printf("%s is used by %u renderables, its lighting isn't baked\n", renderable.model->GetName(), users);
+			continue;
+		}
+
+		Model* model = renderable.model;
+		model->UpdateHierarchy();
+		glm::mat4 objectWorld = transforms.GetWorldMatrix(renderable.transform);
+
+		for (unsigned int mesh = 0; mesh < model->GetMeshCount(); mesh++)
+		{
+			const std::vector<GLfloat>& vertices = model->GetMeshVertices(mesh);
+			const std::vector<unsigned int>& indices = model->GetMeshIndices(mesh);
+			if (vertices.empty() || indices.empty())
+			{
+				continue;
+			}
+
+			baker.AddMesh(&vertices[0], (unsigned int)vertices.size() / 8, &indices[0], (unsigned int)indices.size(),
+				objectWorld * model->GetNodeWorldMatrix(model->GetMeshNode(mesh)));
+			targets.push_back(std::make_pair(model, mesh));
+		}
+	}
+
+	if (targets.empty())
+	{
+		return 0;
+	}
+
+	if (directionalLights.Size() > 0)
+	{
+		baker.SetDirectionalLight(directionalLights.At(0));
+	}
+	for (unsigned int i = 0; i < pointLights.Size(); i++)
+	{
+		baker.AddPointLight(pointLights.At(i));
+	}
+	for (unsigned int i = 0; i < spotLights.Size(); i++)
+	{
+		baker.AddSpotLight(spotLights.At(i));
+	}
+
+	if (!cacheFile || !baker.LoadCache(cacheFile))
+	{
+		baker.Bake(jobs);
+		if (cacheFile)
+		{
+			baker.SaveCache(cacheFile);
+		}
+	}
+
+	for (size_t i = 0; i < targets.size(); i++)
+	{
+		targets[i].first->SetMeshBakedLight(targets[i].second, &baker.GetBakedLight((unsigned int)i)[0]);
+	}
+
+	return (unsigned int)targets.size();
+}
+
+unsigned int Scene::Render(Shader& shader, const Frustum& frustum)
+{
+	QueryVisible(frustum);
+	return RenderVisible(shader, frustum);
+}
+
+unsigned int Scene::RenderVisible(Shader& shader, const Frustum& frustum)
+{
+	if (directionalLights.Size() > 0)
+	{
+		shader.SetDirectionalLight(&directionalLights.At(0));
+	}
+	UniformTable& uniforms = shader.GetUniforms();
+	const std::vector<unsigned int>& visible = visibleSlots;
+
+	for (size_t i = 0; i < visible.size(); i++)
+	{
+		RenderableComponent& renderable = renderables.At(visible[i]);
+		if (!renderable.model)
+		{
+			continue;
+		}
+
+		Material* material = materials.Find(renderables.EntityAt(visible[i]));
+		if (material)
+		{
+			material->UseMaterial(uniforms);
+		}
+
+		LightSelection lights;
+		lightCuller.SelectLights(pointLights.Data(), pointLights.Size(), spotLights.Data(), spotLights.Size(), renderable.worldBounds, lights);
+		shader.SetSelectedLights(pointLights.Data(), spotLights.Data(), lights);
+
+		renderable.model->RenderModel(uniforms, frustum, transforms.GetWorldMatrix(renderable.transform), renderable.nodeBase);
+	}
+
+	return (unsigned int)visible.size();
+}
+
+void Scene::BuildFramePacket(FramePacket& packet, const Frustum& frustum, unsigned long long consumedSequence)
+{
+	TRACE_SCOPE("Scene::BuildFramePacket");
+
+	const unsigned int maxHistory = 64;
+
+	packetSequence++;
+
+	unsigned int changedBegin, changedEnd;
+	transforms.TakeChangedRange(changedBegin, changedEnd);
+
+	packet.movedBegin = 0;
+	packet.movedEnd = 0;
+	const glm::mat4* previousWorld = transforms.GetPreviousWorldMatrices();
+	if (previousWorld && changedBegin < changedEnd)
+	{
+		packet.movedBegin = changedBegin;
+		packet.movedEnd = changedEnd;
+		packet.previousWorldMatrices.assign(previousWorld, previousWorld + (changedEnd - changedBegin));
+		packet.previousNormalMatrices.assign(transforms.GetPreviousNormalMatrices(), transforms.GetPreviousNormalMatrices() + (changedEnd - changedBegin) * 3);
+	}
+
+	unsigned int capacity = transforms.GetCapacity();
+	if (capacity != packetCapacity)
+	{
+		// Storage moved, every older packet is stale in full
+		transformHistory.clear();
+		historyStart = packetSequence - 1;
+		changedBegin = 0;
+		changedEnd = capacity;
+		packetCapacity = capacity;
+	}
+
+	TransformChange change = { packetSequence, changedBegin, changedEnd };
+	transformHistory.push_back(change);
+	if (transformHistory.size() > maxHistory)
+	{
+		transformHistory.pop_front();
+		historyStart++;
+	}
+
+	// This slot last held an older packet, only what changed since then has to be copied
+	unsigned int copyBegin = 0, copyEnd = capacity;
+	if (packet.worldMatrices.size() == capacity)
+	{
+		ChangedSince(packet.sequence, copyBegin, copyEnd);
+	}
+	else
+	{
+		packet.worldMatrices.resize(capacity);
+		packet.normalMatrices.resize(capacity * 3);
+	}
+
+	if (copyBegin < copyEnd)
+	{
+		memcpy(&packet.worldMatrices[copyBegin], transforms.GetWorldMatrices() + copyBegin, sizeof(glm::mat4) * (copyEnd - copyBegin));
+		memcpy(&packet.normalMatrices[copyBegin * 3], transforms.GetNormalMatrices() + copyBegin * 3, sizeof(glm::vec4) * 3 * (copyEnd - copyBegin));
+	}
+
+	packet.sequence = packetSequence;
+	packet.transformCapacity = capacity;
+	ChangedSince(consumedSequence, packet.uploadBegin, packet.uploadEnd);
+
+	packet.hasDirectionalLight = directionalLights.Size() > 0;
+	if (packet.hasDirectionalLight)
+	{
+		packet.directionalLight = directionalLights.At(0);
+	}
+	packet.pointLights.assign(pointLights.Data(), pointLights.Data() + pointLights.Size());
+	packet.spotLights.assign(spotLights.Data(), spotLights.Data() + spotLights.Size());
+
+	packet.materials.clear();
+	packet.draws.clear();
+
+	for (size_t i = 0; i < visibleSlots.size(); i++)
+	{
+		RenderableComponent& renderable = renderables.At(visibleSlots[i]);
+		if (!renderable.model)
+		{
+			continue;
+		}
+
+		const glm::mat4& objectWorld = transforms.GetWorldMatrix(renderable.transform);
+		visibleNodes.clear();
+		renderable.model->CollectVisibleNodes(frustum, objectWorld, visibleNodes);
+		if (visibleNodes.empty())
+		{
+			continue;
+		}
+
+		int materialIndex = -1;
+		Material* material = materials.Find(renderables.EntityAt(visibleSlots[i]));
+		if (material)
+		{
+			materialIndex = (int)packet.materials.size();
+			packet.materials.push_back(*material);
+		}
+
+		for (size_t n = 0; n < visibleNodes.size(); n++)
+		{
+			DrawItem draw = { renderable.model, visibleNodes[n], Model::GetNodeTransform(renderable.nodeBase, visibleNodes[n]), materialIndex, 0.0f,
+				renderable.palette, LightSelection() };
+
+			// Bounding sphere radius over distance, scaled by the projection's focal length
+			BoundingBox bounds = renderable.model->GetNodeWorldBounds(visibleNodes[n], objectWorld);
+			float radius = glm::length(bounds.GetExtents());
+			float distance = glm::length(bounds.GetCentre() - packet.eyePosition);
+			draw.screenCoverage = radius * packet.projection[1][1] / (distance > radius ? distance : radius);
+
+			lightCuller.SelectLights(pointLights.Data(), pointLights.Size(), spotLights.Data(), spotLights.Size(), bounds, draw.lights);
+
+			packet.draws.push_back(draw);
+		}
+	}
+
+	packet.terrain = nullptr;
+	packet.terrainDraws.clear();
+	if (terrain)
+	{
+		terrain->Select(packet, frustum);
+	}
+
+	packet.particles = particles;
+
+	packet.animations = animations;
+	if (animations)
+	{
+		packet.bonePalette = animations->GetPalette();
+		if (keepPrevious)
+		{
+			packet.previousBonePalette.swap(lastPalette);
+			lastPalette = packet.bonePalette;
+		}
+	}
+}
+
+void Scene::SetKeepPrevious(bool enable)
+{
+	keepPrevious = enable;
+	transforms.SetKeepPrevious(enable);
+	lastPalette.clear();
+}
+
+void Scene::ChangedSince(unsigned long long sequence, unsigned int& begin, unsigned int& end)
+{
+	if (sequence < historyStart)
+	{
+		begin = 0;
+		end = packetCapacity;
+		return;
+	}
+
+	begin = packetCapacity;
+	end = 0;
+
+	for (size_t i = 0; i < transformHistory.size(); i++)
+	{
+		const TransformChange& change = transformHistory[i];
+		if (change.sequence <= sequence || change.begin >= change.end)
+		{
+			continue;
+		}
+
+		if (change.begin < begin) begin = change.begin;
+		if (change.end > end) end = change.end;
+	}
+
+	if (begin > end)
+	{
+		begin = 0;
+		end = 0;
+	}
+}
+
+void Scene::ClearScene()
+{
+	for (size_t i = 0; i < models.size(); i++)
+	{
+		models[i]->ClearModel();
+		delete models[i];
+	}
+	models.clear();
+
+	transforms.ClearTransforms();
+	transformComponents.Clear();
+	renderables.Clear();
+	materials.Clear();
+	directionalLights.Clear();
+	pointLights.Clear();
+	spotLights.Clear();
+
+	generations.clear();
+	freeIndices.clear();
+	visibleSlots.clear();
+	aliveCount = 0;
+
+	transformHistory.clear();
+	historyStart = 0;
+	packetSequence = 0;
+	packetCapacity = 0;
+	lastPalette.clear();
+}
+
+Scene::~Scene()
+{
+	ClearScene();
+}
@@ -0,0 +1,175 @@
+#pragma once
+
+#include <vector>
+#include <deque>
+#include <string>
+
+#include <glm\glm.hpp>
+#include <glm\gtc\quaternion.hpp>
+
+#include "ComponentPool.h"
+#include "TransformStore.h"
+#include "BoundingBox.h"
+#include "Frustum.h"
+#include "Model.h"
+#include "Material.h"
+#include "Shader.h"
+#include "DirectionalLight.h"
+#include "PointLight.h"
+#include "SpotLight.h"
+#include "JobSystem.h"
+#include "FramePacket.h"
+#include "Terrain.h"
+#include "ParticleSystem.h"
+#include "AnimationSystem.h"
+#include "LightCuller.h"
+#include "LightBaker.h"
+
+// Low 24 bits index the component pools, high 8 bits catch handles to destroyed entities
+typedef unsigned int Entity;
+const Entity NULL_ENTITY = 0xFFFFFFFF;
+
+struct RenderableComponent
+{
+	Model* model;
+	unsigned int transform;
+	// First of the slots Model::CreateNodeTransforms made for this renderable's nodes
+	unsigned int nodeBase;
+	// The model's bounds as of boundsVersion, refreshed when its nodes move
+	BoundingBox localBounds;
+	unsigned int boundsVersion;
+	BoundingBox worldBounds;
+	// Set by AddAnimation
+	unsigned int palette;
+};
+
+class Scene
+{
+public:
+	Scene();
+
+	Entity CreateEntity();
+	void DestroyEntity(Entity entity);
+	bool IsAlive(Entity entity);
+	unsigned int GetEntityCount() { return aliveCount; }
+	void Reserve(unsigned int entityCount);
+
+	// Models are shared assets, the scene owns them and entities point at them
+	Model* LoadModel(const std::string& fileName);
+	// Models loaded afterwards stream their textures through it
+	void SetTextureStreamer(TextureStreamer* streamer) { textureStreamer = streamer; }
+	// MODEL_IMPORT_* flags for models loaded afterwards
+	void SetModelImportFlags(unsigned int flags) { modelImportFlags = flags; }
+	// Models loaded afterwards build their ray cast BVHs on it, it has to be started
+	void SetLoadJobs(JobSystem* jobs) { loadJobs = jobs; }
+	// Selected into every packet, the scene doesn't own it
+	void SetTerrain(Terrain* sceneTerrain) { terrain = sceneTerrain; }
+	// Handed to the renderer with every packet, emitters follow their transforms
+	void SetParticles(ParticleSystem* sceneParticles) { particles = sceneParticles; }
+	// Poses for AddAnimation, updated by whoever steps the simulation, the scene doesn't own it
+	void SetAnimations(AnimationSystem* sceneAnimations) { animations = sceneAnimations; }
+
+	unsigned int AddTransform(Entity entity, glm::vec3 position, glm::quat rotation, glm::vec3 scale, Entity parent = NULL_ENTITY);
+	void AddRenderable(Entity entity, Model* model);
+	void AddRenderable(Entity entity, Model* model, const BoundingBox& localBounds);
+	void AddMaterial(Entity entity, const Material& material);
+	// Plays one of the renderable's model clips on its own pose. Returns the AnimationSystem instance,
+	// AnimationSystem::NO_INSTANCE for models without bones
+	unsigned int AddAnimation(Entity entity, unsigned int clip, float startTime = 0.0f, float speed = 1.0f);
+	void AddDirectionalLight(Entity entity, const DirectionalLight& light);
+	void AddPointLight(Entity entity, const PointLight& light);
+	void AddSpotLight(Entity entity, const SpotLight& light);
+
+	TransformStore& GetTransforms() { return transforms; }
+	unsigned int GetTransform(Entity entity);
+
+	ComponentPool<RenderableComponent>& GetRenderables() { return renderables; }
+	ComponentPool<PointLight>& GetPointLights() { return pointLights; }
+	ComponentPool<SpotLight>& GetSpotLights() { return spotLights; }
+	// Chooses the lights of every draw RenderVisible and BuildFramePacket emit
+	LightCuller& GetLightCuller() { return lightCuller; }
+
+	// Transform system then bounds system, both linear walks over packed arrays
+	void Update(JobSystem* jobs = nullptr);
+
+	// Renderable slots whose world bounds intersect the frustum
+	const std::vector<unsigned int>& QueryVisible(const Frustum& frustum, JobSystem* jobs = nullptr);
+
+	// Nearest renderable triangle along the ray, NULL_ENTITY when nothing is in the way. World bounds
+	// reject whole entities before their meshes' BVHs are walked. Simulation thread, after Update
+	Entity Raycast(const Ray& ray, RayHit& hit, Model** hitModel = nullptr);
+	// Whether anything blocks the ray before ray.maxDistance, for line of sight
+	bool Occluded(const Ray& ray);
+
+	// Transforms -> bounds -> culling as a job chain, counter drains once the visible list is ready
+	void ScheduleUpdate(JobSystem& jobs, const Frustum& frustum, JobCounter& counter);
+
+	// Indirect light of every renderable whose model kept its vertices (MODEL_IMPORT_BAKE_LIGHTING), baked
+	// into its meshes or loaded from cacheFile when nothing changed since it was written. Models shared by
+	// several renderables and animated ones are skipped, the light lives in the shared meshes.
+	// GL thread, after Update. Returns how many meshes got light
+	unsigned int BakeLighting(LightBaker& baker, JobSystem* jobs, const char* cacheFile);
+
+	unsigned int Render(Shader& shader, const Frustum& frustum);
+	// Draws the result of the last QueryVisible without culling again
+	unsigned int RenderVisible(Shader& shader, const Frustum& frustum);
+
+	// Snapshot of lights, materials, transforms and the draw list of the last QueryVisible for the GL thread.
+	// consumedSequence is the packet the renderer holds, so the upload range covers every packet it skipped
+	void BuildFramePacket(FramePacket& packet, const Frustum& frustum, unsigned long long consumedSequence);
+	// Packets also carry the moved transforms and the bone palette from before their update, so the
+	// renderer can blend objects between packets like the camera. Off by default, it copies every moved matrix
+	void SetKeepPrevious(bool enable);
+
+	void ClearScene();
+
+	~Scene();
+
+private:
+	TextureStreamer* textureStreamer;
+	unsigned int modelImportFlags;
+	JobSystem* loadJobs;
+	Terrain* terrain;
+	ParticleSystem* particles;
+	AnimationSystem* animations;
+
+	std::vector<unsigned char> generations;
+	std::vector<unsigned int> freeIndices;
+	unsigned int aliveCount;
+
+	// Transform slots are not recycled, children must always find their parent at a lower index
+	TransformStore transforms;
+	ComponentPool<unsigned int> transformComponents;
+	ComponentPool<RenderableComponent> renderables;
+	ComponentPool<Material> materials;
+	ComponentPool<DirectionalLight> directionalLights;
+	ComponentPool<PointLight> pointLights;
+	ComponentPool<SpotLight> spotLights;
+	LightCuller lightCuller;
+
+	std::vector<Model*> models;
+	std::vector<unsigned int> visibleSlots;
+	std::vector<std::vector<unsigned int>> visibleBatches;
+	JobCounter transformsDone;
+
+	void UpdateBounds(unsigned int begin, unsigned int end);
+
+	// Transform range changed by each built packet, to bring stale packets and the GPU copy up to date
+	struct TransformChange
+	{
+		unsigned long long sequence;
+		unsigned int begin, end;
+	};
+	std::deque<TransformChange> transformHistory;
+	unsigned long long historyStart;
+	unsigned long long packetSequence;
+	unsigned int packetCapacity;
+	std::vector<unsigned int> visibleNodes;
+	bool keepPrevious;
+	// Palette of the last packet, the previous one of the next
+	std::vector<glm::vec4> lastPalette;
+
+	void ChangedSince(unsigned long long sequence, unsigned int& begin, unsigned int& end);
+
+	static unsigned int EntityIndex(Entity entity) { return entity & 0x00FFFFFF; }
+};
@@ -1,32 +1,35 @@
 #include "Shader.h"
 
+#include <string.h>
+#include <chrono>
+
+#include "CpuTrace.h"
+
 Shader::Shader()
 {
-	shaderID = 0;
-	uniformModel = 0;
-	uniformProjection = 0;
-
-	pointLightCount = 0;
-	spotLightCount = 0;
+	currentFeatures = SHADER_FEATURES_DEFAULT;
 }
 
 void Shader::CreateFromString(const char* vertexCode, const char* fragmentCode)
 {
-	CompileShader(vertexCode, fragmentCode);
+	vertexSource = vertexCode;
+	fragmentSource = fragmentCode;
+
+	GetVariant(currentFeatures);
 }
 
 void Shader::CreateFromFiles(const char* vertexLocation, const char* fragmentLocation)
 {
-	std::string vertexString = ReadFile(vertexLocation);
-	std::string fragmentString = ReadFile(fragmentLocation);
-	const char* vertexCode = vertexString.c_str();
-	const char* fragmentCode = fragmentString.c_str();
+	vertexSource = ReadFile(vertexLocation);
+	fragmentSource = ReadFile(fragmentLocation);
 
-	CompileShader(vertexCode, fragmentCode);
+	GetVariant(currentFeatures);
 }
 
 std::string Shader::ReadFile(const char* fileLocation)
 {
+	TRACE_SCOPE("Shader::ReadFile");
+
 	std::string content;
 	std::ifstream fileStream(fileLocation, std::ios::in);
 
@@ -46,9 +49,69 @@ std::string Shader::ReadFile(const char* fileLocation)
 	return content;
 }
 
-void Shader::CompileShader(const char* vertexCode, const char* fragmentCode)
+std::string Shader::BuildVariantSource(const std::string& source, unsigned int features)
+{
+	std::string defines;
+
+	// Light limits live in CommonValues.h only, the GLSL side just receives them
+	defines += "#define MAX_POINT_LIGHTS " + std::to_string(MAX_POINT_LIGHTS) + "\n";
+	defines += "#define MAX_SPOT_LIGHTS " + std::to_string(MAX_SPOT_LIGHTS) + "\n";
+
+	if (features & SHADER_FEATURE_DIRECTIONAL_LIGHT) defines += "#define USE_DIRECTIONAL_LIGHT\n";
+	if (features & SHADER_FEATURE_POINT_LIGHTS) defines += "#define USE_POINT_LIGHTS\n";
+	if (features & SHADER_FEATURE_SPOT_LIGHTS) defines += "#define USE_SPOT_LIGHTS\n";
+	if (features & SHADER_FEATURE_TEXTURE) defines += "#define USE_TEXTURE\n";
+	if (features & SHADER_FEATURE_SPECULAR) defines += "#define USE_SPECULAR\n";
+	if (features & SHADER_FEATURE_FOG) defines += "#define USE_FOG\n";
+	if (features & SHADER_FEATURE_TEXTURE_ARRAY) defines += "#define USE_TEXTURE_ARRAY\n";
+	if (features & SHADER_FEATURE_TERRAIN) defines += "#define USE_TERRAIN\n";
+	if (features & SHADER_FEATURE_SKINNING) defines += "#define USE_SKINNING\n";
+	if (features & SHADER_FEATURE_DEPTH_ONLY) defines += "#define USE_DEPTH_ONLY\n";
+	if (features & SHADER_FEATURE_BAKED_LIGHTING) defines += "#define USE_BAKED_LIGHTING\n";
+
+	// #version has to stay the first statement, so defines go right after it
+	size_t versionPos = source.find("#version");
+	if (versionPos == std::string::npos)
+	{
+		return defines + source;
+	}
+
+	size_t lineEnd = source.find('\n', versionPos);
+	if (lineEnd == std::string::npos)
+	{
+		return source + "\n" + defines;
+	}
+
+	return source.substr(0, lineEnd + 1) + defines + source.substr(lineEnd + 1);
+}
+
+Shader::ShaderVariant& Shader::GetVariant(unsigned int features)
+{
+	auto found = variants.find(features);
+	if (found != variants.end())
+	{
+		return found->second;
+	}
+
+	ShaderVariant& variant = variants[features];
+	variant.shaderID = 0;
+	variant.compileTime = 0.0;
+
+	std::string vertexCode = BuildVariantSource(vertexSource, features);
+	std::string fragmentCode = BuildVariantSource(fragmentSource, features);
+
+	auto start = std::chrono::steady_clock::now();
+	CompileShader(vertexCode.c_str(), fragmentCode.c_str(), variant);
+	variant.compileTime = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+
+	return variant;
+}
+
+void Shader::CompileShader(const char* vertexCode, const char* fragmentCode, ShaderVariant& variant)
 {
-	shaderID = glCreateProgram();
+	TRACE_SCOPE("Shader::CompileShader");
+
+	GLuint shaderID = glCreateProgram();
 
 	if (!shaderID)
 	{
@@ -62,6 +125,12 @@ void Shader::CompileShader(const char* vertexCode, const char* fragmentCode)
 	GLint result = 0;
 	GLchar eLog[1024] = { 0 };
 
+	// Without the hint drivers may report a binary length of 0, PrintVariantCosts reads it
+	if (GLEW_ARB_get_program_binary)
+	{
+		glProgramParameteri(shaderID, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
+	}
+
 	glLinkProgram(shaderID);
 	glGetProgramiv(shaderID, GL_LINK_STATUS, &result);
 	if (!result)
@@ -71,6 +140,8 @@ void Shader::CompileShader(const char* vertexCode, const char* fragmentCode)
 		return;
 	}
 
+	variant.shaderID = shaderID;
+
 	glValidateProgram(shaderID);
 	glGetProgramiv(shaderID, GL_VALIDATE_STATUS, &result);
 	if (!result)
@@ -80,176 +151,149 @@ void Shader::CompileShader(const char* vertexCode, const char* fragmentCode)
 		return;
 	}
 
-	uniformProjection = glGetUniformLocation(shaderID, "projection");
-	uniformModel = glGetUniformLocation(shaderID, "model");
-	uniformView = glGetUniformLocation(shaderID, "view");
-	uniformDirectionalLight.uniformColour = glGetUniformLocation(shaderID, "directionalLight.base.colour");
-	uniformDirectionalLight.uniformAmbientIntensity = glGetUniformLocation(shaderID, "directionalLight.base.ambientIntensity");
-	uniformDirectionalLight.uniformDirection = glGetUniformLocation(shaderID, "directionalLight.direction");
-	uniformDirectionalLight.uniformDiffuseIntensity = glGetUniformLocation(shaderID, "directionalLight.base.diffuseIntensity");
-	uniformSpecularIntensity = glGetUniformLocation(shaderID, "material.specularIntensity");
-	uniformShininess = glGetUniformLocation(shaderID, "material.shininess");
-	uniformEyePosition = glGetUniformLocation(shaderID, "eyePosition");
-
-	uniformPointLightCount = glGetUniformLocation(shaderID, "pointLightCount");
+	variant.uniforms.Build(shaderID);
+}
 
-	for (size_t i = 0; i < MAX_POINT_LIGHTS; i++)
-	{
-		char locBuff[100] = { '\0' };
+void Shader::SetDirectionalLight(DirectionalLight* dLight)
+{
+	if (!(currentFeatures & SHADER_FEATURE_DIRECTIONAL_LIGHT)) return;
 
-		snprintf(locBuff, sizeof(locBuff), "pointLights[%d].base.colour", i);
-		uniformPointLight[i].uniformColour = glGetUniformLocation(shaderID, locBuff);
+	dLight->UseLight(Current().uniforms);
+}
 
-		snprintf(locBuff, sizeof(locBuff), "pointLights[%d].base.ambientIntensity", i);
-		uniformPointLight[i].uniformAmbientIntensity = glGetUniformLocation(shaderID, locBuff);
+void Shader::SetPointLights(PointLight* pLight, unsigned int lightCount)
+{
+	if (!(currentFeatures & SHADER_FEATURE_POINT_LIGHTS)) return;
+	if (lightCount > MAX_POINT_LIGHTS) lightCount = MAX_POINT_LIGHTS;
 
-		snprintf(locBuff, sizeof(locBuff), "pointLights[%d].base.diffuseIntensity", i);
-		uniformPointLight[i].uniformDiffuseIntensity = glGetUniformLocation(shaderID, locBuff);
+	UniformTable& uniforms = Current().uniforms;
+	uniforms.SetInt(Uniforms::PointLightCount, lightCount);
 
-		snprintf(locBuff, sizeof(locBuff), "pointLights[%d].position", i);
-		uniformPointLight[i].uniformPosition = glGetUniformLocation(shaderID, locBuff);
+	for (unsigned int i = 0; i < lightCount; i++)
+	{
+		pLight[i].UseLight(uniforms, i);
+	}
+}
 
-		snprintf(locBuff, sizeof(locBuff), "pointLights[%d].constant", i);
-		uniformPointLight[i].uniformConstant = glGetUniformLocation(shaderID, locBuff);
+void Shader::SetSpotLights(SpotLight* sLight, unsigned int lightCount)
+{
+	if (!(currentFeatures & SHADER_FEATURE_SPOT_LIGHTS)) return;
+	if (lightCount > MAX_SPOT_LIGHTS) lightCount = MAX_SPOT_LIGHTS;
 
-		snprintf(locBuff, sizeof(locBuff), "pointLights[%d].linear", i);
-		uniformPointLight[i].uniformLinear = glGetUniformLocation(shaderID, locBuff);
+	UniformTable& uniforms = Current().uniforms;
+	uniforms.SetInt(Uniforms::SpotLightCount, lightCount);
 
-		snprintf(locBuff, sizeof(locBuff), "pointLights[%d].exponent", i);
-		uniformPointLight[i].uniformExponent = glGetUniformLocation(shaderID, locBuff);
+	for (unsigned int i = 0; i < lightCount; i++)
+	{
+		sLight[i].UseLight(uniforms, i);
 	}
+}
 
-	uniformSpotLightCount = glGetUniformLocation(shaderID, "spotLightCount");
+void Shader::SetSelectedLights(PointLight* pLight, SpotLight* sLight, const LightSelection& selection)
+{
+	UniformTable& uniforms = Current().uniforms;
 
-	for (size_t i = 0; i < MAX_SPOT_LIGHTS; i++)
+	if (currentFeatures & SHADER_FEATURE_POINT_LIGHTS)
 	{
-		char locBuff[100] = { '\0' };
-
-		snprintf(locBuff, sizeof(locBuff), "spotLights[%d].base.base.colour", i);
-		uniformSpotLight[i].uniformColour = glGetUniformLocation(shaderID, locBuff);
-
-		snprintf(locBuff, sizeof(locBuff), "spotLights[%d].base.base.ambientIntensity", i);
-		uniformSpotLight[i].uniformAmbientIntensity = glGetUniformLocation(shaderID, locBuff);
-
-		snprintf(locBuff, sizeof(locBuff), "spotLights[%d].base.base.diffuseIntensity", i);
-		uniformSpotLight[i].uniformDiffuseIntensity = glGetUniformLocation(shaderID, locBuff);
-
-		snprintf(locBuff, sizeof(locBuff), "spotLights[%d].base.position", i);
-		uniformSpotLight[i].uniformPosition = glGetUniformLocation(shaderID, locBuff);
-
-		snprintf(locBuff, sizeof(locBuff), "spotLights[%d].base.constant", i);
-		uniformSpotLight[i].uniformConstant = glGetUniformLocation(shaderID, locBuff);
-
-		snprintf(locBuff, sizeof(locBuff), "spotLights[%d].base.linear", i);
-		uniformSpotLight[i].uniformLinear = glGetUniformLocation(shaderID, locBuff);
-
-		snprintf(locBuff, sizeof(locBuff), "spotLights[%d].base.exponent", i);
-		uniformSpotLight[i].uniformExponent = glGetUniformLocation(shaderID, locBuff);
-
-		snprintf(locBuff, sizeof(locBuff), "spotLights[%d].direction", i);
-		uniformSpotLight[i].uniformDirection = glGetUniformLocation(shaderID, locBuff);
+		uniforms.SetInt(Uniforms::PointLightCount, selection.pointCount);
+		for (unsigned int i = 0; i < selection.pointCount; i++)
+		{
+			pLight[selection.pointLights[i]].UseLight(uniforms, i);
+		}
+	}
 
-		snprintf(locBuff, sizeof(locBuff), "spotLights[%d].edge", i);
-		uniformSpotLight[i].uniformEdge = glGetUniformLocation(shaderID, locBuff);
+	if (currentFeatures & SHADER_FEATURE_SPOT_LIGHTS)
+	{
+		uniforms.SetInt(Uniforms::SpotLightCount, selection.spotCount);
+		for (unsigned int i = 0; i < selection.spotCount; i++)
+		{
+			sLight[selection.spotLights[i]].UseLight(uniforms, i);
+		}
 	}
 }
 
-GLuint Shader::GetProjectionLocation()
-{
-	return uniformProjection;
-}
-GLuint Shader::GetModelLocation()
-{
-	return uniformModel;
-}
-GLuint Shader::GetViewLocation()
-{
-	return uniformView;
-}
-GLuint Shader::GetAmbientColourLocation()
-{
-	return uniformDirectionalLight.uniformColour;
-}
-GLuint Shader::GetAmbientIntensityLocation()
-{
-	return uniformDirectionalLight.uniformAmbientIntensity;
-}
-GLuint Shader::GetDiffuseIntensityLocation()
-{
-	return uniformDirectionalLight.uniformDiffuseIntensity;
-}
-GLuint Shader::GetDirectionLocation()
+void Shader::SetFog(glm::vec3 colour, GLfloat density)
 {
-	return uniformDirectionalLight.uniformDirection;
-}
-GLuint Shader::GetSpecularIntensityLocation()
-{
-	return uniformSpecularIntensity;
-}
-GLuint Shader::GetShininessLocation()
-{
-	return uniformShininess;
-}
-GLuint Shader::GetEyePositionLocation()
-{
-	return uniformEyePosition;
+	if (!(currentFeatures & SHADER_FEATURE_FOG)) return;
+
+	UniformTable& uniforms = Current().uniforms;
+	uniforms.SetVec3(Uniforms::FogColour, colour);
+	uniforms.SetFloat(Uniforms::FogDensity, density);
 }
 
-void Shader::SetDirectionalLight(DirectionalLight* dLight)
+void Shader::UseShader()
 {
-	dLight->UseLight(uniformDirectionalLight.uniformAmbientIntensity, uniformDirectionalLight.uniformColour,
-		uniformDirectionalLight.uniformDiffuseIntensity, uniformDirectionalLight.uniformDirection);
+	glUseProgram(Current().shaderID);
 }
 
-void Shader::SetPointLights(PointLight* pLight, unsigned int lightCount)
+void Shader::UseShader(unsigned int features)
 {
-	if (lightCount > MAX_POINT_LIGHTS) lightCount = MAX_POINT_LIGHTS;
-
-	glUniform1i(uniformPointLightCount, lightCount);
-
-	for (size_t i = 0; i < lightCount; i++)
-	{
-		pLight[i].UseLight(uniformPointLight[i].uniformAmbientIntensity, uniformPointLight[i].uniformColour,
-			uniformPointLight[i].uniformDiffuseIntensity, uniformPointLight[i].uniformPosition,
-			uniformPointLight[i].uniformConstant, uniformPointLight[i].uniformLinear, uniformPointLight[i].uniformExponent);
-	}
+	currentFeatures = features;
+	glUseProgram(GetVariant(features).shaderID);
 }
 
-void Shader::SetSpotLights(SpotLight* sLight, unsigned int lightCount)
+void Shader::PrintVariantCosts()
 {
-	if (lightCount > MAX_SPOT_LIGHTS) lightCount = MAX_SPOT_LIGHTS;
+	static const char* featureNames[SHADER_FEATURE_COUNT] = { "dir", "point", "spot", "tex", "spec", "fog", "array", "terrain", "skin", "depth", "baked" };
 
-	glUniform1i(uniformSpotLightCount, lightCount);
+	printf("Shader variants: %zu\n", variants.size());
+	printf("  %-28s %10s %10s %12s %10s\n", "features", "compile ms", "uniforms", "light evals", "binary B");
 
-	for (size_t i = 0; i < lightCount; i++)
+	for (auto& entry : variants)
 	{
-		sLight[i].UseLight(uniformSpotLight[i].uniformAmbientIntensity, uniformSpotLight[i].uniformColour,
-			uniformSpotLight[i].uniformDiffuseIntensity, uniformSpotLight[i].uniformPosition, uniformSpotLight[i].uniformDirection,
-			uniformSpotLight[i].uniformConstant, uniformSpotLight[i].uniformLinear, uniformSpotLight[i].uniformExponent,
-			uniformSpotLight[i].uniformEdge);
+		unsigned int features = entry.first;
+		ShaderVariant& variant = entry.second;
+
+		std::string name;
+		for (unsigned int i = 0; i < SHADER_FEATURE_COUNT; i++)
+		{
+			if (features & (1u << i))
+			{
+				if (!name.empty()) name += "+";
+				name += featureNames[i];
+			}
+		}
+		if (name.empty()) name = "none";
+
+		// Worst-case CalcLightByDirection calls per fragment, the dominant ALU term of shader.frag
+		int lightEvaluations = 0;
+		if (features & SHADER_FEATURE_DIRECTIONAL_LIGHT) lightEvaluations += 1;
+		if (features & SHADER_FEATURE_POINT_LIGHTS) lightEvaluations += MAX_POINT_LIGHTS;
+		if (features & SHADER_FEATURE_SPOT_LIGHTS) lightEvaluations += MAX_SPOT_LIGHTS;
+
+		GLint activeUniforms = (GLint)variant.uniforms.GetSize();
+		GLint binaryLength = 0;
+		if (variant.shaderID)
+		{
+			// GLSL has no portable instruction counter, the driver's program binary size is the closest measure
+			if (GLEW_ARB_get_program_binary)
+			{
+				glGetProgramiv(variant.shaderID, GL_PROGRAM_BINARY_LENGTH, &binaryLength);
+			}
+		}
+
+		printf("  %-28s %10.2f %10d %12d %10d\n", name.c_str(), variant.compileTime, activeUniforms, lightEvaluations, binaryLength);
 	}
 }
 
-void Shader::UseShader()
-{
-	glUseProgram(shaderID);
-}
-
 void Shader::ClearShader()
 {
-	if (shaderID != 0)
+	for (auto& entry : variants)
 	{
-		glDeleteProgram(shaderID);
-		shaderID = 0;
+		if (entry.second.shaderID != 0)
+		{
+			glDeleteProgram(entry.second.shaderID);
+		}
 	}
 
-	uniformModel = 0;
-	uniformProjection = 0;
+	variants.clear();
 }
 
 
 void Shader::AddShader(GLuint theProgram, const char* shaderCode, GLenum shaderType)
 {
+	TRACE_SCOPE("Shader::AddShader");
+
 	GLuint theShader = glCreateShader(shaderType);
 
 	const GLchar* theCode[1];
@@ -4,14 +4,18 @@
 #include <string>
 #include <iostream>
 #include <fstream>
+#include <unordered_map>
 
 #include <GL\glew.h>
+#include <glm\glm.hpp>
 
 #include "CommonValues.h"
 
 #include "DirectionalLight.h"
 #include "PointLight.h"
 #include "SpotLight.h"
+#include "LightCuller.h"
+#include "UniformTable.h"
 
 class Shader
 {
@@ -23,71 +27,45 @@ public:
 
 	std::string ReadFile(const char* fileLocation);
 
-	GLuint GetProjectionLocation();
-	GLuint GetModelLocation();
-	GLuint GetViewLocation();
-	GLuint GetAmbientIntensityLocation();
-	GLuint GetAmbientColourLocation();
-	GLuint GetDiffuseIntensityLocation();
-	GLuint GetDirectionLocation();
-	GLuint GetSpecularIntensityLocation();
-	GLuint GetShininessLocation();
-	GLuint GetEyePositionLocation();
+	// Uniforms of the currently selected variant, introspected once at link time
+	UniformTable& GetUniforms() { return Current().uniforms; }
 
 	void SetDirectionalLight(DirectionalLight* dLight);
 	void SetPointLights(PointLight* pLight, unsigned int lightCount);
 	void SetSpotLights(SpotLight* sLight, unsigned int lightCount);
+	// Only the selected entries of the two lists, in the selection's order
+	void SetSelectedLights(PointLight* pLight, SpotLight* sLight, const LightSelection& selection);
+	void SetFog(glm::vec3 colour, GLfloat density);
 
+	// Binds the variant built for the SHADER_FEATURE_* mask, compiling it on first use
 	void UseShader();
+	void UseShader(unsigned int features);
+	unsigned int GetFeatures() { return currentFeatures; }
+
+	void PrintVariantCosts();
 	void ClearShader();
 
 	~Shader();
 
 private:
-	int pointLightCount;
-	int spotLightCount;
-
-	GLuint shaderID, uniformProjection, uniformModel, uniformView, uniformEyePosition,
-		uniformSpecularIntensity, uniformShininess;
-
-	struct {
-		GLuint uniformColour;
-		GLuint uniformAmbientIntensity;
-		GLuint uniformDiffuseIntensity;
-
-		GLuint uniformDirection;
-	} uniformDirectionalLight;
+	struct ShaderVariant
+	{
+		GLuint shaderID;
+		UniformTable uniforms;
 
-	GLuint uniformPointLightCount;
+		double compileTime;
+	};
 
-	struct {
-		GLuint uniformColour;
-		GLuint uniformAmbientIntensity;
-		GLuint uniformDiffuseIntensity;
+	std::string vertexSource;
+	std::string fragmentSource;
 
-		GLuint uniformPosition;
-		GLuint uniformConstant;
-		GLuint uniformLinear;
-		GLuint uniformExponent;
-	} uniformPointLight[MAX_POINT_LIGHTS];
+	std::unordered_map<unsigned int, ShaderVariant> variants;
+	unsigned int currentFeatures;
 
-	GLuint uniformSpotLightCount;
+	ShaderVariant& GetVariant(unsigned int features);
+	ShaderVariant& Current() { return GetVariant(currentFeatures); }
+	std::string BuildVariantSource(const std::string& source, unsigned int features);
 
-	struct {
-		GLuint uniformColour;
-		GLuint uniformAmbientIntensity;
-		GLuint uniformDiffuseIntensity;
-
-		GLuint uniformPosition;
-		GLuint uniformConstant;
-		GLuint uniformLinear;
-		GLuint uniformExponent;
-
-		GLuint uniformDirection;
-		GLuint uniformEdge;
-	} uniformSpotLight[MAX_SPOT_LIGHTS];
-
-	void CompileShader(const char* vertexCode, const char* fragmentCode);
+	void CompileShader(const char* vertexCode, const char* fragmentCode, ShaderVariant& variant);
 	void AddShader(GLuint theProgram, const char* shaderCode, GLenum shaderType);
 };
-
@@ -0,0 +1,19 @@
+#version 330
+
+in vec4 colour;
+in vec2 corner;
+
+out vec4 fragColour;
+
+void main()
+{
+#ifdef USE_POINTS
+	vec2 offset = gl_PointCoord * 2.0 - 1.0;
+#else
+	vec2 offset = corner;
+#endif
+
+	// Soft round sprite, blended additively so draw order doesn't matter
+	float falloff = max(1.0 - dot(offset, offset), 0.0);
+	fragColour = colour * (falloff * falloff);
+}
@@ -0,0 +1,44 @@
+#version 330
+
+layout (location = 0) in vec4 positionAge;
+layout (location = 1) in vec4 velocityLife;
+
+out vec4 colour;
+out vec2 corner;
+
+uniform mat4 projection;
+uniform mat4 view;
+
+uniform vec4 particleColourStart;
+uniform vec4 particleColourEnd;
+// Size at birth, size at death, viewport height in pixels
+uniform vec3 particleShape;
+
+void main()
+{
+	if (positionAge.w < 0.0 || positionAge.w >= velocityLife.w)
+	{
+		// Unborn and dead particles land outside the clip volume
+		gl_Position = vec4(2.0, 2.0, 2.0, 1.0);
+		colour = vec4(0.0);
+		corner = vec2(0.0);
+		return;
+	}
+
+	float t = positionAge.w / velocityLife.w;
+	float size = mix(particleShape.x, particleShape.y, t);
+	colour = mix(particleColourStart, particleColourEnd, t);
+
+	vec4 viewPosition = view * vec4(positionAge.xyz, 1.0);
+
+#ifdef USE_POINTS
+	gl_Position = projection * viewPosition;
+	gl_PointSize = max(size * projection[1][1] * particleShape.z * 0.5 / gl_Position.w, 1.0);
+	corner = vec2(0.0);
+#else
+	// Instanced strip of four vertices, expanded in view space so it always faces the camera
+	corner = vec2(gl_VertexID & 1, gl_VertexID >> 1) * 2.0 - 1.0;
+	viewPosition.xy += corner * size * 0.5;
+	gl_Position = projection * viewPosition;
+#endif
+}
@@ -0,0 +1,68 @@
+// Shared by particle_update.vert (transform feedback) and particle_update.comp, ParticleSystem splices it
+// in after their #version line. A particle is two vec4s: position + age, velocity + lifetime.
+// Negative age is a particle waiting to be born, age past lifetime a dead one that respawns at the emitter
+
+uniform mat4 emitterWorld;
+uniform vec3 emitterOrigin;
+uniform vec3 emitterDirection;
+uniform float emitterSpread;
+// Speed min / max, lifetime min / max
+uniform vec4 emitterRanges;
+// Acceleration in world space, drag per second
+uniform vec4 emitterForces;
+uniform int emitterActive;
+
+uniform float deltaTime;
+uniform int frameSeed;
+
+float Hash(uint x)
+{
+	x ^= x >> 16;
+	x *= 0x7feb352du;
+	x ^= x >> 15;
+	x *= 0x846ca68bu;
+	x ^= x >> 16;
+	return float(x) * (1.0 / 4294967296.0);
+}
+
+void Simulate(inout vec4 positionAge, inout vec4 velocityLife, uint id)
+{
+	positionAge.w += deltaTime;
+	if (positionAge.w < 0.0)
+	{
+		return;
+	}
+
+	if (positionAge.w < velocityLife.w)
+	{
+		velocityLife.xyz += emitterForces.xyz * deltaTime;
+		velocityLife.xyz *= max(1.0 - emitterForces.w * deltaTime, 0.0);
+		positionAge.xyz += velocityLife.xyz * deltaTime;
+		return;
+	}
+
+	if (emitterActive == 0)
+	{
+		// Stays dead until the emitter comes back on
+		positionAge.w = velocityLife.w;
+		return;
+	}
+
+	uint seed = id * 4u + uint(frameSeed) * 2654435761u;
+	float life = mix(emitterRanges.z, emitterRanges.w, Hash(seed));
+	float speed = mix(emitterRanges.x, emitterRanges.y, Hash(seed + 1u));
+
+	// Uniform direction in the cone around emitterDirection
+	float cosTheta = mix(1.0, cos(emitterSpread), Hash(seed + 2u));
+	float sinTheta = sqrt(max(1.0 - cosTheta * cosTheta, 0.0));
+	float phi = 6.2831853 * Hash(seed + 3u);
+	vec3 helper = abs(emitterDirection.y) < 0.99 ? vec3(0.0, 1.0, 0.0) : vec3(1.0, 0.0, 0.0);
+	vec3 tangent = normalize(cross(helper, emitterDirection));
+	vec3 bitangent = cross(emitterDirection, tangent);
+	vec3 local = (tangent * cos(phi) + bitangent * sin(phi)) * sinTheta + emitterDirection * cosTheta;
+
+	// Whatever of the frame is left after the old particle died goes to the new one
+	float age = min(positionAge.w - velocityLife.w, deltaTime);
+	velocityLife = vec4(normalize(mat3(emitterWorld) * local) * speed, life);
+	positionAge = vec4((emitterWorld * vec4(emitterOrigin, 1.0)).xyz + velocityLife.xyz * age, age);
+}
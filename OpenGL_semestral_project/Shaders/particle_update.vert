@@ -0,0 +1,18 @@
+#version 330
+
+layout (location = 0) in vec4 positionAge;
+layout (location = 1) in vec4 velocityLife;
+
+// Captured by transform feedback into the other buffer, nothing is rasterised
+out vec4 outPositionAge;
+out vec4 outVelocityLife;
+
+void main()
+{
+	vec4 position = positionAge;
+	vec4 velocity = velocityLife;
+	Simulate(position, velocity, uint(gl_VertexID));
+
+	outPositionAge = position;
+	outVelocityLife = velocity;
+}
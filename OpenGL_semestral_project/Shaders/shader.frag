@@ -1,14 +1,18 @@
 #version 330
 
+// MAX_POINT_LIGHTS, MAX_SPOT_LIGHTS and the USE_* feature switches are injected
+// by Shader::BuildVariantSource from CommonValues.h, one set per variant.
+
 in vec4 vCol;
 in vec2 TexCoord;
 in vec3 Normal;
 in vec3 FragPos;
 
-out vec4 colour;
+#ifdef USE_BAKED_LIGHTING
+in vec3 BakedLight;
+#endif
 
-const int MAX_POINT_LIGHTS = 3;
-const int MAX_SPOT_LIGHTS = 3;
+out vec4 colour;
 
 struct Light
 {
@@ -45,14 +49,35 @@ struct Material
 	float shininess;
 };
 
-uniform int pointLightCount;
-uniform int spotLightCount;
-
+#ifdef USE_DIRECTIONAL_LIGHT
 uniform DirectionalLight directionalLight;
+#endif
+
+#ifdef USE_POINT_LIGHTS
+uniform int pointLightCount;
 uniform PointLight pointLights[MAX_POINT_LIGHTS];
+#endif
+
+#ifdef USE_SPOT_LIGHTS
+uniform int spotLightCount;
 uniform SpotLight spotLights[MAX_SPOT_LIGHTS];
+#endif
 
+#ifdef USE_TEXTURE
 uniform sampler2D theTexture;
+#endif
+
+#ifdef USE_TEXTURE_ARRAY
+uniform sampler2DArray theTextureArray;
+// Negative for meshes of models that were imported without texture arrays
+uniform int textureLayer;
+#endif
+
+#ifdef USE_FOG
+uniform vec3 fogColour;
+uniform float fogDensity;
+#endif
+
 uniform Material material;
 
 uniform vec3 eyePosition;
@@ -66,6 +91,7 @@ vec4 CalcLightByDirection(Light light, vec3 direction)
 	
 	vec4 specularColour = vec4(0, 0, 0, 0);
 	
+#ifdef USE_SPECULAR
 	if(diffuseFactor > 0.0f)
 	{
 		vec3 fragToEye = normalize(eyePosition - FragPos);
@@ -78,15 +104,19 @@ vec4 CalcLightByDirection(Light light, vec3 direction)
 			specularColour = vec4(light.colour * material.specularIntensity * specularFactor, 1.0f);
 		}
 	}
+#endif
 
 	return (ambientColour + diffuseColour + specularColour);
 }
 
+#ifdef USE_DIRECTIONAL_LIGHT
 vec4 CalcDirectionalLight()
 {
 	return CalcLightByDirection(directionalLight.base, directionalLight.direction);
 }
+#endif
 
+#if defined(USE_POINT_LIGHTS) || defined(USE_SPOT_LIGHTS)
 vec4 CalcPointLight(PointLight pLight)
 {
 	vec3 direction = FragPos - pLight.position;
@@ -100,7 +130,9 @@ vec4 CalcPointLight(PointLight pLight)
 	
 	return (colour / attenuation);
 }
+#endif
 
+#ifdef USE_SPOT_LIGHTS
 vec4 CalcSpotLight(SpotLight sLight)
 {
 	vec3 rayDirection = normalize(FragPos - sLight.base.position);
@@ -116,7 +148,9 @@ vec4 CalcSpotLight(SpotLight sLight)
 		return vec4(0, 0, 0, 0);
 	}
 }
+#endif
 
+#ifdef USE_POINT_LIGHTS
 vec4 CalcPointLights()
 {
 	vec4 totalColour = vec4(0, 0, 0, 0);
@@ -127,7 +161,9 @@ vec4 CalcPointLights()
 	
 	return totalColour;
 }
+#endif
 
+#ifdef USE_SPOT_LIGHTS
 vec4 CalcSpotLights()
 {
 	vec4 totalColour = vec4(0, 0, 0, 0);
@@ -138,12 +174,44 @@ vec4 CalcSpotLights()
 	
 	return totalColour;
 }
+#endif
 
+#ifdef USE_DEPTH_ONLY
+// Depth pre-pass, colour writes are masked off and the depth comes from the rasteriser
 void main()
 {
-	vec4 finalColour = CalcDirectionalLight();
+}
+#else
+void main()
+{
+	vec4 finalColour = vec4(0, 0, 0, 0);
+#ifdef USE_DIRECTIONAL_LIGHT
+	finalColour += CalcDirectionalLight();
+#endif
+#ifdef USE_POINT_LIGHTS
 	finalColour += CalcPointLights();
+#endif
+#ifdef USE_SPOT_LIGHTS
 	finalColour += CalcSpotLights();
-	
+#endif
+#ifdef USE_BAKED_LIGHTING
+	// Light that bounced off static geometry, the direct part above stays dynamic
+	finalColour += vec4(BakedLight, 0.0f);
+#endif
+
+#if defined(USE_TEXTURE) && defined(USE_TEXTURE_ARRAY)
+	vec4 texel = textureLayer >= 0 ? texture(theTextureArray, vec3(TexCoord, float(textureLayer))) : texture(theTexture, TexCoord);
+	colour = texel * finalColour;
+#elif defined(USE_TEXTURE)
 	colour = texture(theTexture, TexCoord) * finalColour;
-}
\ No newline at end of file
+#else
+	colour = finalColour;
+#endif
+
+#ifdef USE_FOG
+	float fogDistance = length(eyePosition - FragPos);
+	float fogFactor = clamp(exp2(-fogDensity * fogDensity * fogDistance * fogDistance), 0.0f, 1.0f);
+	colour = vec4(mix(fogColour, colour.rgb, fogFactor), colour.a);
+#endif
+}
+#endif
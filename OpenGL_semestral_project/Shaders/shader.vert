@@ -4,23 +4,107 @@ layout (location = 0) in vec3 pos;
 layout (location = 1) in vec2 tex;
 layout (location = 2) in vec3 norm;
 
+#ifdef USE_TERRAIN
+// Where the vertex lands on the next coarser terrain level, Terrain builds chunks in world space
+layout (location = 3) in vec3 morphPos;
+uniform float terrainMorphStart;
+uniform float terrainMorphEnd;
+uniform vec3 eyePosition;
+#endif
+
+#ifdef USE_SKINNING
+// Up to four bones of the mesh and their weights, AnimationSystem fills the palette every frame
+layout (location = 4) in uvec4 boneJoints;
+layout (location = 5) in vec4 boneWeights;
+// Three RGBA32F rows of an affine matrix per bone
+uniform samplerBuffer bonePalette;
+// First palette bone of the instance's mesh, -1 for the meshes of a skinned model that have no bones
+uniform int boneBase;
+#endif
+
+#ifdef USE_BAKED_LIGHTING
+// Indirect light from LightBaker, meshes that weren't baked leave the attribute disabled and read 0
+layout (location = 6) in vec3 bakedLight;
+out vec3 BakedLight;
+#endif
+
 out vec4 vCol;
 out vec2 TexCoord;
 out vec3 Normal;
 out vec3 FragPos;
 
-uniform mat4 model;
+// The depth pre-pass and the lighting pass compare depths with GL_EQUAL, both variants have to land on
+// exactly the same positions
+invariant gl_Position;
+
+// World and normal matrices computed by TransformStore, 4 and 3 RGBA32F texels per object
+uniform samplerBuffer modelMatrices;
+uniform samplerBuffer normalMatrices;
+uniform int transformIndex;
+
 uniform mat4 projection;
 uniform mat4 view;
 
+#ifdef USE_SKINNING
+mat4 BoneMatrix(uint joint)
+{
+	int row = (boneBase + int(joint)) * 3;
+	return transpose(mat4(texelFetch(bonePalette, row),
+		texelFetch(bonePalette, row + 1),
+		texelFetch(bonePalette, row + 2),
+		vec4(0.0, 0.0, 0.0, 1.0)));
+}
+#endif
+
 void main()
 {
-	gl_Position = projection * view * model * vec4(pos, 1.0);
+#ifdef USE_TERRAIN
+	// CDLOD: slide onto the coarser grid with distance, so levels meet without cracks
+	float morph = clamp((distance(eyePosition, pos) - terrainMorphStart) / (terrainMorphEnd - terrainMorphStart), 0.0, 1.0);
+	vec4 worldPos = vec4(mix(pos, morphPos, morph), 1.0);
+	mat3 normalMatrix = mat3(1.0);
+#else
+	int modelBase = transformIndex * 4;
+	mat4 model = mat4(texelFetch(modelMatrices, modelBase),
+		texelFetch(modelMatrices, modelBase + 1),
+		texelFetch(modelMatrices, modelBase + 2),
+		texelFetch(modelMatrices, modelBase + 3));
+
+	int normalBase = transformIndex * 3;
+	mat3 normalMatrix = mat3(texelFetch(normalMatrices, normalBase).xyz,
+		texelFetch(normalMatrices, normalBase + 1).xyz,
+		texelFetch(normalMatrices, normalBase + 2).xyz);
+
+#ifdef USE_SKINNING
+	// Linear blend skinning into the mesh node's space, the node's transform does the rest as usual
+	mat4 skin = mat4(1.0);
+	if (boneBase >= 0)
+	{
+		skin = BoneMatrix(boneJoints.x) * boneWeights.x + BoneMatrix(boneJoints.y) * boneWeights.y +
+			BoneMatrix(boneJoints.z) * boneWeights.z + BoneMatrix(boneJoints.w) * boneWeights.w;
+	}
+	vec4 worldPos = model * (skin * vec4(pos, 1.0));
+	// Cofactor matrix, the inverse transpose up to a scale the fragment shader normalizes away.
+	// Joints may scale non-uniformly, a mirrored blend keeps its normals facing out by the determinant's sign
+	mat3 blend = mat3(skin);
+	vec3 cofactor0 = cross(blend[1], blend[2]);
+	float handedness = dot(blend[0], cofactor0) < 0.0 ? -1.0 : 1.0;
+	normalMatrix = normalMatrix * (mat3(cofactor0, cross(blend[2], blend[0]), cross(blend[0], blend[1])) * handedness);
+#else
+	vec4 worldPos = model * vec4(pos, 1.0);
+#endif
+#endif
+
+	gl_Position = projection * view * worldPos;
 	vCol = vec4(clamp(pos, 0.0f, 1.0f), 1.0f);
 	
 	TexCoord = tex;
 	
-	Normal = mat3(transpose(inverse(model))) * norm;
+	Normal = normalMatrix * norm;
 	
-	FragPos = (model * vec4(pos, 1.0)).xyz; 
-}
\ No newline at end of file
+	FragPos = worldPos.xyz; 
+
+#ifdef USE_BAKED_LIGHTING
+	BakedLight = bakedLight;
+#endif
+}
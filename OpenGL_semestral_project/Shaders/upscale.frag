@@ -0,0 +1,44 @@
+#version 330
+
+in vec2 screenCoord;
+
+out vec4 colour;
+
+uniform sampler2D sourceTexture;
+// xy: rendered size in texels, zw: 1 / full size of the texture it sits in the corner of
+uniform vec4 sourceSize;
+
+// Texel coordinates never leave the rendered rectangle, the rest of the texture holds stale frames
+vec3 SampleClamped(vec2 texel)
+{
+	texel = clamp(texel, vec2(0.5), sourceSize.xy - 0.5);
+	return texture(sourceTexture, texel * sourceSize.zw).rgb;
+}
+
+void main()
+{
+	// Catmull-Rom in 9 bilinear taps: the middle two weights of each axis share one fetch
+	vec2 position = screenCoord * sourceSize.xy;
+	vec2 centre = floor(position - 0.5) + 0.5;
+	vec2 f = position - centre;
+
+	vec2 w0 = f * (-0.5 + f * (1.0 - 0.5 * f));
+	vec2 w1 = 1.0 + f * f * (-2.5 + 1.5 * f);
+	vec2 w2 = f * (0.5 + f * (2.0 - 1.5 * f));
+	vec2 w3 = f * f * (-0.5 + 0.5 * f);
+
+	vec2 w12 = w1 + w2;
+	vec2 offset12 = w2 / w12;
+
+	vec2 t0 = centre - 1.0;
+	vec2 t12 = centre + offset12;
+	vec2 t3 = centre + 2.0;
+
+	vec3 result =
+		(SampleClamped(vec2(t0.x, t0.y)) * w0.x + SampleClamped(vec2(t12.x, t0.y)) * w12.x + SampleClamped(vec2(t3.x, t0.y)) * w3.x) * w0.y +
+		(SampleClamped(vec2(t0.x, t12.y)) * w0.x + SampleClamped(vec2(t12.x, t12.y)) * w12.x + SampleClamped(vec2(t3.x, t12.y)) * w3.x) * w12.y +
+		(SampleClamped(vec2(t0.x, t3.y)) * w0.x + SampleClamped(vec2(t12.x, t3.y)) * w12.x + SampleClamped(vec2(t3.x, t3.y)) * w3.x) * w3.y;
+
+	// The negative lobes can overshoot on hard edges
+	colour = vec4(max(result, vec3(0.0)), 1.0);
+}
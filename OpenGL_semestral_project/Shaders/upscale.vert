@@ -0,0 +1,11 @@
+#version 330
+
+out vec2 screenCoord;
+
+void main()
+{
+	// One triangle covering the viewport, no vertex buffer needed
+	vec2 corner = vec2((gl_VertexID << 1) & 2, gl_VertexID & 2);
+	screenCoord = corner;
+	gl_Position = vec4(corner * 2.0 - 1.0, 0.0, 1.0);
+}
@@ -0,0 +1,216 @@
+#include "Skeleton.h"
+
+#include "CpuTrace.h"
+
+#if defined(_M_X64) || defined(_M_IX86) || defined(__SSE2__)
+#define SKELETON_SIMD 1
+#include <emmintrin.h>
+#endif
+
+const unsigned int Skeleton::NO_JOINT;
+const unsigned int Skeleton::PALETTE_ROWS;
+
+void LocalPose::Resize(unsigned int laneCount)
+{
+	// Padding lanes stay identity so they never produce NaNs in the SIMD paths
+	positionX.resize(laneCount, 0.0f);
+	positionY.resize(laneCount, 0.0f);
+	positionZ.resize(laneCount, 0.0f);
+	rotationX.resize(laneCount, 0.0f);
+	rotationY.resize(laneCount, 0.0f);
+	rotationZ.resize(laneCount, 0.0f);
+	rotationW.resize(laneCount, 1.0f);
+	scaleX.resize(laneCount, 1.0f);
+	scaleY.resize(laneCount, 1.0f);
+	scaleZ.resize(laneCount, 1.0f);
+}
+
+Skeleton::Skeleton()
+{
+}
+
+unsigned int Skeleton::AddJoint(const std::string& name, unsigned int parent, glm::vec3 position, glm::quat rotation, glm::vec3 scale)
+{
+	unsigned int joint = (unsigned int)parents.size();
+	parents.push_back(parent);
+	names.push_back(name);
+
+	bindPose.Resize((joint + 4) & ~3u);
+	bindPose.positionX[joint] = position.x;
+	bindPose.positionY[joint] = position.y;
+	bindPose.positionZ[joint] = position.z;
+	bindPose.rotationX[joint] = rotation.x;
+	bindPose.rotationY[joint] = rotation.y;
+	bindPose.rotationZ[joint] = rotation.z;
+	bindPose.rotationW[joint] = rotation.w;
+	bindPose.scaleX[joint] = scale.x;
+	bindPose.scaleY[joint] = scale.y;
+	bindPose.scaleZ[joint] = scale.z;
+
+	return joint;
+}
+
+unsigned int Skeleton::AddBone(unsigned int joint, unsigned int meshJoint, const glm::mat4& offset)
+{
+	SkinBone bone;
+	bone.joint = joint;
+	bone.meshJoint = meshJoint;
+	bone.offset = offset;
+	bones.push_back(bone);
+
+	return (unsigned int)bones.size() - 1;
+}
+
+unsigned int Skeleton::FindJoint(const std::string& name) const
+{
+	for (size_t i = 0; i < names.size(); i++)
+	{
+		if (names[i] == name)
+		{
+			return (unsigned int)i;
+		}
+	}
+
+	return NO_JOINT;
+}
+
+void Skeleton::ComputeLocalBlock(const LocalPose& pose, unsigned int first, glm::mat4* local)
+{
+#ifdef SKELETON_SIMD
+	// Same T * R * S as TransformStore, four joints straight from the SoA pose
+	__m128 qx = _mm_loadu_ps(&pose.rotationX[first]);
+	__m128 qy = _mm_loadu_ps(&pose.rotationY[first]);
+	__m128 qz = _mm_loadu_ps(&pose.rotationZ[first]);
+	__m128 qw = _mm_loadu_ps(&pose.rotationW[first]);
+
+	__m128 one = _mm_set1_ps(1.0f);
+	__m128 two = _mm_set1_ps(2.0f);
+	__m128 zero = _mm_setzero_ps();
+
+	__m128 xx = _mm_mul_ps(qx, qx), yy = _mm_mul_ps(qy, qy), zz = _mm_mul_ps(qz, qz);
+	__m128 xy = _mm_mul_ps(qx, qy), xz = _mm_mul_ps(qx, qz), yz = _mm_mul_ps(qy, qz);
+	__m128 wx = _mm_mul_ps(qw, qx), wy = _mm_mul_ps(qw, qy), wz = _mm_mul_ps(qw, qz);
+
+	__m128 r[3][3];
+	r[0][0] = _mm_sub_ps(one, _mm_mul_ps(two, _mm_add_ps(yy, zz)));
+	r[0][1] = _mm_mul_ps(two, _mm_add_ps(xy, wz));
+	r[0][2] = _mm_mul_ps(two, _mm_sub_ps(xz, wy));
+	r[1][0] = _mm_mul_ps(two, _mm_sub_ps(xy, wz));
+	r[1][1] = _mm_sub_ps(one, _mm_mul_ps(two, _mm_add_ps(xx, zz)));
+	r[1][2] = _mm_mul_ps(two, _mm_add_ps(yz, wx));
+	r[2][0] = _mm_mul_ps(two, _mm_add_ps(xz, wy));
+	r[2][1] = _mm_mul_ps(two, _mm_sub_ps(yz, wx));
+	r[2][2] = _mm_sub_ps(one, _mm_mul_ps(two, _mm_add_ps(xx, yy)));
+
+	__m128 scale[3] = { _mm_loadu_ps(&pose.scaleX[first]), _mm_loadu_ps(&pose.scaleY[first]), _mm_loadu_ps(&pose.scaleZ[first]) };
+
+	for (int column = 0; column < 3; column++)
+	{
+		__m128 s = scale[column];
+		__m128 m0 = _mm_mul_ps(r[column][0], s), m1 = _mm_mul_ps(r[column][1], s), m2 = _mm_mul_ps(r[column][2], s), m3 = zero;
+		_MM_TRANSPOSE4_PS(m0, m1, m2, m3);
+		_mm_storeu_ps(&local[0][column][0], m0);
+		_mm_storeu_ps(&local[1][column][0], m1);
+		_mm_storeu_ps(&local[2][column][0], m2);
+		_mm_storeu_ps(&local[3][column][0], m3);
+	}
+
+	__m128 t0 = _mm_loadu_ps(&pose.positionX[first]), t1 = _mm_loadu_ps(&pose.positionY[first]), t2 = _mm_loadu_ps(&pose.positionZ[first]), t3 = one;
+	_MM_TRANSPOSE4_PS(t0, t1, t2, t3);
+	_mm_storeu_ps(&local[0][3][0], t0);
+	_mm_storeu_ps(&local[1][3][0], t1);
+	_mm_storeu_ps(&local[2][3][0], t2);
+	_mm_storeu_ps(&local[3][3][0], t3);
+#else
+	for (unsigned int i = 0; i < 4; i++)
+	{
+		unsigned int id = first + i;
+		glm::quat rotation(pose.rotationW[id], pose.rotationX[id], pose.rotationY[id], pose.rotationZ[id]);
+		glm::mat3 basis = glm::mat3_cast(rotation);
+		local[i] = glm::mat4(1.0f);
+		local[i][0] = glm::vec4(basis[0] * pose.scaleX[id], 0.0f);
+		local[i][1] = glm::vec4(basis[1] * pose.scaleY[id], 0.0f);
+		local[i][2] = glm::vec4(basis[2] * pose.scaleZ[id], 0.0f);
+		local[i][3] = glm::vec4(pose.positionX[id], pose.positionY[id], pose.positionZ[id], 1.0f);
+	}
+#endif
+}
+
+#ifdef SKELETON_SIMD
+// a * b for column-major matrices, one column of the result per iteration
+static void MultiplyMatrices(const glm::mat4& a, const glm::mat4& b, glm::mat4& result)
+{
+	__m128 a0 = _mm_loadu_ps(&a[0][0]), a1 = _mm_loadu_ps(&a[1][0]), a2 = _mm_loadu_ps(&a[2][0]), a3 = _mm_loadu_ps(&a[3][0]);
+	for (int column = 0; column < 4; column++)
+	{
+		__m128 sum = _mm_mul_ps(a0, _mm_set1_ps(b[column][0]));
+		sum = _mm_add_ps(sum, _mm_mul_ps(a1, _mm_set1_ps(b[column][1])));
+		sum = _mm_add_ps(sum, _mm_mul_ps(a2, _mm_set1_ps(b[column][2])));
+		sum = _mm_add_ps(sum, _mm_mul_ps(a3, _mm_set1_ps(b[column][3])));
+		_mm_storeu_ps(&result[column][0], sum);
+	}
+}
+#else
+static void MultiplyMatrices(const glm::mat4& a, const glm::mat4& b, glm::mat4& result)
+{
+	result = a * b;
+}
+#endif
+
+void Skeleton::BuildPalette(const LocalPose& pose, std::vector<glm::mat4>& scratch, glm::vec4* palette) const
+{
+	unsigned int jointCount = GetJointCount();
+	unsigned int laneCount = GetLaneCount();
+	scratch.resize(laneCount);
+
+	for (unsigned int first = 0; first < laneCount; first += 4)
+	{
+		ComputeLocalBlock(pose, first, &scratch[first]);
+	}
+
+	// Parent first order, so every parent is already in model space when its children get to it
+	for (unsigned int i = 0; i < jointCount; i++)
+	{
+		if (parents[i] != NO_JOINT)
+		{
+			glm::mat4 local = scratch[i];
+			MultiplyMatrices(scratch[parents[i]], local, scratch[i]);
+		}
+	}
+
+	// A mesh's bones are contiguous, so its node is inverted once rather than per bone
+	unsigned int invertedJoint = NO_JOINT;
+	glm::mat4 meshInverse(1.0f);
+	glm::mat4 jointToMesh, bone;
+	for (size_t b = 0; b < bones.size(); b++)
+	{
+		const SkinBone& skin = bones[b];
+		if (skin.meshJoint != invertedJoint)
+		{
+			meshInverse = skin.meshJoint == NO_JOINT ? glm::mat4(1.0f) : glm::inverse(scratch[skin.meshJoint]);
+			invertedJoint = skin.meshJoint;
+		}
+
+		MultiplyMatrices(meshInverse, scratch[skin.joint], jointToMesh);
+		MultiplyMatrices(jointToMesh, skin.offset, bone);
+
+		// Rows of the top 3x4, the bottom row of an affine matrix is implied
+		glm::vec4* rows = &palette[b * PALETTE_ROWS];
+		rows[0] = glm::vec4(bone[0][0], bone[1][0], bone[2][0], bone[3][0]);
+		rows[1] = glm::vec4(bone[0][1], bone[1][1], bone[2][1], bone[3][1]);
+		rows[2] = glm::vec4(bone[0][2], bone[1][2], bone[2][2], bone[3][2]);
+	}
+}
+
+void Skeleton::ClearSkeleton()
+{
+	parents.clear();
+	names.clear();
+	bindPose.Resize(0);
+	bones.clear();
+}
+
+Skeleton::~Skeleton()
+{
+	ClearSkeleton();
+}
@@ -0,0 +1,63 @@
+#pragma once
+
+#include <vector>
+#include <string>
+
+#include <glm\glm.hpp>
+#include <glm\gtc\quaternion.hpp>
+
+// Local joint transforms as structure of arrays, padded to a multiple of 4 joints for the SIMD paths
+struct LocalPose
+{
+	std::vector<float> positionX, positionY, positionZ;
+	std::vector<float> rotationX, rotationY, rotationZ, rotationW;
+	std::vector<float> scaleX, scaleY, scaleZ;
+
+	void Resize(unsigned int laneCount);
+};
+
+// One palette entry: a joint seen from the node its mesh hangs off, after the mesh's inverse bind matrix
+struct SkinBone
+{
+	unsigned int joint;
+	unsigned int meshJoint;
+	glm::mat4 offset;
+};
+
+// Joint hierarchy in parent-first order plus the bones skinned meshes reference. A pose goes in as
+// local transforms and comes out as the bone palette shader.vert (USE_SKINNING) reads: three RGBA32F
+// rows of an affine matrix per bone
+class Skeleton
+{
+public:
+	static const unsigned int NO_JOINT = 0xFFFFFFFF;
+	static const unsigned int PALETTE_ROWS = 3;
+
+	Skeleton();
+
+	// Parents have to be added before their children
+	unsigned int AddJoint(const std::string& name, unsigned int parent, glm::vec3 position, glm::quat rotation, glm::vec3 scale);
+	unsigned int AddBone(unsigned int joint, unsigned int meshJoint, const glm::mat4& offset);
+
+	unsigned int FindJoint(const std::string& name) const;
+	unsigned int GetJointCount() const { return (unsigned int)parents.size(); }
+	unsigned int GetLaneCount() const { return (unsigned int)bindPose.positionX.size(); }
+	unsigned int GetBoneCount() const { return (unsigned int)bones.size(); }
+	const LocalPose& GetBindPose() const { return bindPose; }
+
+	// Writes GetBoneCount() * PALETTE_ROWS rows. scratch is reused between calls, one per thread
+	void BuildPalette(const LocalPose& pose, std::vector<glm::mat4>& scratch, glm::vec4* palette) const;
+
+	void ClearSkeleton();
+
+	~Skeleton();
+
+private:
+	std::vector<unsigned int> parents;
+	std::vector<std::string> names;
+	LocalPose bindPose;
+	std::vector<SkinBone> bones;
+
+	// Local matrices of joints [first, first + 4)
+	static void ComputeLocalBlock(const LocalPose& pose, unsigned int first, glm::mat4* local);
+};
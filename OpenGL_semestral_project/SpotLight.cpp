@@ -1,6 +1,6 @@
 #include "SpotLight.h"
 
-
+#include <algorithm>
 
 SpotLight::SpotLight() : PointLight()
 {
@@ -22,22 +22,19 @@ SpotLight::SpotLight(GLfloat red, GLfloat green, GLfloat blue,
 	procEdge = cosf(glm::radians(edge));
 }
 
-void SpotLight::UseLight(GLuint ambientIntensityLocation, GLuint ambientColourLocation,
-	GLuint diffuseIntensityLocation, GLuint positionLocation, GLuint directionLocation,
-	GLuint constantLocation, GLuint linearLocation, GLuint exponentLocation,
-	GLuint edgeLocation)
+void SpotLight::UseLight(UniformTable& uniforms, unsigned int index)
 {
-	glUniform3f(ambientColourLocation, colour.x, colour.y, colour.z);
-	glUniform1f(ambientIntensityLocation, ambientIntensity);
-	glUniform1f(diffuseIntensityLocation, diffuseIntensity);
+	uniforms.SetVec3(UniformElement(Uniforms::SpotColour, index), colour);
+	uniforms.SetFloat(UniformElement(Uniforms::SpotAmbientIntensity, index), ambientIntensity);
+	uniforms.SetFloat(UniformElement(Uniforms::SpotDiffuseIntensity, index), diffuseIntensity);
 
-	glUniform3f(positionLocation, position.x, position.y, position.z);
-	glUniform1f(constantLocation, constant);
-	glUniform1f(linearLocation, linear);
-	glUniform1f(exponentLocation, exponent);
+	uniforms.SetVec3(UniformElement(Uniforms::SpotPosition, index), position);
+	uniforms.SetFloat(UniformElement(Uniforms::SpotConstant, index), constant);
+	uniforms.SetFloat(UniformElement(Uniforms::SpotLinear, index), linear);
+	uniforms.SetFloat(UniformElement(Uniforms::SpotExponent, index), exponent);
 
-	glUniform3f(directionLocation, direction.x, direction.y, direction.z);
-	glUniform1f(edgeLocation, procEdge);
+	uniforms.SetVec3(UniformElement(Uniforms::SpotDirection, index), direction);
+	uniforms.SetFloat(UniformElement(Uniforms::SpotEdge, index), procEdge);
 }
 
 void SpotLight::SetFlash(glm::vec3 pos, glm::vec3 dir)
@@ -46,6 +43,39 @@ void SpotLight::SetFlash(glm::vec3 pos, glm::vec3 dir)
 	direction = dir;
 }
 
+GLfloat SpotLight::GetInfluence(glm::vec3 centre, GLfloat radius)
+{
+	glm::vec3 toCentre = centre - position;
+	GLfloat along = glm::dot(toCentre, direction);
+	if (along < -radius)
+	{
+		return 0.0f;
+	}
+
+	// Distance from the centre to the cone's surface, measured square to the surface
+	GLfloat across = sqrtf(std::max(glm::dot(toCentre, toCentre) - along * along, 0.0f));
+	GLfloat sinEdge = sqrtf(std::max(1.0f - procEdge * procEdge, 0.0f));
+	if (procEdge * across - sinEdge * along > radius)
+	{
+		return 0.0f;
+	}
+
+	return PointLight::GetInfluence(centre, radius);
+}
+
+glm::vec3 SpotLight::GetDiffuse(glm::vec3 point, glm::vec3 normal, glm::vec3& toLight, GLfloat& distance)
+{
+	glm::vec3 diffuse = PointLight::GetDiffuse(point, normal, toLight, distance);
+
+	GLfloat factor = glm::dot(-toLight, direction);
+	if (factor <= procEdge || distance <= 0.0f)
+	{
+		return glm::vec3(0.0f);
+	}
+
+	return diffuse * (1.0f - (1.0f - factor) * (1.0f / (1.0f - procEdge)));
+}
+
 SpotLight::~SpotLight()
 {
 }
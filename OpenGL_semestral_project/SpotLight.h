@@ -13,13 +13,15 @@ public:
 		GLfloat con, GLfloat lin, GLfloat exp,
 		GLfloat edg);
 
-	void UseLight(GLuint ambientIntensityLocation, GLuint ambientColourLocation,
-		GLuint diffuseIntensityLocation, GLuint positionLocation, GLuint directionLocation,
-		GLuint constantLocation, GLuint linearLocation, GLuint exponentLocation,
-		GLuint edgeLocation);
+	void UseLight(UniformTable& uniforms, unsigned int index);
 
 	void SetFlash(glm::vec3 pos, glm::vec3 dir);
 
+	// PointLight's influence, and 0 for spheres wholly outside the cone
+	GLfloat GetInfluence(glm::vec3 centre, GLfloat radius);
+	// PointLight's diffuse term faded towards the edge the way shader.frag does
+	glm::vec3 GetDiffuse(glm::vec3 point, glm::vec3 normal, glm::vec3& toLight, GLfloat& distance);
+
 	~SpotLight();
 
 private:
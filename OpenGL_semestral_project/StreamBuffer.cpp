@@ -0,0 +1,238 @@
+#include "StreamBuffer.h"
+
+#include <stdio.h>
+
+#include "Clock.h"
+#include "CpuTrace.h"
+#include "GpuMemory.h"
+
+const unsigned int StreamBuffer::FRAMES_IN_FLIGHT;
+
+StreamBuffer::StreamBuffer()
+{
+	target = GL_ARRAY_BUFFER;
+	buffer = 0;
+	persistent = false;
+
+	frameSize = 0;
+	frameUsed = 0;
+	currentRegion = 0;
+
+	mapped = nullptr;
+	frameBase = nullptr;
+	for (unsigned int i = 0; i < FRAMES_IN_FLIGHT; i++)
+	{
+		fences[i] = 0;
+	}
+	inFrame = false;
+
+	frameCount = 0;
+	streamedBytes = 0;
+	stallCount = 0;
+	overflowCount = 0;
+	stallTime = 0.0;
+
+	allocation = GpuMemory::NO_ALLOCATION;
+}
+
+void StreamBuffer::CreateBuffer(GLenum bufferTarget, GLsizeiptr size, bool allowPersistent)
+{
+	ClearBuffer();
+
+	target = bufferTarget;
+	frameSize = size;
+	persistent = allowPersistent && (GLEW_VERSION_4_4 || GLEW_ARB_buffer_storage);
+
+	glGenBuffers(1, &buffer);
+	glBindBuffer(target, buffer);
+
+	if (persistent)
+	{
+		GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+		glBufferStorage(target, frameSize * FRAMES_IN_FLIGHT, nullptr, flags);
+		mapped = (unsigned char*)glMapBufferRange(target, 0, frameSize * FRAMES_IN_FLIGHT, flags);
+		if (!mapped)
+		{
+			printf("Failed to map %lld byte stream buffer persistently, falling back to orphaning\n", (long long)(frameSize * FRAMES_IN_FLIGHT));
+			glBindBuffer(target, 0);
+			glDeleteBuffers(1, &buffer);
+			glGenBuffers(1, &buffer);
+			glBindBuffer(target, buffer);
+			persistent = false;
+		}
+	}
+
+	if (!persistent)
+	{
+		glBufferData(target, frameSize, nullptr, GL_STREAM_DRAW);
+	}
+
+	glBindBuffer(target, 0);
+
+	allocation = GpuMemory::Allocate(GPU_MEMORY_UNIFORM, persistent ? frameSize * FRAMES_IN_FLIGHT : frameSize, "StreamBuffer");
+}
+
+void StreamBuffer::BeginFrame()
+{
+	if (buffer == 0 || inFrame)
+	{
+		return;
+	}
+
+	frameUsed = 0;
+
+	if (persistent)
+	{
+		GLsync fence = fences[currentRegion];
+		if (fence)
+		{
+			// Zero timeout first so only frames that really wait show up as stalls
+			GLenum result = glClientWaitSync(fence, 0, 0);
+			if (result == GL_TIMEOUT_EXPIRED)
+			{
+				TRACE_SCOPE("StreamBuffer stall");
+				double start = Clock::Now();
+				stallCount++;
+				do
+				{
+					result = glClientWaitSync(fence, GL_SYNC_FLUSH_COMMANDS_BIT, 1000000000);
+				} while (result == GL_TIMEOUT_EXPIRED);
+				stallTime += Clock::Now() - start;
+			}
+			if (result == GL_WAIT_FAILED)
+			{
+				printf("StreamBuffer fence wait failed\n");
+			}
+
+			glDeleteSync(fence);
+			fences[currentRegion] = 0;
+		}
+
+		frameBase = mapped + frameSize * currentRegion;
+	}
+	else
+	{
+		// Orphan the old storage, the driver keeps it alive for draws still in flight
+		glBindBuffer(target, buffer);
+		glBufferData(target, frameSize, nullptr, GL_STREAM_DRAW);
+		frameBase = (unsigned char*)glMapBufferRange(target, 0, frameSize, GL_MAP_WRITE_BIT | GL_MAP_UNSYNCHRONIZED_BIT);
+		glBindBuffer(target, 0);
+		if (!frameBase)
+		{
+			printf("Failed to map stream buffer\n");
+		}
+	}
+
+	inFrame = true;
+}
+
+void* StreamBuffer::Allocate(GLsizeiptr size, GLsizeiptr alignment, GLintptr& offset)
+{
+	if (!inFrame || !frameBase)
+	{
+		return nullptr;
+	}
+
+	GLsizeiptr start = frameUsed;
+	if (alignment > 1)
+	{
+		start = (start + alignment - 1) / alignment * alignment;
+	}
+
+	if (start + size > frameSize)
+	{
+		overflowCount++;
+		return nullptr;
+	}
+
+	frameUsed = start + size;
+	offset = (persistent ? frameSize * currentRegion : 0) + start;
+
+	return frameBase + start;
+}
+
+void StreamBuffer::FinishWrites()
+{
+	if (!inFrame || persistent || !frameBase)
+	{
+		return;
+	}
+
+	glBindBuffer(target, buffer);
+	glUnmapBuffer(target);
+	glBindBuffer(target, 0);
+	frameBase = nullptr;
+}
+
+void StreamBuffer::EndFrame()
+{
+	if (!inFrame)
+	{
+		return;
+	}
+
+	FinishWrites();
+
+	if (persistent)
+	{
+		fences[currentRegion] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+		currentRegion = (currentRegion + 1) % FRAMES_IN_FLIGHT;
+	}
+
+	frameBase = nullptr;
+	frameCount++;
+	streamedBytes += frameUsed;
+	inFrame = false;
+}
+
+void StreamBuffer::PrintStats()
+{
+	if (buffer == 0 || frameCount == 0)
+	{
+		return;
+	}
+
+	printf("Stream buffer, %s, %u x %.1f KB\n", persistent ? "persistent" : "orphaning",
+		persistent ? FRAMES_IN_FLIGHT : 1, frameSize / 1024.0);
+	printf("  streamed:        %8.1f KB per frame\n", streamedBytes / 1024.0 / frameCount);
+	printf("  stalls:          %8llu (%.3f ms total)\n", stallCount, stallTime * 1000.0);
+	printf("  overflows:       %8llu\n", overflowCount);
+}
+
+void StreamBuffer::ClearBuffer()
+{
+	for (unsigned int i = 0; i < FRAMES_IN_FLIGHT; i++)
+	{
+		if (fences[i])
+		{
+			glDeleteSync(fences[i]);
+			fences[i] = 0;
+		}
+	}
+
+	if (buffer != 0)
+	{
+		if (mapped || frameBase)
+		{
+			glBindBuffer(target, buffer);
+			glUnmapBuffer(target);
+			glBindBuffer(target, 0);
+		}
+		glDeleteBuffers(1, &buffer);
+		buffer = 0;
+		GpuMemory::Free(allocation);
+	}
+
+	mapped = nullptr;
+	frameBase = nullptr;
+	frameSize = 0;
+	frameUsed = 0;
+	currentRegion = 0;
+	persistent = false;
+	inFrame = false;
+}
+
+StreamBuffer::~StreamBuffer()
+{
+	ClearBuffer();
+}
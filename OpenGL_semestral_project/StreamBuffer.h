@@ -0,0 +1,65 @@
+#pragma once
+
+#include <GL\glew.h>
+
+// Ring of per-frame regions for data that is rewritten every frame. With GL 4.4 / ARB_buffer_storage
+// the whole ring is mapped once (persistent + coherent) and each region is guarded by a fence, so
+// writes go straight into driver memory and only wait when the GPU is FRAMES_IN_FLIGHT frames behind.
+// Without it every frame orphans a single region and maps it unsynchronised (GL 3.3 path)
+class StreamBuffer
+{
+public:
+	static const unsigned int FRAMES_IN_FLIGHT = 3;
+
+	StreamBuffer();
+
+	// frameSize bytes available between BeginFrame and EndFrame. Uses orphaning when persistent
+	// mapping isn't allowed, isn't supported or fails
+	void CreateBuffer(GLenum bufferTarget, GLsizeiptr frameSize, bool allowPersistent = true);
+	bool IsCreated() { return buffer != 0; }
+	bool IsPersistent() { return persistent; }
+
+	// Waits for the GPU to release the next region (counted as a stall when it has to)
+	void BeginFrame();
+	// Aligned region of the current frame, nullptr when the frame is full. offset is relative to GetBuffer()
+	void* Allocate(GLsizeiptr size, GLsizeiptr alignment, GLintptr& offset);
+	// Makes the writes visible, has to come before any draw that reads this frame's regions
+	void FinishWrites();
+	// Fences the region once every draw reading it has been submitted
+	void EndFrame();
+
+	GLuint GetBuffer() { return buffer; }
+	GLsizeiptr GetFrameSize() { return frameSize; }
+
+	GLsizeiptr GetFrameBytes() { return frameUsed; }
+	unsigned long long GetStallCount() { return stallCount; }
+	unsigned long long GetOverflowCount() { return overflowCount; }
+
+	void PrintStats();
+
+	void ClearBuffer();
+
+	~StreamBuffer();
+
+private:
+	GLenum target;
+	GLuint buffer;
+	bool persistent;
+
+	GLsizeiptr frameSize;
+	GLsizeiptr frameUsed;
+	unsigned int currentRegion;
+
+	unsigned char* mapped;
+	unsigned char* frameBase;
+	GLsync fences[FRAMES_IN_FLIGHT];
+	bool inFrame;
+
+	unsigned long long frameCount;
+	unsigned long long streamedBytes;
+	unsigned long long stallCount;
+	unsigned long long overflowCount;
+	double stallTime;
+
+	unsigned int allocation;
+};
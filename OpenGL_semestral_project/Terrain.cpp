@@ -0,0 +1,701 @@
+#include "Terrain.h"
+
+#include <stdio.h>
+#include <algorithm>
+
+#include "CpuTrace.h"
+#include "GpuMemory.h"
+
+const unsigned int Terrain::CHUNK_QUADS;
+constexpr float Terrain::PREFETCH_SCALE;
+
+// Position, texture coordinate, normal, position on the next coarser grid
+static const unsigned int TERRAIN_VERTEX_FLOATS = 11;
+
+static bool BoxIntersectsSphere(const BoundingBox& box, glm::vec3 centre, float radius)
+{
+	glm::vec3 closest = glm::clamp(centre, box.min, box.max);
+	glm::vec3 offset = closest - centre;
+	return glm::dot(offset, offset) <= radius * radius;
+}
+
+Terrain::Terrain()
+{
+	width = 0;
+	depth = 0;
+	spacing = 1.0f;
+	origin = glm::vec3(0.0f, 0.0f, 0.0f);
+
+	levelCount = 0;
+	lodDistance = 0.0f;
+
+	texture = nullptr;
+	textureTile = 1.0f;
+	material = Material(0.2f, 4.0f);
+
+	maxChunks = 1024;
+	buildBudget = 8;
+	nextChunkId = 1;
+	selectFrame = 0;
+
+	IBO = 0;
+	quadrantIndexCount = 0;
+	indexAllocation = GpuMemory::NO_ALLOCATION;
+
+	builtCount = 0;
+	evictedCount = 0;
+	lastDrawCount = 0;
+	maxDrawCount = 0;
+	lastTriangles = 0;
+	maxTriangles = 0;
+}
+
+bool Terrain::LoadHeightmap(const char* fileName, float worldSize, float heightScale, glm::vec3 terrainOrigin)
+{
+	TRACE_SCOPE("Terrain::LoadHeightmap");
+
+	int channels;
+	unsigned short* data = stbi_load_16(fileName, &width, &depth, &channels, 1);
+	if (!data)
+	{
+		printf("Failed to find: %s\n", fileName);
+		width = 0;
+		depth = 0;
+		return false;
+	}
+
+	if (width < 2 || depth < 2)
+	{
+		printf("Heightmap %s is too small\n", fileName);
+		stbi_image_free(data);
+		width = 0;
+		depth = 0;
+		return false;
+	}
+
+	heights.resize((size_t)width * depth);
+	for (size_t i = 0; i < heights.size(); i++)
+	{
+		heights[i] = data[i] / 65535.0f * heightScale;
+	}
+	stbi_image_free(data);
+
+	spacing = worldSize / (float)(std::max(width, depth) - 1);
+	origin = terrainOrigin;
+
+	// Level L nodes cover CHUNK_QUADS << L samples, the root level is a single node
+	nodesX.clear();
+	nodesZ.clear();
+	levelCount = 0;
+	while (true)
+	{
+		unsigned int nodeSize = CHUNK_QUADS << levelCount;
+		nodesX.push_back((width - 1 + nodeSize - 1) / nodeSize);
+		nodesZ.push_back((depth - 1 + nodeSize - 1) / nodeSize);
+		levelCount++;
+		if (nodesX.back() == 1 && nodesZ.back() == 1)
+		{
+			break;
+		}
+	}
+
+	BuildHeightRanges();
+	SetLodDistance(lodDistance);
+
+	printf("Terrain %s: %dx%d samples, %.1f units across, %u levels\n", fileName, width, depth, worldSize, levelCount);
+
+	return true;
+}
+
+void Terrain::SetLodDistance(float distance)
+{
+	// A level L node has to be fully morphed before its coarser neighbour starts morphing,
+	// which holds while its diagonal stays under about 0.66 of its range
+	float minimum = CHUNK_QUADS * spacing * 2.5f;
+	lodDistance = distance > minimum ? distance : minimum;
+
+	BuildLodRanges();
+}
+
+void Terrain::SetStreaming(unsigned int maxResidentChunks, unsigned int buildsPerFrame)
+{
+	maxChunks = maxResidentChunks;
+	buildBudget = buildsPerFrame > 0 ? buildsPerFrame : 1;
+}
+
+void Terrain::SetTexture(Texture* terrainTexture, float tileSize)
+{
+	texture = terrainTexture;
+	textureTile = tileSize > 0.0f ? tileSize : 1.0f;
+}
+
+float Terrain::Sample(int x, int z)
+{
+	x = std::min(std::max(x, 0), width - 1);
+	z = std::min(std::max(z, 0), depth - 1);
+	return heights[(size_t)z * width + x];
+}
+
+glm::vec3 Terrain::SamplePosition(int x, int z)
+{
+	// Clamping the position as well as the height turns chunk parts past the edge into degenerate triangles
+	x = std::min(std::max(x, 0), width - 1);
+	z = std::min(std::max(z, 0), depth - 1);
+	return origin + glm::vec3(x * spacing, heights[(size_t)z * width + x], z * spacing);
+}
+
+float Terrain::GetHeight(float x, float z)
+{
+	if (heights.empty())
+	{
+		return origin.y;
+	}
+
+	float localX = (x - origin.x) / spacing;
+	float localZ = (z - origin.z) / spacing;
+	int x0 = (int)floorf(localX);
+	int z0 = (int)floorf(localZ);
+	float fx = localX - x0;
+	float fz = localZ - z0;
+
+	float top = Sample(x0, z0) * (1.0f - fx) + Sample(x0 + 1, z0) * fx;
+	float bottom = Sample(x0, z0 + 1) * (1.0f - fx) + Sample(x0 + 1, z0 + 1) * fx;
+
+	return origin.y + top * (1.0f - fz) + bottom * fz;
+}
+
+BoundingBox Terrain::GetBounds()
+{
+	if (levelCount == 0)
+	{
+		return BoundingBox();
+	}
+
+	return GetNodeBounds(levelCount - 1, 0, 0);
+}
+
+BoundingBox Terrain::GetNodeBounds(unsigned int level, unsigned int x, unsigned int z)
+{
+	int nodeSize = CHUNK_QUADS << level;
+	int minX = std::min((int)x * nodeSize, width - 1), maxX = std::min((int)(x + 1) * nodeSize, width - 1);
+	int minZ = std::min((int)z * nodeSize, depth - 1), maxZ = std::min((int)(z + 1) * nodeSize, depth - 1);
+
+	glm::vec2 range = heightRanges[level][z * nodesX[level] + x];
+
+	return BoundingBox(origin + glm::vec3(minX * spacing, range.x, minZ * spacing),
+		origin + glm::vec3(maxX * spacing, range.y, maxZ * spacing));
+}
+
+void Terrain::BuildHeightRanges()
+{
+	heightRanges.assign(levelCount, std::vector<glm::vec2>());
+
+	heightRanges[0].resize(nodesX[0] * nodesZ[0]);
+	for (unsigned int z = 0; z < nodesZ[0]; z++)
+	{
+		for (unsigned int x = 0; x < nodesX[0]; x++)
+		{
+			glm::vec2 range(1e30f, -1e30f);
+			for (unsigned int j = 0; j <= CHUNK_QUADS; j++)
+			{
+				for (unsigned int i = 0; i <= CHUNK_QUADS; i++)
+				{
+					float height = Sample(x * CHUNK_QUADS + i, z * CHUNK_QUADS + j);
+					range.x = std::min(range.x, height);
+					range.y = std::max(range.y, height);
+				}
+			}
+			heightRanges[0][z * nodesX[0] + x] = range;
+		}
+	}
+
+	for (unsigned int level = 1; level < levelCount; level++)
+	{
+		heightRanges[level].resize(nodesX[level] * nodesZ[level]);
+		for (unsigned int z = 0; z < nodesZ[level]; z++)
+		{
+			for (unsigned int x = 0; x < nodesX[level]; x++)
+			{
+				glm::vec2 range(1e30f, -1e30f);
+				for (unsigned int c = 0; c < 4; c++)
+				{
+					unsigned int childX = x * 2 + (c & 1), childZ = z * 2 + (c >> 1);
+					if (childX < nodesX[level - 1] && childZ < nodesZ[level - 1])
+					{
+						glm::vec2 child = heightRanges[level - 1][childZ * nodesX[level - 1] + childX];
+						range.x = std::min(range.x, child.x);
+						range.y = std::max(range.y, child.y);
+					}
+				}
+				heightRanges[level][z * nodesX[level] + x] = range;
+			}
+		}
+	}
+}
+
+void Terrain::BuildLodRanges()
+{
+	lodRanges.resize(levelCount);
+	float range = lodDistance;
+	for (unsigned int level = 0; level < levelCount; level++)
+	{
+		lodRanges[level] = range;
+		range *= 2.0f;
+	}
+}
+
+Terrain::ChunkRecord* Terrain::FindResident(unsigned int level, unsigned int x, unsigned int z)
+{
+	auto found = chunks.find(NodeKey(level, x, z));
+	return found != chunks.end() ? &found->second : nullptr;
+}
+
+void Terrain::Select(FramePacket& packet, const Frustum& frustum)
+{
+	TRACE_SCOPE("Terrain::Select");
+
+	packet.terrain = this;
+	packet.terrainDraws.clear();
+
+	if (levelCount == 0)
+	{
+		return;
+	}
+
+	selectFrame++;
+	EvictChunks(packet.sequence);
+
+	// The root is what everything falls back to, it never waits for the build budget
+	unsigned int root = levelCount - 1;
+	if (!FindResident(root, 0, 0))
+	{
+		BuildChunk(NodeKey(root, 0, 0));
+	}
+
+	buildRequests.clear();
+	SelectNode(packet, frustum, root, 0, 0);
+
+	// Coarse levels first, they unlock refinement for everything below them
+	std::sort(buildRequests.begin(), buildRequests.end(), [](unsigned long long a, unsigned long long b) { return a > b; });
+	buildRequests.erase(std::unique(buildRequests.begin(), buildRequests.end()), buildRequests.end());
+	for (size_t i = 0; i < buildRequests.size() && i < buildBudget; i++)
+	{
+		BuildChunk(buildRequests[i]);
+	}
+}
+
+void Terrain::SelectNode(FramePacket& packet, const Frustum& frustum, unsigned int level, unsigned int x, unsigned int z)
+{
+	BoundingBox bounds = GetNodeBounds(level, x, z);
+	if (!frustum.TestBox(bounds))
+	{
+		return;
+	}
+
+	ChunkRecord* record = FindResident(level, x, z);
+	record->lastUsed = selectFrame;
+
+	if (level == 0 || !BoxIntersectsSphere(bounds, packet.eyePosition, lodRanges[level - 1] * PREFETCH_SCALE))
+	{
+		AddDraw(packet, record->id, level, 0xF);
+		return;
+	}
+
+	bool inRange[4];
+	bool childrenReady = true;
+	bool anyInRange = false;
+	for (unsigned int c = 0; c < 4; c++)
+	{
+		unsigned int childX = x * 2 + (c & 1), childZ = z * 2 + (c >> 1);
+		inRange[c] = false;
+
+		// Quadrants past the heightmap edge have no child, the parent's degenerate quarter covers them
+		if (childX >= nodesX[level - 1] || childZ >= nodesZ[level - 1])
+		{
+			continue;
+		}
+
+		BoundingBox childBounds = GetNodeBounds(level - 1, childX, childZ);
+		if (!BoxIntersectsSphere(childBounds, packet.eyePosition, lodRanges[level - 1] * PREFETCH_SCALE))
+		{
+			continue;
+		}
+
+		bool resident = FindResident(level - 1, childX, childZ) != nullptr;
+		if (!resident)
+		{
+			buildRequests.push_back(NodeKey(level - 1, childX, childZ));
+		}
+
+		inRange[c] = BoxIntersectsSphere(childBounds, packet.eyePosition, lodRanges[level - 1]);
+		if (inRange[c])
+		{
+			anyInRange = true;
+			childrenReady = childrenReady && resident;
+		}
+	}
+
+	// Until every child that's needed has streamed in, the node stands in for all of them
+	if (!anyInRange || !childrenReady)
+	{
+		AddDraw(packet, record->id, level, 0xF);
+		return;
+	}
+
+	unsigned char quadrants = 0;
+	for (unsigned int c = 0; c < 4; c++)
+	{
+		if (inRange[c])
+		{
+			SelectNode(packet, frustum, level - 1, x * 2 + (c & 1), z * 2 + (c >> 1));
+		}
+		else
+		{
+			quadrants |= 1 << c;
+		}
+	}
+
+	if (quadrants)
+	{
+		AddDraw(packet, record->id, level, quadrants);
+	}
+}
+
+void Terrain::AddDraw(FramePacket& packet, unsigned int id, unsigned int level, unsigned char quadrants)
+{
+	TerrainDraw draw;
+	draw.chunk = id;
+	draw.quadrants = quadrants;
+
+	if (level + 1 < levelCount)
+	{
+		// Vertices sit on their own grid up to two thirds of the way through the level's range
+		// and on the next coarser grid at its end
+		float previous = level > 0 ? lodRanges[level - 1] : 0.0f;
+		draw.morphStart = previous + (lodRanges[level] - previous) * 0.66f;
+		draw.morphEnd = lodRanges[level];
+	}
+	else
+	{
+		// Nothing coarser to morph into
+		draw.morphStart = 1e30f;
+		draw.morphEnd = 2e30f;
+	}
+
+	packet.terrainDraws.push_back(draw);
+}
+
+void Terrain::BuildChunk(unsigned long long key)
+{
+	unsigned int level = (unsigned int)(key >> 48);
+	unsigned int x = (unsigned int)((key >> 24) & 0xFFFFFF);
+	unsigned int z = (unsigned int)(key & 0xFFFFFF);
+
+	int stride = 1 << level;
+	int baseX = x * CHUNK_QUADS * stride;
+	int baseZ = z * CHUNK_QUADS * stride;
+	const unsigned int row = CHUNK_QUADS + 1;
+
+	std::vector<glm::vec3> positions(row * row);
+	for (unsigned int j = 0; j < row; j++)
+	{
+		for (unsigned int i = 0; i < row; i++)
+		{
+			positions[j * row + i] = SamplePosition(baseX + i * stride, baseZ + j * stride);
+		}
+	}
+
+	PendingUpload upload;
+	upload.id = nextChunkId++;
+	upload.vertices.resize(row * row * TERRAIN_VERTEX_FLOATS);
+
+	for (unsigned int j = 0; j < row; j++)
+	{
+		for (unsigned int i = 0; i < row; i++)
+		{
+			int sampleX = baseX + i * stride, sampleZ = baseZ + j * stride;
+			glm::vec3 position = positions[j * row + i];
+
+			glm::vec3 normal = glm::normalize(glm::vec3(Sample(sampleX - stride, sampleZ) - Sample(sampleX + stride, sampleZ),
+				2.0f * stride * spacing,
+				Sample(sampleX, sampleZ - stride) - Sample(sampleX, sampleZ + stride)));
+
+			// Odd vertices land on the coarser grid's edge or, for odd/odd, on its quad diagonal,
+			// which runs the same way as the one the index buffer cuts every quad along
+			glm::vec3 morph = position;
+			if ((i & 1) && !(j & 1)) morph = (positions[j * row + i - 1] + positions[j * row + i + 1]) * 0.5f;
+			else if (!(i & 1) && (j & 1)) morph = (positions[(j - 1) * row + i] + positions[(j + 1) * row + i]) * 0.5f;
+			else if ((i & 1) && (j & 1)) morph = (positions[(j - 1) * row + i + 1] + positions[(j + 1) * row + i - 1]) * 0.5f;
+
+			GLfloat* vertex = &upload.vertices[(j * row + i) * TERRAIN_VERTEX_FLOATS];
+			vertex[0] = position.x; vertex[1] = position.y; vertex[2] = position.z;
+			vertex[3] = position.x / textureTile; vertex[4] = position.z / textureTile;
+			vertex[5] = normal.x; vertex[6] = normal.y; vertex[7] = normal.z;
+			vertex[8] = morph.x; vertex[9] = morph.y; vertex[10] = morph.z;
+		}
+	}
+
+	ChunkRecord record = { upload.id, selectFrame };
+	chunks[key] = record;
+	builtCount++;
+
+	std::lock_guard<std::mutex> lock(pendingMutex);
+	pendingUploads.push_back(std::move(upload));
+}
+
+void Terrain::EvictChunks(unsigned long long sequence)
+{
+	if (chunks.size() <= maxChunks)
+	{
+		return;
+	}
+
+	// Least recently used first, never the root and never anything the last selection touched
+	std::vector<std::pair<unsigned long long, unsigned long long>> candidates;
+	for (auto& entry : chunks)
+	{
+		unsigned int level = (unsigned int)(entry.first >> 48);
+		if (level + 1 < levelCount && entry.second.lastUsed + 1 < selectFrame)
+		{
+			candidates.push_back(std::make_pair(entry.second.lastUsed, entry.first));
+		}
+	}
+	std::sort(candidates.begin(), candidates.end());
+
+	size_t excess = chunks.size() - maxChunks;
+	std::lock_guard<std::mutex> lock(pendingMutex);
+	for (size_t i = 0; i < candidates.size() && i < excess; i++)
+	{
+		auto found = chunks.find(candidates[i].second);
+		PendingFree pending = { found->second.id, sequence };
+		pendingFrees.push_back(pending);
+		chunks.erase(found);
+		evictedCount++;
+	}
+}
+
+void Terrain::CreateIndexBuffer()
+{
+	const unsigned int row = CHUNK_QUADS + 1;
+	const unsigned int half = CHUNK_QUADS / 2;
+
+	// Grouped by quadrant so a node can draw only the quarters its children don't cover
+	std::vector<GLushort> indices;
+	indices.reserve(CHUNK_QUADS * CHUNK_QUADS * 6);
+	for (unsigned int q = 0; q < 4; q++)
+	{
+		unsigned int startX = (q & 1) * half, startZ = (q >> 1) * half;
+		for (unsigned int j = startZ; j < startZ + half; j++)
+		{
+			for (unsigned int i = startX; i < startX + half; i++)
+			{
+				GLushort corner = (GLushort)(j * row + i);
+				GLushort quad[6] = { corner, (GLushort)(corner + row), (GLushort)(corner + 1),
+					(GLushort)(corner + 1), (GLushort)(corner + row), (GLushort)(corner + row + 1) };
+				indices.insert(indices.end(), quad, quad + 6);
+			}
+		}
+	}
+	quadrantIndexCount = (GLsizei)(half * half * 6);
+
+	glGenBuffers(1, &IBO);
+	glBindBuffer(GL_COPY_WRITE_BUFFER, IBO);
+	glBufferData(GL_COPY_WRITE_BUFFER, sizeof(indices[0]) * indices.size(), &indices[0], GL_STATIC_DRAW);
+	glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+
+	indexAllocation = GpuMemory::Allocate(GPU_MEMORY_MESH_INDEX, sizeof(indices[0]) * indices.size(), "Terrain");
+}
+
+void Terrain::SyncChunks(unsigned long long sequence)
+{
+	std::vector<PendingUpload> uploads;
+	std::vector<PendingFree> frees;
+	{
+		std::lock_guard<std::mutex> lock(pendingMutex);
+		uploads.swap(pendingUploads);
+
+		// Packets older than the eviction may still draw the chunk
+		for (size_t i = 0; i < pendingFrees.size();)
+		{
+			if (pendingFrees[i].sequence <= sequence)
+			{
+				frees.push_back(pendingFrees[i]);
+				pendingFrees[i] = pendingFrees.back();
+				pendingFrees.pop_back();
+			}
+			else
+			{
+				i++;
+			}
+		}
+	}
+
+	if (uploads.empty() && frees.empty())
+	{
+		return;
+	}
+
+	TRACE_SCOPE("Terrain::SyncChunks");
+
+	if (IBO == 0)
+	{
+		CreateIndexBuffer();
+	}
+
+	GpuMemoryOwner owner("Terrain", "chunks");
+	for (size_t i = 0; i < uploads.size(); i++)
+	{
+		GpuChunk chunk;
+		GLsizeiptr size = sizeof(GLfloat) * uploads[i].vertices.size();
+
+		glGenVertexArrays(1, &chunk.VAO);
+		glBindVertexArray(chunk.VAO);
+		glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, IBO);
+
+		glGenBuffers(1, &chunk.VBO);
+		glBindBuffer(GL_ARRAY_BUFFER, chunk.VBO);
+		glBufferData(GL_ARRAY_BUFFER, size, &uploads[i].vertices[0], GL_STATIC_DRAW);
+
+		GLsizei stride = sizeof(GLfloat) * TERRAIN_VERTEX_FLOATS;
+		glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, stride, 0);
+		glEnableVertexAttribArray(0);
+		glVertexAttribPointer(1, 2, GL_FLOAT, GL_FALSE, stride, (void*)(sizeof(GLfloat) * 3));
+		glEnableVertexAttribArray(1);
+		glVertexAttribPointer(2, 3, GL_FLOAT, GL_FALSE, stride, (void*)(sizeof(GLfloat) * 5));
+		glEnableVertexAttribArray(2);
+		glVertexAttribPointer(3, 3, GL_FLOAT, GL_FALSE, stride, (void*)(sizeof(GLfloat) * 8));
+		glEnableVertexAttribArray(3);
+
+		glBindVertexArray(0);
+		glBindBuffer(GL_ARRAY_BUFFER, 0);
+		glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
+
+		chunk.allocation = GpuMemory::Allocate(GPU_MEMORY_MESH_VERTEX, size);
+		gpuChunks[uploads[i].id] = chunk;
+	}
+
+	for (size_t i = 0; i < frees.size(); i++)
+	{
+		auto found = gpuChunks.find(frees[i].id);
+		if (found == gpuChunks.end())
+		{
+			continue;
+		}
+
+		glDeleteBuffers(1, &found->second.VBO);
+		glDeleteVertexArrays(1, &found->second.VAO);
+		GpuMemory::Free(found->second.allocation);
+		gpuChunks.erase(found);
+	}
+}
+
+unsigned int Terrain::Render(const FramePacket& packet, UniformTable& uniforms, unsigned int& triangles)
+{
+	TRACE_SCOPE("Terrain::Render");
+
+	triangles = 0;
+	if (packet.terrainDraws.empty())
+	{
+		return 0;
+	}
+
+	uniforms.SetInt(Uniforms::TextureLayer, -1);
+	material.UseMaterial(uniforms);
+	if (texture)
+	{
+		texture->UseTexture();
+	}
+
+	unsigned int drawCalls = 0;
+	for (size_t i = 0; i < packet.terrainDraws.size(); i++)
+	{
+		const TerrainDraw& draw = packet.terrainDraws[i];
+		auto found = gpuChunks.find(draw.chunk);
+		if (found == gpuChunks.end())
+		{
+			continue;
+		}
+
+		uniforms.SetFloat(Uniforms::TerrainMorphStart, draw.morphStart);
+		uniforms.SetFloat(Uniforms::TerrainMorphEnd, draw.morphEnd);
+
+		glBindVertexArray(found->second.VAO);
+		if (draw.quadrants == 0xF)
+		{
+			glDrawElements(GL_TRIANGLES, quadrantIndexCount * 4, GL_UNSIGNED_SHORT, 0);
+			drawCalls++;
+			triangles += quadrantIndexCount * 4 / 3;
+		}
+		else
+		{
+			for (unsigned int q = 0; q < 4; q++)
+			{
+				if (draw.quadrants & (1 << q))
+				{
+					glDrawElements(GL_TRIANGLES, quadrantIndexCount, GL_UNSIGNED_SHORT, (void*)(sizeof(GLushort) * quadrantIndexCount * q));
+					drawCalls++;
+					triangles += quadrantIndexCount / 3;
+				}
+			}
+		}
+	}
+	glBindVertexArray(0);
+
+	lastDrawCount = drawCalls;
+	lastTriangles = triangles;
+	if (drawCalls > maxDrawCount) maxDrawCount = drawCalls;
+	if (triangles > maxTriangles) maxTriangles = triangles;
+
+	return drawCalls;
+}
+
+void Terrain::PrintStats()
+{
+	if (levelCount == 0)
+	{
+		return;
+	}
+
+	printf("Terrain, %u levels, finest range %.1f\n", levelCount, lodDistance);
+	printf("  chunks:          %8zu resident, %zu on the GPU, %llu built, %llu evicted\n", chunks.size(), gpuChunks.size(), builtCount, evictedCount);
+	printf("  draws:           %8u last frame, %u max\n", lastDrawCount, maxDrawCount);
+	printf("  triangles:       %8u last frame, %u max\n", lastTriangles, maxTriangles);
+}
+
+void Terrain::ClearTerrain()
+{
+	for (auto& entry : gpuChunks)
+	{
+		glDeleteBuffers(1, &entry.second.VBO);
+		glDeleteVertexArrays(1, &entry.second.VAO);
+		GpuMemory::Free(entry.second.allocation);
+	}
+	gpuChunks.clear();
+
+	if (IBO != 0)
+	{
+		glDeleteBuffers(1, &IBO);
+		IBO = 0;
+		GpuMemory::Free(indexAllocation);
+	}
+
+	{
+		std::lock_guard<std::mutex> lock(pendingMutex);
+		pendingUploads.clear();
+		pendingFrees.clear();
+	}
+
+	chunks.clear();
+	heights.clear();
+	heightRanges.clear();
+	nodesX.clear();
+	nodesZ.clear();
+	levelCount = 0;
+	width = 0;
+	depth = 0;
+}
+
+Terrain::~Terrain()
+{
+	ClearTerrain();
+}
@@ -0,0 +1,148 @@
+#pragma once
+
+#include <vector>
+#include <unordered_map>
+#include <mutex>
+
+#include <GL\glew.h>
+#include <glm\glm.hpp>
+
+#include "BoundingBox.h"
+#include "Frustum.h"
+#include "Texture.h"
+#include "Material.h"
+#include "UniformTable.h"
+#include "FramePacket.h"
+
+// Heightmap terrain drawn as a CDLOD quadtree. Every node, whatever its level, is one CHUNK_QUADS^2 grid
+// sampled with a stride of 2^level, so the triangle count depends on the LOD distances and not on the
+// terrain size. Vertices carry their position on the next coarser grid and shader.vert (USE_TERRAIN)
+// slides them onto it with distance, which keeps neighbouring levels crack free without stitching.
+// Chunk vertices are built on the simulation thread around the camera, coarse levels first; a node is
+// only refined once all four children are resident, so streaming falls back to coarser chunks
+class Terrain
+{
+public:
+	static const unsigned int CHUNK_QUADS = 32;
+	// Children are requested a bit before they are needed
+	static constexpr float PREFETCH_SCALE = 1.25f;
+
+	Terrain();
+
+	// Any image stb_image reads, 16-bit PNG keeps full precision. worldSize spans the longer side,
+	// heightScale is the world height of a white pixel, origin is the corner of the first sample
+	bool LoadHeightmap(const char* fileName, float worldSize, float heightScale, glm::vec3 origin);
+
+	// Distance the finest level is used up to, each coarser level doubles it. Clamped to what keeps
+	// neighbouring levels morphing into each other
+	void SetLodDistance(float distance);
+	void SetStreaming(unsigned int maxResidentChunks, unsigned int buildsPerFrame);
+	void SetTexture(Texture* texture, float tileSize);
+	void SetMaterial(const Material& terrainMaterial) { material = terrainMaterial; }
+
+	// World height under x, z, bilinear between samples
+	float GetHeight(float x, float z);
+	BoundingBox GetBounds();
+	unsigned int GetLevelCount() { return levelCount; }
+
+	// Simulation thread: builds requested chunks, evicts old ones and appends the nodes to draw for
+	// packet.eyePosition to packet.terrainDraws
+	void Select(FramePacket& packet, const Frustum& frustum);
+
+	// GL thread: uploads chunks built since the last call and deletes the evicted ones no packet
+	// from sequence on can reference
+	void SyncChunks(unsigned long long sequence);
+	// GL thread, shader variant with SHADER_FEATURE_TERRAIN bound. Returns draw calls
+	unsigned int Render(const FramePacket& packet, UniformTable& uniforms, unsigned int& triangles);
+
+	unsigned int GetResidentChunkCount() { return (unsigned int)chunks.size(); }
+	void PrintStats();
+
+	void ClearTerrain();
+
+	~Terrain();
+
+private:
+	struct ChunkRecord
+	{
+		unsigned int id;
+		unsigned long long lastUsed;
+	};
+
+	struct PendingUpload
+	{
+		unsigned int id;
+		std::vector<GLfloat> vertices;
+	};
+
+	struct PendingFree
+	{
+		unsigned int id;
+		unsigned long long sequence;
+	};
+
+	struct GpuChunk
+	{
+		GLuint VAO, VBO;
+		unsigned int allocation;
+	};
+
+	// Heightmap
+	std::vector<float> heights;
+	int width, depth;
+	float spacing;
+	glm::vec3 origin;
+
+	// Per level, (minimum, maximum) height of every node
+	unsigned int levelCount;
+	std::vector<unsigned int> nodesX, nodesZ;
+	std::vector<std::vector<glm::vec2>> heightRanges;
+	std::vector<float> lodRanges;
+	float lodDistance;
+
+	Texture* texture;
+	float textureTile;
+	Material material;
+
+	// Simulation thread side of the cache
+	std::unordered_map<unsigned long long, ChunkRecord> chunks;
+	std::vector<unsigned long long> buildRequests;
+	unsigned int maxChunks;
+	unsigned int buildBudget;
+	unsigned int nextChunkId;
+	unsigned long long selectFrame;
+
+	// Handed from the simulation thread to the GL thread
+	std::mutex pendingMutex;
+	std::vector<PendingUpload> pendingUploads;
+	std::vector<PendingFree> pendingFrees;
+
+	// GL thread side
+	std::unordered_map<unsigned int, GpuChunk> gpuChunks;
+	GLuint IBO;
+	GLsizei quadrantIndexCount;
+	unsigned int indexAllocation;
+
+	unsigned long long builtCount, evictedCount;
+	unsigned int lastDrawCount, maxDrawCount;
+	unsigned int lastTriangles, maxTriangles;
+
+	static unsigned long long NodeKey(unsigned int level, unsigned int x, unsigned int z)
+	{
+		return ((unsigned long long)level << 48) | ((unsigned long long)x << 24) | z;
+	}
+
+	float Sample(int x, int z);
+	glm::vec3 SamplePosition(int x, int z);
+	BoundingBox GetNodeBounds(unsigned int level, unsigned int x, unsigned int z);
+	void BuildHeightRanges();
+	void BuildLodRanges();
+
+	ChunkRecord* FindResident(unsigned int level, unsigned int x, unsigned int z);
+	void SelectNode(FramePacket& packet, const Frustum& frustum, unsigned int level, unsigned int x, unsigned int z);
+	void AddDraw(FramePacket& packet, unsigned int id, unsigned int level, unsigned char quadrants);
+	void BuildChunk(unsigned long long key);
+	void EvictChunks(unsigned long long sequence);
+
+	void CreateIndexBuffer();
+};
@@ -1,5 +1,10 @@
 #include "Texture.h"
 
+#include "CpuTrace.h"
+#include "GpuMemory.h"
+
+unsigned int Texture::bindCount = 0;
+
 
 
 Texture::Texture()
@@ -8,7 +13,10 @@ Texture::Texture()
 	width = 0;
 	height = 0;
 	bitDepth = 0;
+	levelCount = 0;
+	baseLevel = 0;
 	fileLocation = "";
+	allocation = GpuMemory::NO_ALLOCATION;
 }
 
 Texture::Texture(const char* fileLoc)
@@ -17,11 +25,16 @@ Texture::Texture(const char* fileLoc)
 	width = 0;
 	height = 0;
 	bitDepth = 0;
+	levelCount = 0;
+	baseLevel = 0;
 	fileLocation = fileLoc;
+	allocation = GpuMemory::NO_ALLOCATION;
 }
 
 bool Texture::LoadTexture()
 {
+	TRACE_SCOPE("Texture::LoadTexture");
+
 	unsigned char* texData = stbi_load(fileLocation, &width, &height, &bitDepth, 0);
 	if (!texData)
 	{
@@ -39,6 +52,7 @@ bool Texture::LoadTexture()
 
 	glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB, width, height, 0, GL_RGB, GL_UNSIGNED_BYTE, texData);
 	glGenerateMipmap(GL_TEXTURE_2D);
+	allocation = GpuMemory::Allocate(GPU_MEMORY_TEXTURE, GpuMemory::TextureBytes(width, height, 3, true), fileLocation);
 
 	glBindTexture(GL_TEXTURE_2D, 0);
 
@@ -49,6 +63,8 @@ bool Texture::LoadTexture()
 
 bool Texture::LoadTextureA()
 {
+	TRACE_SCOPE("Texture::LoadTextureA");
+
 	unsigned char* texData = stbi_load(fileLocation, &width, &height, &bitDepth, 0);
 	if (!texData)
 	{
@@ -66,6 +82,7 @@ bool Texture::LoadTextureA()
 
 	glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, width, height, 0, GL_RGBA, GL_UNSIGNED_BYTE, texData);
 	glGenerateMipmap(GL_TEXTURE_2D);
+	allocation = GpuMemory::Allocate(GPU_MEMORY_TEXTURE, GpuMemory::TextureBytes(width, height, 4, true), fileLocation);
 
 	glBindTexture(GL_TEXTURE_2D, 0);
 
@@ -74,19 +91,85 @@ bool Texture::LoadTextureA()
 	return true;
 }
 
+void Texture::CreateStreamed(int textureWidth, int textureHeight)
+{
+	width = textureWidth;
+	height = textureHeight;
+	bitDepth = 4;
+
+	levelCount = 1;
+	for (int size = width > height ? width : height; size > 1; size /= 2)
+	{
+		levelCount++;
+	}
+
+	glGenTextures(1, &textureID);
+	glBindTexture(GL_TEXTURE_2D, textureID);
+
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
+	// Streaming only pays off when the sampler actually picks smaller levels
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, levelCount - 1);
+
+	// Mid grey until the real smallest level arrives
+	const unsigned char placeholder[4] = { 128, 128, 128, 255 };
+	glTexImage2D(GL_TEXTURE_2D, levelCount - 1, GL_RGBA8, 1, 1, 0, GL_RGBA, GL_UNSIGNED_BYTE, placeholder);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_BASE_LEVEL, levelCount - 1);
+	baseLevel = levelCount - 1;
+
+	glBindTexture(GL_TEXTURE_2D, 0);
+
+	allocation = GpuMemory::Allocate(GPU_MEMORY_TEXTURE, GpuMemory::TextureBytes(1, 1, 4, true), fileLocation);
+}
+
+void Texture::UploadLevel(int level, const unsigned char* rgbaData)
+{
+	int levelWidth = width >> level;
+	int levelHeight = height >> level;
+
+	glBindTexture(GL_TEXTURE_2D, textureID);
+	glTexImage2D(GL_TEXTURE_2D, level, GL_RGBA8, levelWidth > 0 ? levelWidth : 1, levelHeight > 0 ? levelHeight : 1, 0, GL_RGBA, GL_UNSIGNED_BYTE, rgbaData);
+	glBindTexture(GL_TEXTURE_2D, 0);
+}
+
+void Texture::ReleaseLevel(int level)
+{
+	glBindTexture(GL_TEXTURE_2D, textureID);
+	glTexImage2D(GL_TEXTURE_2D, level, GL_RGBA8, 0, 0, 0, GL_RGBA, GL_UNSIGNED_BYTE, NULL);
+	glBindTexture(GL_TEXTURE_2D, 0);
+}
+
+void Texture::SetBaseLevel(int level)
+{
+	glBindTexture(GL_TEXTURE_2D, textureID);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_BASE_LEVEL, level);
+	glBindTexture(GL_TEXTURE_2D, 0);
+	baseLevel = level;
+
+	int levelWidth = width >> level;
+	int levelHeight = height >> level;
+	GpuMemory::Resize(allocation, GpuMemory::TextureBytes(levelWidth > 0 ? levelWidth : 1, levelHeight > 0 ? levelHeight : 1, 4, true));
+}
+
 void Texture::UseTexture()
 {
 	glActiveTexture(GL_TEXTURE0);
 	glBindTexture(GL_TEXTURE_2D, textureID);
+	bindCount++;
 }
 
 void Texture::ClearTexture()
 {
 	glDeleteTextures(1, &textureID);
 	textureID = 0;
+	GpuMemory::Free(allocation);
 	width = 0;
 	height = 0;
 	bitDepth = 0;
+	levelCount = 0;
+	baseLevel = 0;
 	fileLocation = "";
 }
 
@@ -16,12 +16,34 @@ public:
 	void UseTexture();
 	void ClearTexture();
 
+	// Streamed textures start as a 1x1 placeholder, TextureStreamer then fills levels from the
+	// smallest up. Only levels [base, last] exist on the GPU, sampling is clamped to them
+	void CreateStreamed(int textureWidth, int textureHeight);
+	void UploadLevel(int level, const unsigned char* rgbaData);
+	// Gives the level's storage back by respecifying it as 0x0, has to be below the base level
+	void ReleaseLevel(int level);
+	void SetBaseLevel(int level);
+
+	int GetWidth() { return width; }
+	int GetHeight() { return height; }
+	int GetLevelCount() { return levelCount; }
+	int GetBaseLevel() { return baseLevel; }
+
+	// Texture binds issued on the GL thread, array binds included, for per-frame statistics
+	static void CountBind() { bindCount++; }
+	static unsigned int GetBindCount() { return bindCount; }
+
 	~Texture();
 
 private:
 	GLuint textureID;
 	int width, height, bitDepth;
+	int levelCount, baseLevel;
 
 	const char* fileLocation;
+
+	unsigned int allocation;
+
+	static unsigned int bindCount;
 };
 
@@ -0,0 +1,130 @@
+#include "TextureArray.h"
+
+#include <math.h>
+
+#include "Texture.h"
+#include "GpuMemory.h"
+
+const unsigned int TextureArray::CACHED_UNITS;
+GLuint TextureArray::boundArrays[TextureArray::CACHED_UNITS] = {};
+
+TextureArray::TextureArray()
+{
+	textureID = 0;
+	width = 0;
+	height = 0;
+	layerCount = 0;
+
+	allocation = GpuMemory::NO_ALLOCATION;
+}
+
+void TextureArray::CreateArray(GLsizei arrayWidth, GLsizei arrayHeight, GLsizei arrayLayers, const unsigned char* layers, const char* asset)
+{
+	ClearArray();
+
+	width = arrayWidth;
+	height = arrayHeight;
+	layerCount = arrayLayers;
+
+	glGenTextures(1, &textureID);
+	glBindTexture(GL_TEXTURE_2D_ARRAY, textureID);
+
+	glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_S, GL_REPEAT);
+	glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_T, GL_REPEAT);
+	glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+	glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+
+	glTexImage3D(GL_TEXTURE_2D_ARRAY, 0, GL_RGBA8, width, height, layerCount, 0, GL_RGBA, GL_UNSIGNED_BYTE, layers);
+	glGenerateMipmap(GL_TEXTURE_2D_ARRAY);
+
+	// Whichever unit was active has no array now
+	glBindTexture(GL_TEXTURE_2D_ARRAY, 0);
+	ForgetBinding(0);
+
+	allocation = GpuMemory::Allocate(GPU_MEMORY_TEXTURE, GpuMemory::TextureBytes(width, height, 4, true) * layerCount, asset);
+}
+
+void TextureArray::UseArray(GLuint textureUnit)
+{
+	if (textureUnit < CACHED_UNITS)
+	{
+		if (boundArrays[textureUnit] == textureID)
+		{
+			return;
+		}
+		boundArrays[textureUnit] = textureID;
+	}
+
+	glActiveTexture(GL_TEXTURE0 + textureUnit);
+	glBindTexture(GL_TEXTURE_2D_ARRAY, textureID);
+	glActiveTexture(GL_TEXTURE0);
+	Texture::CountBind();
+}
+
+void TextureArray::ForgetBinding(GLuint texture)
+{
+	for (unsigned int i = 0; i < CACHED_UNITS; i++)
+	{
+		if (texture == 0 || boundArrays[i] == texture)
+		{
+			boundArrays[i] = 0;
+		}
+	}
+}
+
+void TextureArray::ResizeImage(const unsigned char* source, int sourceWidth, int sourceHeight, unsigned char* target, int targetWidth, int targetHeight)
+{
+	for (int y = 0; y < targetHeight; y++)
+	{
+		// Texel centres line up, so a same-size resize is an exact copy
+		float sourceY = (y + 0.5f) * sourceHeight / targetHeight - 0.5f;
+		if (sourceY < 0.0f) sourceY = 0.0f;
+		int y0 = (int)sourceY;
+		int y1 = y0 + 1 < sourceHeight ? y0 + 1 : y0;
+		float fy = sourceY - y0;
+
+		for (int x = 0; x < targetWidth; x++)
+		{
+			float sourceX = (x + 0.5f) * sourceWidth / targetWidth - 0.5f;
+			if (sourceX < 0.0f) sourceX = 0.0f;
+			int x0 = (int)sourceX;
+			int x1 = x0 + 1 < sourceWidth ? x0 + 1 : x0;
+			float fx = sourceX - x0;
+
+			for (int c = 0; c < 4; c++)
+			{
+				float top = source[((size_t)y0 * sourceWidth + x0) * 4 + c] * (1.0f - fx) + source[((size_t)y0 * sourceWidth + x1) * 4 + c] * fx;
+				float bottom = source[((size_t)y1 * sourceWidth + x0) * 4 + c] * (1.0f - fx) + source[((size_t)y1 * sourceWidth + x1) * 4 + c] * fx;
+				target[((size_t)y * targetWidth + x) * 4 + c] = (unsigned char)(top * (1.0f - fy) + bottom * fy + 0.5f);
+			}
+		}
+	}
+}
+
+int TextureArray::LayerSize(int size, int maxSize)
+{
+	int exponent = (int)floorf(log2f((float)size) + 0.5f);
+	int layerSize = 1 << (exponent > 0 ? exponent : 0);
+	return layerSize < maxSize ? layerSize : maxSize;
+}
+
+void TextureArray::ClearArray()
+{
+	if (textureID != 0)
+	{
+		ForgetBinding(textureID);
+		glDeleteTextures(1, &textureID);
+		textureID = 0;
+	}
+
+	GpuMemory::Free(allocation);
+
+	width = 0;
+	height = 0;
+	layerCount = 0;
+}
+
+TextureArray::~TextureArray()
+{
+	ClearArray();
+}
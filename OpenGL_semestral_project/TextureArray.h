@@ -0,0 +1,45 @@
+#pragma once
+
+#include <vector>
+
+#include <GL\glew.h>
+
+// RGBA8 GL_TEXTURE_2D_ARRAY, every layer the same size so meshes can switch texture with a uniform
+class TextureArray
+{
+public:
+	static const unsigned int CACHED_UNITS = 16;
+
+	TextureArray();
+
+	// layers holds width * height * 4 bytes per layer, back to back
+	void CreateArray(GLsizei arrayWidth, GLsizei arrayHeight, GLsizei layerCount, const unsigned char* layers, const char* asset);
+
+	// Skips the bind when this array is already on the unit, units from CACHED_UNITS on always bind
+	void UseArray(GLuint textureUnit);
+
+	GLsizei GetWidth() { return width; }
+	GLsizei GetHeight() { return height; }
+	GLsizei GetLayerCount() { return layerCount; }
+
+	// Bilinear resize of an RGBA8 image, used to bring mismatched textures to the array size
+	static void ResizeImage(const unsigned char* source, int sourceWidth, int sourceHeight, unsigned char* target, int targetWidth, int targetHeight);
+	// Power of two closest to size in log scale, capped at maxSize
+	static int LayerSize(int size, int maxSize);
+
+	void ClearArray();
+
+	~TextureArray();
+
+private:
+	GLuint textureID;
+	GLsizei width, height, layerCount;
+
+	unsigned int allocation;
+
+	// GL_TEXTURE_2D_ARRAY binding of each unit as far as UseArray knows
+	static GLuint boundArrays[CACHED_UNITS];
+
+	// Drops texture from the units it is cached on, 0 drops every unit
+	static void ForgetBinding(GLuint texture);
+};
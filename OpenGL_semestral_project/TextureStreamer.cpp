@@ -0,0 +1,453 @@
+#include "TextureStreamer.h"
+
+#include <stdio.h>
+#include <math.h>
+#include <algorithm>
+
+#include "Model.h"
+#include "GpuMemory.h"
+#include "CpuTrace.h"
+
+const int TextureStreamer::MIN_RESIDENT_SIZE;
+const unsigned int TextureStreamer::EVICT_DELAY;
+const unsigned int TextureStreamer::RETRY_DELAY;
+const unsigned int TextureStreamer::READ_ATTEMPTS;
+
+TextureStreamer::TextureStreamer()
+{
+	budget = 0;
+	uploadLimit = 0;
+	residentBytes = 0;
+	otherBytes = 0;
+	trimRequested.store(false);
+	frame = 0;
+
+	running.store(false);
+
+	uploadedBytes = 0;
+	uploadedLevels = 0;
+	evictedLevels = 0;
+	readCount = 0;
+	failedReadCount = 0;
+	overBudgetFrames = 0;
+}
+
+void TextureStreamer::Start(size_t budgetBytes, size_t uploadBytesPerFrame)
+{
+	if (running.load())
+	{
+		return;
+	}
+
+	budget = budgetBytes;
+	uploadLimit = uploadBytesPerFrame;
+
+	running.store(true);
+	loader = std::thread(&TextureStreamer::LoaderLoop, this);
+}
+
+bool TextureStreamer::AddTexture(Texture* texture, const std::string& fileName)
+{
+	if (!running.load())
+	{
+		return false;
+	}
+
+	int width, height, channels;
+	if (!stbi_info(fileName.c_str(), &width, &height, &channels))
+	{
+		printf("Failed to find: %s\n", fileName.c_str());
+		return false;
+	}
+
+	texture->CreateStreamed(width, height);
+
+	StreamedTexture* entry = new StreamedTexture();
+	entry->texture = texture;
+	entry->fileName = fileName;
+	entry->width = width;
+	entry->height = height;
+	entry->levelCount = texture->GetLevelCount();
+
+	entry->floorLevel = 0;
+	while ((width >> entry->floorLevel) > MIN_RESIDENT_SIZE || (height >> entry->floorLevel) > MIN_RESIDENT_SIZE)
+	{
+		entry->floorLevel++;
+	}
+
+	entry->residentLevel = entry->levelCount;
+	entry->requestedLevel = entry->floorLevel;
+	entry->wantedLevel = entry->floorLevel;
+	entry->targetLevel = entry->floorLevel;
+	entry->coverage = 0.0f;
+	entry->wantedFrame = 0;
+	entry->failedReads = 0;
+	entry->retryFrame = 0;
+	entry->readState.store(READ_IDLE);
+
+	textureLookup[texture] = (unsigned int)textures.size();
+	textures.push_back(entry);
+
+	// Small levels are wanted no matter what is on screen, so the first read starts right away
+	QueueRead(entry);
+	return true;
+}
+
+void TextureStreamer::RequestLevel(Texture* texture, float screenPixels)
+{
+	std::unordered_map<Texture*, unsigned int>::iterator found = textureLookup.find(texture);
+	if (found == textureLookup.end())
+	{
+		return;
+	}
+
+	StreamedTexture* entry = textures[found->second];
+
+	// One texel per pixel when the texture is stretched once across the mesh
+	int size = entry->width > entry->height ? entry->width : entry->height;
+	int level = entry->floorLevel;
+	if (screenPixels >= 1.0f)
+	{
+		level = (int)floorf(log2f(size / screenPixels));
+		if (level < 0) level = 0;
+		if (level > entry->floorLevel) level = entry->floorLevel;
+	}
+
+	if (level < entry->requestedLevel)
+	{
+		entry->requestedLevel = level;
+	}
+	if (screenPixels > entry->coverage)
+	{
+		entry->coverage = screenPixels;
+	}
+}
+
+void TextureStreamer::Update(const FramePacket& packet, float viewportHeight)
+{
+	TRACE_SCOPE("TextureStreamer::Update");
+
+	frame++;
+
+	for (size_t i = 0; i < textures.size(); i++)
+	{
+		textures[i]->requestedLevel = textures[i]->floorLevel;
+		textures[i]->coverage = 0.0f;
+	}
+
+	for (size_t i = 0; i < packet.draws.size(); i++)
+	{
+		const DrawItem& draw = packet.draws[i];
+		draw.model->RequestNodeTextures(draw.node, draw.screenCoverage * viewportHeight, *this);
+	}
+
+	bool trim = trimRequested.exchange(false);
+
+	size_t total = 0;
+	for (size_t i = 0; i < textures.size(); i++)
+	{
+		StreamedTexture* entry = textures[i];
+
+		// Finer requests apply at once, coarser ones only after they held for EVICT_DELAY frames
+		if (entry->requestedLevel <= entry->wantedLevel)
+		{
+			entry->wantedLevel = entry->requestedLevel;
+			entry->wantedFrame = frame;
+		}
+		else if (frame - entry->wantedFrame > EVICT_DELAY)
+		{
+			entry->wantedLevel = entry->requestedLevel;
+		}
+
+		entry->targetLevel = trim ? entry->floorLevel : entry->wantedLevel;
+
+		int state = entry->readState.load(std::memory_order_acquire);
+		if (state == READ_FAILED)
+		{
+			entry->failedReads++;
+			failedReadCount++;
+			entry->retryFrame = frame + ((unsigned long long)RETRY_DELAY << (entry->failedReads - 1));
+			state = entry->failedReads < READ_ATTEMPTS ? READ_IDLE : READ_ABANDONED;
+			entry->readState.store(state, std::memory_order_release);
+		}
+
+		if (entry->failedReads > 0 && state != READ_READY)
+		{
+			if (state == READ_IDLE && frame >= entry->retryFrame && entry->targetLevel < entry->residentLevel)
+			{
+				QueueRead(entry);
+			}
+
+			// Nothing finer is coming until a read works, other textures can have the room meanwhile
+			if (entry->targetLevel < entry->residentLevel)
+			{
+				entry->targetLevel = entry->residentLevel;
+			}
+		}
+
+		total += ResidentBytes(entry, entry->targetLevel);
+	}
+
+	// Whatever isn't streamed stays put, so it comes off the top of the budget every frame
+	size_t textureUsage = GpuMemory::GetUsage(GPU_MEMORY_TEXTURE);
+	otherBytes = textureUsage > residentBytes ? textureUsage - residentBytes : 0;
+	size_t available = budget > otherBytes ? budget - otherBytes : 0;
+
+	// Over budget, the least visible textures give up their finest level first
+	while (total > available)
+	{
+		StreamedTexture* victim = nullptr;
+		for (size_t i = 0; i < textures.size(); i++)
+		{
+			StreamedTexture* entry = textures[i];
+			if (entry->targetLevel < entry->floorLevel && (!victim || entry->coverage < victim->coverage ||
+				(entry->coverage == victim->coverage && entry->targetLevel < victim->targetLevel)))
+			{
+				victim = entry;
+			}
+		}
+
+		if (!victim)
+		{
+			overBudgetFrames++;
+			break;
+		}
+
+		total -= ResidentBytes(victim, victim->targetLevel);
+		victim->targetLevel++;
+		total += ResidentBytes(victim, victim->targetLevel);
+	}
+
+	// Evictions first, they free room for this frame's uploads. The base moves before the
+	// level is dropped so the texture is never incomplete
+	for (size_t i = 0; i < textures.size(); i++)
+	{
+		StreamedTexture* entry = textures[i];
+		while (entry->residentLevel < entry->targetLevel)
+		{
+			entry->texture->SetBaseLevel(entry->residentLevel + 1);
+			entry->texture->ReleaseLevel(entry->residentLevel);
+			entry->residentLevel++;
+			evictedLevels++;
+		}
+	}
+
+	std::vector<StreamedTexture*> loads;
+	for (size_t i = 0; i < textures.size(); i++)
+	{
+		if (textures[i]->targetLevel < textures[i]->residentLevel)
+		{
+			loads.push_back(textures[i]);
+		}
+	}
+	std::sort(loads.begin(), loads.end(), [](const StreamedTexture* a, const StreamedTexture* b) { return a->coverage > b->coverage; });
+
+	size_t uploaded = 0;
+	for (size_t i = 0; i < loads.size(); i++)
+	{
+		StreamedTexture* entry = loads[i];
+
+		int state = entry->readState.load(std::memory_order_acquire);
+		if (state == READ_IDLE)
+		{
+			QueueRead(entry);
+			continue;
+		}
+		if (state != READ_READY)
+		{
+			continue;
+		}
+
+		entry->failedReads = 0;
+
+		// Smallest to largest so every step is a complete texture, the floor levels ignore the upload limit
+		int firstLevel = entry->residentLevel;
+		while (entry->residentLevel > entry->targetLevel && (uploaded < uploadLimit || entry->residentLevel > entry->floorLevel))
+		{
+			int level = entry->residentLevel - 1;
+			entry->texture->UploadLevel(level, &entry->levels[level][0]);
+			uploaded += entry->levels[level].size();
+			uploadedLevels++;
+			entry->residentLevel = level;
+		}
+
+		if (entry->residentLevel != firstLevel)
+		{
+			entry->texture->SetBaseLevel(entry->residentLevel);
+		}
+	}
+	uploadedBytes += uploaded;
+
+	residentBytes = 0;
+	for (size_t i = 0; i < textures.size(); i++)
+	{
+		StreamedTexture* entry = textures[i];
+
+		// Decoded data is kept only until the levels it was read for are on the GPU
+		if (entry->residentLevel <= entry->targetLevel && entry->readState.load(std::memory_order_acquire) == READ_READY)
+		{
+			std::vector<std::vector<unsigned char> >().swap(entry->levels);
+			entry->readState.store(READ_IDLE, std::memory_order_release);
+		}
+
+		residentBytes += ResidentBytes(entry, entry->residentLevel);
+	}
+}
+
+void TextureStreamer::PrintStats()
+{
+	if (textures.empty())
+	{
+		return;
+	}
+
+	const double megabyte = 1024.0 * 1024.0;
+
+	printf("Texture streaming, %u textures\n", (unsigned int)textures.size());
+	printf("  resident:        %8.2f MB of %.2f MB budget, over budget in %llu frames\n", residentBytes / megabyte, budget / megabyte, overBudgetFrames);
+	printf("  not streamed:    %8.2f MB\n", otherBytes / megabyte);
+	printf("  uploaded:        %8.2f MB in %llu levels, %llu levels evicted\n", uploadedBytes / megabyte, uploadedLevels, evictedLevels);
+	printf("  file reads:      %8llu, %llu failed\n", readCount, failedReadCount);
+
+	for (size_t i = 0; i < textures.size(); i++)
+	{
+		StreamedTexture* entry = textures[i];
+		int level = entry->residentLevel < entry->levelCount ? entry->residentLevel : entry->levelCount - 1;
+		printf("    %4dx%-4d level %d (wanted %d)  %s%s\n", entry->width >> level, entry->height >> level, entry->residentLevel, entry->wantedLevel, entry->fileName.c_str(),
+			entry->readState.load() == READ_ABANDONED ? "  unreadable" : "");
+	}
+}
+
+void TextureStreamer::ClearStreamer()
+{
+	if (running.load())
+	{
+		{
+			std::lock_guard<std::mutex> lock(readMutex);
+			running.store(false);
+			readQueue.clear();
+		}
+		readCondition.notify_all();
+		loader.join();
+	}
+
+	for (size_t i = 0; i < textures.size(); i++)
+	{
+		delete textures[i];
+	}
+	textures.clear();
+	textureLookup.clear();
+	residentBytes = 0;
+}
+
+void TextureStreamer::QueueRead(StreamedTexture* entry)
+{
+	entry->readState.store(READ_PENDING, std::memory_order_release);
+	readCount++;
+
+	{
+		std::lock_guard<std::mutex> lock(readMutex);
+		readQueue.push_back(entry);
+	}
+	readCondition.notify_one();
+}
+
+void TextureStreamer::LoaderLoop()
+{
+	TRACE_THREAD_NAME("TextureLoader");
+
+	while (true)
+	{
+		StreamedTexture* entry;
+		{
+			std::unique_lock<std::mutex> lock(readMutex);
+			readCondition.wait(lock, [this]() { return !readQueue.empty() || !running.load(); });
+			if (!running.load())
+			{
+				return;
+			}
+
+			entry = readQueue.front();
+			readQueue.erase(readQueue.begin());
+		}
+
+		bool loaded = ReadTexture(entry);
+		entry->readState.store(loaded ? READ_READY : READ_FAILED, std::memory_order_release);
+	}
+}
+
+bool TextureStreamer::ReadTexture(StreamedTexture* entry)
+{
+	TRACE_SCOPE("TextureStreamer::ReadTexture");
+
+	int width, height, channels;
+	// Retries of a broken file stay quiet, the first failure already said why
+	bool report = entry->failedReads == 0;
+
+	unsigned char* texData = stbi_load(entry->fileName.c_str(), &width, &height, &channels, 4);
+	if (!texData)
+	{
+		if (report) printf("Failed to find: %s\n", entry->fileName.c_str());
+		return false;
+	}
+
+	if (width != entry->width || height != entry->height)
+	{
+		if (report) printf("%s changed size while streaming\n", entry->fileName.c_str());
+		stbi_image_free(texData);
+		return false;
+	}
+
+	entry->levels.resize(entry->levelCount);
+	entry->levels[0].assign(texData, texData + (size_t)width * height * 4);
+	stbi_image_free(texData);
+
+	// 2x2 box filter, odd edges reuse their last row or column
+	for (int level = 1; level < entry->levelCount; level++)
+	{
+		const std::vector<unsigned char>& source = entry->levels[level - 1];
+		int sourceWidth = width;
+		int sourceHeight = height;
+		width = width > 1 ? width / 2 : 1;
+		height = height > 1 ? height / 2 : 1;
+
+		std::vector<unsigned char>& target = entry->levels[level];
+		target.resize((size_t)width * height * 4);
+
+		for (int y = 0; y < height; y++)
+		{
+			int y0 = y * 2;
+			int y1 = y0 + 1 < sourceHeight ? y0 + 1 : y0;
+			for (int x = 0; x < width; x++)
+			{
+				int x0 = x * 2;
+				int x1 = x0 + 1 < sourceWidth ? x0 + 1 : x0;
+				for (int c = 0; c < 4; c++)
+				{
+					unsigned int sum = source[((size_t)y0 * sourceWidth + x0) * 4 + c] + source[((size_t)y0 * sourceWidth + x1) * 4 + c] +
+						source[((size_t)y1 * sourceWidth + x0) * 4 + c] + source[((size_t)y1 * sourceWidth + x1) * 4 + c];
+					target[((size_t)y * width + x) * 4 + c] = (unsigned char)((sum + 2) / 4);
+				}
+			}
+		}
+	}
+
+	return true;
+}
+
+size_t TextureStreamer::ResidentBytes(const StreamedTexture* entry, int level)
+{
+	if (level >= entry->levelCount)
+	{
+		return GpuMemory::TextureBytes(1, 1, 4, false);
+	}
+
+	int width = entry->width >> level;
+	int height = entry->height >> level;
+	return GpuMemory::TextureBytes(width > 0 ? width : 1, height > 0 ? height : 1, 4, true);
+}
+
+TextureStreamer::~TextureStreamer()
+{
+	ClearStreamer();
+}
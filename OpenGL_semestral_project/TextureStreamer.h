@@ -0,0 +1,121 @@
+#pragma once
+
+#include <vector>
+#include <string>
+#include <unordered_map>
+#include <atomic>
+#include <mutex>
+#include <thread>
+#include <condition_variable>
+
+#include "Texture.h"
+#include "FramePacket.h"
+
+// Keeps each texture's finest resident mip close to what its on-screen size needs, inside a budget.
+// Files are decoded and mipmapped on a loader thread, the GL thread only uploads and evicts levels.
+// Levels no larger than MIN_RESIDENT_SIZE stay resident once loaded, so nothing ever goes blank
+class TextureStreamer
+{
+public:
+	static const int MIN_RESIDENT_SIZE = 64;
+	// Frames a texture keeps its levels after it was last seen
+	static const unsigned int EVICT_DELAY = 120;
+	// Frames before a failed read is tried again, doubling after every failure up to READ_ATTEMPTS reads
+	static const unsigned int RETRY_DELAY = 60;
+	static const unsigned int READ_ATTEMPTS = 4;
+
+	TextureStreamer();
+
+	// The budget covers all GPU_MEMORY_TEXTURE memory, textures that don't stream shrink what's left for streaming
+	void Start(size_t budgetBytes, size_t uploadBytesPerFrame = 8 * 1024 * 1024);
+	void SetBudget(size_t bytes) { budget = bytes; }
+	bool IsRunning() { return running.load(); }
+
+	// Replaces Texture::LoadTexture. Only reads the file header here, false if it can't be loaded
+	bool AddTexture(Texture* texture, const std::string& fileName);
+
+	// Called for each texture of a visible mesh, screenPixels being the mesh's size on screen
+	void RequestLevel(Texture* texture, float screenPixels);
+
+	// GL thread, once per frame: gathers requests from the packet's draws, fits them into the
+	// budget, evicts, uploads what the loader has finished and queues new reads
+	void Update(const FramePacket& packet, float viewportHeight);
+
+	// Next Update drops every texture to its minimum, for GPU memory budget callbacks
+	void Trim() { trimRequested.store(true); }
+
+	size_t GetResidentBytes() { return residentBytes; }
+	// Texture memory the streamer doesn't manage, as of the last Update
+	size_t GetOtherBytes() { return otherBytes; }
+	void PrintStats();
+
+	void ClearStreamer();
+
+	~TextureStreamer();
+
+private:
+	enum ReadState
+	{
+		READ_IDLE,
+		READ_PENDING,
+		READ_READY,
+		READ_FAILED,
+		// READ_ATTEMPTS reads failed, the texture keeps whatever it has
+		READ_ABANDONED
+	};
+
+	struct StreamedTexture
+	{
+		Texture* texture;
+		std::string fileName;
+		int width, height;
+		int levelCount;
+		// Coarsest level that never gets evicted
+		int floorLevel;
+		// Finest level on the GPU, levelCount while only the placeholder is there
+		int residentLevel;
+		int requestedLevel;
+		int wantedLevel;
+		int targetLevel;
+		float coverage;
+		// Last frame wantedLevel was asked for, it only gets coarser EVICT_DELAY frames later
+		unsigned long long wantedFrame;
+		// Failed reads since the last one that worked, the next is queued at retryFrame.
+		// While they fail the texture only takes budget for what is resident
+		unsigned int failedReads;
+		unsigned long long retryFrame;
+
+		// The loader owns levels while the state is READ_PENDING
+		std::atomic<int> readState;
+		std::vector<std::vector<unsigned char> > levels;
+	};
+
+	std::vector<StreamedTexture*> textures;
+	std::unordered_map<Texture*, unsigned int> textureLookup;
+
+	size_t budget;
+	size_t uploadLimit;
+	size_t residentBytes;
+	size_t otherBytes;
+	std::atomic<bool> trimRequested;
+	unsigned long long frame;
+
+	std::thread loader;
+	std::atomic<bool> running;
+	std::mutex readMutex;
+	std::condition_variable readCondition;
+	std::vector<StreamedTexture*> readQueue;
+
+	unsigned long long uploadedBytes;
+	unsigned long long uploadedLevels;
+	unsigned long long evictedLevels;
+	unsigned long long readCount;
+	unsigned long long failedReadCount;
+	unsigned long long overBudgetFrames;
+
+	void QueueRead(StreamedTexture* entry);
+	void LoaderLoop();
+	static bool ReadTexture(StreamedTexture* entry);
+
+	static size_t ResidentBytes(const StreamedTexture* entry, int level);
+};
@@ -0,0 +1,176 @@
+#include "TransformBuffer.h"
+
+#include <string.h>
+
+#include "GpuMemory.h"
+
+TransformBuffer::TransformBuffer()
+{
+	capacity = 0;
+
+	modelBuffer = 0;
+	modelTexture = 0;
+	normalBuffer = 0;
+	normalTexture = 0;
+
+	allocation = GpuMemory::NO_ALLOCATION;
+}
+
+void TransformBuffer::Upload(const glm::mat4* worldMatrices, const glm::vec4* normalMatrices, unsigned int newCapacity, unsigned int begin, unsigned int end)
+{
+	if (newCapacity == 0)
+	{
+		return;
+	}
+
+	if (modelBuffer == 0)
+	{
+		glGenBuffers(1, &modelBuffer);
+		glGenBuffers(1, &normalBuffer);
+		if (modelTexture == 0)
+		{
+			glGenTextures(1, &modelTexture);
+			glGenTextures(1, &normalTexture);
+		}
+		allocation = GpuMemory::Allocate(GPU_MEMORY_UNIFORM, 0, "TransformBuffer");
+	}
+
+	if (newCapacity != capacity)
+	{
+		// Storage changed size, reallocate both buffers and resend everything
+		glBindBuffer(GL_TEXTURE_BUFFER, modelBuffer);
+		glBufferData(GL_TEXTURE_BUFFER, sizeof(glm::mat4) * newCapacity, worldMatrices, GL_DYNAMIC_DRAW);
+		glBindBuffer(GL_TEXTURE_BUFFER, normalBuffer);
+		glBufferData(GL_TEXTURE_BUFFER, sizeof(glm::vec4) * 3 * newCapacity, normalMatrices, GL_DYNAMIC_DRAW);
+
+		glBindTexture(GL_TEXTURE_BUFFER, modelTexture);
+		glTexBuffer(GL_TEXTURE_BUFFER, GL_RGBA32F, modelBuffer);
+		glBindTexture(GL_TEXTURE_BUFFER, normalTexture);
+		glTexBuffer(GL_TEXTURE_BUFFER, GL_RGBA32F, normalBuffer);
+		glBindTexture(GL_TEXTURE_BUFFER, 0);
+
+		capacity = newCapacity;
+		GpuMemory::Resize(allocation, (sizeof(glm::mat4) + sizeof(glm::vec4) * 3) * capacity);
+	}
+	else if (begin < end)
+	{
+		UploadRange(&worldMatrices[begin], &normalMatrices[begin * 3], begin, end);
+	}
+
+	glBindBuffer(GL_TEXTURE_BUFFER, 0);
+}
+
+void TransformBuffer::UploadRange(const glm::mat4* worldMatrices, const glm::vec4* normalMatrices, unsigned int begin, unsigned int end)
+{
+	if (begin >= end || end > capacity)
+	{
+		return;
+	}
+
+	unsigned int changed = end - begin;
+
+	glBindBuffer(GL_TEXTURE_BUFFER, modelBuffer);
+	glBufferSubData(GL_TEXTURE_BUFFER, sizeof(glm::mat4) * begin, sizeof(glm::mat4) * changed, worldMatrices);
+	glBindBuffer(GL_TEXTURE_BUFFER, normalBuffer);
+	glBufferSubData(GL_TEXTURE_BUFFER, sizeof(glm::vec4) * 3 * begin, sizeof(glm::vec4) * 3 * changed, normalMatrices);
+	glBindBuffer(GL_TEXTURE_BUFFER, 0);
+}
+
+bool TransformBuffer::Stream(StreamBuffer& stream, const glm::mat4* worldMatrices, const glm::vec4* normalMatrices, unsigned int streamCapacity,
+	unsigned int overlayBegin, unsigned int overlayEnd, const glm::mat4* overlayWorld, const glm::vec4* overlayNormals)
+{
+	if (streamCapacity == 0 || !CanStream())
+	{
+		return false;
+	}
+
+	GLsizeiptr worldSize = sizeof(glm::mat4) * streamCapacity;
+	GLsizeiptr normalSize = sizeof(glm::vec4) * 3 * streamCapacity;
+	GLint alignment = StreamAlignment();
+
+	GLintptr worldOffset = 0, normalOffset = 0;
+	void* worldTarget = stream.Allocate(worldSize, alignment, worldOffset);
+	void* normalTarget = worldTarget ? stream.Allocate(normalSize, alignment, normalOffset) : nullptr;
+	if (!normalTarget)
+	{
+		return false;
+	}
+
+	memcpy(worldTarget, worldMatrices, worldSize);
+	memcpy(normalTarget, normalMatrices, normalSize);
+	if (overlayWorld && overlayBegin < overlayEnd && overlayEnd <= streamCapacity)
+	{
+		memcpy((glm::mat4*)worldTarget + overlayBegin, overlayWorld, sizeof(glm::mat4) * (overlayEnd - overlayBegin));
+		memcpy((glm::vec4*)normalTarget + overlayBegin * 3, overlayNormals, sizeof(glm::vec4) * 3 * (overlayEnd - overlayBegin));
+	}
+
+	if (modelTexture == 0)
+	{
+		glGenTextures(1, &modelTexture);
+		glGenTextures(1, &normalTexture);
+	}
+
+	glBindTexture(GL_TEXTURE_BUFFER, modelTexture);
+	glTexBufferRange(GL_TEXTURE_BUFFER, GL_RGBA32F, stream.GetBuffer(), worldOffset, worldSize);
+	glBindTexture(GL_TEXTURE_BUFFER, normalTexture);
+	glTexBufferRange(GL_TEXTURE_BUFFER, GL_RGBA32F, stream.GetBuffer(), normalOffset, normalSize);
+	glBindTexture(GL_TEXTURE_BUFFER, 0);
+
+	// The textures no longer point at our own buffers, the next Upload has to rebuild them
+	capacity = 0;
+
+	return true;
+}
+
+bool TransformBuffer::CanStream()
+{
+	return GLEW_VERSION_4_3 || GLEW_ARB_texture_buffer_range;
+}
+
+GLsizeiptr TransformBuffer::StreamSize(unsigned int streamCapacity)
+{
+	return (sizeof(glm::mat4) + sizeof(glm::vec4) * 3) * streamCapacity + StreamAlignment() * 2;
+}
+
+GLint TransformBuffer::StreamAlignment()
+{
+	static GLint alignment = 0;
+	if (alignment == 0)
+	{
+		glGetIntegerv(GL_TEXTURE_BUFFER_OFFSET_ALIGNMENT, &alignment);
+		if (alignment < 1) alignment = 256;
+	}
+	return alignment;
+}
+
+void TransformBuffer::UseTransforms(GLuint modelTextureUnit, GLuint normalTextureUnit)
+{
+	glActiveTexture(GL_TEXTURE0 + modelTextureUnit);
+	glBindTexture(GL_TEXTURE_BUFFER, modelTexture);
+	glActiveTexture(GL_TEXTURE0 + normalTextureUnit);
+	glBindTexture(GL_TEXTURE_BUFFER, normalTexture);
+	glActiveTexture(GL_TEXTURE0);
+}
+
+void TransformBuffer::ClearBuffer()
+{
+	if (modelTexture != 0)
+	{
+		glDeleteTextures(1, &modelTexture);
+		glDeleteTextures(1, &normalTexture);
+		glDeleteBuffers(1, &modelBuffer);
+		glDeleteBuffers(1, &normalBuffer);
+		modelTexture = 0;
+		normalTexture = 0;
+		modelBuffer = 0;
+		normalBuffer = 0;
+		GpuMemory::Free(allocation);
+	}
+
+	capacity = 0;
+}
+
+TransformBuffer::~TransformBuffer()
+{
+	ClearBuffer();
+}
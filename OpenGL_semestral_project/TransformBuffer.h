@@ -0,0 +1,43 @@
+#pragma once
+
+#include <GL\glew.h>
+#include <glm\glm.hpp>
+
+#include "StreamBuffer.h"
+
+// GPU side of the transforms: world and normal matrices in RGBA32F texture buffers for shader.vert
+class TransformBuffer
+{
+public:
+	TransformBuffer();
+
+	// Sends [begin, end) of the matrices, or everything when the capacity changed
+	void Upload(const glm::mat4* worldMatrices, const glm::vec4* normalMatrices, unsigned int capacity, unsigned int begin, unsigned int end);
+	// Replaces [begin, end) after an Upload, the matrices start at begin rather than at 0
+	void UploadRange(const glm::mat4* worldMatrices, const glm::vec4* normalMatrices, unsigned int begin, unsigned int end);
+	// Writes every matrix into the current frame of stream and points the texture buffers at it, [overlayBegin, overlayEnd)
+	// comes from the overlay matrices instead, which start at overlayBegin.
+	// Needs GL 4.3 / ARB_texture_buffer_range, false when unsupported or the frame is full
+	bool Stream(StreamBuffer& stream, const glm::mat4* worldMatrices, const glm::vec4* normalMatrices, unsigned int capacity,
+		unsigned int overlayBegin = 0, unsigned int overlayEnd = 0, const glm::mat4* overlayWorld = nullptr, const glm::vec4* overlayNormals = nullptr);
+	static bool CanStream();
+	// Stream bytes one Stream call needs in the worst case
+	static GLsizeiptr StreamSize(unsigned int capacity);
+	void UseTransforms(GLuint modelTextureUnit, GLuint normalTextureUnit);
+
+	unsigned int GetCapacity() { return capacity; }
+
+	void ClearBuffer();
+
+	~TransformBuffer();
+
+private:
+	unsigned int capacity;
+
+	GLuint modelBuffer, modelTexture;
+	GLuint normalBuffer, normalTexture;
+
+	unsigned int allocation;
+
+	static GLint StreamAlignment();
+};
@@ -0,0 +1,378 @@
+#include "TransformStore.h"
+
+#include <string.h>
+
+#include "CpuTrace.h"
+
+#if defined(_M_X64) || defined(_M_IX86) || defined(__SSE2__)
+#define TRANSFORM_SIMD 1
+#include <emmintrin.h>
+#endif
+
+const unsigned int TransformStore::NO_PARENT;
+
+TransformStore::TransformStore()
+{
+	count = 0;
+	frame = 0;
+	uploadBegin = 0;
+	uploadEnd = 0;
+	keepPrevious = false;
+	computedCount = 0;
+}
+
+void TransformStore::Reserve(unsigned int reserveCount)
+{
+	unsigned int padded = (reserveCount + 3) & ~3u;
+
+	positionX.reserve(padded); positionY.reserve(padded); positionZ.reserve(padded);
+	rotationX.reserve(padded); rotationY.reserve(padded); rotationZ.reserve(padded); rotationW.reserve(padded);
+	scaleX.reserve(padded); scaleY.reserve(padded); scaleZ.reserve(padded);
+	parents.reserve(padded);
+	dirty.reserve(padded);
+	updateFrames.reserve(padded);
+	worldMatrices.reserve(padded);
+	normalMatrices.reserve(padded * 3);
+}
+
+void TransformStore::Grow(unsigned int newCount)
+{
+	unsigned int padded = (newCount + 3) & ~3u;
+	if (padded <= positionX.size())
+	{
+		return;
+	}
+
+	// Padding lanes hold an identity transform so the SIMD path never divides by a zero scale
+	positionX.resize(padded, 0.0f); positionY.resize(padded, 0.0f); positionZ.resize(padded, 0.0f);
+	rotationX.resize(padded, 0.0f); rotationY.resize(padded, 0.0f); rotationZ.resize(padded, 0.0f); rotationW.resize(padded, 1.0f);
+	scaleX.resize(padded, 1.0f); scaleY.resize(padded, 1.0f); scaleZ.resize(padded, 1.0f);
+	parents.resize(padded, NO_PARENT);
+	dirty.resize(padded, 0);
+	updateFrames.resize(padded, 0);
+	worldMatrices.resize(padded, glm::mat4(1.0f));
+	normalMatrices.resize(padded * 3, glm::vec4(0.0f));
+}
+
+unsigned int TransformStore::CreateTransform(unsigned int parent)
+{
+	unsigned int id = count;
+	Grow(count + 1);
+	count++;
+
+	parents[id] = parent < id ? parent : NO_PARENT;
+	dirty[id] = 1;
+
+	return id;
+}
+
+void TransformStore::SetPosition(unsigned int id, glm::vec3 position)
+{
+	positionX[id] = position.x;
+	positionY[id] = position.y;
+	positionZ[id] = position.z;
+	dirty[id] = 1;
+}
+
+void TransformStore::SetRotation(unsigned int id, glm::quat rotation)
+{
+	rotationX[id] = rotation.x;
+	rotationY[id] = rotation.y;
+	rotationZ[id] = rotation.z;
+	rotationW[id] = rotation.w;
+	dirty[id] = 1;
+}
+
+void TransformStore::SetScale(unsigned int id, glm::vec3 scale)
+{
+	scaleX[id] = scale.x;
+	scaleY[id] = scale.y;
+	scaleZ[id] = scale.z;
+	dirty[id] = 1;
+}
+
+glm::vec3 TransformStore::GetPosition(unsigned int id)
+{
+	return glm::vec3(positionX[id], positionY[id], positionZ[id]);
+}
+
+glm::mat3 TransformStore::GetNormalMatrix(unsigned int id)
+{
+	return glm::mat3(glm::vec3(normalMatrices[id * 3]), glm::vec3(normalMatrices[id * 3 + 1]), glm::vec3(normalMatrices[id * 3 + 2]));
+}
+
+void TransformStore::UpdateWorldMatrices(JobSystem* jobs)
+{
+	TRACE_SCOPE("TransformStore::UpdateWorldMatrices");
+
+	frame++;
+
+	unsigned int firstDirty = count;
+	unsigned int lastDirty = 0;
+
+	// Children sit after their parents, so one forward pass propagates dirtiness down the hierarchy
+	for (unsigned int i = 0; i < count; i++)
+	{
+		if (parents[i] != NO_PARENT && dirty[parents[i]])
+		{
+			dirty[i] = 1;
+		}
+
+		if (dirty[i])
+		{
+			if (i < firstDirty) firstDirty = i & ~3u;
+			lastDirty = (i & ~3u) + 4;
+		}
+	}
+
+	if (firstDirty >= lastDirty)
+	{
+		return;
+	}
+
+	unsigned int keptBegin = uploadBegin < uploadEnd && uploadBegin < firstDirty ? uploadBegin : firstDirty;
+	unsigned int keptEnd = lastDirty > count ? count : lastDirty;
+	if (keepPrevious)
+	{
+		KeepPrevious(firstDirty, keptEnd);
+	}
+
+	// Local matrices only read their own components, so blocks can be spread over workers
+	auto computeBlocks = [this, firstDirty](unsigned int begin, unsigned int end)
+	{
+		for (unsigned int block = firstDirty + begin * 4; block < firstDirty + end * 4; block += 4)
+		{
+			if (!IsBlockDirty(block))
+			{
+				continue;
+			}
+
+			ComputeLocalBlock(block);
+			updateFrames[block] = frame;
+			updateFrames[block + 1] = frame;
+			updateFrames[block + 2] = frame;
+			updateFrames[block + 3] = frame;
+		}
+	};
+
+	unsigned int blockCount = (lastDirty - firstDirty) / 4;
+	if (jobs)
+	{
+		jobs->ParallelFor(blockCount, 1024, computeBlocks);
+	}
+	else
+	{
+		computeBlocks(0, blockCount);
+	}
+
+	for (unsigned int i = firstDirty; i < lastDirty && i < count; i++)
+	{
+		// Whole blocks get their local matrix rebuilt, so clean neighbours need their parent reapplied too
+		if (parents[i] != NO_PARENT && IsBlockDirty(i & ~3u))
+		{
+			ApplyParent(i);
+		}
+	}
+
+	if (lastDirty > count) lastDirty = count;
+
+	if (keepPrevious)
+	{
+		// New transforms had no pose before this update, they shouldn't fly in from the origin
+		for (unsigned int i = computedCount > firstDirty ? computedCount : firstDirty; i < keptEnd; i++)
+		{
+			previousWorldMatrices[i - keptBegin] = worldMatrices[i];
+			memcpy(&previousNormalMatrices[(i - keptBegin) * 3], &normalMatrices[i * 3], sizeof(glm::vec4) * 3);
+		}
+	}
+	computedCount = count;
+
+	if (uploadBegin == uploadEnd)
+	{
+		uploadBegin = firstDirty;
+		uploadEnd = lastDirty;
+	}
+	else
+	{
+		if (firstDirty < uploadBegin) uploadBegin = firstDirty;
+		if (lastDirty > uploadEnd) uploadEnd = lastDirty;
+	}
+
+	memset(&dirty[firstDirty], 0, lastDirty - firstDirty);
+}
+
+void TransformStore::KeepPrevious(unsigned int begin, unsigned int end)
+{
+	if (uploadBegin == uploadEnd)
+	{
+		previousWorldMatrices.assign(&worldMatrices[begin], &worldMatrices[begin] + (end - begin));
+		previousNormalMatrices.assign(&normalMatrices[begin * 3], &normalMatrices[begin * 3] + (end - begin) * 3);
+		return;
+	}
+
+	// Anything between the kept range and the new one hasn't changed since the range was taken
+	if (begin < uploadBegin)
+	{
+		previousWorldMatrices.insert(previousWorldMatrices.begin(), &worldMatrices[begin], &worldMatrices[uploadBegin]);
+		previousNormalMatrices.insert(previousNormalMatrices.begin(), &normalMatrices[begin * 3], &normalMatrices[uploadBegin * 3]);
+	}
+	if (end > uploadEnd)
+	{
+		previousWorldMatrices.insert(previousWorldMatrices.end(), &worldMatrices[uploadEnd], &worldMatrices[0] + end);
+		previousNormalMatrices.insert(previousNormalMatrices.end(), &normalMatrices[uploadEnd * 3], &normalMatrices[0] + end * 3);
+	}
+}
+
+void TransformStore::ComputeLocalBlock(unsigned int first)
+{
+#ifdef TRANSFORM_SIMD
+	// Four transforms per iteration straight from the SoA arrays: M = T * R * S and N = R * S^-1
+	__m128 qx = _mm_loadu_ps(&rotationX[first]);
+	__m128 qy = _mm_loadu_ps(&rotationY[first]);
+	__m128 qz = _mm_loadu_ps(&rotationZ[first]);
+	__m128 qw = _mm_loadu_ps(&rotationW[first]);
+
+	__m128 one = _mm_set1_ps(1.0f);
+	__m128 two = _mm_set1_ps(2.0f);
+	__m128 zero = _mm_setzero_ps();
+
+	__m128 xx = _mm_mul_ps(qx, qx), yy = _mm_mul_ps(qy, qy), zz = _mm_mul_ps(qz, qz);
+	__m128 xy = _mm_mul_ps(qx, qy), xz = _mm_mul_ps(qx, qz), yz = _mm_mul_ps(qy, qz);
+	__m128 wx = _mm_mul_ps(qw, qx), wy = _mm_mul_ps(qw, qy), wz = _mm_mul_ps(qw, qz);
+
+	__m128 r[3][3];
+	r[0][0] = _mm_sub_ps(one, _mm_mul_ps(two, _mm_add_ps(yy, zz)));
+	r[0][1] = _mm_mul_ps(two, _mm_add_ps(xy, wz));
+	r[0][2] = _mm_mul_ps(two, _mm_sub_ps(xz, wy));
+	r[1][0] = _mm_mul_ps(two, _mm_sub_ps(xy, wz));
+	r[1][1] = _mm_sub_ps(one, _mm_mul_ps(two, _mm_add_ps(xx, zz)));
+	r[1][2] = _mm_mul_ps(two, _mm_add_ps(yz, wx));
+	r[2][0] = _mm_mul_ps(two, _mm_add_ps(xz, wy));
+	r[2][1] = _mm_mul_ps(two, _mm_sub_ps(yz, wx));
+	r[2][2] = _mm_sub_ps(one, _mm_mul_ps(two, _mm_add_ps(xx, yy)));
+
+	__m128 scale[3] = { _mm_loadu_ps(&scaleX[first]), _mm_loadu_ps(&scaleY[first]), _mm_loadu_ps(&scaleZ[first]) };
+
+	for (int column = 0; column < 3; column++)
+	{
+		__m128 s = scale[column];
+		__m128 invS = _mm_div_ps(one, s);
+
+		__m128 m0 = _mm_mul_ps(r[column][0], s), m1 = _mm_mul_ps(r[column][1], s), m2 = _mm_mul_ps(r[column][2], s), m3 = zero;
+		_MM_TRANSPOSE4_PS(m0, m1, m2, m3);
+		_mm_storeu_ps(&worldMatrices[first][column][0], m0);
+		_mm_storeu_ps(&worldMatrices[first + 1][column][0], m1);
+		_mm_storeu_ps(&worldMatrices[first + 2][column][0], m2);
+		_mm_storeu_ps(&worldMatrices[first + 3][column][0], m3);
+
+		__m128 n0 = _mm_mul_ps(r[column][0], invS), n1 = _mm_mul_ps(r[column][1], invS), n2 = _mm_mul_ps(r[column][2], invS), n3 = zero;
+		_MM_TRANSPOSE4_PS(n0, n1, n2, n3);
+		_mm_storeu_ps(&normalMatrices[first * 3 + column][0], n0);
+		_mm_storeu_ps(&normalMatrices[(first + 1) * 3 + column][0], n1);
+		_mm_storeu_ps(&normalMatrices[(first + 2) * 3 + column][0], n2);
+		_mm_storeu_ps(&normalMatrices[(first + 3) * 3 + column][0], n3);
+	}
+
+	__m128 t0 = _mm_loadu_ps(&positionX[first]), t1 = _mm_loadu_ps(&positionY[first]), t2 = _mm_loadu_ps(&positionZ[first]), t3 = one;
+	_MM_TRANSPOSE4_PS(t0, t1, t2, t3);
+	_mm_storeu_ps(&worldMatrices[first][3][0], t0);
+	_mm_storeu_ps(&worldMatrices[first + 1][3][0], t1);
+	_mm_storeu_ps(&worldMatrices[first + 2][3][0], t2);
+	_mm_storeu_ps(&worldMatrices[first + 3][3][0], t3);
+#else
+	for (unsigned int i = first; i < first + 4; i++)
+	{
+		ComputeLocalScalar(i);
+	}
+#endif
+}
+
+void TransformStore::ComputeLocalScalar(unsigned int id)
+{
+	float x = rotationX[id], y = rotationY[id], z = rotationZ[id], w = rotationW[id];
+
+	glm::vec3 rotation[3];
+	rotation[0] = glm::vec3(1.0f - 2.0f * (y * y + z * z), 2.0f * (x * y + w * z), 2.0f * (x * z - w * y));
+	rotation[1] = glm::vec3(2.0f * (x * y - w * z), 1.0f - 2.0f * (x * x + z * z), 2.0f * (y * z + w * x));
+	rotation[2] = glm::vec3(2.0f * (x * z + w * y), 2.0f * (y * z - w * x), 1.0f - 2.0f * (x * x + y * y));
+
+	float scale[3] = { scaleX[id], scaleY[id], scaleZ[id] };
+
+	for (int column = 0; column < 3; column++)
+	{
+		worldMatrices[id][column] = glm::vec4(rotation[column] * scale[column], 0.0f);
+		normalMatrices[id * 3 + column] = glm::vec4(rotation[column] / scale[column], 0.0f);
+	}
+	worldMatrices[id][3] = glm::vec4(positionX[id], positionY[id], positionZ[id], 1.0f);
+}
+
+void TransformStore::ApplyParent(unsigned int id)
+{
+	unsigned int parent = parents[id];
+
+	// (P * L)^-T == P^-T * L^-T, so normal matrices compose the same way as world matrices
+	worldMatrices[id] = worldMatrices[parent] * worldMatrices[id];
+
+	glm::mat3 normal = GetNormalMatrix(parent) * GetNormalMatrix(id);
+	for (int column = 0; column < 3; column++)
+	{
+		normalMatrices[id * 3 + column] = glm::vec4(normal[column], 0.0f);
+	}
+}
+
+void TransformStore::Upload()
+{
+	TRACE_SCOPE("TransformStore::Upload");
+
+	if (count == 0)
+	{
+		return;
+	}
+
+	gpuBuffer.Upload(&worldMatrices[0], &normalMatrices[0], (unsigned int)positionX.size(), uploadBegin, uploadEnd);
+
+	uploadBegin = 0;
+	uploadEnd = 0;
+}
+
+void TransformStore::UseTransforms(GLuint modelTextureUnit, GLuint normalTextureUnit)
+{
+	gpuBuffer.UseTransforms(modelTextureUnit, normalTextureUnit);
+}
+
+bool TransformStore::TakeChangedRange(unsigned int& begin, unsigned int& end)
+{
+	begin = uploadBegin;
+	end = uploadEnd;
+
+	uploadBegin = 0;
+	uploadEnd = 0;
+
+	return begin < end;
+}
+
+void TransformStore::ClearTransforms()
+{
+	gpuBuffer.ClearBuffer();
+
+	count = 0;
+	computedCount = 0;
+	uploadBegin = 0;
+	uploadEnd = 0;
+
+	positionX.clear(); positionY.clear(); positionZ.clear();
+	rotationX.clear(); rotationY.clear(); rotationZ.clear(); rotationW.clear();
+	scaleX.clear(); scaleY.clear(); scaleZ.clear();
+	parents.clear();
+	dirty.clear();
+	updateFrames.clear();
+	worldMatrices.clear();
+	normalMatrices.clear();
+	previousWorldMatrices.clear();
+	previousNormalMatrices.clear();
+}
+
+TransformStore::~TransformStore()
+{
+	ClearTransforms();
+}
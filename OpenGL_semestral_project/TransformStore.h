@@ -0,0 +1,95 @@
+#pragma once
+
+#include <vector>
+
+#include <GL\glew.h>
+#include <glm\glm.hpp>
+#include <glm\gtc\quaternion.hpp>
+
+#include "JobSystem.h"
+#include "TransformBuffer.h"
+
+class TransformStore
+{
+public:
+	static const unsigned int NO_PARENT = 0xFFFFFFFF;
+
+	TransformStore();
+
+	// Parents have to exist before their children, which keeps the arrays in update order
+	unsigned int CreateTransform(unsigned int parent = NO_PARENT);
+	void Reserve(unsigned int count);
+
+	void SetPosition(unsigned int id, glm::vec3 position);
+	void SetRotation(unsigned int id, glm::quat rotation);
+	void SetScale(unsigned int id, glm::vec3 scale);
+
+	glm::vec3 GetPosition(unsigned int id);
+	unsigned int GetParent(unsigned int id) { return parents[id]; }
+	unsigned int GetCount() { return count; }
+
+	const glm::mat4& GetWorldMatrix(unsigned int id) { return worldMatrices[id]; }
+	glm::mat3 GetNormalMatrix(unsigned int id);
+
+	// Recomputes world and normal matrices of dirty transforms and their descendants,
+	// local matrices are split across jobs when a job system is given
+	void UpdateWorldMatrices(JobSystem* jobs = nullptr);
+
+	// True when the last UpdateWorldMatrices produced a new world matrix for the transform
+	bool WasUpdated(unsigned int id) { return updateFrames[id] == frame; }
+
+	// Streams the changed range into the texture buffers read by shader.vert
+	void Upload();
+	void UseTransforms(GLuint modelTextureUnit, GLuint normalTextureUnit);
+
+	// For copying matrices elsewhere instead of Upload, hands over and resets the changed range
+	bool TakeChangedRange(unsigned int& begin, unsigned int& end);
+	// With keepPrevious the store also remembers what the changed range held when it was last taken,
+	// for blending between simulation updates. Off by default, it costs a copy of every moved matrix
+	void SetKeepPrevious(bool enable) { keepPrevious = enable; }
+	// Matrices of the range the last TakeChangedRange returned, from before it changed. Null without keepPrevious
+	const glm::mat4* GetPreviousWorldMatrices() { return keepPrevious && !previousWorldMatrices.empty() ? &previousWorldMatrices[0] : nullptr; }
+	const glm::vec4* GetPreviousNormalMatrices() { return keepPrevious && !previousNormalMatrices.empty() ? &previousNormalMatrices[0] : nullptr; }
+	unsigned int GetCapacity() { return (unsigned int)positionX.size(); }
+	const glm::mat4* GetWorldMatrices() { return worldMatrices.empty() ? nullptr : &worldMatrices[0]; }
+	const glm::vec4* GetNormalMatrices() { return normalMatrices.empty() ? nullptr : &normalMatrices[0]; }
+
+	void ClearTransforms();
+
+	~TransformStore();
+
+private:
+	unsigned int count;
+
+	// SoA components, padded to a multiple of 4 for the SIMD path
+	std::vector<float> positionX, positionY, positionZ;
+	std::vector<float> rotationX, rotationY, rotationZ, rotationW;
+	std::vector<float> scaleX, scaleY, scaleZ;
+	std::vector<unsigned int> parents;
+	std::vector<unsigned char> dirty;
+	std::vector<unsigned int> updateFrames;
+	unsigned int frame;
+
+	std::vector<glm::mat4> worldMatrices;
+	// Normal matrices as 3 padded columns, matching the RGBA32F texel layout
+	std::vector<glm::vec4> normalMatrices;
+
+	unsigned int uploadBegin, uploadEnd;
+	TransformBuffer gpuBuffer;
+
+	bool keepPrevious;
+	// Transforms that existed at the last UpdateWorldMatrices, the rest have no earlier pose
+	unsigned int computedCount;
+	// [uploadBegin, uploadEnd) as it was after the last TakeChangedRange
+	std::vector<glm::mat4> previousWorldMatrices;
+	std::vector<glm::vec4> previousNormalMatrices;
+
+	void Grow(unsigned int newCount);
+	// Extends the previous matrices to cover [begin, end) before it is recomputed
+	void KeepPrevious(unsigned int begin, unsigned int end);
+	// ComputeLocalBlock rebuilds all four slots of a block when any one of them is dirty
+	bool IsBlockDirty(unsigned int first) { return (dirty[first] | dirty[first + 1] | dirty[first + 2] | dirty[first + 3]) != 0; }
+	void ComputeLocalBlock(unsigned int first);
+	void ComputeLocalScalar(unsigned int id);
+	void ApplyParent(unsigned int id);
+};
@@ -0,0 +1,253 @@
+#include "UniformTable.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <algorithm>
+
+#include <glm\gtc\type_ptr.hpp>
+
+UniformTable::UniformTable()
+{
+	uploadCount = 0;
+	skippedCount = 0;
+}
+
+void UniformTable::Build(GLuint program)
+{
+	Clear();
+
+	GLint uniformCount = 0;
+	GLint maxNameLength = 0;
+	glGetProgramiv(program, GL_ACTIVE_UNIFORMS, &uniformCount);
+	glGetProgramiv(program, GL_ACTIVE_UNIFORM_MAX_LENGTH, &maxNameLength);
+
+	std::vector<GLchar> nameBuffer(maxNameLength + 1, '\0');
+	unsigned int cacheSize = 0;
+
+	for (GLint i = 0; i < uniformCount; i++)
+	{
+		GLsizei nameLength = 0;
+		GLint arraySize = 0;
+		GLenum type = 0;
+		glGetActiveUniform(program, (GLuint)i, (GLsizei)nameBuffer.size(), &nameLength, &arraySize, &type, &nameBuffer[0]);
+
+		std::string name(&nameBuffer[0], nameLength);
+
+		unsigned int element = 0;
+		UniformId baseId = HashName(name, element);
+
+		// Arrays of plain types come back as one entry named "name[0]", struct arrays are already split per member
+		std::string baseName = name;
+		if (arraySize > 1 && baseName.size() > 3 && baseName.compare(baseName.size() - 3, 3, "[0]") == 0)
+		{
+			baseName.resize(baseName.size() - 3);
+		}
+		else
+		{
+			arraySize = 1;
+		}
+
+		for (GLint e = 0; e < arraySize; e++)
+		{
+			std::string elementName = arraySize > 1 ? baseName + "[" + std::to_string(e) + "]" : name;
+
+			GLint location = glGetUniformLocation(program, elementName.c_str());
+			if (location < 0)
+			{
+				continue;
+			}
+
+			UniformEntry entry;
+			entry.id = UniformElement(baseId, element + e);
+			entry.location = location;
+			entry.type = type;
+			entry.cacheOffset = cacheSize;
+			entry.cached = false;
+			entries.push_back(entry);
+
+			cacheSize += CacheWords(type);
+		}
+	}
+
+	cache.assign(cacheSize, 0);
+
+	std::sort(entries.begin(), entries.end(), [](const UniformEntry& a, const UniformEntry& b) { return a.id < b.id; });
+
+	for (size_t i = 1; i < entries.size(); i++)
+	{
+		if (entries[i].id == entries[i - 1].id)
+		{
+			printf("Uniform hash collision at locations %d and %d!\n", entries[i - 1].location, entries[i].location);
+		}
+	}
+}
+
+bool UniformTable::Has(UniformId id)
+{
+	return Find(id) != nullptr;
+}
+
+GLint UniformTable::GetLocation(UniformId id)
+{
+	UniformEntry* entry = Find(id);
+	return entry ? entry->location : -1;
+}
+
+void UniformTable::SetInt(UniformId id, GLint value)
+{
+	UniformEntry* entry = Find(id);
+	if (entry && Changed(entry, &value, sizeof(value)))
+	{
+		glUniform1i(entry->location, value);
+	}
+}
+
+void UniformTable::SetFloat(UniformId id, GLfloat value)
+{
+	UniformEntry* entry = Find(id);
+	if (entry && Changed(entry, &value, sizeof(value)))
+	{
+		glUniform1f(entry->location, value);
+	}
+}
+
+void UniformTable::SetVec3(UniformId id, const glm::vec3& value)
+{
+	UniformEntry* entry = Find(id);
+	if (entry && Changed(entry, glm::value_ptr(value), sizeof(GLfloat) * 3))
+	{
+		glUniform3f(entry->location, value.x, value.y, value.z);
+	}
+}
+
+void UniformTable::SetVec4(UniformId id, const glm::vec4& value)
+{
+	UniformEntry* entry = Find(id);
+	if (entry && Changed(entry, glm::value_ptr(value), sizeof(GLfloat) * 4))
+	{
+		glUniform4f(entry->location, value.x, value.y, value.z, value.w);
+	}
+}
+
+void UniformTable::SetMat3(UniformId id, const glm::mat3& value)
+{
+	UniformEntry* entry = Find(id);
+	if (entry && Changed(entry, glm::value_ptr(value), sizeof(GLfloat) * 9))
+	{
+		glUniformMatrix3fv(entry->location, 1, GL_FALSE, glm::value_ptr(value));
+	}
+}
+
+void UniformTable::SetMat4(UniformId id, const glm::mat4& value)
+{
+	UniformEntry* entry = Find(id);
+	if (entry && Changed(entry, glm::value_ptr(value), sizeof(GLfloat) * 16))
+	{
+		glUniformMatrix4fv(entry->location, 1, GL_FALSE, glm::value_ptr(value));
+	}
+}
+
+void UniformTable::ResetCounters()
+{
+	uploadCount = 0;
+	skippedCount = 0;
+}
+
+UniformTable::UniformEntry* UniformTable::Find(UniformId id)
+{
+	auto found = std::lower_bound(entries.begin(), entries.end(), id,
+		[](const UniformEntry& entry, UniformId key) { return entry.id < key; });
+
+	if (found == entries.end() || found->id != id)
+	{
+		return nullptr;
+	}
+
+	return &(*found);
+}
+
+bool UniformTable::Changed(UniformEntry* entry, const void* value, size_t size)
+{
+	if (size > CacheWords(entry->type) * sizeof(GLuint))
+	{
+		// Setter type doesn't match the declared uniform, upload and let GL report it
+		uploadCount++;
+		return true;
+	}
+
+	GLuint* cached = &cache[entry->cacheOffset];
+	if (entry->cached && memcmp(cached, value, size) == 0)
+	{
+		skippedCount++;
+		return false;
+	}
+
+	memcpy(cached, value, size);
+	entry->cached = true;
+	uploadCount++;
+	return true;
+}
+
+UniformId UniformTable::HashName(const std::string& name, unsigned int& element)
+{
+	UniformId hash = 2166136261u;
+	bool firstSubscript = true;
+	element = 0;
+
+	for (size_t i = 0; i < name.size(); i++)
+	{
+		if (name[i] == '[')
+		{
+			unsigned int index = 0;
+			for (i++; i < name.size() && name[i] != ']'; i++)
+			{
+				index = index * 10 + (name[i] - '0');
+			}
+
+			if (firstSubscript)
+			{
+				element = index;
+				firstSubscript = false;
+			}
+			continue;
+		}
+
+		hash = (hash ^ (unsigned char)name[i]) * 16777619u;
+	}
+
+	return hash;
+}
+
+unsigned int UniformTable::CacheWords(GLenum type)
+{
+	switch (type)
+	{
+	case GL_FLOAT_VEC2:
+	case GL_INT_VEC2:
+		return 2;
+	case GL_FLOAT_VEC3:
+	case GL_INT_VEC3:
+		return 3;
+	case GL_FLOAT_VEC4:
+	case GL_INT_VEC4:
+	case GL_FLOAT_MAT2:
+		return 4;
+	case GL_FLOAT_MAT3:
+		return 9;
+	case GL_FLOAT_MAT4:
+		return 16;
+	default:
+		return 1;
+	}
+}
+
+void UniformTable::Clear()
+{
+	entries.clear();
+	cache.clear();
+	ResetCounters();
+}
+
+UniformTable::~UniformTable()
+{
+}
@@ -0,0 +1,140 @@
+#pragma once
+
+#include <vector>
+#include <string>
+
+#include <GL\glew.h>
+#include <glm\glm.hpp>
+
+typedef unsigned int UniformId;
+
+// FNV-1a over the uniform name with array subscripts left out ("pointLights.base.colour")
+constexpr UniformId HashUniform(const char* name, UniformId hash = 2166136261u)
+{
+	return *name ? HashUniform(name + 1, (hash ^ (unsigned char)(*name)) * 16777619u) : hash;
+}
+
+// Key of one element of an array uniform, element 0 keeps the plain name hash
+constexpr UniformId UniformElement(UniformId id, unsigned int element)
+{
+	return element ? (id ^ (element * 0x9E3779B9u)) * 16777619u : id;
+}
+
+namespace Uniforms
+{
+	constexpr UniformId ModelMatrices = HashUniform("modelMatrices");
+	constexpr UniformId NormalMatrices = HashUniform("normalMatrices");
+	constexpr UniformId TransformIndex = HashUniform("transformIndex");
+	constexpr UniformId View = HashUniform("view");
+	constexpr UniformId Projection = HashUniform("projection");
+	constexpr UniformId EyePosition = HashUniform("eyePosition");
+
+	constexpr UniformId MaterialSpecularIntensity = HashUniform("material.specularIntensity");
+	constexpr UniformId MaterialShininess = HashUniform("material.shininess");
+
+	constexpr UniformId DirectionalColour = HashUniform("directionalLight.base.colour");
+	constexpr UniformId DirectionalAmbientIntensity = HashUniform("directionalLight.base.ambientIntensity");
+	constexpr UniformId DirectionalDiffuseIntensity = HashUniform("directionalLight.base.diffuseIntensity");
+	constexpr UniformId DirectionalDirection = HashUniform("directionalLight.direction");
+
+	constexpr UniformId PointLightCount = HashUniform("pointLightCount");
+	constexpr UniformId PointColour = HashUniform("pointLights.base.colour");
+	constexpr UniformId PointAmbientIntensity = HashUniform("pointLights.base.ambientIntensity");
+	constexpr UniformId PointDiffuseIntensity = HashUniform("pointLights.base.diffuseIntensity");
+	constexpr UniformId PointPosition = HashUniform("pointLights.position");
+	constexpr UniformId PointConstant = HashUniform("pointLights.constant");
+	constexpr UniformId PointLinear = HashUniform("pointLights.linear");
+	constexpr UniformId PointExponent = HashUniform("pointLights.exponent");
+
+	constexpr UniformId SpotLightCount = HashUniform("spotLightCount");
+	constexpr UniformId SpotColour = HashUniform("spotLights.base.base.colour");
+	constexpr UniformId SpotAmbientIntensity = HashUniform("spotLights.base.base.ambientIntensity");
+	constexpr UniformId SpotDiffuseIntensity = HashUniform("spotLights.base.base.diffuseIntensity");
+	constexpr UniformId SpotPosition = HashUniform("spotLights.base.position");
+	constexpr UniformId SpotConstant = HashUniform("spotLights.base.constant");
+	constexpr UniformId SpotLinear = HashUniform("spotLights.base.linear");
+	constexpr UniformId SpotExponent = HashUniform("spotLights.base.exponent");
+	constexpr UniformId SpotDirection = HashUniform("spotLights.direction");
+	constexpr UniformId SpotEdge = HashUniform("spotLights.edge");
+
+	constexpr UniformId FogColour = HashUniform("fogColour");
+	constexpr UniformId FogDensity = HashUniform("fogDensity");
+
+	constexpr UniformId TextureArray = HashUniform("theTextureArray");
+	constexpr UniformId TextureLayer = HashUniform("textureLayer");
+
+	constexpr UniformId TerrainMorphStart = HashUniform("terrainMorphStart");
+	constexpr UniformId TerrainMorphEnd = HashUniform("terrainMorphEnd");
+
+	constexpr UniformId BonePalette = HashUniform("bonePalette");
+	constexpr UniformId BoneBase = HashUniform("boneBase");
+
+	constexpr UniformId EmitterWorld = HashUniform("emitterWorld");
+	constexpr UniformId EmitterOrigin = HashUniform("emitterOrigin");
+	constexpr UniformId EmitterDirection = HashUniform("emitterDirection");
+	constexpr UniformId EmitterSpread = HashUniform("emitterSpread");
+	constexpr UniformId EmitterRanges = HashUniform("emitterRanges");
+	constexpr UniformId EmitterForces = HashUniform("emitterForces");
+	constexpr UniformId EmitterActive = HashUniform("emitterActive");
+	constexpr UniformId DeltaTime = HashUniform("deltaTime");
+	constexpr UniformId FrameSeed = HashUniform("frameSeed");
+	constexpr UniformId ParticleFirst = HashUniform("particleFirst");
+	constexpr UniformId ParticleCount = HashUniform("particleCount");
+	constexpr UniformId ParticleColourStart = HashUniform("particleColourStart");
+	constexpr UniformId ParticleColourEnd = HashUniform("particleColourEnd");
+	constexpr UniformId ParticleShape = HashUniform("particleShape");
+
+	constexpr UniformId SourceTexture = HashUniform("sourceTexture");
+	constexpr UniformId SourceSize = HashUniform("sourceSize");
+}
+
+class UniformTable
+{
+public:
+	UniformTable();
+
+	// Introspects every active uniform of a linked program, replaces any previous contents
+	void Build(GLuint program);
+
+	bool Has(UniformId id);
+	GLint GetLocation(UniformId id);
+	size_t GetSize() { return entries.size(); }
+
+	// Each setter uploads only when the value differs from the last one sent to this program
+	void SetInt(UniformId id, GLint value);
+	void SetFloat(UniformId id, GLfloat value);
+	void SetVec3(UniformId id, const glm::vec3& value);
+	void SetVec4(UniformId id, const glm::vec4& value);
+	void SetMat3(UniformId id, const glm::mat3& value);
+	void SetMat4(UniformId id, const glm::mat4& value);
+
+	unsigned int GetUploadCount() { return uploadCount; }
+	unsigned int GetSkippedCount() { return skippedCount; }
+	void ResetCounters();
+
+	void Clear();
+
+	~UniformTable();
+
+private:
+	struct UniformEntry
+	{
+		UniformId id;
+		GLint location;
+		GLenum type;
+		unsigned int cacheOffset;
+		bool cached;
+	};
+
+	std::vector<UniformEntry> entries;
+	std::vector<GLuint> cache;
+
+	unsigned int uploadCount;
+	unsigned int skippedCount;
+
+	UniformEntry* Find(UniformId id);
+	bool Changed(UniformEntry* entry, const void* value, size_t size);
+
+	static UniformId HashName(const std::string& name, unsigned int& element);
+	static unsigned int CacheWords(GLenum type);
+};
@@ -1,5 +1,10 @@
 #include "Window.h"
 
+#ifndef _WIN32
+#include <EGL/egl.h>
+#include <EGL/eglext.h>
+#endif
+
 Window::Window()
 {
 	width = 800;
@@ -12,6 +17,12 @@ Window::Window()
 
 	xChange = 0.0f;
 	yChange = 0.0f;
+
+	mainWindow = NULL;
+	headless = false;
+	eglDisplay = NULL;
+	eglContext = NULL;
+	eglSurface = NULL;
 }
 
 Window::Window(GLint windowWidth, GLint windowHeight)
@@ -26,6 +37,12 @@ Window::Window(GLint windowWidth, GLint windowHeight)
 
 	xChange = 0.0f;
 	yChange = 0.0f;
+
+	mainWindow = NULL;
+	headless = false;
+	eglDisplay = NULL;
+	eglContext = NULL;
+	eglSurface = NULL;
 }
 
 int Window::Initialise()
@@ -87,6 +104,170 @@ int Window::Initialise()
 	return 0;
 }
 
+#ifdef _WIN32
+// WGL has no windowless context, a hidden GLFW window works with both vendor drivers and Mesa's opengl32.dll
+static bool CreateHeadlessContext(Window* window, GLFWwindow** hiddenWindow, GLint width, GLint height)
+{
+	if (!glfwInit())
+	{
+		printf("Error Initialising GLFW");
+		return false;
+	}
+
+	glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 3);
+	glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 3);
+	glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
+	glfwWindowHint(GLFW_OPENGL_FORWARD_COMPAT, GL_TRUE);
+	glfwWindowHint(GLFW_VISIBLE, GLFW_FALSE);
+
+	*hiddenWindow = glfwCreateWindow(width, height, "OpenGL Semestral Project | headless", NULL, NULL);
+	if (!*hiddenWindow)
+	{
+		printf("Error creating hidden GLFW window!");
+		glfwTerminate();
+		return false;
+	}
+
+	glfwMakeContextCurrent(*hiddenWindow);
+	glfwSetWindowUserPointer(*hiddenWindow, window);
+	return true;
+}
+#else
+// EGL pbuffer context, falls back to Mesa's surfaceless platform when there is no display server at all
+static bool CreateHeadlessContext(void** display, void** context, void** surface)
+{
+	EGLDisplay eglDisplay = eglGetDisplay(EGL_DEFAULT_DISPLAY);
+	EGLint major, minor;
+	if (eglDisplay == EGL_NO_DISPLAY || !eglInitialize(eglDisplay, &major, &minor))
+	{
+		PFNEGLGETPLATFORMDISPLAYEXTPROC getPlatformDisplay = (PFNEGLGETPLATFORMDISPLAYEXTPROC)eglGetProcAddress("eglGetPlatformDisplayEXT");
+		eglDisplay = getPlatformDisplay ? getPlatformDisplay(EGL_PLATFORM_SURFACELESS_MESA, EGL_DEFAULT_DISPLAY, NULL) : EGL_NO_DISPLAY;
+		if (eglDisplay == EGL_NO_DISPLAY || !eglInitialize(eglDisplay, &major, &minor))
+		{
+			printf("Error initialising EGL display: 0x%x\n", eglGetError());
+			return false;
+		}
+	}
+
+	const EGLint configAttributes[] = {
+		EGL_SURFACE_TYPE, EGL_PBUFFER_BIT,
+		EGL_RENDERABLE_TYPE, EGL_OPENGL_BIT,
+		EGL_RED_SIZE, 8, EGL_GREEN_SIZE, 8, EGL_BLUE_SIZE, 8,
+		EGL_DEPTH_SIZE, 24,
+		EGL_NONE
+	};
+	EGLConfig config;
+	EGLint configCount = 0;
+	if (!eglChooseConfig(eglDisplay, configAttributes, &config, 1, &configCount) || configCount == 0)
+	{
+		printf("Error choosing EGL config: 0x%x\n", eglGetError());
+		eglTerminate(eglDisplay);
+		return false;
+	}
+
+	eglBindAPI(EGL_OPENGL_API);
+
+	const EGLint contextAttributes[] = {
+		EGL_CONTEXT_MAJOR_VERSION, 3,
+		EGL_CONTEXT_MINOR_VERSION, 3,
+		EGL_CONTEXT_OPENGL_PROFILE_MASK, EGL_CONTEXT_OPENGL_CORE_PROFILE_BIT,
+		EGL_NONE
+	};
+	EGLContext eglContext = eglCreateContext(eglDisplay, config, EGL_NO_CONTEXT, contextAttributes);
+	if (eglContext == EGL_NO_CONTEXT)
+	{
+		printf("Error creating EGL context: 0x%x\n", eglGetError());
+		eglTerminate(eglDisplay);
+		return false;
+	}
+
+	// Everything is drawn into the render target, the pbuffer only has to make the context current
+	const EGLint surfaceAttributes[] = { EGL_WIDTH, 1, EGL_HEIGHT, 1, EGL_NONE };
+	EGLSurface eglSurface = eglCreatePbufferSurface(eglDisplay, config, surfaceAttributes);
+	if (eglSurface == EGL_NO_SURFACE)
+	{
+		printf("Error creating EGL pbuffer surface: 0x%x\n", eglGetError());
+		eglDestroyContext(eglDisplay, eglContext);
+		eglTerminate(eglDisplay);
+		return false;
+	}
+
+	if (!eglMakeCurrent(eglDisplay, eglSurface, eglSurface, eglContext))
+	{
+		printf("Error making EGL context current: 0x%x\n", eglGetError());
+		eglDestroySurface(eglDisplay, eglSurface);
+		eglDestroyContext(eglDisplay, eglContext);
+		eglTerminate(eglDisplay);
+		return false;
+	}
+
+	*display = eglDisplay;
+	*context = eglContext;
+	*surface = eglSurface;
+	return true;
+}
+#endif
+
+int Window::InitialiseHeadless()
+{
+	headless = true;
+
+#ifdef _WIN32
+	if (!CreateHeadlessContext(this, &mainWindow, width, height))
+	{
+		return 1;
+	}
+#else
+	if (!CreateHeadlessContext(&eglDisplay, &eglContext, &eglSurface))
+	{
+		return 1;
+	}
+#endif
+
+	glewExperimental = GL_TRUE;
+
+	GLenum error = glewInit();
+#ifndef _WIN32
+	// GLEW's GLX path has no display to query under EGL, the GL entry points still load
+	if (error == GLEW_ERROR_NO_GLX_DISPLAY)
+	{
+		error = GLEW_OK;
+	}
+#endif
+	if (error != GLEW_OK)
+	{
+		printf("Error: %s", glewGetErrorString(error));
+		return 1;
+	}
+
+	bufferWidth = width;
+	bufferHeight = height;
+
+	if (!offscreenTarget.CreateTarget(bufferWidth, bufferHeight))
+	{
+		return 1;
+	}
+	offscreenTarget.Bind();
+
+	glEnable(GL_DEPTH_TEST);
+
+	printf("Headless %dx%d on %s\n", bufferWidth, bufferHeight, (const char*)glGetString(GL_RENDERER));
+
+	return 0;
+}
+
+void Window::swapBuffers()
+{
+	if (headless)
+	{
+		// Nothing to present, just make sure the frame is submitted
+		glFlush();
+		return;
+	}
+
+	glfwSwapBuffers(mainWindow);
+}
+
 void Window::createCallbacks()
 {
 	glfwSetKeyCallback(mainWindow, handleKeys);
@@ -149,6 +330,18 @@ void Window::handleMouse(GLFWwindow* window, double xPos, double yPos)
 
 Window::~Window()
 {
+#ifndef _WIN32
+	if (eglDisplay)
+	{
+		offscreenTarget.ClearTarget();
+		eglMakeCurrent((EGLDisplay)eglDisplay, EGL_NO_SURFACE, EGL_NO_SURFACE, EGL_NO_CONTEXT);
+		if (eglSurface) eglDestroySurface((EGLDisplay)eglDisplay, (EGLSurface)eglSurface);
+		eglDestroyContext((EGLDisplay)eglDisplay, (EGLContext)eglContext);
+		eglTerminate((EGLDisplay)eglDisplay);
+		return;
+	}
+#endif
+
 	glfwDestroyWindow(mainWindow);
 	glfwTerminate();
 }
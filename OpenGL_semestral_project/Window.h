@@ -5,6 +5,8 @@
 #include <GL\glew.h>
 #include <GLFW\glfw3.h>
 
+#include "RenderTarget.h"
+
 class Window
 {
 public:
@@ -13,6 +15,8 @@ public:
 	Window(GLint windowWidth, GLint windowHeight);
 
 	int Initialise();
+	// Offscreen context without a visible window or cursor capture, renders into an FBO
+	int InitialiseHeadless();
 
 	GLint getBufferWidth() { 
 		return (GLint) (bufferWidth);
@@ -21,7 +25,9 @@ public:
 		return (GLint) (bufferHeight);
 	}
 
-	bool getShouldClose() { return glfwWindowShouldClose(mainWindow); }
+	bool getShouldClose() { return headless ? false : glfwWindowShouldClose(mainWindow); }
+	bool isHeadless() { return headless; }
+	RenderTarget* getRenderTarget() { return &offscreenTarget; }
 
 	bool* getKeys() { 
 		return keys; 
@@ -30,7 +36,7 @@ public:
 	GLfloat getXChange();
 	GLfloat getYChange();
 
-	void swapBuffers() { glfwSwapBuffers(mainWindow); }
+	void swapBuffers();
 
 	~Window();
 
@@ -41,6 +47,13 @@ private:
 	GLint bufferWidth;
 	GLint bufferHeight;
 
+	bool headless;
+	RenderTarget offscreenTarget;
+	// EGL handles on platforms where headless contexts go through EGL, kept opaque here
+	void* eglDisplay;
+	void* eglContext;
+	void* eglSurface;
+
 	bool keys[1024] = { 0 };
 
 	GLfloat lastX;
@@ -1,9 +1,14 @@
 #define STB_IMAGE_IMPLEMENTATION
 
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
 #include <cmath>
 #include <vector>
+#include <thread>
+#include <mutex>
+#include <atomic>
+#include <chrono>
 
 #include <GL\glew.h>
 #include <GLFW\glfw3.h>
@@ -20,6 +25,26 @@
 #include "Material.h"
 
 #include "Model.h"
+#include "Scene.h"
+#include "Frustum.h"
+#include "JobSystem.h"
+#include "FrameMailbox.h"
+#include "FrameRenderer.h"
+#include "Clock.h"
+#include "FixedTimestep.h"
+#include "FrameLimiter.h"
+#include "FrameStats.h"
+#include "GpuProfiler.h"
+#include "CpuTrace.h"
+#include "CameraPath.h"
+#include "InputLog.h"
+#include "GpuMemory.h"
+#include "TextureStreamer.h"
+#include "Benchmarks.h"
+#include "Terrain.h"
+#include "ParticleSystem.h"
+#include "AnimationSystem.h"
+#include "DynamicResolution.h"
 
 const float toRadians = 3.14159265f / 180.0f;
 
@@ -28,20 +53,60 @@ std::vector<Mesh*> meshList;
 std::vector<Shader> shaderList;
 Camera camera;
 
-Texture brickTexture;
-Texture dirtTexture;
-
-Material shinyMaterial;
-Material dullMaterial;
-
-DirectionalLight mainLight;
-PointLight pointLights[MAX_POINT_LIGHTS];
-SpotLight spotLights[MAX_SPOT_LIGHTS];
-
-Model xwing, mountains;
-
-GLfloat deltaTime = 0.0f;
-GLfloat lastTime = 0.0f;
+Scene scene;
+Frustum viewFrustum;
+JobSystem jobSystem;
+
+// Simulation runs on its own thread and hands frames to the GL thread through the mailbox
+FrameMailbox frameMailbox;
+FrameRenderer frameRenderer;
+std::thread simulationThread;
+std::atomic<bool> simulationRunning(false);
+const double simulationInterval = 1.0 / 120.0;
+
+FrameLimiter frameLimiter;
+FrameStats frameStats;
+GpuProfiler gpuProfiler;
+TextureStreamer textureStreamer;
+
+// --terrain replaces mountains.obj with a streamed heightmap terrain
+const char* terrainFile = nullptr;
+float terrainSize = 4096.0f;
+float terrainHeight = 600.0f;
+Terrain terrain;
+Texture terrainTexture("Textures/dirt.png");
+
+// --particles turns on engine exhaust and a spark fountain sharing that many GPU particles
+unsigned int particleCount = 0;
+bool particleCompute = true;
+ParticleSystem particles;
+
+// --character adds a rigged model playing its first clip, poses are evaluated on the jobs every step
+const char* characterFile = nullptr;
+AnimationSystem animations;
+
+// --dynamic-resolution renders below the window size whenever the GPU frame goes over that many milliseconds
+double resolutionTarget = 0.0;
+float resolutionMinScale = DynamicResolution::DEFAULT_MIN_SCALE;
+DynamicResolution dynamicResolution;
+
+// The camera stops this far short of whatever it flies into
+bool cameraCollision = true;
+const float cameraRadius = 0.3f;
+
+// GLFW callbacks fire on the main thread, the simulation only sees copies taken under this lock
+std::mutex inputMutex;
+bool inputKeys[1024] = { 0 };
+GLfloat inputXChange = 0.0f;
+GLfloat inputYChange = 0.0f;
+
+// --record writes what the simulation consumed, --replay feeds it back instead of live input.
+// A replay delta above zero replaces the recorded timing with one step of that length per frame
+InputLog inputLog;
+double replayDelta = 0.0;
+std::atomic<bool> replayFinished(false);
+
+unsigned int sceneFeatures = SHADER_FEATURES_DEFAULT;
 
 bool direction = true;
 float triOffset = 0.0f;
@@ -64,137 +129,864 @@ static const char* fShader = "Shaders/shader.frag";
 
 void CreateShaders()
 {
+	TRACE_SCOPE("CreateShaders");
+
 	Shader* shader1 = new Shader();
 	shader1->CreateFromFiles(vShader, fShader);
 	shaderList.push_back(*shader1);
 }
 
-// Main function
-int main()
+void CreateScene()
 {
-	mainWindow = Window(800, 600);
-	mainWindow.Initialise();
+	TRACE_SCOPE("CreateScene");
 
-	CreateShaders();
+	Material shinyMaterial = Material(4.0f, 256);
 
-	camera = Camera(glm::vec3(0.0f, 0.0f, 0.0f), glm::vec3(0.0f, 1.0f, 0.0f), -90.0f, 0.0f, 5.0f, 0.5f);
+	Model* xwing = scene.LoadModel("Models/x-wing.obj");
+	Entity xwingEntity = scene.CreateEntity();
+	unsigned int xwingTransform = scene.AddTransform(xwingEntity, glm::vec3(-5.0f, 2.0f, 0.0f), glm::quat(), glm::vec3(0.006f, 0.006f, 0.006f));
+	scene.AddRenderable(xwingEntity, xwing);
+	scene.AddMaterial(xwingEntity, shinyMaterial);
 
-	brickTexture = Texture("Textures/brick.png");
-	brickTexture.LoadTexture();
-	dirtTexture = Texture("Textures/dirt.png");
-	dirtTexture.LoadTexture();
+	if (particleCount > 0 && particles.Initialise(particleCount, particleCompute))
+	{
+		// Half of the budget on the four engines, in model units so they follow the x-wing's transform
+		const glm::vec2 nozzles[4] = { glm::vec2(1354.8f, 41.4f), glm::vec2(1467.3f, 111.1f), glm::vec2(1467.3f, 41.5f), glm::vec2(1354.8f, 111.1f) };
+		for (unsigned int i = 0; i < 4; i++)
+		{
+			ParticleEmitter exhaust;
+			exhaust.transform = xwingTransform;
+			exhaust.position = glm::vec3(nozzles[i].x, nozzles[i].y, -1890.0f);
+			exhaust.direction = glm::vec3(0.0f, 0.0f, -1.0f);
+			exhaust.spread = 0.08f;
+			exhaust.speedMin = 2.0f;
+			exhaust.speedMax = 3.0f;
+			exhaust.lifeMin = 0.2f;
+			exhaust.lifeMax = 0.5f;
+			exhaust.drag = 1.5f;
+			exhaust.sizeStart = 0.12f;
+			exhaust.sizeEnd = 0.02f;
+			exhaust.colourStart = glm::vec4(1.0f, 0.35f, 0.3f, 1.0f) * 0.08f;
+			exhaust.colourEnd = glm::vec4(0.2f, 0.05f, 0.3f, 1.0f) * 0.02f;
+			exhaust.count = particleCount / 8;
+			particles.AddEmitter(exhaust);
+		}
+
+		// The rest falls under gravity below the x-wing
+		ParticleEmitter sparks;
+		sparks.position = glm::vec3(-5.0f, 0.0f, 3.0f);
+		sparks.spread = 0.5f;
+		sparks.speedMin = 3.0f;
+		sparks.speedMax = 5.0f;
+		sparks.lifeMin = 1.0f;
+		sparks.lifeMax = 2.0f;
+		sparks.acceleration = glm::vec3(0.0f, -9.81f, 0.0f);
+		sparks.drag = 0.2f;
+		sparks.sizeStart = 0.04f;
+		sparks.sizeEnd = 0.01f;
+		sparks.colourStart = glm::vec4(1.0f, 0.8f, 0.4f, 1.0f) * 0.1f;
+		sparks.colourEnd = glm::vec4(0.6f, 0.1f, 0.0f, 1.0f) * 0.05f;
+		sparks.count = particleCount - particles.GetParticleCount();
+		particles.AddEmitter(sparks);
+
+		scene.SetParticles(&particles);
+	}
 
-	shinyMaterial = Material(4.0f, 256);
-	dullMaterial = Material(0.3f, 4);
+	scene.SetAnimations(&animations);
+	if (characterFile)
+	{
+		Model* character = scene.LoadModel(characterFile);
+		Entity characterEntity = scene.CreateEntity();
+		scene.AddTransform(characterEntity, glm::vec3(0.0f, -2.0f, -5.0f), glm::quat(), glm::vec3(1.0f, 1.0f, 1.0f));
+		scene.AddRenderable(characterEntity, character);
+		scene.AddMaterial(characterEntity, shinyMaterial);
+		if (character->IsSkinned())
+		{
+			scene.AddAnimation(characterEntity, 0);
+		}
+		else
+		{
+			printf("%s has no bones, drawn as a static model\n", characterFile);
+		}
+	}
 
-	xwing = Model();
-	xwing.LoadModel("Models/x-wing.obj");
+	if (terrainFile && terrain.LoadHeightmap(terrainFile, terrainSize, terrainHeight, glm::vec3(-terrainSize * 0.5f, -50.0f, -terrainSize * 0.5f)))
+	{
+		terrainTexture.LoadTextureA();
+		terrain.SetTexture(&terrainTexture, 8.0f);
+		scene.SetTerrain(&terrain);
 
-	mountains = Model();
-	mountains.LoadModel("Models/mountains.obj");
+		// Start above the ground in the middle of the map
+		float ground = terrain.GetHeight(0.0f, 0.0f) + 30.0f;
+		camera.setPose(glm::vec3(0.0f, ground, 0.0f), glm::vec3(0.0f, ground, -1.0f));
+	}
+	else
+	{
+		Model* mountains = scene.LoadModel("Models/mountains.obj");
+		Entity mountainsEntity = scene.CreateEntity();
+		scene.AddTransform(mountainsEntity, glm::vec3(-7.0f, -50.0f, 10.0f), glm::quat(), glm::vec3(1.0f, 1.0f, 1.0f));
+		scene.AddRenderable(mountainsEntity, mountains);
+		scene.AddMaterial(mountainsEntity, shinyMaterial);
+	}
 
-	mainLight = DirectionalLight(1.0f, 1.0f, 1.0f,
+	scene.AddDirectionalLight(scene.CreateEntity(), DirectionalLight(1.0f, 1.0f, 1.0f,
 		0.3f, 0.6f,
-		0.0f, 0.0f, -1.0f);
+		0.0f, 0.0f, -1.0f));
 
-	unsigned int pointLightCount = 0;
-	pointLights[0] = PointLight(0.0f, 0.0f, 1.0f,
+	scene.AddPointLight(scene.CreateEntity(), PointLight(0.0f, 0.0f, 1.0f,
 		0.0f, 0.1f,
 		0.0f, 0.0f, 0.0f,
-		0.3f, 0.2f, 0.1f);
-	pointLightCount++;
-	pointLights[1] = PointLight(0.0f, 1.0f, 0.0f,
+		0.3f, 0.2f, 0.1f));
+	scene.AddPointLight(scene.CreateEntity(), PointLight(0.0f, 1.0f, 0.0f,
 		0.0f, 0.1f,
 		-4.0f, 2.0f, 0.0f,
-		0.3f, 0.1f, 0.1f);
-	pointLightCount++;
+		0.3f, 0.1f, 0.1f));
 
-	unsigned int spotLightCount = 0;
-	spotLights[0] = SpotLight(1.0f, 1.0f, 1.0f,
+	scene.AddSpotLight(scene.CreateEntity(), SpotLight(1.0f, 1.0f, 1.0f,
 		0.0f, 2.0f,
 		0.0f, 0.0f, 0.0f,
 		0.0f, -1.0f, 0.0f,
 		1.0f, 0.0f, 0.0f,
-		20.0f);
-	spotLightCount++;
-	spotLights[1] = SpotLight(1.0f, 1.0f, 1.0f,
+		20.0f));
+	scene.AddSpotLight(scene.CreateEntity(), SpotLight(1.0f, 1.0f, 1.0f,
 		0.0f, 1.0f,
 		0.0f, -1.5f, 0.0f,
 		-100.0f, -1.0f, 0.0f,
 		1.0f, 0.0f, 0.0f,
-		20.0f);
-	spotLightCount++;
+		20.0f));
+}
 
-	GLuint uniformProjection = 0, uniformModel = 0, uniformView = 0, uniformAmbientIntensity = 0, uniformAmbientColour = 0, uniformEyePosition = 0,
-		uniformSpecularIntensity = 0, uniformShininess = 0;
-	glm::mat4 projection = glm::perspective(glm::radians(45.0f), (GLfloat)mainWindow.getBufferWidth() / mainWindow.getBufferHeight(), 0.1f, 100.0f);
+// Casts from where the camera was to where it moved and pulls it back cameraRadius short of the first hit,
+// then keeps it above the terrain
+void ResolveCameraCollision(glm::vec3 from)
+{
+	glm::vec3 to = camera.getCameraPosition();
+	glm::vec3 position = to;
 
+	glm::vec3 move = to - from;
+	float length = glm::length(move);
+	if (length > 0.0f)
+	{
+		Ray ray(from, move / length, length + cameraRadius);
+		RayHit hit;
+		if (scene.Raycast(ray, hit) != NULL_ENTITY)
+		{
+			position = from + ray.direction * glm::max(hit.distance - cameraRadius, 0.0f);
+		}
+	}
+
+	if (terrainFile)
+	{
+		float ground = terrain.GetHeight(position.x, position.z) + cameraRadius;
+		if (position.y < ground)
+		{
+			position.y = ground;
+		}
+	}
+
+	if (position != to)
+	{
+		camera.setPose(position, position + camera.getCameraDirection());
+	}
+}
+
+// Reports what is under the centre of the screen
+void PickAtCentre()
+{
+	double start = Clock::Now();
+
+	Ray ray(camera.getCameraPosition(), camera.getCameraDirection());
+	RayHit hit;
+	Model* model = nullptr;
+	Entity entity = scene.Raycast(ray, hit, &model);
+
+	double elapsed = Clock::Now() - start;
+
+	if (entity == NULL_ENTITY)
+	{
+		printf("Pick: nothing (%.3f ms)\n", elapsed * 1000.0);
+		return;
+	}
+
+	printf("Pick: entity %u, %s node \"%s\" mesh %u triangle %u (u %.2f, v %.2f) at %.2f (%.3f ms)\n", entity & 0x00FFFFFF,
+		model->GetName(), model->GetNodeName(hit.node).c_str(), hit.mesh, hit.triangle, hit.u, hit.v, hit.distance, elapsed * 1000.0);
+}
+
+void SimulationLoop(glm::mat4 projection)
+{
+	TRACE_THREAD_NAME("Simulation");
+
+	InputFrame input;
+	FixedTimestep timestep(simulationInterval, 8);
+	double lastTime = Clock::Now();
+	double lastInputTime = lastTime;
+	bool pickHeld = false;
+
+	while (simulationRunning.load())
+	{
+		double now;
+		unsigned int steps;
+		GLfloat stepDelta = (GLfloat)timestep.GetStep();
+		double stepTime, stepInterval;
+
+		if (inputLog.IsReplaying())
+		{
+			if (!inputLog.NextFrame(input))
+			{
+				replayFinished.store(true);
+				break;
+			}
+
+			// Paced like the recording, but the camera only ever sees the logged steps
+			double delta = replayDelta > 0.0 ? replayDelta : input.deltaTime;
+			Clock::SleepUntil(lastTime + delta);
+			lastTime += delta;
+			now = lastTime;
+
+			steps = replayDelta > 0.0 ? 1 : input.steps;
+			if (replayDelta > 0.0) stepDelta = (GLfloat)replayDelta;
+			stepTime = now;
+			stepInterval = delta;
+		}
+		else
+		{
+			now = Clock::Now();
+			steps = timestep.Advance(now - lastTime);
+			lastTime = now;
+
+			if (steps == 0)
+			{
+				Clock::SleepFor(timestep.GetStep() - timestep.GetAccumulator());
+				continue;
+			}
+
+			{
+				std::lock_guard<std::mutex> lock(inputMutex);
+				memcpy(input.keys, inputKeys, sizeof(input.keys));
+				input.xChange = inputXChange;
+				input.yChange = inputYChange;
+				inputXChange = 0.0f;
+				inputYChange = 0.0f;
+			}
+
+			input.deltaTime = now - lastInputTime;
+			input.steps = steps;
+			lastInputTime = now;
+			inputLog.RecordFrame(input);
+
+			stepTime = now - timestep.GetAccumulator();
+			stepInterval = timestep.GetStep();
+		}
+
+		TRACE_SCOPE("SimulationStep");
+
+		// Mouse deltas are distances, not rates, so they go in once however many steps run
+		camera.mouseControl(input.xChange, input.yChange);
+
+		glm::vec3 previousPosition = camera.getCameraPosition();
+		glm::vec3 previousDirection = camera.getCameraDirection();
+		for (unsigned int i = 0; i < steps; i++)
+		{
+			previousPosition = camera.getCameraPosition();
+			previousDirection = camera.getCameraDirection();
+			camera.keyControl(input.keys, stepDelta);
+
+			if (cameraCollision)
+			{
+				ResolveCameraCollision(previousPosition);
+			}
+		}
+
+		if (input.keys[GLFW_KEY_P] && !pickHeld)
+		{
+			PickAtCentre();
+		}
+		pickHeld = input.keys[GLFW_KEY_P];
+
+		glm::mat4 view = camera.calculateViewMatrix();
+		viewFrustum.Update(projection * view);
+
+		animations.Update(stepDelta * steps, &jobSystem);
+		scene.Update(&jobSystem);
+		scene.QueryVisible(viewFrustum, &jobSystem);
+
+		FramePacket& packet = frameMailbox.BeginWrite();
+		packet.view = view;
+		packet.projection = projection;
+		packet.eyePosition = camera.getCameraPosition();
+		packet.eyeDirection = camera.getCameraDirection();
+		packet.previousEyePosition = previousPosition;
+		packet.previousEyeDirection = previousDirection;
+		packet.stepTime = stepTime;
+		packet.stepInterval = stepInterval;
+		scene.BuildFramePacket(packet, viewFrustum, frameMailbox.GetConsumedSequence());
+		packet.publishTime = Clock::Now();
+		frameMailbox.Publish();
+	}
+
+	if (timestep.GetDroppedSteps() > 0)
+	{
+		printf("Simulation dropped %llu steps after stalls\n", timestep.GetDroppedSteps());
+	}
+}
+
+static void WriteTimingJson(FILE* report, const char* name, FrameStats& stats, bool last)
+{
+	fprintf(report, "  \"%s\": { \"mean\": %.4f, \"p50\": %.4f, \"p95\": %.4f, \"p99\": %.4f, \"max\": %.4f }%s\n", name,
+		stats.GetMean() * 1000.0, stats.GetPercentile(50.0) * 1000.0, stats.GetPercentile(95.0) * 1000.0,
+		stats.GetPercentile(99.0) * 1000.0, stats.GetMax() * 1000.0, last ? "" : ",");
+}
+
+// Deterministic flythrough for CI and driver comparisons: no simulation thread, no input, no vsync,
+// the camera position depends only on the frame number. Results go out as JSON
+int RunHeadless(unsigned int frameCount, const char* reportFile, const char* pathFile, glm::mat4 projection)
+{
+	CameraPath path;
+	if (!pathFile || !path.LoadPath(pathFile))
+	{
+		path.CreateDefaultPath();
+	}
+
+	FrameStats cpuStats(frameCount);
+	FramePacket packet;
+	unsigned long long drawCallSum = 0, triangleSum = 0;
+	unsigned int drawCallMax = 0, triangleMax = 0;
+	unsigned long long textureBindSum = 0;
+	unsigned int textureBindMax = 0;
+	unsigned long long streamedSum = 0;
+
+	double start = Clock::Now();
+
+	for (unsigned int frame = 0; frame < frameCount; frame++)
+	{
+		TRACE_SCOPE("Frame");
+
+		double frameStart = Clock::Now();
+
+		if (inputLog.IsReplaying())
+		{
+			// A recorded session replaces the path, stepped exactly as logged but without pacing
+			InputFrame input;
+			if (!inputLog.NextFrame(input))
+			{
+				frameCount = frame;
+				break;
+			}
+
+			camera.mouseControl(input.xChange, input.yChange);
+			unsigned int steps = replayDelta > 0.0 ? 1 : input.steps;
+			GLfloat stepDelta = (GLfloat)(replayDelta > 0.0 ? replayDelta : simulationInterval);
+			for (unsigned int i = 0; i < steps; i++)
+			{
+				camera.keyControl(input.keys, stepDelta);
+			}
+		}
+		else
+		{
+			glm::vec3 position, target;
+			path.Evaluate(frameCount > 1 ? (float)frame / (frameCount - 1) : 0.0f, position, target);
+			camera.setPose(position, target);
+		}
+
+		glm::mat4 view = camera.calculateViewMatrix();
+		viewFrustum.Update(projection * view);
+
+		animations.Update((float)simulationInterval, &jobSystem);
+		scene.Update(&jobSystem);
+		scene.QueryVisible(viewFrustum, &jobSystem);
+
+		// Same packet every frame, so only transforms changed since the last one are copied
+		packet.view = view;
+		packet.projection = projection;
+		packet.eyePosition = camera.getCameraPosition();
+		packet.eyeDirection = camera.getCameraDirection();
+		packet.previousEyePosition = packet.eyePosition;
+		packet.previousEyeDirection = packet.eyeDirection;
+		packet.stepTime = frameStart;
+		packet.stepInterval = 0.0;
+		scene.BuildFramePacket(packet, viewFrustum, packet.sequence);
+		packet.publishTime = Clock::Now();
+
+		gpuProfiler.BeginFrame();
+
+		if (dynamicResolution.IsInitialised())
+		{
+			dynamicResolution.BeginFrame();
+		}
+
+		gpuProfiler.BeginScope("Clear");
+		glClearColor(0.0f, 0.0f, 0.0f, 1.0f);
+		glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+		gpuProfiler.EndScope();
+
+		frameRenderer.Render(packet, shaderList[0], sceneFeatures, &gpuProfiler);
+		textureStreamer.Update(packet, (float)mainWindow.getBufferHeight());
+
+		if (dynamicResolution.IsInitialised())
+		{
+			dynamicResolution.Present(mainWindow.getRenderTarget(), &gpuProfiler);
+		}
+
+		glUseProgram(0);
+		gpuProfiler.EndFrame();
+		mainWindow.swapBuffers();
+
+		cpuStats.AddFrame(Clock::Now() - frameStart);
+
+		unsigned int drawCalls = frameRenderer.GetDrawCallCount();
+		unsigned int triangles = frameRenderer.GetTriangleCount();
+		drawCallSum += drawCalls;
+		triangleSum += triangles;
+		if (drawCalls > drawCallMax) drawCallMax = drawCalls;
+		if (triangles > triangleMax) triangleMax = triangles;
+		unsigned int textureBinds = frameRenderer.GetTextureBindCount();
+		textureBindSum += textureBinds;
+		if (textureBinds > textureBindMax) textureBindMax = textureBinds;
+		streamedSum += frameRenderer.GetStreamedBytes();
+	}
+
+	gpuProfiler.FinishFrames();
+	double elapsed = Clock::Now() - start;
+
+	// The profiler's own history only keeps the last few hundred frames, the timeline keeps far more but
+	// wraps too, long runs with many scopes only report their most recent frames
+	FrameStats gpuStats(frameCount);
+	int frameScope = gpuProfiler.FindScope("Frame");
+	if (frameScope >= 0)
+	{
+		std::vector<GpuTimelineEvent> timeline = gpuProfiler.GetTimeline();
+		for (size_t i = 0; i < timeline.size(); i++)
+		{
+			if (timeline[i].scope == (unsigned int)frameScope)
+			{
+				gpuStats.AddFrame(timeline[i].end - timeline[i].begin);
+			}
+		}
+
+		if (gpuProfiler.GetOverwrittenEvents() > 0)
+		{
+			printf("GPU timeline wrapped, %llu older scopes dropped, gpu_ms covers the last %u frames only\n",
+				gpuProfiler.GetOverwrittenEvents(), gpuStats.GetFrameCount());
+		}
+	}
+
+	FILE* report = stdout;
+	if (reportFile)
+	{
+		report = fopen(reportFile, "w");
+		if (!report)
+		{
+			printf("Failed to write %s!\n", reportFile);
+			return 1;
+		}
+	}
+
+	fprintf(report, "{\n");
+	fprintf(report, "  \"frames\": %u,\n", frameCount);
+	fprintf(report, "  \"width\": %d,\n", mainWindow.getBufferWidth());
+	fprintf(report, "  \"height\": %d,\n", mainWindow.getBufferHeight());
+	fprintf(report, "  \"renderer\": \"%s\",\n", (const char*)glGetString(GL_RENDERER));
+	fprintf(report, "  \"path_points\": %u,\n", path.GetPointCount());
+	fprintf(report, "  \"wall_seconds\": %.4f,\n", elapsed);
+	fprintf(report, "  \"fps\": %.2f,\n", elapsed > 0.0 ? frameCount / elapsed : 0.0);
+	WriteTimingJson(report, "cpu_ms", cpuStats, false);
+	if (gpuStats.GetFrameCount() > 0)
+	{
+		fprintf(report, "  \"gpu_frames\": %u,\n", gpuStats.GetFrameCount());
+		WriteTimingJson(report, "gpu_ms", gpuStats, false);
+	}
+	fprintf(report, "  \"draw_calls\": { \"mean\": %.2f, \"max\": %u },\n", frameCount > 0 ? (double)drawCallSum / frameCount : 0.0, drawCallMax);
+	fprintf(report, "  \"triangles\": { \"mean\": %.1f, \"max\": %u },\n", frameCount > 0 ? (double)triangleSum / frameCount : 0.0, triangleMax);
+	fprintf(report, "  \"texture_binds\": { \"mean\": %.2f, \"max\": %u },\n", frameCount > 0 ? (double)textureBindSum / frameCount : 0.0, textureBindMax);
+	fprintf(report, "  \"stream_kb\": %.2f,\n", frameCount > 0 ? streamedSum / 1024.0 / frameCount : 0.0);
+	fprintf(report, "  \"stream_stalls\": %llu,\n", frameRenderer.GetStreamStallCount());
+	fprintf(report, "  \"fragments_shaded\": %.0f,\n", frameRenderer.GetShadedFragments());
+	if (frameRenderer.GetDepthComplexity() > 0.0)
+	{
+		fprintf(report, "  \"depth_complexity\": %.3f,\n", frameRenderer.GetDepthComplexity());
+	}
+	fprintf(report, "  \"lights_per_draw\": { \"point\": %.3f, \"spot\": %.3f, \"over_limit\": %.4f },\n",
+		scene.GetLightCuller().GetMeanPointLights(), scene.GetLightCuller().GetMeanSpotLights(), scene.GetLightCuller().GetOverLimitFraction());
+	if (dynamicResolution.IsInitialised())
+	{
+		fprintf(report, "  \"resolution_scale\": { \"target_ms\": %.2f, \"final\": %.3f, \"mean\": %.3f, \"lowest\": %.3f },\n",
+			dynamicResolution.GetTargetMs(), dynamicResolution.GetScale(), dynamicResolution.GetMeanScale(), dynamicResolution.GetLowestScale());
+		fprintf(report, "  \"time_to_target_ms\": { \"mean\": %.2f, \"max\": %.2f, \"episodes\": %u, \"over_target\": %.4f },\n",
+			dynamicResolution.GetMeanRecoveryMs(), dynamicResolution.GetMaxRecoveryMs(), dynamicResolution.GetRecoveryCount(),
+			dynamicResolution.GetOverTargetFraction());
+	}
+	fprintf(report, "  \"gpu_memory_mb\": { \"current\": %.2f, \"peak\": %.2f }\n",
+		GpuMemory::GetUsage(GPU_MEMORY_TOTAL) / (1024.0 * 1024.0), GpuMemory::GetHighWater(GPU_MEMORY_TOTAL) / (1024.0 * 1024.0));
+	fprintf(report, "}\n");
+
+	if (report != stdout)
+	{
+		fclose(report);
+		printf("Benchmark report written to %s\n", reportFile);
+	}
+
+	return 0;
+}
+
+// Main function
+int main(int argc, char** argv)
+{
+	if (argc > 2 && strcmp(argv[1], "--bench") == 0)
+	{
+		return RunBenchmark(argv[2]);
+	}
+
+	TRACE_THREAD_NAME("Main");
+
+	FrameSyncMode syncMode = FRAME_SYNC_VSYNC;
+	double frameCap = 0.0;
+	const char* traceFile = nullptr;
+	unsigned int headlessFrames = 0;
+	const char* reportFile = nullptr;
+	const char* pathFile = nullptr;
+	GLint width = 800, height = 600;
+	double textureBudget = 256.0;
+	const char* streamMode = "off";
+	unsigned int modelImportFlags = MODEL_IMPORT_DEFAULT;
+	const char* bakeFile = nullptr;
+	for (int i = 1; i + 1 < argc; i++)
+	{
+		if (strcmp(argv[i], "--vsync") == 0)
+		{
+			if (strcmp(argv[i + 1], "off") == 0) syncMode = FRAME_SYNC_OFF;
+			else if (strcmp(argv[i + 1], "adaptive") == 0) syncMode = FRAME_SYNC_ADAPTIVE;
+			else syncMode = FRAME_SYNC_VSYNC;
+		}
+		else if (strcmp(argv[i], "--fps-cap") == 0)
+		{
+			frameCap = atof(argv[i + 1]);
+		}
+		else if (strcmp(argv[i], "--trace") == 0)
+		{
+			traceFile = argv[i + 1];
+		}
+		else if (strcmp(argv[i], "--gpu-scopes") == 0)
+		{
+			// 1 = passes, 2 = models, 3 = meshes
+			gpuProfiler.SetMaxDepth((unsigned int)atoi(argv[i + 1]));
+		}
+		else if (strcmp(argv[i], "--headless") == 0)
+		{
+			headlessFrames = (unsigned int)atoi(argv[i + 1]);
+		}
+		else if (strcmp(argv[i], "--report") == 0)
+		{
+			reportFile = argv[i + 1];
+		}
+		else if (strcmp(argv[i], "--path") == 0)
+		{
+			pathFile = argv[i + 1];
+		}
+		else if (strcmp(argv[i], "--gpu-budget") == 0)
+		{
+			// Nothing can be evicted yet, so going over only warns with the current top consumers
+			GpuMemory::SetBudget(GPU_MEMORY_TOTAL, (size_t)(atof(argv[i + 1]) * 1024.0 * 1024.0),
+				[](GpuMemoryCategory, size_t used, size_t budget)
+				{
+					printf("GPU memory over budget: %.2f of %.2f MB\n", used / (1024.0 * 1024.0), budget / (1024.0 * 1024.0));
+					GpuMemory::PrintReport(5);
+				});
+		}
+		else if (strcmp(argv[i], "--texture-budget") == 0)
+		{
+			// In MB, 0 loads every texture in full like before
+			textureBudget = atof(argv[i + 1]);
+		}
+		else if (strcmp(argv[i], "--texture-arrays") == 0)
+		{
+			if (strcmp(argv[i + 1], "on") == 0)
+			{
+				modelImportFlags |= MODEL_IMPORT_TEXTURE_ARRAYS;
+				sceneFeatures |= SHADER_FEATURE_TEXTURE_ARRAY;
+			}
+		}
+		else if (strcmp(argv[i], "--stream-transforms") == 0)
+		{
+			// persistent, orphan or off
+			streamMode = argv[i + 1];
+		}
+		else if (strcmp(argv[i], "--depth-prepass") == 0)
+		{
+			if (strcmp(argv[i + 1], "on") == 0)
+			{
+				modelImportFlags |= MODEL_IMPORT_POSITION_STREAM;
+				frameRenderer.SetDepthPrepass(true);
+			}
+		}
+		else if (strcmp(argv[i], "--bake-lighting") == 0)
+		{
+			// Cache file, rebaked whenever the static models or the lights change
+			bakeFile = argv[i + 1];
+			modelImportFlags |= MODEL_IMPORT_BAKE_LIGHTING;
+			sceneFeatures |= SHADER_FEATURE_BAKED_LIGHTING;
+		}
+		else if (strcmp(argv[i], "--light-culling") == 0)
+		{
+			scene.GetLightCuller().SetEnabled(strcmp(argv[i + 1], "off") != 0);
+		}
+		else if (strcmp(argv[i], "--terrain") == 0)
+		{
+			terrainFile = argv[i + 1];
+		}
+		else if (strcmp(argv[i], "--terrain-size") == 0)
+		{
+			// World units across the heightmap and height of a white pixel, "4096x600"
+			sscanf(argv[i + 1], "%fx%f", &terrainSize, &terrainHeight);
+		}
+		else if (strcmp(argv[i], "--particles") == 0)
+		{
+			particleCount = (unsigned int)atoi(argv[i + 1]);
+		}
+		else if (strcmp(argv[i], "--particle-update") == 0)
+		{
+			// compute where GL 4.3 has it, or feedback to force the GL 3.3 transform feedback path
+			particleCompute = strcmp(argv[i + 1], "feedback") != 0;
+		}
+		else if (strcmp(argv[i], "--particle-render") == 0)
+		{
+			particles.SetRenderMode(strcmp(argv[i + 1], "points") == 0 ? PARTICLE_RENDER_POINTS : PARTICLE_RENDER_QUADS);
+		}
+		else if (strcmp(argv[i], "--character") == 0)
+		{
+			characterFile = argv[i + 1];
+		}
+		else if (strcmp(argv[i], "--dynamic-resolution") == 0)
+		{
+			// GPU frame time target in milliseconds, 0 renders at the window size like before
+			resolutionTarget = atof(argv[i + 1]);
+		}
+		else if (strcmp(argv[i], "--min-resolution-scale") == 0)
+		{
+			resolutionMinScale = (float)atof(argv[i + 1]);
+		}
+		else if (strcmp(argv[i], "--camera-collision") == 0)
+		{
+			cameraCollision = strcmp(argv[i + 1], "off") != 0;
+		}
+		else if (strcmp(argv[i], "--record") == 0)
+		{
+			inputLog.BeginRecording(argv[i + 1]);
+		}
+		else if (strcmp(argv[i], "--replay") == 0)
+		{
+			inputLog.LoadReplay(argv[i + 1]);
+		}
+		else if (strcmp(argv[i], "--replay-delta") == 0)
+		{
+			replayDelta = atof(argv[i + 1]);
+		}
+		else if (strcmp(argv[i], "--size") == 0)
+		{
+			sscanf(argv[i + 1], "%dx%d", &width, &height);
+		}
+	}
+
+	scene.SetModelImportFlags(modelImportFlags);
+
+	mainWindow = Window(width, height);
+	if ((headlessFrames > 0 ? mainWindow.InitialiseHeadless() : mainWindow.Initialise()) != 0)
+	{
+		return 1;
+	}
+
+	CreateShaders();
+
+	if (strcmp(streamMode, "off") != 0)
+	{
+		frameRenderer.SetStreamTransforms(true, strcmp(streamMode, "orphan") != 0);
+	}
+
+	camera = Camera(glm::vec3(0.0f, 0.0f, 0.0f), glm::vec3(0.0f, 1.0f, 0.0f), -90.0f, 0.0f, 5.0f, 0.5f);
+	animations.QueryPaletteLimit();
+
+	if (textureBudget > 0.0)
+	{
+		size_t budgetBytes = (size_t)(textureBudget * 1024.0 * 1024.0);
+		textureStreamer.Start(budgetBytes);
+		scene.SetTextureStreamer(&textureStreamer);
+
+		// The streamer leaves room for textures that don't stream itself, the budget here only counts overruns
+		GpuMemory::SetBudget(GPU_MEMORY_TEXTURE, budgetBytes, nullptr);
+	}
+
+	// Workers are up before the scene loads so model BVHs build on them
+	jobSystem.Start();
+	scene.SetLoadJobs(&jobSystem);
+
+	CreateScene();
+
+	if (bakeFile)
+	{
+		// Once before the first frame, the bake needs the static models where they will stay
+		scene.Update(&jobSystem);
+		LightBaker lightBaker;
+		if (scene.BakeLighting(lightBaker, &jobSystem, bakeFile) > 0)
+		{
+			lightBaker.PrintStats();
+		}
+	}
+
+	// Terrain needs to be seen to its far edge, the near plane moves out to keep depth precision
+	float nearPlane = terrainFile ? 0.5f : 0.1f;
+	float farPlane = terrainFile ? terrainSize * 1.5f : 100.0f;
+	glm::mat4 projection = glm::perspective(glm::radians(45.0f), (GLfloat)mainWindow.getBufferWidth() / mainWindow.getBufferHeight(), nearPlane, farPlane);
+
+	gpuProfiler.Initialise();
+
+	if (resolutionTarget > 0.0)
+	{
+		// Without timestamps there is nothing to steer by, the scale then stays at the window size
+		if (!gpuProfiler.IsEnabled())
+		{
+			printf("Dynamic resolution needs GPU timer queries, rendering at full size\n");
+		}
+		dynamicResolution.Initialise(mainWindow.getBufferWidth(), mainWindow.getBufferHeight(), resolutionTarget, resolutionMinScale);
+	}
+
+	if (headlessFrames > 0)
+	{
+		int result = RunHeadless(headlessFrames, reportFile, pathFile, projection);
+		jobSystem.Stop();
+
+		if (traceFile)
+		{
+			CpuTrace::ExportChromeTrace(traceFile, &gpuProfiler);
+		}
+		frameRenderer.ClearRenderer();
+		gpuProfiler.ClearProfiler();
+		textureStreamer.ClearStreamer();
+		scene.GetLightCuller().PrintStats();
+		terrain.PrintStats();
+		terrain.ClearTerrain();
+		terrainTexture.ClearTexture();
+		particles.PrintStats();
+		particles.ClearParticles();
+		animations.PrintStats();
+		animations.ClearAnimations();
+		dynamicResolution.PrintStats();
+		dynamicResolution.ClearResolution();
+		mainWindow.getRenderTarget()->ClearTarget();
+
+		return result;
+	}
+
+	// Fixed steps run behind the display, objects are blended between packets like the camera
+	scene.SetKeepPrevious(true);
+
+	frameLimiter.SetSyncMode(syncMode);
+	frameLimiter.SetFrameCap(frameCap);
+
+	simulationRunning.store(true);
+	simulationThread = std::thread(SimulationLoop, projection);
+
+	double lastFrame = Clock::Now();
 
 	// Loop until window closed
-	while (!mainWindow.getShouldClose())
+	while (!mainWindow.getShouldClose() && !replayFinished.load())
 	{
-		GLfloat now = (GLfloat) glfwGetTime();
-		deltaTime = now - lastTime;
-		lastTime = now;
+		 TRACE_SCOPE("Frame");
+
+		 double now = Clock::Now();
+		 frameStats.AddFrame(now - lastFrame);
+		 lastFrame = now;
 
 		 // Get + Handle user input events
-		 glfwPollEvents();
-		 
-		 camera.keyControl(mainWindow.getKeys(), deltaTime);
-		 camera.mouseControl(mainWindow.getXChange(), mainWindow.getYChange());
+		 {
+			 TRACE_SCOPE("PollEvents");
+			 glfwPollEvents();
+		 }
+
+		 {
+			 std::lock_guard<std::mutex> lock(inputMutex);
+			 memcpy(inputKeys, mainWindow.getKeys(), sizeof(inputKeys));
+			 inputXChange += mainWindow.getXChange();
+			 inputYChange += mainWindow.getYChange();
+		 }
+
+		 gpuProfiler.BeginFrame();
+
+		 if (dynamicResolution.IsInitialised())
+		 {
+			 dynamicResolution.BeginFrame();
+		 }
 
-		 
 		 // Clear window
+		 gpuProfiler.BeginScope("Clear");
 		 glClearColor(0.0f, 0.0f, 0.0f, 1.0f);
 		 glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
-		 
-		 // Use shader program
-		 shaderList[0].UseShader();
-		 uniformModel = shaderList[0].GetModelLocation();
-		 uniformProjection = shaderList[0].GetProjectionLocation();
-		 uniformView = shaderList[0].GetViewLocation();
-		 uniformAmbientColour = shaderList[0].GetAmbientColourLocation();
-		 uniformAmbientIntensity = shaderList[0].GetAmbientIntensityLocation();
-
-		 uniformEyePosition = shaderList[0].GetEyePositionLocation();
-		 uniformSpecularIntensity = shaderList[0].GetSpecularIntensityLocation();
-		 uniformShininess = shaderList[0].GetShininessLocation();
-
-		 glm::vec3 lowerLight = camera.getCameraPosition();
-		 lowerLight.y -= 0.3f;
-
-		 shaderList[0].SetDirectionalLight(&mainLight);
-		 shaderList[0].SetPointLights(pointLights, pointLightCount);
-		 shaderList[0].SetSpotLights(spotLights, spotLightCount);
-		 
-		 // Diagonal + rotational translations
-		 glm::mat4 model = glm::mat4(1.0f);
-		 
-		 
-		 // Set uniform variable value for xMove in vertex shader
-		 glUniformMatrix4fv(uniformModel, 1, GL_FALSE, glm::value_ptr(model));
-		 glUniformMatrix4fv(uniformProjection, 1, GL_FALSE, glm::value_ptr(projection));
-		 glUniformMatrix4fv(uniformView, 1, GL_FALSE, glm::value_ptr(camera.calculateViewMatrix()));
-
-		 model = glm::mat4(1.0f);
-		 model = glm::translate(model, glm::vec3(-5.0f, 2.0f, 0.0f));
-		 model = glm::scale(model, glm::vec3(0.006f, 0.006f, 0.006f));
-		 glUniformMatrix4fv(uniformModel, 1, GL_FALSE, glm::value_ptr(model));
-		 shinyMaterial.UseMaterial(uniformSpecularIntensity, uniformShininess);
-		 xwing.RenderModel();
-
-		 model = glm::mat4(1.0f);
-		 model = glm::translate(model, glm::vec3(-7.0f, -50.0f, 10.0f));
-		 model = glm::scale(model, glm::vec3(1.0f, 1.0f, 1.0f));
-		 glUniformMatrix4fv(uniformModel, 1, GL_FALSE, glm::value_ptr(model));
-		 shinyMaterial.UseMaterial(uniformSpecularIntensity, uniformShininess);
-		 mountains.RenderModel();
+		 gpuProfiler.EndScope();
+
+		 // Newest simulated frame, the simulation is already working on the next one
+		 FramePacket* packet = frameMailbox.Acquire();
+		 if (packet)
+		 {
+			 frameRenderer.Render(*packet, shaderList[0], sceneFeatures, &gpuProfiler);
+			 textureStreamer.Update(*packet, (float)mainWindow.getBufferHeight());
+		 }
+
+		 if (dynamicResolution.IsInitialised())
+		 {
+			 dynamicResolution.Present(nullptr, &gpuProfiler);
+		 }
 
 		 // Unuse shader program
 		 glUseProgram(0);
-		 
-		 mainWindow.swapBuffers();
+		 gpuProfiler.EndFrame();
+
+		 {
+			 TRACE_SCOPE("FrameLimiter::Wait");
+			 frameLimiter.Wait();
+		 }
+		 {
+			 TRACE_SCOPE("SwapBuffers");
+			 mainWindow.swapBuffers();
+		 }
+	}
+
+	simulationRunning.store(false);
+	simulationThread.join();
+
+	if (inputLog.IsRecording())
+	{
+		printf("Recorded %llu input frames\n", inputLog.GetFrameCount());
+		inputLog.EndRecording();
+	}
+	else if (inputLog.IsReplaying())
+	{
+		printf("Replayed %llu input frames\n", inputLog.GetFrameCount());
+	}
+
+	jobSystem.Stop();
+	frameStats.Print("Frame pacing");
+	frameLimiter.PrintStats();
+	frameRenderer.PrintLatency();
+	printf("  packets:         %8llu published, %llu never drawn\n", frameMailbox.GetPublishedCount(), frameMailbox.GetDroppedCount());
+	gpuProfiler.PrintReport();
+	GpuMemory::PrintReport();
+	textureStreamer.PrintStats();
+	scene.GetLightCuller().PrintStats();
+	terrain.PrintStats();
+	particles.PrintStats();
+	animations.PrintStats();
+	dynamicResolution.PrintStats();
+	if (traceFile)
+	{
+		CpuTrace::ExportChromeTrace(traceFile, &gpuProfiler);
 	}
+	frameRenderer.ClearRenderer();
+	gpuProfiler.ClearProfiler();
+	textureStreamer.ClearStreamer();
+	terrain.ClearTerrain();
+	terrainTexture.ClearTexture();
+	particles.ClearParticles();
+	animations.ClearAnimations();
+	dynamicResolution.ClearResolution();
+	shaderList[0].PrintVariantCosts();
 
 	// Terminate GLFW
 	glfwTerminate();